@@ -7,7 +7,8 @@
  *   compile_shader, make_program, link_program, use_program,
  *   vertex_array_1f, vertex_array_4f, uniform_1i, uniform_matrix_4fv,
  *   buffer_texture_create, image_create_texture, image_update_texture,
- *   vertex_buffer_create, vertex_array_pointer, declare_main
+ *   vertex_buffer_create, vertex_array_pointer, instance_array_pointer,
+ *   instance_array_bind, declare_main
  */
 #pragma once
 
@@ -234,6 +235,23 @@ static void vertex_array_pointer(program *prog, const char *attr, GLint size,
     }
 }
 
+/*
+ * per instance attribute starting at instance base. GL 3.3 lacks base
+ * instance draws so pointers are rebound for each instanced command.
+ */
+template<typename X, typename T>
+static void instance_array_pointer(program *prog, const char *attr, GLint size,
+    GLenum type, GLboolean norm, X T::*member, size_t base)
+{
+    const void *obj = (const void *)(reinterpret_cast<std::ptrdiff_t>(
+        &(reinterpret_cast<T const *>(NULL)->*member) ) + base * sizeof(T));
+    if (prog->attrs.find(attr) != prog->attrs.end()) {
+        glEnableVertexAttribArray(prog->attrs[attr]);
+        glVertexAttribPointer(prog->attrs[attr], size, type, norm, sizeof(T), obj);
+        glVertexAttribDivisor(prog->attrs[attr], 1);
+    }
+}
+
 static void vertex_array_1f(program *prog, const char *attr, float v1)
 {
     if (prog->attrs.find(attr) != prog->attrs.end()) {
@@ -251,6 +269,16 @@ static void vertex_array_4f(program *prog, const char *attr, float v1,
     }
 }
 
+/* draw_instance attributes for programs linked with shaders/instance.vsh */
+static void instance_array_bind(program *prog, size_t base)
+{
+    instance_array_pointer(prog, "a_rect", 4, GL_FLOAT, 0, &draw_instance::rect, base);
+    instance_array_pointer(prog, "a_uvrect", 4, GL_FLOAT, 0, &draw_instance::uv, base);
+    instance_array_pointer(prog, "a_color", 4, GL_UNSIGNED_BYTE, 1, &draw_instance::color, base);
+    instance_array_pointer(prog, "a_shape", 1, GL_FLOAT, 0, &draw_instance::shape, base);
+    vertex_array_1f(prog, "a_gamma", 1.0f);
+}
+
 static void uniform_1i(program *prog, const char *uniform, GLint i)
 {
     if (prog->uniforms.find(uniform) != prog->uniforms.end()) {
@@ -340,23 +368,28 @@ static void image_update_texture(GLuint tex, draw_image img)
     GLsizei width = (GLsizei)img.size[0];
     GLsizei height = (GLsizei)img.size[1];
     GLsizei depth = (GLsizei)img.size[2];
+    GLenum format = depth == 4 ? GL_RGBA : GL_RED;
 
-    /* skip texture update if modified width and height is less than zero
-     * note: we currently ignore the dimensions of the modified rectangle */
+    /* skip texture update if modified width and height is less than zero */
     if (img.modrect[2] <= 0 || img.modrect[3] <= 0) return;
+    if (depth != 1 && depth != 4) return;
 
     glBindTexture(GL_TEXTURE_2D, tex);
 
-    switch (depth) {
-    case 1:
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height,
-            0, GL_RED, GL_UNSIGNED_BYTE, (GLvoid*)img.pixels);
-        break;
-    case 4:
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
-            0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)img.pixels);
-        break;
+    /* upload each dirty rectangle, or the modified rectangle, as rows
+     * of the full image using the image width as the row length */
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (auto &r : draw_image_rects(img)) {
+        int x1 = std::max(0, r.a.x), y1 = std::max(0, r.a.y);
+        int x2 = std::min((int)width, r.b.x), y2 = std::min((int)height, r.b.y);
+        if (x2 <= x1 || y2 <= y1) continue;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x1, y1, x2 - x1, y2 - y1,
+            format, GL_UNSIGNED_BYTE,
+            (GLvoid*)(img.pixels + ((size_t)y1 * width + x1) * depth));
     }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
 static GLenum cmd_mode_gl(int cmd_mode)
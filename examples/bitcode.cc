@@ -1,7 +1,8 @@
 /*
- * order0 entropy coding
+ * order0, order1 and order2 entropy coding
  *
  * - compress and decompress commands with stats
+ * - block-parallel container with a block index for random access
  *
  * Entropy Coding, Sachin Garg, 2006.
  *
@@ -22,10 +23,18 @@
 #include <algorithm>
 #include <numeric>
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
 
 #include <sys/stat.h>
 
 #include "bitcode.h"
+#include "worker.h"
 
 /*
  * file io
@@ -70,20 +79,102 @@ static size_t write_file(std::vector<uint8_t> &buf, const char* filename)
 }
 
 /*
- * order0 range encode using adaptive frequencies
+ * order-n context model
+ *
+ * order0 codes with one frequency table, order1 selects a table using the
+ * previous byte and order2 using the previous two bytes. order2 tables are
+ * created when a context is first seen and inherit scaled frequencies from
+ * the order1 table of the previous byte, which is also updated, so sparse
+ * contexts start from an estimate instead of a flat distribution. symbols
+ * are counted with a larger increment so that tables adapt quickly.
+ */
+
+static const size_t ContextIncrement = 32;
+static const size_t InheritTotal = 256;
+
+struct ContextTable
+{
+	FreqTable t;
+	size_t count;
+
+	ContextTable() : t(256, ContextIncrement), count(0) {}
+	ContextTable(const FreqTable &parent, size_t MaxRange);
+
+	void Update(FreqMode freq, size_t sym, size_t MaxRange);
+};
+
+ContextTable::ContextTable(const FreqTable &parent, size_t MaxRange)
+	: t(256, ContextIncrement), count(0)
+{
+	size_t total = parent.CumFreq.back();
+	for (size_t s = 0; s < 256; s++) {
+		size_t f = parent.CumFreq[s] - (s ? parent.CumFreq[s-1] : 0);
+		t.Freq[s] = 1 + f * InheritTotal / total;
+	}
+	t.ToCumulative(MaxRange);
+}
+
+void ContextTable::Update(FreqMode freq, size_t sym, size_t MaxRange)
+{
+	/* young tables refresh at powers of two, then every interval */
+	size_t i = count++;
+	t.Update(freq, sym, MaxRange,
+		i <= FreqIntervalMask && !(i & (i - 1)) ? 0 : i);
+}
+
+struct ContextModel
+{
+	size_t order;
+	FreqMode freq;
+	std::vector<std::unique_ptr<ContextTable>> tables;
+	std::vector<std::unique_ptr<ContextTable>> parents;
+	size_t history;
+
+	ContextModel(size_t order, FreqMode freq)
+		: order(order), freq(freq), tables(1ull << (order * 8)),
+		  parents(order > 1 ? 256 : 0), history(0) {}
+
+	ContextTable& parent()
+	{
+		auto &p = parents[history & 0xff];
+		if (!p) p = std::make_unique<ContextTable>();
+		return *p;
+	}
+
+	FreqTable& get(size_t MaxRange)
+	{
+		auto &t = tables[history & msk(order * 8)];
+		if (!t) {
+			t = order > 1 ? std::make_unique<ContextTable>(parent().t, MaxRange)
+			              : std::make_unique<ContextTable>();
+		}
+		return t->t;
+	}
+
+	void update(size_t sym, size_t MaxRange)
+	{
+		tables[history & msk(order * 8)]->Update(freq, sym, MaxRange);
+		if (order > 1) parent().Update(freq, sym, MaxRange);
+		history = (history << 8) | sym;
+	}
+};
+
+/*
+ * order-n range encode using adaptive frequencies
  */
 template <typename Coder>
-static size_t order0_encode(bitcode_reader &in, bitcode_writer &out,
-	size_t input_size, FreqMode freq)
+static size_t context_encode(bitcode_reader &in, bitcode_writer &out,
+	size_t input_size, size_t order, FreqMode freq)
 {
 	Coder c(&out);
-	FreqTable t(256);
+	ContextModel m(order, freq);
 
 	for (size_t i = 0; i < input_size; i++)
 	{
+		FreqTable &t = m.get(c.MaxRange);
 		uint8_t sym = in.read_fixed(8);
 		c.EncodeRange(!sym ? 0 : t.CumFreq[sym-1], t.CumFreq[sym], t.CumFreq.back());
-		t.Update(freq, sym, c.MaxRange, i);
+		m.update(sym, c.MaxRange);
 	}
 
 	c.Flush();
@@ -93,19 +184,20 @@ static size_t order0_encode(bitcode_reader &in, bitcode_writer &out,
 }
 
 /*
- * order0 range decode using adaptive frequencies
+ * order-n range decode using adaptive frequencies
  */
 template <typename Coder>
-static size_t order0_decode(bitcode_reader &in, bitcode_writer &out,
-	size_t output_size, FreqMode freq)
+static size_t context_decode(bitcode_reader &in, bitcode_writer &out,
+	size_t output_size, size_t order, FreqMode freq)
 {
 	Coder c(&in);
-	FreqTable t(256);
+	ContextModel m(order, freq);
 
 	c.Prime();
 
 	for (size_t i = 0; i < output_size; i++)
 	{
+		FreqTable &t = m.get(c.MaxRange);
 		size_t Count = c.GetCurrentCount(t.CumFreq.back());
 
 		auto si = std::upper_bound(t.CumFreq.begin(), t.CumFreq.end(), Count);
@@ -113,7 +205,7 @@ static size_t order0_decode(bitcode_reader &in, bitcode_writer &out,
 
 		out.write_fixed(sym, 8);
 		c.RemoveRange(!sym ? 0 : t.CumFreq[sym-1], t.CumFreq[sym], t.CumFreq.back());
-		t.Update(freq, sym, c.MaxRange, i);
+		m.update(sym, c.MaxRange);
 	}
 
 	out.flush();
@@ -122,11 +214,228 @@ static size_t order0_decode(bitcode_reader &in, bitcode_writer &out,
 }
 
 /*
- * order0 entropy coding compress and decompress commands with stats
+ * single stream header
+ *
+ *   u32 magic, u64 size, u8 order, u8 freq, range coded data...
+ */
+
+static const uint32_t StreamMagic = 0x30736362; /* "bcs0" */
+static const size_t StreamHeaderSize = 14;
+
+static void write_stream_header(bitcode_writer &out, size_t size,
+	size_t order, FreqMode freq)
+{
+	out.write_fixed(StreamMagic, 32);
+	out.write_fixed(size, 64);
+	out.write_fixed(order, 8);
+	out.write_fixed(freq, 8);
+	out.flush();
+}
+
+static bool read_stream_header(bitcode_reader &in, size_t &size,
+	size_t &order, FreqMode &freq)
+{
+	if (in.read_fixed(32) != StreamMagic) return false;
+	size = in.read_fixed(64);
+	order = in.read_fixed(8);
+	freq = (FreqMode)in.read_fixed(8);
+	return !in.eof && order <= 2 &&
+		(freq == FreqModeDynPerSymbol || freq == FreqModeDynPerInterval);
+}
+
+/*
+ * block-parallel container
+ *
+ * the input is split into fixed size blocks that are coded independently
+ * on a worker pool. the header is followed by an index of the end offset
+ * of each coded block so any block can be located and decoded on its own.
+ *
+ *   u32 magic, u64 size, u32 block_size, u8 order, u8 freq, u32 num_blocks,
+ *   u64 block_end[num_blocks], block data...
+ */
+
+static const uint32_t BlockMagic = 0x30626362; /* "bcb0" */
+static const size_t BlockHeaderSize = 22;
+
+struct block_header
+{
+	uint64_t size;
+	uint32_t block_size;
+	uint8_t order;
+	uint8_t freq;
+	std::vector<uint64_t> index;
+
+	size_t num_blocks() const { return index.size(); }
+	size_t data_offset() const { return BlockHeaderSize + index.size() * 8; }
+	size_t block_length(size_t i) const {
+		return std::min<size_t>(block_size, size - i * block_size);
+	}
+};
+
+static bool read_block_header(const std::vector<uint8_t> &buf, block_header &h)
+{
+	if (buf.size() < BlockHeaderSize) return false;
+	vector_reader in(std::vector<uint8_t>(buf.begin(),
+		buf.begin() + BlockHeaderSize));
+	bitcode_reader bin(&in);
+	if (bin.read_fixed(32) != BlockMagic) return false;
+	h.size = bin.read_fixed(64);
+	h.block_size = (uint32_t)bin.read_fixed(32);
+	h.order = (uint8_t)bin.read_fixed(8);
+	h.freq = (uint8_t)bin.read_fixed(8);
+	size_t num_blocks = bin.read_fixed(32);
+	if (h.order > 2 || h.block_size == 0 ||
+		(h.freq != FreqModeDynPerSymbol &&
+		 h.freq != FreqModeDynPerInterval) ||
+		num_blocks != (h.size + h.block_size - 1) / h.block_size ||
+		buf.size() < BlockHeaderSize + num_blocks * 8) return false;
+	h.index.resize(num_blocks);
+	for (size_t i = 0; i < num_blocks; i++) {
+		memcpy(&h.index[i], &buf[BlockHeaderSize + i * 8], 8);
+		h.index[i] = le64(h.index[i]);
+		if (h.index[i] < (i ? h.index[i-1] : 0) ||
+			h.data_offset() + h.index[i] > buf.size()) return false;
+	}
+	return true;
+}
+
+static void write_block_header(std::vector<uint8_t> &buf, const block_header &h)
+{
+	vector_writer out;
+	bitcode_writer bout(&out);
+	bout.write_fixed(BlockMagic, 32);
+	bout.write_fixed(h.size, 64);
+	bout.write_fixed(h.block_size, 32);
+	bout.write_fixed(h.order, 8);
+	bout.write_fixed(h.freq, 8);
+	bout.write_fixed(h.index.size(), 32);
+	for (uint64_t end : h.index) {
+		bout.write_fixed(end, 64);
+	}
+	bout.flush();
+	buf.insert(buf.begin(), out.buffer.begin(), out.buffer.end());
+}
+
+/*
+ * decode one block of a container, located with the block index
+ */
+static void block_decode(const std::vector<uint8_t> &buf, const block_header &h,
+	size_t i, uint8_t *dst)
+{
+	size_t start = h.data_offset() + (i ? h.index[i-1] : 0);
+	size_t end = h.data_offset() + h.index[i];
+	size_t length = h.block_length(i);
+
+	vector_reader in(std::vector<uint8_t>(buf.begin() + start, buf.begin() + end));
+	vector_writer out;
+	bitcode_reader bin(&in);
+	bitcode_writer bout(&out);
+
+	out.buffer.resize(length);
+	context_decode<RangeCoder32>(bin, bout, length, h.order, (FreqMode)h.freq);
+	memcpy(dst, out.buffer.data(), length);
+}
+
+struct block_codec
+{
+	const std::vector<uint8_t> *input;
+	std::vector<uint8_t> *output;
+	block_header header;
+	std::vector<std::vector<uint8_t>> blocks;
+	bool decoding;
+};
+
+struct block_worker : pool_worker<size_t>
+{
+	block_codec *codec;
+
+	block_worker(block_codec *codec) : codec(codec) {}
+
+	virtual void operator()(size_t &i)
+	{
+		const block_header &h = codec->header;
+		if (codec->decoding) {
+			block_decode(*codec->input, h, i,
+				codec->output->data() + i * h.block_size);
+			return;
+		}
+
+		auto begin = codec->input->begin() + i * h.block_size;
+		vector_reader in(std::vector<uint8_t>(begin, begin + h.block_length(i)));
+		vector_writer out;
+		bitcode_reader bin(&in);
+		bitcode_writer bout(&out);
+
+		out.buffer.resize(h.block_length(i) + h.block_length(i)/2);
+		size_t size = context_encode<RangeCoder32>(bin, bout, h.block_length(i),
+			h.order, (FreqMode)h.freq);
+		out.buffer.resize(size);
+		codec->blocks[i] = std::move(out.buffer);
+	}
+};
+
+static void block_run(block_codec &codec, size_t num_threads)
+{
+	size_t num_blocks = codec.header.num_blocks();
+	pool_executor<size_t,block_worker> pool(num_threads, num_blocks,
+		[&codec](){ return new block_worker(&codec); });
+	block_worker worker(&codec);
+	for (size_t i = 0; i < num_blocks; i++) {
+		if (num_threads > 0) {
+			pool.enqueue(i);
+		} else {
+			worker(i);
+		}
+	}
+	pool.run();
+}
+
+static size_t block_compress(const std::vector<uint8_t> &in,
+	std::vector<uint8_t> &out, size_t order, FreqMode freq,
+	size_t block_size, size_t num_threads)
+{
+	block_codec codec{&in, &out, { in.size(), (uint32_t)block_size,
+		(uint8_t)order, (uint8_t)freq, { } }, { }, false };
+	size_t num_blocks = (in.size() + block_size - 1) / block_size;
+	codec.header.index.resize(num_blocks);
+	codec.blocks.resize(num_blocks);
+
+	block_run(codec, num_threads);
+
+	out.clear();
+	for (size_t i = 0; i < num_blocks; i++) {
+		out.insert(out.end(), codec.blocks[i].begin(), codec.blocks[i].end());
+		codec.header.index[i] = out.size();
+	}
+	write_block_header(out, codec.header);
+
+	return out.size();
+}
+
+static size_t block_decompress(const std::vector<uint8_t> &in,
+	std::vector<uint8_t> &out, size_t num_threads)
+{
+	block_codec codec{&in, &out, { }, { }, true };
+	if (!read_block_header(in, codec.header)) {
+		fprintf(stderr, "block_decompress: invalid container\n");
+		exit(1);
+	}
+	out.resize(codec.header.size);
+
+	block_run(codec, num_threads);
+
+	return out.size();
+}
+
+/*
+ * entropy coding compress and decompress commands with stats
  */
 
 static clock_t start, end;
 static size_t loops = 1;
+static size_t order = 0;
+static size_t threads = std::thread::hardware_concurrency();
+static size_t block_size = 64 << 10;
 static size_t input_size, output_size, decode_size;
 
 static double time_secs(clock_t start, clock_t end, size_t loops)
@@ -134,12 +443,18 @@ static double time_secs(clock_t start, clock_t end, size_t loops)
 	return (double) (end - start) / CLOCKS_PER_SEC / (double)loops;
 }
 
-static void print_results(const char* op, clock_t start, clock_t end,
+static double wall_secs(std::chrono::steady_clock::time_point start,
+	std::chrono::steady_clock::time_point end, size_t loops)
+{
+	return std::chrono::duration<double>(end - start).count() / (double)loops;
+}
+
+static void print_results(const char* op, double secs,
 	size_t input_size, size_t output_size, size_t TimingSize)
 {
-	printf("%s: %zu -> %zu in %6.2f secs (%8.2f ns/byte)\n",
-		op, input_size, output_size, time_secs(start, end, loops),
-		time_secs(start, end, loops) / (double)TimingSize * 1e9);
+	printf("%s%zu: %zu -> %zu in %6.2f secs (%8.2f ns/byte, %8.2f MB/s)\n",
+		op, order, input_size, output_size, secs,
+		secs / (double)TimingSize * 1e9, (double)TimingSize / secs / 1e6);
 }
 
 static void do_compress(const char* in_filename, const char* out_filename,
@@ -151,70 +466,182 @@ static void do_compress(const char* in_filename, const char* out_filename,
     bitcode_writer bout(&out);
 
 	input_size = read_file(in.buffer, in_filename);
-	for (size_t i = 0; i < sizeof(size_t); i++) {
-		out.buffer.push_back(((uint8_t*)&input_size)[i]);
-	}
-	out.buffer.resize(input_size + input_size/2);
+	out.buffer.resize(StreamHeaderSize + input_size + input_size/2);
+	write_stream_header(bout, input_size, order, freq);
 
 	start = clock();
 	for (size_t l = 0; l < loops; l++) {
 		bin.seek(0);
-		bout.seek(sizeof(size_t));
-		output_size = order0_encode<RangeCoder32>(bin, bout, input_size, freq);
+		bout.seek(StreamHeaderSize);
+		output_size = context_encode<RangeCoder32>(bin, bout, input_size, order, freq);
 	}
 	end = clock();
 
-	out.buffer.resize(output_size += sizeof(size_t));
+	out.buffer.resize(output_size);
 	write_file(out.buffer, out_filename);
-	print_results("Encode0", start, end, input_size, output_size, input_size);
+	print_results("Encode", time_secs(start, end, loops),
+		input_size, output_size, input_size);
 }
 
-static void do_decompress(const char* in_filename, const char* out_filename,
-	FreqMode freq)
+static void do_decompress(const char* in_filename, const char* out_filename)
 {
 	vector_reader in;
 	vector_writer out;
     bitcode_reader bin(&in);
     bitcode_writer bout(&out);
+	FreqMode freq;
 
 	input_size = read_file(in.buffer, in_filename);
-	for (size_t i = 0; i < sizeof(size_t); i++) {
-		((uint8_t *)&output_size)[i] = bin.read_fixed(8);
+	if (!read_stream_header(bin, output_size, order, freq)) {
+		fprintf(stderr, "do_decompress: invalid stream header\n");
+		exit(1);
 	}
 	out.buffer.resize(output_size);
 
 	start = clock();
 	for (size_t l = 0; l < loops; l++) {
-		bin.seek(sizeof(size_t));
+		bin.seek(StreamHeaderSize);
 		bout.seek(0);
-		decode_size = order0_decode<RangeCoder32>(bin, bout, output_size, freq);
+		decode_size = context_decode<RangeCoder32>(bin, bout, output_size, order, freq);
 		assert(output_size == decode_size);
 	}
 	end = clock();
 
 	write_file(out.buffer, out_filename);
-	print_results("Decode0", start, end, input_size, output_size, output_size);
+	print_results("Decode", time_secs(start, end, loops),
+		input_size, output_size, output_size);
+}
+
+static void do_block_compress(const char* in_filename, const char* out_filename,
+	FreqMode freq)
+{
+	std::vector<uint8_t> in, out;
+
+	input_size = read_file(in, in_filename);
+
+	auto t1 = std::chrono::steady_clock::now();
+	for (size_t l = 0; l < loops; l++) {
+		output_size = block_compress(in, out, order, freq, block_size, threads);
+	}
+	auto t2 = std::chrono::steady_clock::now();
+
+	write_file(out, out_filename);
+	print_results("BlockEncode", wall_secs(t1, t2, loops),
+		input_size, output_size, input_size);
+}
+
+static void do_block_decompress(const char* in_filename, const char* out_filename)
+{
+	std::vector<uint8_t> in, out;
+	block_header h;
+
+	input_size = read_file(in, in_filename);
+	if (read_block_header(in, h)) {
+		order = h.order;
+	}
+
+	auto t1 = std::chrono::steady_clock::now();
+	for (size_t l = 0; l < loops; l++) {
+		output_size = block_decompress(in, out, threads);
+	}
+	auto t2 = std::chrono::steady_clock::now();
+
+	write_file(out, out_filename);
+	print_results("BlockDecode", wall_secs(t1, t2, loops),
+		input_size, output_size, output_size);
+}
+
+/*
+ * block container ratio and throughput for 1..threads worker threads
+ */
+static void do_block_bench(const char* in_filename, const char* out_filename,
+	FreqMode freq)
+{
+	std::vector<uint8_t> in, out, dec;
+	block_header h;
+
+	input_size = read_file(in, in_filename);
+	for (size_t n = 1; n <= std::max<size_t>(threads, 1); n = n < threads ?
+		std::min(n * 2, threads) : n + 1)
+	{
+		auto t1 = std::chrono::steady_clock::now();
+		for (size_t l = 0; l < loops; l++) {
+			output_size = block_compress(in, out, order, freq, block_size, n);
+		}
+		auto t2 = std::chrono::steady_clock::now();
+		for (size_t l = 0; l < loops; l++) {
+			block_decompress(out, dec, n);
+		}
+		auto t3 = std::chrono::steady_clock::now();
+		if (dec != in) {
+			fprintf(stderr, "do_block_bench: decode mismatch\n");
+			exit(1);
+		}
+
+		/* random access to the last block through the index */
+		bool ok = read_block_header(out, h);
+		if (!ok) {
+			fprintf(stderr, "do_block_bench: invalid container\n");
+			exit(1);
+		}
+		if (h.num_blocks() > 0) {
+			size_t last = h.num_blocks() - 1;
+			std::vector<uint8_t> block(h.block_length(last));
+			block_decode(out, h, last, block.data());
+			if (!std::equal(block.begin(), block.end(),
+				in.begin() + last * block_size)) {
+				fprintf(stderr, "do_block_bench: block mismatch\n");
+				exit(1);
+			}
+		}
+
+		double e = wall_secs(t1, t2, loops), d = wall_secs(t2, t3, loops);
+		printf("Block%zu: %zu -> %zu threads %2zu blocks %4zu "
+			"ratio %6.3f bits/byte encode %8.2f MB/s decode %8.2f MB/s\n",
+			order, input_size, output_size, n, h.num_blocks(),
+			output_size * 8.0 / input_size, input_size / e / 1e6,
+			input_size / d / 1e6);
+	}
+
+	write_file(out, out_filename);
 }
 
 int main(int argc,char *argv[])
 {
-	loops = (argc == 6 ? atoi(argv[5]) : loops);
-	if (argc < 5) {
-		fprintf(stderr, "Usage: c|d s|p input_dataName output_dataName [loops]\n"
+	loops = (argc >= 6 ? atoi(argv[5]) : loops);
+	order = (argc >= 7 ? atoi(argv[6]) : order);
+	threads = (argc >= 8 ? atoi(argv[7]) : threads);
+	block_size = (argc >= 9 ? atoi(argv[8]) << 10 : block_size);
+	if (argc < 5 || order > 2 || loops < 1 || block_size == 0) {
+		fprintf(stderr, "Usage: c|d|p|u|b s|i input_dataName output_dataName "
+						"[loops] [order] [threads] [block_kib]\n"
 						"c: compress\n"
-						"d: decompress\n"
+						"d: decompress, order and freq from the header\n"
+						"p: compress parallel blocks\n"
+						"u: decompress parallel blocks\n"
+						"b: benchmark parallel blocks with 1..threads\n"
 						"s: freq_dyn_sym\n"
-						"i: freq_dyn_interval\n");
+						"i: freq_dyn_interval\n"
+						"order: context order 0, 1 or 2 (default 0)\n");
+		exit(9);
+	}
+
+	FreqMode freq;
+	switch (argv[2][0]) {
+	case 's': freq = FreqModeDynPerSymbol; break;
+	case 'i': freq = FreqModeDynPerInterval; break;
+	default:
+		fprintf(stderr, "%s: '%s' unknown frequency mode", argv[0], argv[2]);
 		exit(9);
-	} else if (argv[1][0] == 'c' && argv[2][0] == 's') {
-		do_compress(argv[3], argv[4], FreqModeDynPerSymbol);
-	} else if (argv[1][0] == 'c' && argv[2][0] == 'i') {
-		do_compress(argv[3], argv[4], FreqModeDynPerInterval);
-	} else if (argv[1][0] == 'd' && argv[2][0] == 's') {
-		do_decompress(argv[3], argv[4], FreqModeDynPerSymbol);
-	} else if (argv[1][0] == 'd' && argv[2][0] == 'i') {
-		do_decompress(argv[3], argv[4], FreqModeDynPerInterval);
-	} else {
+	}
+
+	switch (argv[1][0]) {
+	case 'c': do_compress(argv[3], argv[4], freq); break;
+	case 'd': do_decompress(argv[3], argv[4]); break;
+	case 'p': do_block_compress(argv[3], argv[4], freq); break;
+	case 'u': do_block_decompress(argv[3], argv[4]); break;
+	case 'b': do_block_bench(argv[3], argv[4], freq); break;
+	default:
 		fprintf(stderr, "%s: '%s' unknown command", argv[0], argv[1]);
 		exit(9);
 	}
@@ -98,12 +98,6 @@ void parse_options(int argc, char **argv)
     }
 }
 
-static bool endsWith(std::string str, std::string ext)
-{
-    size_t i = str.find(ext);
-    return (i == str.size() - ext.size());
-}
-
 void scanFontDir(std::string dir)
 {
     std::vector<std::string> dirs;
@@ -115,7 +109,7 @@ void scanFontDir(std::string dir)
         for (auto &name : file::list(current_dir)) {
             if (file::dirExists(name)) {
                 dirs.push_back(name);
-            } else if (endsWith(name, ".ttf")) {
+            } else if (font_manager::isFontFile(name)) {
                 fontfiles.push_back(name);
             }
         }
@@ -70,6 +70,9 @@ static bool multithread = false;
 static bool batch_render = true;
 static bool display_ansi = false;
 static bool clear_ansi = false;
+static int png_level = -1;
+static int png_threads = 0;
+static bool rca_format = false;
 static font_manager_ft manager;
 
 static const char* shades[4][4] = {
@@ -289,6 +292,9 @@ static void print_help(int argc, char **argv)
         "  -g, --glyph <glyph>    display single glyph (ANSI console)\n"
         "  -s, --size <pixels>    font size (default %d)\n"
         "  -l, --limit <integer>  render atlas glyph limit (default %d)\n"
+        "  -z, --level <integer>  png compression level 0-9 (default zlib)\n"
+        "  -j, --jobs <integer>   png encoder threads (default libpng)\n"
+        "  -k, --rca              save range coded atlas image (.rca)\n"
         "  -o, --output <path>    output path (defaults to <path>.atlas)\n"
         "  -f, --font <ttf-file>  font path (mandatory)\n"
         "  -a, --scan <font-dir>  convert all fonts in directory\n",
@@ -355,6 +361,18 @@ static void parse_options(int argc, char **argv)
             if (check_param(++i == argc, "--limit")) break;
             glyph_limit = atoi(argv[i++]);
         }
+        else if (match_opt(argv[i], "-z", "--level")) {
+            if (check_param(++i == argc, "--level")) break;
+            png_level = atoi(argv[i++]);
+        }
+        else if (match_opt(argv[i], "-j", "--jobs")) {
+            if (check_param(++i == argc, "--jobs")) break;
+            png_threads = atoi(argv[i++]);
+        }
+        else if (match_opt(argv[i], "-k", "--rca")) {
+            rca_format = true;
+            i++;
+        }
         else if (match_opt(argv[i], "-q", "--quiet")) {
             quiet = true;
             i++;
@@ -408,6 +426,9 @@ uint64_t process_one_file(font_face *face, const char *output_path)
 {
     font_atlas atlas(font_atlas::DEFAULT_WIDTH, font_atlas::DEFAULT_HEIGHT,
         font_atlas::MSDF_DEPTH);
+    atlas.image_type = rca_format ? font_atlas::rca_file : font_atlas::png_file;
+    atlas.png_options.compression_level = png_level;
+    atlas.png_options.num_threads = png_threads;
 
     const auto t1 = high_resolution_clock::now();
 
@@ -484,13 +505,11 @@ static std::vector<std::string> sortList(std::vector<std::string> l)
     return l;
 }
 
-static std::vector<std::string> endsWith(std::vector<std::string> l,
-    std::string ext)
+static std::vector<std::string> fontFiles(std::vector<std::string> l)
 {
     std::vector<std::string> list;
     for (auto &p : l) {
-        size_t i = p.find(ext);
-        if (i == p.size() - ext.size()) {
+        if (font_manager::isFontFile(p)) {
             list.push_back(p);
         }
     }
@@ -522,9 +541,11 @@ int main(int argc, char **argv)
     /* gather files */
     std::vector<font_job> jobs;
     if (scan_path) {
-        for (auto &path : sortList(endsWith(file::list(scan_path), ".ttf"))) {
-            font_face *face = manager.findFontByPath(path);
-            jobs.push_back(font_job{face, path});
+        for (auto &path : sortList(fontFiles(file::list(scan_path)))) {
+            manager.scanFontPath(path);
+        }
+        for (auto &face : manager.getFontList()) {
+            jobs.push_back(font_job{face.get(), face->path});
         }
     } else {
         font_face *face = manager.findFontByPath(font_path);
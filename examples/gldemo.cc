@@ -43,7 +43,7 @@ using mat4 = glm::mat4;
 /* globals */
 
 static program simple, msdf;
-static GLuint vao, vbo, ibo;
+static GLuint vao, vbo, ibo, vbo16, ibo16;
 static std::map<int,GLuint> tex_map;
 static mat4 mvp;
 static GLFWwindow* window;
@@ -58,6 +58,9 @@ static float font_scale = 2.0f;
 static float load_factor = 5.0;
 static bool help_text = false;
 static bool overlay_stats = false;
+static bool batch_cmds = false;
+static bool compact = false;
+static float pos_scale = 1.0f;
 static int window_width = 2560, window_height = 1440;
 static int framebuffer_width, framebuffer_height;
 static double tl, tn, td, tb;
@@ -167,11 +170,40 @@ struct wisdom {
 };
 
 static draw_list batch;
+static draw_list_compact packed;
 static std::vector<std::string> book;
 static std::vector<wisdom> wise;
 
 /* display  */
 
+static void update_uniforms(program *prog);
+
+static void vertex_array_config(program *p, bool packed)
+{
+    if (packed) {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo16);
+        vertex_array_pointer(p, "a_pos", 3, GL_SHORT, 0, &draw_vertex16::pos);
+        vertex_array_pointer(p, "a_uv0", 2, GL_UNSIGNED_SHORT, 1, &draw_vertex16::uv);
+        vertex_array_pointer(p, "a_color", 4, GL_UNSIGNED_BYTE, 1, &draw_vertex16::color);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        vertex_array_pointer(p, "a_pos", 3, GL_FLOAT, 0, &draw_vertex::pos);
+        vertex_array_pointer(p, "a_uv0", 2, GL_FLOAT, 0, &draw_vertex::uv);
+        vertex_array_pointer(p, "a_color", 4, GL_UNSIGNED_BYTE, 1, &draw_vertex::color);
+    }
+    vertex_array_1f(p, "a_gamma", 2.0f);
+}
+
+static void set_pos_scale(float scale)
+{
+    if (pos_scale == scale) return;
+    pos_scale = scale;
+    glUseProgram(msdf.pid);
+    update_uniforms(&msdf);
+    glUseProgram(simple.pid);
+    update_uniforms(&simple);
+}
+
 static void rect(draw_list &batch, font_atlas *atlas,
     float x1, float y1, float x2, float y2, float z, uint color)
 {
@@ -277,9 +309,30 @@ static void draw(double tn, double td, bool skip = false)
         y -= ((float)stats_font_fize * scale * 1.334f);
     }
 
-    /* updates buffers */
-    vertex_buffer_create("vbo", &vbo, GL_ARRAY_BUFFER, batch.vertices);
-    vertex_buffer_create("ibo", &ibo, GL_ELEMENT_ARRAY_BUFFER, batch.indices);
+    /* join commands with the same shader and image */
+    if (batch_cmds) {
+        draw_list_batch(batch);
+    }
+
+    /* updates buffers, using compact formats when the list fits them */
+    bool vpack = compact && draw_list_pack(batch, packed) &&
+        packed.packed_vertices();
+    bool ipack = compact && packed.short_indices;
+    glBindVertexArray(vao);
+    if (vpack) {
+        vertex_buffer_create("vbo16", &vbo16, GL_ARRAY_BUFFER, packed.vertices);
+    } else {
+        vertex_buffer_create("vbo", &vbo, GL_ARRAY_BUFFER, batch.vertices);
+    }
+    if (ipack) {
+        vertex_buffer_create("ibo16", &ibo16, GL_ELEMENT_ARRAY_BUFFER, packed.indices);
+    } else {
+        vertex_buffer_create("ibo", &ibo, GL_ELEMENT_ARRAY_BUFFER, batch.indices);
+    }
+    if (compact) {
+        vertex_array_config(&simple, vpack);
+        set_pos_scale(vpack ? packed.pos_scale : 1.0f);
+    }
 
     /* update textures */
     for (auto img : batch.images) {
@@ -295,11 +348,18 @@ static void draw(double tn, double td, bool skip = false)
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glBindVertexArray(vao);
-    for (auto cmd : batch.cmds) {
+    for (size_t i = 0; i < batch.cmds.size(); i++) {
+        draw_cmd &cmd = batch.cmds[i];
         glUseProgram(cmd_shader_gl(cmd.shader)->pid);
         glBindTexture(GL_TEXTURE_2D, tex_map[cmd.iid]);
-        glDrawElements(cmd_mode_gl(cmd.mode), cmd.count, GL_UNSIGNED_INT,
-            (void*)(cmd.offset * sizeof(uint)));
+        if (ipack) {
+            glDrawElementsBaseVertex(cmd_mode_gl(cmd.mode), cmd.count,
+                GL_UNSIGNED_SHORT, (void*)(cmd.offset * sizeof(uint16_t)),
+                packed.bases[i]);
+        } else {
+            glDrawElements(cmd_mode_gl(cmd.mode), cmd.count, GL_UNSIGNED_INT,
+                (void*)(cmd.offset * sizeof(uint)));
+        }
     }
 }
 
@@ -316,7 +376,12 @@ static void display()
 
 static void update_uniforms(program *prog)
 {
-    uniform_matrix_4fv(prog, "u_mvp", (const GLfloat *)&mvp[0][0]);
+    /* compact positions are fixed point with pos_scale units per pixel */
+    mat4 m = mvp;
+    for (int i = 0; i < 3; i++) {
+        m[i] *= 1.0f / pos_scale;
+    }
+    uniform_matrix_4fv(prog, "u_mvp", (const GLfloat *)&m[0][0]);
     uniform_1i(prog, "u_tex0", 0);
 }
 
@@ -364,11 +429,7 @@ static void initialize()
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    program *p = &simple;
-    vertex_array_pointer(p, "a_pos", 3, GL_FLOAT, 0, &draw_vertex::pos);
-    vertex_array_pointer(p, "a_uv0", 2, GL_FLOAT, 0, &draw_vertex::uv);
-    vertex_array_pointer(p, "a_color", 4, GL_UNSIGNED_BYTE, 1, &draw_vertex::color);
-    vertex_array_1f(p, "a_gamma", 2.0f);
+    vertex_array_config(&simple, false);
     glBindVertexArray(0);
 
     /*
@@ -581,6 +642,8 @@ void print_help(int argc, char **argv)
         "  -y, --overlay-stats                show statistics overlay\n"
         "  -m, --enable-msdf                  enable MSDF font rendering\n"
         "  -q, --quadruple                    quadruple the object count\n"
+        "  -b, --batch                        reorder commands to reduce state changes\n"
+        "  -z, --compact                      upload 16-bit vertices and indices\n"
         "  -h, --help                         command line help\n",
         argv[0], font_path, font_scale, load_factor, render_text);
 }
@@ -633,6 +696,12 @@ void parse_options(int argc, char **argv)
         } else if (match_opt(argv[i], "-q", "--quadruple")) {
             load_factor *= 4.0f;
             i++;
+        } else if (match_opt(argv[i], "-b", "--batch")) {
+            batch_cmds = true;
+            i++;
+        } else if (match_opt(argv[i], "-z", "--compact")) {
+            compact = true;
+            i++;
         } else if (match_opt(argv[i], "-s", "--frame-size")) {
             if (check_param(++i == argc, "--frame-size")) break;
             sscanf(argv[i++], "%dx%d", &window_width, &window_height);
@@ -28,6 +28,7 @@
 #include "font.h"
 #include "glyph.h"
 #include "msdf.h"
+#include "worker.h"
 #include "multi.h"
 #include "logger.h"
 #include "app.h"
@@ -13,6 +13,7 @@
 #include <cerrno>
 #include <cctype>
 #include <climits>
+#include <cfloat>
 #include <cassert>
 #include <cmath>
 #include <ctime>
@@ -21,6 +22,7 @@
 #include <vector>
 #include <array>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <string>
 #include <algorithm>
@@ -44,6 +46,7 @@
 #include "draw.h"
 #include "font.h"
 #include "glyph.h"
+#include "bvh.h"
 #include "canvas.h"
 #include "color.h"
 #include "logger.h"
@@ -57,7 +60,7 @@ using vec2 = glm::vec2;
 
 /* globals */
 
-static texture_buffer shape_tb, edge_tb, brush_tb;
+static texture_buffer shape_tb, edge_tb, brush_tb, cell_tb, cell_edge_tb;
 static program prog_simple, prog_msdf, prog_canvas;
 static GLuint vao, vbo, ibo;
 static std::map<int,GLuint> tex_map;
@@ -549,6 +552,8 @@ static void update()
     buffer_texture_create(shape_tb, canvas.ctx->shapes, GL_TEXTURE0, GL_R32F);
     buffer_texture_create(edge_tb, canvas.ctx->edges, GL_TEXTURE1, GL_R32F);
     buffer_texture_create(brush_tb, canvas.ctx->brushes, GL_TEXTURE2, GL_R32F);
+    buffer_texture_create(cell_tb, canvas.ctx->cells, GL_TEXTURE3, GL_R32F);
+    buffer_texture_create(cell_edge_tb, canvas.ctx->cell_edges, GL_TEXTURE4, GL_R32F);
 
     /* update vertex and index buffers arrays (idempotent) */
     vertex_buffer_create("vbo", &vbo, GL_ARRAY_BUFFER, batch.vertices);
@@ -579,6 +584,10 @@ static void display()
             glBindTexture(GL_TEXTURE_BUFFER, edge_tb.tex);
             glActiveTexture(GL_TEXTURE2);
             glBindTexture(GL_TEXTURE_BUFFER, brush_tb.tex);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_BUFFER, cell_tb.tex);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_BUFFER, cell_edge_tb.tex);
         } else {
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, tex_map[cmd.iid]);
@@ -596,6 +605,8 @@ static void update_uniforms(program *prog)
     uniform_1i(prog, "tb_shape", 0);
     uniform_1i(prog, "tb_edge", 1);
     uniform_1i(prog, "tb_brush", 2);
+    uniform_1i(prog, "tb_cell", 3);
+    uniform_1i(prog, "tb_cell_edge", 4);
 }
 
 static void reshape()
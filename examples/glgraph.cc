@@ -13,6 +13,7 @@
 #include <cerrno>
 #include <cctype>
 #include <climits>
+#include <cfloat>
 #include <cassert>
 #include <cmath>
 #include <ctime>
@@ -21,6 +22,7 @@
 #include <vector>
 #include <array>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <string>
 #include <algorithm>
@@ -38,6 +40,7 @@
 #include "draw.h"
 #include "font.h"
 #include "glyph.h"
+#include "bvh.h"
 #include "canvas.h"
 #include "color.h"
 #include "logger.h"
@@ -53,9 +56,10 @@ using vec2 = glm::vec2;
 
 /* globals */
 
-static texture_buffer shape_tb, edge_tb, brush_tb;
+static texture_buffer shape_tb, edge_tb, brush_tb, cell_tb, cell_edge_tb;
 static program prog_simple, prog_msdf, prog_canvas;
-static GLuint vao, vbo, ibo;
+static program inst_simple, inst_msdf, inst_canvas;
+static GLuint vao, vbo, ibo, inst_vao, inst_vbo;
 static std::map<int,GLuint> tex_map;
 static font_manager_ft manager;
 static MVGCanvas canvas(&manager);
@@ -76,6 +80,7 @@ static int framebuffer_width, framebuffer_height;
 static double tl, tn, td;
 static bool help_text = false;
 static bool overlay_stats = false;
+static bool batch_cmds = false;
 
 /* canvas state */
 
@@ -95,12 +100,13 @@ static ui9::Root root(&manager);
 
 /* display  */
 
-static program* cmd_shader_gl(int cmd_shader)
+static program* cmd_shader_gl(int cmd_shader, int cmd_mode)
 {
+    bool inst = cmd_mode == mode_instances;
     switch (cmd_shader) {
-    case shader_simple:  return &prog_simple;
-    case shader_msdf:    return &prog_msdf;
-    case shader_canvas:  return &prog_canvas;
+    case shader_simple:  return inst ? &inst_simple : &prog_simple;
+    case shader_msdf:    return inst ? &inst_msdf : &prog_msdf;
+    case shader_canvas:  return inst ? &inst_canvas : &prog_canvas;
     default: return nullptr;
     }
 }
@@ -208,6 +214,7 @@ static void update()
     canvas.set_transform(mat3(s,  0,  tx,
                               0,  s,  ty,
                               0,  0,  1));
+    canvas.set_viewport(vec2(0), vec2(window_width, window_height));
     canvas.set_scale(sqrtf((framebuffer_width * framebuffer_height) /
         (float)(window_width * window_height)));
 
@@ -220,14 +227,22 @@ static void update()
         render_stats_text(batch, manager);
     }
 
+    /* join commands with the same shader and image */
+    if (batch_cmds) {
+        draw_list_batch(batch);
+    }
+
     /* synchronize canvas texture buffers */
     buffer_texture_create(shape_tb, canvas.ctx->shapes, GL_TEXTURE0, GL_R32F);
     buffer_texture_create(edge_tb, canvas.ctx->edges, GL_TEXTURE1, GL_R32F);
     buffer_texture_create(brush_tb, canvas.ctx->brushes, GL_TEXTURE2, GL_R32F);
+    buffer_texture_create(cell_tb, canvas.ctx->cells, GL_TEXTURE3, GL_R32F);
+    buffer_texture_create(cell_edge_tb, canvas.ctx->cell_edges, GL_TEXTURE4, GL_R32F);
 
     /* update vertex and index buffers arrays (idempotent) */
     vertex_buffer_create("vbo", &vbo, GL_ARRAY_BUFFER, batch.vertices);
     vertex_buffer_create("ibo", &ibo, GL_ELEMENT_ARRAY_BUFFER, batch.indices);
+    vertex_buffer_create("inst_vbo", &inst_vbo, GL_ARRAY_BUFFER, batch.instances);
 }
 
 static void display()
@@ -246,7 +261,8 @@ static void display()
         }
     }
     for (auto cmd : batch.cmds) {
-        glUseProgram(cmd_shader_gl(cmd.shader)->pid);
+        program *p = cmd_shader_gl(cmd.shader, cmd.mode);
+        glUseProgram(p->pid);
         if (cmd.iid == tbo_iid) {
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_BUFFER, shape_tb.tex);
@@ -254,13 +270,24 @@ static void display()
             glBindTexture(GL_TEXTURE_BUFFER, edge_tb.tex);
             glActiveTexture(GL_TEXTURE2);
             glBindTexture(GL_TEXTURE_BUFFER, brush_tb.tex);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_BUFFER, cell_tb.tex);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_BUFFER, cell_edge_tb.tex);
         } else {
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, tex_map[cmd.iid]);
         }
-        glBindVertexArray(vao);
-        glDrawElements(cmd_mode_gl(cmd.mode), cmd.count, GL_UNSIGNED_INT,
-            (void*)(cmd.offset * sizeof(uint)));
+        if (cmd.mode == mode_instances) {
+            glBindVertexArray(inst_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, inst_vbo);
+            instance_array_bind(p, cmd.offset);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, cmd.count);
+        } else {
+            glBindVertexArray(vao);
+            glDrawElements(cmd_mode_gl(cmd.mode), cmd.count, GL_UNSIGNED_INT,
+                (void*)(cmd.offset * sizeof(uint)));
+        }
     }
 }
 
@@ -271,6 +298,8 @@ static void update_uniforms(program *prog)
     uniform_1i(prog, "tb_shape", 0);
     uniform_1i(prog, "tb_edge", 1);
     uniform_1i(prog, "tb_brush", 2);
+    uniform_1i(prog, "tb_cell", 3);
+    uniform_1i(prog, "tb_cell_edge", 4);
 }
 
 static void reshape()
@@ -291,6 +320,15 @@ static void reshape()
 
     glUseProgram(prog_simple.pid);
     update_uniforms(&prog_simple);
+
+    glUseProgram(inst_canvas.pid);
+    update_uniforms(&inst_canvas);
+
+    glUseProgram(inst_msdf.pid);
+    update_uniforms(&inst_msdf);
+
+    glUseProgram(inst_simple.pid);
+    update_uniforms(&inst_simple);
 }
 
 /* keyboard callback */
@@ -388,21 +426,29 @@ static void cursor_position(GLFWwindow* window, double xpos, double ypos)
 
 static void initialize()
 {
-    GLuint simple_fsh, msdf_fsh, canvas_fsh, vsh;
+    GLuint simple_fsh, msdf_fsh, canvas_fsh, vsh, inst_vsh;
 
     std::vector<std::string> attrs = {
         "a_pos", "a_uv0", "a_color", "a_shape", "a_gamma"
     };
+    std::vector<std::string> inst_attrs = {
+        "a_rect", "a_uvrect", "a_color", "a_shape", "a_gamma"
+    };
 
     /* shader program */
     vsh = compile_shader(GL_VERTEX_SHADER, "shaders/simple.vsh");
+    inst_vsh = compile_shader(GL_VERTEX_SHADER, "shaders/instance.vsh");
     simple_fsh = compile_shader(GL_FRAGMENT_SHADER, "shaders/simple.fsh");
     msdf_fsh = compile_shader(GL_FRAGMENT_SHADER, "shaders/msdf.fsh");
     canvas_fsh = compile_shader(GL_FRAGMENT_SHADER, "shaders/canvas.fsh");
     link_program(&prog_simple, vsh, simple_fsh, attrs);
     link_program(&prog_msdf, vsh, msdf_fsh, attrs);
     link_program(&prog_canvas, vsh, canvas_fsh, attrs);
+    link_program(&inst_simple, inst_vsh, simple_fsh, inst_attrs);
+    link_program(&inst_msdf, inst_vsh, msdf_fsh, inst_attrs);
+    link_program(&inst_canvas, inst_vsh, canvas_fsh, inst_attrs);
     glDeleteShader(vsh);
+    glDeleteShader(inst_vsh);
     glDeleteShader(simple_fsh);
     glDeleteShader(msdf_fsh);
     glDeleteShader(canvas_fsh);
@@ -424,6 +470,10 @@ static void initialize()
     vertex_array_1f(p, "a_gamma", 1.0f);
     glBindVertexArray(0);
 
+    /* instance attributes are bound per command in display */
+    vertex_buffer_create("inst_vbo", &inst_vbo, GL_ARRAY_BUFFER, batch.instances);
+    glGenVertexArrays(1, &inst_vao);
+
     /*
      * we need to scan font directory for caching to work, as it uses
      * font ids assigned during scanning. this also means that if the
@@ -502,7 +552,9 @@ void print_help(int argc, char **argv)
         "  -h, --help                command line help\n"
         "  -y, --overlay-stats       show statistics overlay\n"
         "  -m, --disable-msdf        disable MSDF font rendering\n"
-        "  -M, --disable-autoload    disable MSDF atlas autoloading\n",
+        "  -M, --disable-autoload    disable MSDF atlas autoloading\n"
+        "  -i, --instanced           draw glyphs and shapes as instances\n"
+        "  -b, --batch               reorder commands to reduce state changes\n",
         argv[0]);
 }
 
@@ -537,6 +589,12 @@ void parse_options(int argc, char **argv)
         } else if (match_opt(argv[i], "-M", "--disable-autoload")) {
             manager.msdf_autoload = false;
             i++;
+        } else if (match_opt(argv[i], "-i", "--instanced")) {
+            batch.flags = list_instanced;
+            i++;
+        } else if (match_opt(argv[i], "-b", "--batch")) {
+            batch_cmds = true;
+            i++;
         } else {
             fprintf(stderr, "error: unknown option: %s\n", argv[i]);
             help_text = true;
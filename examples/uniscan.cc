@@ -26,6 +26,8 @@
 #include "bitcode.h"
 #include "format.h"
 #include "hashmap.h"
+#include "file.h"
+#include "unicode.h"
 
 using namespace std::chrono;
 
@@ -39,6 +41,7 @@ typedef unsigned int uint;
 
 static const char* blocks_file = "data/unicode/Blocks.txt";
 static const char* data_file = "data/unicode/UnicodeData.txt";
+static const char* db_file = "data/unicode/UnicodeData.db";
 static const char* search_data;
 static bool optimized_search = true;
 static bool print_data = false;
@@ -50,6 +53,7 @@ static bool debug_comments = false;
 static bool compress_stats = false;
 static bool experiment = false;
 static bool compress_data = false;
+static bool compile_db = false;
 static bool help_text = false;
 
 static vector<string> split(string str,
@@ -878,6 +882,40 @@ static void do_search_rabin_karp()
         (float)tl / 1e3, (uint64_t)ts / 1e3, data.size(), byte_count);
 }
 
+static void do_search_db()
+{
+    /*
+     * map the compiled database
+     */
+    const auto t1 = high_resolution_clock::now();
+    unicode_db db;
+    if (!db.open(db_file)) {
+        exit(1);
+    }
+    const auto t2 = high_resolution_clock::now();
+
+    /*
+     * match terms against the distinct words of all names
+     */
+    vector<size_t> names;
+    db.search(split(search_data, " ", false, false), names);
+    for (auto i : names) {
+        uint32_t code = db.name_code(i);
+        char buf[5];
+        utf32_to_utf8(buf, sizeof(buf), code);
+        printf("%s\tU+%04x\t%s\n", buf, code, db.name(code).c_str());
+    }
+
+    /*
+     * print timings
+     */
+    const auto t3 = high_resolution_clock::now();
+    uint64_t tl = duration_cast<nanoseconds>(t2 - t1).count();
+    uint64_t ts = duration_cast<nanoseconds>(t3 - t2).count();
+    printf("[Database] load = %.fμs, search = %.fμs, names = %zu, bytes = %u\n",
+        (float)tl / 1e3, (uint64_t)ts / 1e3, db.num_names(), db.header->length);
+}
+
 /*
  * order0 range encode using adaptive frequencies
  */
@@ -1256,6 +1294,94 @@ void do_compress_data()
     }
 }
 
+/*
+ * compile the binary database
+ */
+
+static bool parse_entry(struct data &d, unicode_entry &e)
+{
+    unsigned long ccc = strtoul(d.Canonical_Combining_Class.c_str(), nullptr, 10);
+    e.first = e.last = d.Code;
+    e.name = d.Name;
+    e.name_kind = unicode_name_plain;
+    e.ccc = (uint8_t)ccc;
+    return unicode_db::parse_category(d.General_Category.c_str(), e.category) &&
+        unicode_db::parse_bidi(d.Bidi_Class.c_str(), e.bidi);
+}
+
+static vector<unicode_entry> read_entries()
+{
+    vector<data> data = read_data();
+    vector<unicode_entry> entries;
+
+    for (size_t i = 0; i < data.size(); i++) {
+        unicode_entry e;
+        if (!parse_entry(data[i], e)) {
+            fprintf(stderr, "error: bad properties: U+%04x\n", data[i].Code);
+            exit(1);
+        }
+
+        /* <CJK Ideograph, First> and <CJK Ideograph, Last> rows are ranges */
+        string &name = data[i].Name;
+        size_t c = name.find(", First>");
+        if (c != string::npos && i + 1 < data.size()) {
+            string range = name.substr(1, c - 1);
+            e.last = data[++i].Code;
+            if (range.find("CJK Ideograph") == 0) {
+                e.name = "CJK UNIFIED IDEOGRAPH-";
+                e.name_kind = unicode_name_code;
+            } else if (range.find("Tangut Ideograph") == 0) {
+                e.name = "TANGUT IDEOGRAPH-";
+                e.name_kind = unicode_name_code;
+            } else if (range.find("Hangul Syllable") == 0) {
+                e.name = "HANGUL SYLLABLE ";
+                e.name_kind = unicode_name_hangul;
+            } else {
+                e.name = "";
+                e.name_kind = unicode_name_none;
+            }
+        }
+        entries.push_back(e);
+    }
+
+    return entries;
+}
+
+void do_compile_db()
+{
+    token_set ts;
+    vector<unicode_entry> entries = read_entries();
+    vector<unicode_block> blocks;
+
+    for (auto &b : read_blocks()) {
+        blocks.push_back(unicode_block{ b.start, b.end, b.name });
+    }
+
+    /* name n-grams chosen as for write_dict, most useful first */
+    for (auto &e : entries) {
+        if (e.name.size() > 0) ts.tokenize(e.name);
+    }
+    for (auto &e : entries) {
+        if (e.name.size() > 0) ts.compress(e.name);
+    }
+    vector<string> ngrams;
+    for (auto &n : sort_filter_ngram(compute_ngram_freq(ts.symbols, 3), 255)) {
+        ngrams.push_back(n.first);
+    }
+
+    if (!unicode_db::compile(db_file, entries, blocks, ngrams)) {
+        exit(1);
+    }
+
+    unicode_db db;
+    if (!db.open(db_file)) {
+        exit(1);
+    }
+    printf("%s: %zu records, %zu names, %zu blocks, %u n-grams, %u bytes\n",
+        db_file, (size_t)db.header->num_records, db.num_names(),
+        db.num_blocks(), db.header->num_ngrams, db.header->length);
+}
+
 void do_experiment()
 {
     token_set ts;
@@ -1291,8 +1417,11 @@ void print_help(int argc, char **argv)
         "Options:\n"
         "  -u, --data-file <name>       unicode data file\n"
         "  -b, --blocks-file <name>     unicode blocks file\n"
+        "  -d, --db-file <name>         compiled unicode database\n"
+        "  -c, --compile-db             compile unicode database\n"
         "  -p, --print-data             print unicode data\n"
-        "  -s, --search <string>        search unicode data\n"
+        "  -s, --search <string>        search unicode data (uses the\n"
+        "                               compiled database if present)\n"
         "  -x, --brute-force            disable search optimization\n"
         "  -B, --print-blocks           print unicode blocks\n"
         "  -S, --debug-symbols          compress debug symbols\n"
@@ -1329,6 +1458,12 @@ void parse_options(int argc, char **argv)
         } else if (match_opt(argv[i], "-b", "--blocks-file")) {
             if (check_param(++i == argc, "--blocks-file")) break;
             blocks_file = argv[i++];
+        } else if (match_opt(argv[i], "-d", "--db-file")) {
+            if (check_param(++i == argc, "--db-file")) break;
+            db_file = argv[i++];
+        } else if (match_opt(argv[i], "-c", "--compile-db")) {
+            compile_db = true;
+            i++;
         } else if (match_opt(argv[i], "-p", "--print-data")) {
             print_data = true;
             i++;
@@ -1387,11 +1522,14 @@ int main(int argc, char **argv)
     parse_options(argc, argv);
 
     if (print_data) do_print_data();
+    if (compile_db) do_compile_db();
     if (search_data)
-        if (optimized_search)
-            do_search_rabin_karp();
-        else
+        if (!optimized_search)
             do_search_brute_force();
+        else if (file::fileExists(db_file))
+            do_search_db();
+        else
+            do_search_rabin_karp();
     if (print_blocks) do_print_blocks();
     if (compress_stats) do_compress_stats();
     if (compress_data) do_compress_data();
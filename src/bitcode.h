@@ -7,11 +7,19 @@
 
 #include <vector>
 #include <numeric>
+#include <algorithm>
 #include <functional>
 
 #include "ztdbits.h"
 #include "ztdendian.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
 #ifdef _WIN32
 typedef long long ssize_t;
 #endif
@@ -165,11 +173,193 @@ static vlu_result vlu_decode_56(uint64_t vlu, uint64_t limit = 8)
     int t1 = ctz(~vlu);
     bool cont = t1 >= limit;
     int shamt = cont ? limit : t1 + 1;
-    uint64_t mask = ~(-(int64_t)!cont << (shamt * bits_per_unit));
+    uint64_t mask = cont ? -1ull : (1ull << (shamt * bits_per_unit)) - 1;
     uint64_t num = (vlu >> shamt) & mask;
     return vlu_result{ num, shamt | -(int64_t)cont };
 }
 
+/*
+ * vlu_simd_table - parse of eight bytes holding one and two byte symbols
+ *
+ * indexed by bit 0 of each byte. bit 0 is clear in the first byte of a
+ * one byte symbol and set in the first byte of longer symbols, which are
+ * two byte symbols if bit 1 is clear. wide holds the first byte of each
+ * two byte symbol so that bit 1 can be checked, and shuffle moves each
+ * symbol into a 16-bit lane.
+ */
+struct vlu_simd_entry
+{
+    uint8_t count;
+    uint8_t bytes;
+    uint8_t wide;
+    uint8_t shuffle[16];
+};
+
+struct vlu_simd_table
+{
+    vlu_simd_entry entries[256];
+
+    vlu_simd_table()
+    {
+        for (size_t m = 0; m < 256; m++) {
+            vlu_simd_entry &e = entries[m];
+            memset(&e, 0, sizeof(e));
+            memset(e.shuffle, 0x80, sizeof(e.shuffle));
+            size_t pos = 0;
+            while (pos < 8) {
+                size_t len = (m >> pos) & 1 ? 2 : 1;
+                if (pos + len > 8) break;
+                e.shuffle[e.count*2] = (uint8_t)pos;
+                if (len == 2) {
+                    e.shuffle[e.count*2+1] = (uint8_t)(pos + 1);
+                    e.wide |= (uint8_t)(1 << pos);
+                }
+                e.count++;
+                pos += len;
+            }
+            e.bytes = (uint8_t)pos;
+        }
+    }
+
+    static const vlu_simd_table& get()
+    {
+        static const vlu_simd_table table;
+        return table;
+    }
+};
+
+static inline uint64_t vlu_load_56(const uint8_t *buf, size_t len)
+{
+    uint64_t w = 0;
+    memcpy(&w, buf, std::min(len, sizeof(w)));
+    return le64(w);
+}
+
+/*
+ * vlu_decode_56_n - decode up to count VLU8 symbols from a byte buffer
+ *
+ * returns the number of symbols decoded and sets consumed to the number
+ * of bytes read. stops early at a truncated symbol. with SSSE3, runs of
+ * one and two byte symbols are decoded eight or sixteen at a time.
+ */
+static size_t vlu_decode_56_n(uint64_t *symbols, size_t count,
+    const uint8_t *buf, size_t len, size_t &consumed)
+{
+    size_t i = 0, pos = 0;
+
+#if defined(__SSSE3__)
+    const vlu_simd_table &table = vlu_simd_table::get();
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= count && pos + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(buf + pos));
+        uint32_t m0 = _mm_movemask_epi8(_mm_slli_epi16(v, 7));
+        if (m0 == 0) {
+            /* sixteen one byte symbols */
+            __m128i b = _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7f));
+            __m128i h[2] = { _mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero) };
+            __m128i *out = (__m128i*)(symbols + i);
+            for (size_t j = 0; j < 2; j++) {
+                __m128i lo = _mm_unpacklo_epi16(h[j], zero);
+                __m128i hi = _mm_unpackhi_epi16(h[j], zero);
+                _mm_storeu_si128(out++, _mm_unpacklo_epi32(lo, zero));
+                _mm_storeu_si128(out++, _mm_unpackhi_epi32(lo, zero));
+                _mm_storeu_si128(out++, _mm_unpacklo_epi32(hi, zero));
+                _mm_storeu_si128(out++, _mm_unpackhi_epi32(hi, zero));
+            }
+            i += 16;
+            pos += 16;
+            continue;
+        }
+        uint32_t m1 = _mm_movemask_epi8(_mm_slli_epi16(v, 6));
+        const vlu_simd_entry &e = table.entries[m0 & 0xff];
+        if ((m1 & e.wide) == 0) {
+            /* one and two byte symbols in the first eight bytes */
+            __m128i x = _mm_shuffle_epi8(v,
+                _mm_loadu_si128((const __m128i*)e.shuffle));
+            __m128i sel = _mm_cmpeq_epi16(_mm_and_si128(x, _mm_set1_epi16(1)),
+                _mm_set1_epi16(1));
+            x = _mm_or_si128(_mm_and_si128(sel, _mm_srli_epi16(x, 2)),
+                _mm_andnot_si128(sel, _mm_srli_epi16(x, 1)));
+            __m128i lo = _mm_unpacklo_epi16(x, zero);
+            __m128i hi = _mm_unpackhi_epi16(x, zero);
+            __m128i *out = (__m128i*)(symbols + i);
+            _mm_storeu_si128(out++, _mm_unpacklo_epi32(lo, zero));
+            _mm_storeu_si128(out++, _mm_unpackhi_epi32(lo, zero));
+            _mm_storeu_si128(out++, _mm_unpacklo_epi32(hi, zero));
+            _mm_storeu_si128(out++, _mm_unpackhi_epi32(hi, zero));
+            i += e.count;
+            pos += e.bytes;
+            continue;
+        }
+        /* longer symbol */
+        uint64_t w = vlu_load_56(buf + pos, 8);
+        symbols[i++] = vlu_decode_56(w).val;
+        pos += vlu_decoded_size_56(w);
+    }
+#endif
+
+    while (i < count && pos + 8 <= len) {
+        uint64_t w = vlu_load_56(buf + pos, 8);
+        vlu_result r = vlu_decode_56(w);
+        symbols[i++] = r.val;
+        pos += r.shamt < 0 ? 8 : r.shamt;
+    }
+    while (i < count && pos < len) {
+        uint64_t w = vlu_load_56(buf + pos, len - pos);
+        size_t n = vlu_decoded_size_56(w);
+        if (pos + n > len) break;
+        symbols[i++] = vlu_decode_56(w).val;
+        pos += n;
+    }
+
+    consumed = pos;
+    return i;
+}
+
+/*
+ * vlu_encode_56_n - encode count VLU8 symbols into a byte buffer
+ *
+ * returns the number of bytes written. the buffer must have room for
+ * eight bytes per symbol as symbols are stored with 64-bit writes. with
+ * SSE2, runs of sixteen symbols below 128 are packed together.
+ */
+static size_t vlu_encode_56_n(uint8_t *buf, const uint64_t *symbols,
+    size_t count)
+{
+    size_t i = 0, pos = 0;
+
+    while (i < count) {
+#if defined(__SSE2__)
+        uint64_t any = 0;
+        for (size_t j = 0; j < 16 && i + 16 <= count; j++) any |= symbols[i + j];
+        if (i + 16 <= count && any < 128) {
+            /* sixteen one byte symbols */
+            const __m128i *in = (const __m128i*)(symbols + i);
+            __m128i d[4];
+            for (size_t j = 0; j < 4; j++) {
+                __m128i a = _mm_shuffle_epi32(_mm_loadu_si128(in++), _MM_SHUFFLE(3,1,2,0));
+                __m128i b = _mm_shuffle_epi32(_mm_loadu_si128(in++), _MM_SHUFFLE(3,1,2,0));
+                d[j] = _mm_unpacklo_epi64(a, b);
+            }
+            __m128i w = _mm_packus_epi16(_mm_packs_epi32(d[0], d[1]),
+                _mm_packs_epi32(d[2], d[3]));
+            _mm_storeu_si128((__m128i*)(buf + pos), _mm_add_epi8(w, w));
+            i += 16;
+            pos += 16;
+            continue;
+        }
+#endif
+        for (size_t end = std::min(i + 16, count); i < end; i++) {
+            vlu_result r = vlu_encode_56(symbols[i]);
+            uint64_t w = le64(r.val);
+            memcpy(buf + pos, &w, sizeof(w));
+            pos += r.shamt < 0 ? 8 : r.shamt;
+        }
+    }
+
+    return pos;
+}
+
 
 /*
  * ~~~===~~~
@@ -253,7 +443,13 @@ struct vector_writer : writer, vector_buffer
 
     virtual ssize_t write(const void *buf, size_t len)
     {
-        buffer.resize(offset + len);
+        /* grow geometrically, writes before the end do not truncate */
+        if (offset + len > buffer.size()) {
+            if (offset + len > buffer.capacity()) {
+                buffer.reserve(std::max(offset + len, buffer.capacity() * 2));
+            }
+            buffer.resize(offset + len);
+        }
         memcpy(buffer.data() + offset, buf, len);
         offset += len;
         return len;
@@ -283,9 +479,10 @@ struct bitcode_reader
     u64u data; /* little-endian buffer */
     size_t mark; /* buffered bits */
     reader *in; /* input reader */
+    bool eof; /* a read went past the end of the input */
 
-    bitcode_reader() : data{0}, mark(0), in(nullptr) {}
-    bitcode_reader(reader *in) : data{0}, mark(0), in(in) {}
+    bitcode_reader() : data{0}, mark(0), in(nullptr), eof(false) {}
+    bitcode_reader(reader *in) : data{0}, mark(0), in(in), eof(false) {}
 
     /* used and available free space in buffer */
     size_t used() const { return mark; }
@@ -295,6 +492,7 @@ struct bitcode_reader
     {
         mark = 0;
         data.w = 0;
+        eof = false;
         if (in) in->seek(offset);
     }
     ssize_t tell() const { return in->tell() + (mark & ~7); }
@@ -303,6 +501,7 @@ struct bitcode_reader
     {
         mark = 0;
         data.w = 0;
+        eof = false;
         if (in) in->reset();
     }
 
@@ -320,6 +519,7 @@ struct bitcode_reader
             size_t len = in->read(d.buf, bits>>3);
             size_t chunk = len<<3;
             data.w = le64(((le64(d.w) & msk(chunk)) << mark) | (le64(data.w) & msk(mark)));
+            mark += chunk;
         }
     }
 
@@ -327,22 +527,50 @@ struct bitcode_reader
     {
         sync();
         vlu_result result = vlu_decode_56(le64(data.w));
+        if (mark < (size_t)(result.shamt<<3) && result.shamt > 4) {
+            uint64_t lo = read_fixed(32);
+            return vlu_decode_56(lo | (read_fixed((result.shamt<<3) - 32) << 32)).val;
+        }
         uint64_t symbol = result.val;
         size_t read = std::min((size_t)(result.shamt<<3), mark);
+        eof |= read < (size_t)(result.shamt<<3);
         mark -= read;
-        data.w = le64(le64(data.w) >> read);
+        data.w = read < 64 ? le64(le64(data.w) >> read) : 0;
         return symbol;
     }
 
     uint64_t read_fixed(size_t bit_width)
     {
-        if (mark < bit_width) sync();
+        if (mark < bit_width) {
+            sync();
+            if (mark < bit_width && bit_width > 32) {
+                uint64_t lo = read_fixed(32);
+                return lo | (read_fixed(bit_width - 32) << 32);
+            }
+            eof |= mark < bit_width;
+        }
         uint64_t symbol = le64(data.w) & msk(bit_width);
         size_t read = std::min((size_t)bit_width, mark);
         mark -= read;
-        data.w = le64(le64(data.w) >> read);
+        data.w = read < 64 ? le64(le64(data.w) >> read) : 0;
         return symbol;
     }
+
+    template <typename T>
+    void read_vlu_n(T *symbols, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            symbols[i] = (T)read_vlu();
+        }
+    }
+
+    template <typename T>
+    void read_fixed_n(T *symbols, size_t count, size_t bit_width)
+    {
+        for (size_t i = 0; i < count; i++) {
+            symbols[i] = (T)read_fixed(bit_width);
+        }
+    }
 };
 
 struct bitcode_writer
@@ -391,36 +619,163 @@ struct bitcode_writer
         if (bits == 0) return;
 
         out->write(data.buf, (bits>>3));
-        data.w = le64(le64(data.w) >> bits);
+        data.w = bits < 64 ? le64(le64(data.w) >> bits) : 0;
         mark -= bits;
     }
 
     void write_vlu(uint64_t symbol)
     {
         vlu_result r = vlu_encode_56(symbol);
-        while (r.shamt) {
-            if (avail() == 0) sync();
-            size_t chunk = std::min((size_t)(r.shamt<<3), avail());
-            data.w = le64(((r.val & msk(chunk)) << mark) | (le64(data.w) & msk(mark)));
-            r.shamt -= (chunk>>3);
-            r.val >>= chunk;
-            mark += chunk;
-        }
+        write_fixed(r.val, (r.shamt < 0 ? 8 : r.shamt)<<3);
     }
 
     void write_fixed(uint64_t symbol, size_t bit_width)
     {
+        /* fast path when the symbol fits in the buffer */
+        if (bit_width < avail()) {
+            data.w = le64(((symbol & msk(bit_width)) << mark) | (le64(data.w) & msk(mark)));
+            mark += bit_width;
+            return;
+        }
         while (bit_width) {
             if (avail() == 0) sync();
             size_t chunk = std::min(bit_width, avail());
             data.w = le64(((symbol & msk(chunk)) << mark) | (le64(data.w) & msk(mark)));
             bit_width -= chunk;
-            symbol >>= chunk;
+            symbol = chunk < 64 ? symbol >> chunk : 0;
             mark += chunk;
         }
     }
 };
 
+/*
+ * bitcode_memory_reader
+ *
+ * bitcode reader over contiguous memory without the virtual reader
+ * interface. the bit buffer is refilled with one unaligned 64-bit load
+ * which leaves it holding 56 to 63 bits. bits above the mark hold the
+ * following bytes, so loads that overlap them OR in identical values.
+ */
+
+struct bitcode_memory_reader
+{
+    uint64_t bits; /* little-endian bit buffer */
+    size_t mark; /* buffered bits */
+    const uint8_t *data; /* input memory */
+    size_t size; /* input size */
+    size_t offset; /* next byte to load */
+
+    bitcode_memory_reader() :
+        bits(0), mark(0), data(nullptr), size(0), offset(0) {}
+    bitcode_memory_reader(const void *data, size_t size) :
+        bits(0), mark(0), data((const uint8_t*)data), size(size), offset(0) {}
+
+    template <typename CONTAINER>
+    bitcode_memory_reader(const CONTAINER &c) :
+        bitcode_memory_reader(c.data(), c.size() * sizeof(*c.data())) {}
+
+    void seek(size_t o)
+    {
+        bits = 0;
+        mark = 0;
+        offset = o;
+    }
+    size_t tell() const { return offset - (mark>>3); }
+
+    void refill()
+    {
+        if (offset + 8 <= size) {
+            uint64_t w;
+            memcpy(&w, data + offset, 8);
+            bits |= le64(w) << mark;
+            offset += (63 - mark) >> 3;
+            mark |= 56;
+        } else {
+            while (mark <= 56 && offset < size) {
+                bits |= (uint64_t)data[offset++] << mark;
+                mark += 8;
+            }
+        }
+    }
+
+    void consume(size_t read)
+    {
+        bits = read < 64 ? bits >> read : 0;
+        mark -= read;
+    }
+
+    uint64_t read_fixed(size_t bit_width)
+    {
+        if (mark < bit_width) {
+            refill();
+            if (mark < bit_width && bit_width > 32) {
+                uint64_t lo = read_fixed(32);
+                return lo | (read_fixed(bit_width - 32) << 32);
+            }
+        }
+        uint64_t symbol = bits & msk(bit_width);
+        consume(std::min(bit_width, mark));
+        return symbol;
+    }
+
+    uint64_t read_vlu()
+    {
+        if (mark < 64) refill();
+        size_t len = vlu_decoded_size_56(bits) << 3;
+        if (mark < len && len > 32) {
+            uint64_t lo = read_fixed(32);
+            return vlu_decode_56(lo | (read_fixed(len - 32) << 32)).val;
+        }
+        vlu_result result = vlu_decode_56(bits);
+        consume(std::min(len, mark));
+        return result.val;
+    }
+
+    template <typename T>
+    void read_vlu_n(T *symbols, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            symbols[i] = (T)read_vlu();
+        }
+    }
+
+    void read_vlu_n(uint64_t *symbols, size_t count)
+    {
+#if defined(__SSSE3__)
+        /* byte aligned streams are decoded in batches from memory,
+         * without SSSE3 the batch decoder is no faster than read_vlu */
+        if ((mark & 7) == 0) {
+            size_t start = tell(), consumed;
+            size_t n = vlu_decode_56_n(symbols, count, data + start,
+                size - start, consumed);
+            seek(start + consumed);
+            symbols += n;
+            count -= n;
+        }
+#endif
+        for (size_t i = 0; i < count; i++) {
+            symbols[i] = read_vlu();
+        }
+    }
+
+    template <typename T>
+    void read_fixed_n(T *symbols, size_t count, size_t bit_width)
+    {
+        if (bit_width > 56) {
+            for (size_t i = 0; i < count; i++) {
+                symbols[i] = (T)read_fixed(bit_width);
+            }
+            return;
+        }
+        const uint64_t m = msk(bit_width);
+        for (size_t i = 0; i < count; i++) {
+            if (mark < bit_width) refill();
+            symbols[i] = (T)(bits & m);
+            consume(std::min(bit_width, mark));
+        }
+    }
+};
+
 /*
  * ~~~===~~~
  *
@@ -524,7 +879,7 @@ using RangeCoder64 = RangeCoder<uint64_t, 1ull << 56, 1ull << 48, 1ull << 48>;
 using RangeCoder32 = RangeCoder<uint32_t, 1u << 24, 1u << 16, 1u << 16>;
 
 template <>
-uint32_t RangeCoder<uint32_t, 1u << 24, 1u << 16, 1u << 16>::DivideRange(uint32_t Range, uint32_t TotalRange)
+inline uint32_t RangeCoder<uint32_t, 1u << 24, 1u << 16, 1u << 16>::DivideRange(uint32_t Range, uint32_t TotalRange)
 {
     /* return Range / TotalRange; */
     if (LastRange != TotalRange) {
@@ -549,9 +904,10 @@ struct FreqTable
 {
     std::vector<size_t> Freq;
     std::vector<size_t> CumFreq;
+    size_t Increment;
 
-    FreqTable(size_t num_syms)
-        : Freq(num_syms), CumFreq(num_syms)
+    FreqTable(size_t num_syms, size_t Increment = 1)
+        : Freq(num_syms), CumFreq(num_syms), Increment(Increment)
     {
         for (size_t i = 0, sz = Freq.size(); i < sz; i++) {
             Freq[i] = 1;
@@ -595,9 +951,9 @@ static void rescale_cumualtive(std::vector<size_t> &F)
 }
 
 /* update cumulative frequency table every interval */
-void FreqTable::UpdateInterval(size_t sym, size_t MaxRange, size_t i)
+inline void FreqTable::UpdateInterval(size_t sym, size_t MaxRange, size_t i)
 {
-    Freq[sym]++;
+    Freq[sym] += Increment;
 
     if ((i & FreqIntervalMask) == 0) {
         to_cumualtive(CumFreq, Freq);
@@ -609,10 +965,10 @@ void FreqTable::UpdateInterval(size_t sym, size_t MaxRange, size_t i)
 }
 
 /* update cumulative frequency table every sym */
-void FreqTable::UpdateSymbol(size_t sym, size_t MaxRange, size_t i)
+inline void FreqTable::UpdateSymbol(size_t sym, size_t MaxRange, size_t i)
 {
     for (size_t j = sym, sz = CumFreq.size(); j < sz; j++) {
-        CumFreq[j]++;
+        CumFreq[j] += Increment;
     }
     if (CumFreq.back() >= MaxRange) {
         rescale_cumualtive(CumFreq);
@@ -620,7 +976,7 @@ void FreqTable::UpdateSymbol(size_t sym, size_t MaxRange, size_t i)
 }
 
 /* initialize cumulative frequency table */
-void FreqTable::Update(FreqMode freq, size_t sym, size_t MaxRange, size_t i)
+inline void FreqTable::Update(FreqMode freq, size_t sym, size_t MaxRange, size_t i)
 {
     switch (freq) {
     case FreqModeDynPerSymbol:   UpdateSymbol(sym, MaxRange, i);   break;
@@ -629,7 +985,7 @@ void FreqTable::Update(FreqMode freq, size_t sym, size_t MaxRange, size_t i)
 }
 
 /* convert frequency to cumulative frequency */
-void FreqTable::ToCumulative(size_t MaxRange)
+inline void FreqTable::ToCumulative(size_t MaxRange)
 {
     to_cumualtive(CumFreq, Freq);
     while (CumFreq.back() > MaxRange) {
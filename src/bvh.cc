@@ -0,0 +1,117 @@
+// See LICENSE for license details.
+
+#include <cfloat>
+#include <vector>
+#include <algorithm>
+
+#include "glm/glm.hpp"
+
+#include "bvh.h"
+
+using vec2 = glm::vec2;
+
+/*
+ * bvh_tree
+ */
+
+bvh_tree::bvh_tree() : nodes(), leaves(), refits(0) {}
+
+void bvh_tree::clear()
+{
+    nodes.clear();
+    leaves.clear();
+    refits = 0;
+}
+
+int bvh_tree::build_node(int parent, const bvh_box *boxes, const vec2 *centers,
+    int *ids, size_t count)
+{
+    int node_num = (int)nodes.size();
+    nodes.push_back(bvh_node{bvh_box::empty(), parent, -1, -1, -1});
+
+    if (count == 1) {
+        nodes[node_num].box = boxes[ids[0]];
+        nodes[node_num].id = ids[0];
+        leaves[ids[0]] = node_num;
+        return node_num;
+    }
+
+    /* split at the median center along the longest axis of the centers */
+    vec2 cmin(FLT_MAX), cmax(-FLT_MAX);
+    for (size_t i = 0; i < count; i++) {
+        cmin = glm::min(cmin, centers[ids[i]]);
+        cmax = glm::max(cmax, centers[ids[i]]);
+    }
+    int axis = (cmax.x - cmin.x) >= (cmax.y - cmin.y) ? 0 : 1;
+    size_t half = count / 2;
+    std::nth_element(ids, ids + half, ids + count, [&](int a, int b) {
+        return centers[a][axis] < centers[b][axis];
+    });
+
+    int left = build_node(node_num, boxes, centers, ids, half);
+    int right = build_node(node_num, boxes, centers, ids + half, count - half);
+    nodes[node_num].left = left;
+    nodes[node_num].right = right;
+    nodes[node_num].box = nodes[left].box.merge(nodes[right].box);
+    return node_num;
+}
+
+void bvh_tree::build(const bvh_box *boxes, size_t count)
+{
+    clear();
+    if (count == 0) return;
+
+    std::vector<vec2> centers(count);
+    std::vector<int> ids(count);
+    for (size_t i = 0; i < count; i++) {
+        centers[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        ids[i] = (int)i;
+    }
+
+    nodes.reserve(count * 2 - 1);
+    leaves.resize(count);
+    build_node(-1, boxes, centers.data(), ids.data(), count);
+}
+
+void bvh_tree::rebuild()
+{
+    std::vector<bvh_box> boxes(leaves.size());
+    for (size_t i = 0; i < leaves.size(); i++) {
+        boxes[i] = nodes[leaves[i]].box;
+    }
+    build(boxes.data(), boxes.size());
+}
+
+void bvh_tree::update(int id, bvh_box box)
+{
+    int node_num = leaves[id];
+    nodes[node_num].box = box;
+    while ((node_num = nodes[node_num].parent) != -1) {
+        bvh_node &n = nodes[node_num];
+        n.box = nodes[n.left].box.merge(nodes[n.right].box);
+    }
+    refits++;
+}
+
+void bvh_tree::query(const bvh_box &box, std::vector<int> &out) const
+{
+    if (nodes.size() == 0) return;
+
+    int stack[64], depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        const bvh_node &n = nodes[stack[--depth]];
+        if (!n.box.intersects(box)) continue;
+        if (n.id != -1) {
+            out.push_back(n.id);
+        } else {
+            stack[depth++] = n.right;
+            stack[depth++] = n.left;
+        }
+    }
+}
+
+void bvh_tree::query(vec2 point, std::vector<int> &out) const
+{
+    query(bvh_box{point, point}, out);
+}
@@ -0,0 +1,70 @@
+// See LICENSE for license details.
+
+#pragma once
+
+#include <cfloat>
+
+/*
+ * bvh_tree
+ *
+ * Bounding volume hierarchy of 2D axis aligned boxes keyed by item id.
+ * The tree is built top down by splitting at the median center on the
+ * longest axis, with one item per leaf. Updating the box of an item
+ * refits its ancestors in place, which is cheap but loosens the tree,
+ * so callers rebuild once refits exceeds the number of items.
+ */
+
+struct bvh_box
+{
+    glm::vec2 min, max;
+
+    static bvh_box empty()
+    {
+        return bvh_box{glm::vec2(FLT_MAX), glm::vec2(-FLT_MAX)};
+    }
+
+    bool intersects(const bvh_box &o) const
+    {
+        return min.x <= o.max.x && max.x >= o.min.x &&
+               min.y <= o.max.y && max.y >= o.min.y;
+    }
+
+    bool contains(glm::vec2 p) const
+    {
+        return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y;
+    }
+
+    bvh_box merge(const bvh_box &o) const
+    {
+        return bvh_box{glm::min(min, o.min), glm::max(max, o.max)};
+    }
+};
+
+struct bvh_node
+{
+    bvh_box box;
+    int parent;
+    int left, right;    /* child nodes, -1 for leaves */
+    int id;             /* item id of leaves, -1 for inner nodes */
+};
+
+struct bvh_tree
+{
+    std::vector<bvh_node> nodes;
+    std::vector<int> leaves;    /* leaf node of each item id */
+    size_t refits;
+
+    bvh_tree();
+
+    size_t size() const { return leaves.size(); }
+    void clear();
+    void build(const bvh_box *boxes, size_t count);
+    void rebuild();
+    void update(int id, bvh_box box);
+    void query(const bvh_box &box, std::vector<int> &out) const;
+    void query(glm::vec2 point, std::vector<int> &out) const;
+
+    /* internal interfaces */
+    int build_node(int parent, const bvh_box *boxes, const glm::vec2 *centers,
+        int *ids, size_t count);
+};
@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <climits>
+#include <cfloat>
 #include <cstring>
 #include <cassert>
 #include <cctype>
@@ -13,6 +14,7 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <tuple>
 #include <algorithm>
 #include <functional>
@@ -36,6 +38,7 @@
 #include "draw.h"
 #include "font.h"
 #include "glyph.h"
+#include "bvh.h"
 #include "canvas.h"
 #include "logger.h"
 
@@ -117,11 +120,55 @@ int AEdge::num_points(int edge_type)
     case MVGPrimitiveRectangle:        return 2;
     case MVGPrimitiveCircle:           return 2;
     case MVGPrimitiveEllipse:          return 2;
-    case MVGPrimitiveRoundedRectangle: return 2;
+    case MVGPrimitiveRoundedRectangle: return 3;
     }
     return 0;
 }
 
+/*
+ * cubic to quadratic conversion
+ *
+ * the quadratic with control point (3(c1 + c2) - (p0 + p3)) / 4 is within
+ * sqrt(3)/36 * |p3 - 3c2 + 3c1 - p0| of the cubic. splitting the cubic into
+ * n equal parameter intervals divides the third difference by n^3, so the
+ * smallest n meeting the tolerance is computed directly from the bound.
+ */
+
+static vec2 cubic_point(const vec2 p[4], float t)
+{
+    float s = 1.0f - t;
+    return p[0]*(s*s*s) + p[1]*(3.0f*s*s*t) + p[2]*(3.0f*s*t*t) + p[3]*(t*t*t);
+}
+
+static vec2 cubic_tangent(const vec2 p[4], float t)
+{
+    float s = 1.0f - t;
+    return (p[1]-p[0])*(3.0f*s*s) + (p[2]-p[1])*(6.0f*s*t) + (p[3]-p[2])*(3.0f*t*t);
+}
+
+void AEdge::cubic_to_quadratics(const AEdge &e, float tolerance,
+    std::vector<AEdge> &out)
+{
+    const int max_split = 64;
+    const vec2 *p = e.p;
+
+    vec2 d3 = p[3] - p[2]*3.0f + p[1]*3.0f - p[0];
+    float err = sqrtf(3.0f) / 36.0f * glm::length(d3);
+    int n = tolerance > 0 ? (int)ceilf(cbrtf(err / tolerance)) : max_split;
+    n = std::max(1, std::min(max_split, n));
+
+    vec2 q0 = p[0], d0 = cubic_tangent(p, 0.0f);
+    for (int i = 1; i <= n; i++) {
+        float t = (float)i / (float)n, h = 1.0f / (float)n;
+        vec2 q3 = i == n ? p[3] : cubic_point(p, t), d1 = cubic_tangent(p, t);
+        vec2 q1 = q0 + d0 * (h / 3.0f), q2 = q3 - d1 * (h / 3.0f);
+        vec2 c = ((q1 + q2) * 3.0f - q0 - q3) * 0.25f;
+        out.push_back(AEdge{MVGEdgeQuadratic, { q0, c, q3 }});
+        q0 = q3;
+        d0 = d1;
+    }
+}
+
 int ABrush::num_points(int brush_type)
 {
     switch (brush_type) {
@@ -143,12 +190,23 @@ int ABrush::num_colors(int brush_type)
 }
 
 
+AContext::AContext() :
+    shapes(), contours(), edges(), brushes(), cells(), cell_edges(),
+    brush_index(), shape_index(), shapes_indexed(0), shapes_binned(0),
+    pos(0), cubic_tolerance(default_cubic_tolerance) {}
+
 void AContext::clear()
 {
     shapes.clear();
     contours.clear();
     edges.clear();
     brushes.clear();
+    cells.clear();
+    cell_edges.clear();
+    brush_index.clear();
+    shape_index.clear();
+    shapes_indexed = 0;
+    shapes_binned = 0;
 }
 
 int AContext::new_shape(vec2 offset, vec2 size)
@@ -169,6 +227,16 @@ int AContext::new_contour()
 
 int AContext::new_edge(AEdge e)
 {
+    if (e.type == MVGEdgeCubic) {
+        std::vector<AEdge> quads;
+        AEdge::cubic_to_quadratics(e, cubic_tolerance, quads);
+        int edge_num = (int)edges.size();
+        for (auto &q : quads) {
+            new_edge(q);
+        }
+        return edge_num;
+    }
+
     int edge_num = (int)edges.size();
     edges.push_back(e);
     if (shapes.back().contour_count > 0) {
@@ -185,6 +253,7 @@ int AContext::copy_shape(AShape *shape, AEdge *edges)
     s.fill_brush = shape->fill_brush;
     s.stroke_brush = shape->stroke_brush;
     s.stroke_width = shape->stroke_width;
+    s.stroke_mode = shape->stroke_mode;
     for (int i = 0; i < shape->edge_count; i++) {
         new_edge(edges[i]);
     }
@@ -213,8 +282,8 @@ bool AContext::shape_equals(AShape *s0, AEdge *e0, AShape *s1, AEdge *e1)
     if (s0->fill_brush != s1->fill_brush) return false;
     if (s0->stroke_brush != s1->stroke_brush) return false;
     if (s0->stroke_width != s1->stroke_width) return false;
-    if (e0->type != e1->type) return false;
     for (int i = 0; i < s0->edge_count; i++) {
+        if (e0[i].type != e1[i].type) return false;
         int match_points = AEdge::num_points((int)e0[i].type);
         for (int j = 0; j < match_points; j++) {
             if (e0[i].p[j] != e1[i].p[j]) return false;
@@ -223,22 +292,81 @@ bool AContext::shape_equals(AShape *s0, AEdge *e0, AShape *s1, AEdge *e1)
     return true;
 }
 
+/*
+ * hashes must agree with brush_equals and shape_equals, so they only
+ * include compared fields and treat -0.0f and 0.0f as the same value.
+ */
+
+static size_t hash_mix(size_t h, float f)
+{
+    uint32_t u;
+    f = f == 0.0f ? 0.0f : f;
+    memcpy(&u, &f, sizeof(u));
+    return (h ^ u) * 0x100000001b3ull;
+}
+
+static size_t hash_mix(size_t h, vec2 v)
+{
+    return hash_mix(hash_mix(h, v.x), v.y);
+}
+
+static size_t hash_mix(size_t h, vec4 v)
+{
+    return hash_mix(hash_mix(hash_mix(hash_mix(h, v.x), v.y), v.z), v.w);
+}
+
+size_t AContext::brush_hash(ABrush *b)
+{
+    size_t h = hash_mix(0xcbf29ce484222325ull, b->type);
+    int match_points = ABrush::num_points((int)b->type);
+    int match_colors = ABrush::num_colors((int)b->type);
+    for (int i = 0; i < match_points; i++) {
+        h = hash_mix(h, b->p[i]);
+    }
+    for (int i = 0; i < match_colors; i++) {
+        h = hash_mix(h, b->c[i]);
+    }
+    return h;
+}
+
+size_t AContext::shape_hash(AShape *s, AEdge *e)
+{
+    size_t h = hash_mix(0xcbf29ce484222325ull, s->edge_count);
+    h = hash_mix(h, s->offset);
+    h = hash_mix(h, s->size);
+    h = hash_mix(h, s->fill_brush);
+    h = hash_mix(h, s->stroke_brush);
+    h = hash_mix(h, s->stroke_width);
+    for (int i = 0; i < s->edge_count; i++) {
+        int match_points = AEdge::num_points((int)e[i].type);
+        h = hash_mix(h, e[i].type);
+        for (int j = 0; j < match_points; j++) {
+            h = hash_mix(h, e[i].p[j]);
+        }
+    }
+    return h;
+}
+
 int AContext::new_brush(ABrush b)
 {
     int brush = (int)brushes.size();
     brushes.push_back(b);
+    brush_index.insert(std::make_pair(brush_hash(&b), brush));
     return brush;
 }
 
 int AContext::find_brush(ABrush *b)
 {
-    /* this is really inefficient! */
-    for (size_t i = 0; i < brushes.size(); i++) {
-        if (brush_equals(&brushes[i], b)) {
-            return (int)i;
+    /* lowest numbered match, as returned by a linear search */
+    int brush_num = -1;
+    auto r = brush_index.equal_range(brush_hash(b));
+    for (auto i = r.first; i != r.second; i++) {
+        if ((brush_num == -1 || i->second < brush_num) &&
+            brush_equals(&brushes[i->second], b)) {
+            brush_num = i->second;
         }
     }
-    return -1;
+    return brush_num;
 }
 
 int AContext::add_brush(ABrush *b, bool dedup)
@@ -250,25 +378,63 @@ int AContext::add_brush(ABrush *b, bool dedup)
     return brush_num;
 }
 
+static void index_erase(std::unordered_multimap<size_t,int> &index,
+    size_t hash, int num)
+{
+    auto r = index.equal_range(hash);
+    for (auto i = r.first; i != r.second; i++) {
+        if (i->second == num) {
+            index.erase(i);
+            return;
+        }
+    }
+}
+
 bool AContext::update_brush(int brush_num, ABrush *b)
 {
     bool update = !brush_equals(&brushes[brush_num], b);
     if (update) {
+        index_erase(brush_index, brush_hash(&brushes[brush_num]), brush_num);
         brushes[brush_num] = *b;
+        brush_index.insert(std::make_pair(brush_hash(b), brush_num));
     }
     return update;
 }
 
+void AContext::index_shapes()
+{
+    /* the last shape is not indexed as edges may still be added to it */
+    while (shapes_indexed + 1 < shapes.size()) {
+        AShape *s = &shapes[shapes_indexed];
+        AEdge *e = edges.data() + (int)s->edge_offset;
+        shape_index.insert(std::make_pair(shape_hash(s, e), (int)shapes_indexed));
+        shapes_indexed++;
+    }
+}
+
 int AContext::find_shape(AShape *s, AEdge *e)
 {
-    /* this is really inefficient! */
-    for (size_t i = 0; i < shapes.size(); i++) {
-        int j = (int)shapes[i].edge_offset;
-        if (shape_equals(&shapes[i], &edges[j], s, e)) {
-            return (int)i;
+    index_shapes();
+
+    /* lowest numbered match, as returned by a linear search */
+    int shape_num = -1;
+    auto r = shape_index.equal_range(shape_hash(s, e));
+    for (auto i = r.first; i != r.second; i++) {
+        AShape *os = &shapes[i->second];
+        AEdge *oe = edges.data() + (int)os->edge_offset;
+        if ((shape_num == -1 || i->second < shape_num) &&
+            shape_equals(os, oe, s, e)) {
+            shape_num = i->second;
+        }
+    }
+    if (shape_num == -1 && shapes_indexed < shapes.size()) {
+        AShape *os = &shapes[shapes_indexed];
+        AEdge *oe = edges.data() + (int)os->edge_offset;
+        if (shape_equals(os, oe, s, e)) {
+            shape_num = (int)shapes_indexed;
         }
     }
-    return -1;
+    return shape_num;
 }
 
 int AContext::add_shape(AShape *s, AEdge *e, bool dedup)
@@ -289,18 +455,138 @@ bool AContext::update_shape(int shape_num, AShape *s, AEdge *e)
         return false;
     }
 
+    bool indexed = (size_t)shape_num < shapes_indexed;
+    if (indexed) {
+        index_erase(shape_index, shape_hash(os, oe), shape_num);
+    }
+
     s->contour_offset = os->contour_offset;
     s->contour_count  = os->contour_count;
     s->edge_offset    = os->edge_offset;
 
     shapes[shape_num] = s[0];
     for (int i = 0; i < s->edge_count; i++) {
-        edges[i] = e[i];
+        oe[i] = e[i];
+    }
+
+    if (indexed) {
+        shape_index.insert(std::make_pair(shape_hash(os, oe), shape_num));
     }
 
     return true;
 }
 
+/*
+ * edge binning
+ *
+ * each binned shape has a grid of cells covering its edges and its quad.
+ * a cell lists every edge that can be the nearest edge to some point in
+ * the cell: the distance from any point in the cell to an edge is at
+ * most the distance to its farthest cell corner from the first point of
+ * the edge, and at least the distance between the cell and the edge's
+ * control point bounds. edges with a lower bound exceeding the smallest
+ * upper bound are excluded. the search is exact so fragments produce the
+ * same distance as a full scan. fragments outside of the grid fall back
+ * to visiting all of the edges of the shape.
+ */
+
+static bool edge_bounds(const AEdge &e, vec2 &emin, vec2 &emax)
+{
+    int n;
+    switch ((int)e.type) {
+    case MVGEdgeLinear:    n = 2; break;
+    case MVGEdgeQuadratic: n = 3; break;
+    default: return false;
+    }
+    emin = emax = e.p[0];
+    for (int i = 1; i < n; i++) {
+        emin = glm::min(emin, e.p[i]);
+        emax = glm::max(emax, e.p[i]);
+    }
+    return true;
+}
+
+void AContext::bin_shapes()
+{
+    for (; shapes_binned < shapes.size(); shapes_binned++) {
+        AShape &shape = shapes[shapes_binned];
+        if (!bin_shape((int)shapes_binned)) {
+            shape.cell_offset = 0;
+            shape.cell_count = 0;
+        }
+    }
+}
+
+bool AContext::bin_shape(int shape_num)
+{
+    AShape &shape = shapes[shape_num];
+    int edge_offset = (int)shape.edge_offset;
+    int edge_count = (int)shape.edge_count;
+
+    if (edge_count < cell_min_edges) return false;
+
+    /* grid covers the edges and the quad including the stroke */
+    std::vector<vec2> &bounds = bin_bounds;
+    bounds.resize((size_t)edge_count * 2);
+    vec2 gmin = glm::min(vec2(0), shape.offset);
+    vec2 gmax = glm::max(shape.size, shape.offset + shape.size);
+    for (int i = 0; i < edge_count; i++) {
+        vec2 &emin = bounds[i * 2], &emax = bounds[i * 2 + 1];
+        if (!edge_bounds(edges[edge_offset + i], emin, emax)) return false;
+        gmin = glm::min(gmin, emin);
+        gmax = glm::max(gmax, emax);
+    }
+    float pad = shape.stroke_width * 0.5f + 1.0f;
+    gmin -= vec2(pad);
+    gmax += vec2(pad);
+
+    shape.cell_offset = (float)cells.size();
+    shape.cell_count = (float)(cell_grid * cell_grid);
+    shape.cell_origin = gmin;
+    shape.cell_size = (gmax - gmin) / (float)cell_grid;
+
+    std::vector<float> &lower = bin_lower;
+    lower.resize((size_t)edge_count);
+    for (int y = 0; y < cell_grid; y++) {
+        for (int x = 0; x < cell_grid; x++) {
+            vec2 c0 = gmin + shape.cell_size * vec2((float)x, (float)y);
+            vec2 c1 = c0 + shape.cell_size;
+            float cutoff = FLT_MAX;
+            for (int i = 0; i < edge_count; i++) {
+                vec2 &emin = bounds[i * 2], &emax = bounds[i * 2 + 1];
+                vec2 p = edges[edge_offset + i].p[0];
+                vec2 gap = glm::max(vec2(0), glm::max(emin - c1, c0 - emax));
+                vec2 far = glm::max(glm::abs(p - c0), glm::abs(p - c1));
+                lower[i] = glm::length(gap);
+                cutoff = std::min(cutoff, glm::length(far));
+            }
+
+            /* tolerance for rounding in the distance functions */
+            cutoff += cutoff * 1e-4f + 1e-3f;
+
+            cells.push_back(ACell{(float)cell_edges.size(), 0});
+            for (int i = 0; i < edge_count; i++) {
+                if (lower[i] <= cutoff) {
+                    cell_edges.push_back((float)(edge_offset + i));
+                    cells.back().edge_count++;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int AContext::find_cell(const AShape &shape, vec2 origin)
+{
+    if (shape.cell_count == 0) return -1;
+    vec2 c = glm::floor((origin - shape.cell_origin) / shape.cell_size);
+    if (!(c.x >= 0 && c.y >= 0 && c.x < cell_grid && c.y < cell_grid)) {
+        return -1;
+    }
+    return (int)shape.cell_offset + (int)c.y * cell_grid + (int)c.x;
+}
+
 /*
  * draw list utility
  */
@@ -311,21 +597,33 @@ static vec2 transform(vec2 pos, mat3 matrix)
     return vec2(v.x / v.z, v.y / v.z);
 }
 
-static void rect(draw_list &b, uint iid, vec2 A, vec2 B, float Z,
-    vec2 UV0, vec2 UV1, uint c, float s, mat3 m = mat3(1))
+static void rect_vertices(draw_vertex *v, vec2 A, vec2 B, float Z,
+    vec2 UV0, vec2 UV1, uint c, float s, mat3 m)
 {
-    uint o = static_cast<uint>(b.vertices.size());
+    auto v1 = transform(A,m);
+    auto v2 = transform(B,m);
 
+    v[0] = {{v1.x, v1.y, Z}, {UV0.x, UV0.y}, c, s};
+    v[1] = {{v2.x, v1.y, Z}, {UV1.x, UV0.y}, c, s};
+    v[2] = {{v2.x, v2.y, Z}, {UV1.x, UV1.y}, c, s};
+    v[3] = {{v1.x, v2.y, Z}, {UV0.x, UV1.y}, c, s};
+}
+
+static draw_instance rect_instance(vec2 A, vec2 B, vec2 UV0, vec2 UV1,
+    uint c, float s, mat3 m)
+{
     auto v1 = transform(A,m);
     auto v2 = transform(B,m);
 
-    uint o0 = draw_list_vertex(b, {{v1.x, v1.y, Z}, {UV0.x, UV0.y}, c, s});
-    uint o1 = draw_list_vertex(b, {{v2.x, v1.y, Z}, {UV1.x, UV0.y}, c, s});
-    uint o2 = draw_list_vertex(b, {{v2.x, v2.y, Z}, {UV1.x, UV1.y}, c, s});
-    uint o3 = draw_list_vertex(b, {{v1.x, v2.y, Z}, {UV0.x, UV1.y}, c, s});
+    return draw_instance{{v1.x, v1.y, v2.x, v2.y}, {UV0.x, UV0.y, UV1.x, UV1.y},
+        c, s};
+}
 
-    draw_list_indices(b, iid, mode_triangles, shader_canvas,
-        {o0, o3, o1, o1, o3, o2});
+static void rect(draw_list &b, uint iid, vec2 A, vec2 B, float Z,
+    vec2 UV0, vec2 UV1, uint c, float s, mat3 m = mat3(1))
+{
+    draw_list_rect(b, iid, shader_canvas, Z,
+        rect_instance(A, B, UV0, UV1, c, s, m));
 }
 
 static void rect(draw_list &batch, vec2 A, vec2 B, float Z,
@@ -393,17 +691,26 @@ float MVGDrawable::get_z() { return z; }
 vec2 MVGDrawable::get_position() { return pos; }
 bool MVGDrawable::is_visible() { return visible; }
 
-void MVGDrawable::set_z(float z) { this->z = z; }
-void MVGDrawable::set_position(vec2 pos) { this->pos = pos; }
-void MVGDrawable::set_visible(bool v) { visible = v; }
+void MVGDrawable::set_z(float z) { this->z = z; invalidate(false); }
+void MVGDrawable::set_position(vec2 pos) { this->pos = pos; invalidate(true); }
+void MVGDrawable::set_visible(bool v) { visible = v; invalidate(false); }
 
 MVGBrush MVGDrawable::get_fill_brush() { return fill_brush; }
 MVGBrush MVGDrawable::get_stroke_brush() { return stroke_brush; }
 float MVGDrawable::get_stroke_width() { return stroke_width; }
 
-void MVGDrawable::set_fill_brush(MVGBrush brush) { fill_brush = brush; }
-void MVGDrawable::set_stroke_brush(MVGBrush brush) { stroke_brush = brush; }
-void MVGDrawable::set_stroke_width(float width) { stroke_width = width; }
+void MVGDrawable::set_fill_brush(MVGBrush brush) { fill_brush = brush; invalidate(false); }
+void MVGDrawable::set_stroke_brush(MVGBrush brush) { stroke_brush = brush; invalidate(false); }
+void MVGDrawable::set_stroke_width(float width) { stroke_width = width; invalidate(true); }
+
+void MVGDrawable::invalidate(bool bounds)
+{
+    dirty = true;
+    if (bounds && !bounds_dirty && canvas) {
+        bounds_dirty = true;
+        canvas->dirty_bounds.push_back(drawable_num);
+    }
+}
 
 /* MVGEdges */
 
@@ -411,23 +718,36 @@ void MVGEdges::clear()
 {
     edges.clear();
     contours.clear();
+    invalidate(false);
 }
 
 void MVGEdges::new_contour()
 {
     contours.emplace_back(AContour{(float)edges.size(), 0});
+    invalidate(false);
 }
 
 void MVGEdges::new_edge(AEdge e)
 {
+    if (e.type == MVGEdgeCubic) {
+        std::vector<AEdge> quads;
+        AEdge::cubic_to_quadratics(e, canvas ? canvas->ctx->cubic_tolerance :
+            AContext::default_cubic_tolerance, quads);
+        for (auto &q : quads) {
+            new_edge(q);
+        }
+        return;
+    }
+
     edges.push_back(e);
     if (contours.size() > 0) {
         contours.back().edge_count++;
     }
+    invalidate(false);
 }
 
-void MVGEdges::set_offset(vec2 v) { offset = v; }
-void MVGEdges::set_size(vec2 v) { size = v; }
+void MVGEdges::set_offset(vec2 v) { offset = v; invalidate(true); }
+void MVGEdges::set_size(vec2 v) { size = v; invalidate(true); }
 
 vec2 MVGEdges::get_offset() { return offset; }
 vec2 MVGEdges::get_size() { return size; }
@@ -449,6 +769,11 @@ MVGPatch* MVGPatch::new_quadratic_curve(vec2 p1, vec2 c1, vec2 p2) {
     return this;
 }
 
+MVGPatch* MVGPatch::new_cubic_curve(vec2 p1, vec2 c1, vec2 c2, vec2 p2) {
+    MVGEdges::new_edge(AEdge{MVGEdgeCubic, { p1, c1, c2, p2 }});
+    return this;
+}
+
 /* MVGPath */
 
 MVGPath* MVGPath::new_contour() {
@@ -466,6 +791,11 @@ MVGPath* MVGPath::new_quadratic_curve(vec2 p1, vec2 c1, vec2 p2) {
     return this;
 }
 
+MVGPath* MVGPath::new_cubic_curve(vec2 p1, vec2 c1, vec2 c2, vec2 p2) {
+    MVGEdges::new_edge(AEdge{MVGEdgeCubic, { p1, c1, c2, p2 }});
+    return this;
+}
+
 /* MVGTextStyle */
 
 float MVGTextStyle::get_size() { return size; }
@@ -495,13 +825,14 @@ text_valign MVGText::get_valign() { return valign; }
 std::string MVGText::get_text() { return text; }
 std::string MVGText::get_lang() { return lang; }
 MVGText::render_as MVGText::get_render_mode() { return mode;}
+MVGText::text_lod MVGText::get_lod() { return lod; }
 
-void MVGText::set_size(float size) { shapes.clear(); this->size = size; }
-void MVGText::set_face(font_face *face) { shapes.clear(); this->face = face; }
-void MVGText::set_halign(text_halign halign) { this->halign = halign; }
-void MVGText::set_valign(text_valign valign) { this->valign = valign; }
-void MVGText::set_lang(std::string lang) { shapes.clear(); this->lang = lang; }
-void MVGText::set_render_mode(MVGText::render_as mode) { this->mode = mode; }
+void MVGText::set_size(float size) { shapes.clear(); this->size = size; invalidate(true); }
+void MVGText::set_face(font_face *face) { shapes.clear(); this->face = face; invalidate(true); }
+void MVGText::set_halign(text_halign halign) { this->halign = halign; invalidate(true); }
+void MVGText::set_valign(text_valign valign) { this->valign = valign; invalidate(true); }
+void MVGText::set_lang(std::string lang) { shapes.clear(); this->lang = lang; invalidate(true); }
+void MVGText::set_render_mode(MVGText::render_as mode) { this->mode = mode; invalidate(false); }
 
 void MVGText::set_text(std::string text)
 {
@@ -510,6 +841,7 @@ void MVGText::set_text(std::string text)
     }
     shapes.clear();
     this->text = text;
+    invalidate(true);
 }
 
 MVGTextStyle MVGText::get_text_style() {
@@ -526,6 +858,7 @@ void MVGText::set_text_style(MVGTextStyle style) {
     fill_brush = style.fill_brush;
     stroke_brush = style.stroke_brush;
     stroke_width = style.stroke_width;
+    invalidate(true);
 }
 
 text_segment& MVGText::get_text_segment() {
@@ -571,25 +904,286 @@ vec2 MVGText::get_text_offset() {
 /* MVGCircle */
 
 vec2 MVGCircle::get_origin() { return origin; }
-void MVGCircle::set_origin(vec2 v) { origin = v; }
+void MVGCircle::set_origin(vec2 v) { origin = v; invalidate(false); }
 float MVGCircle::get_radius() { return radius; }
-void MVGCircle::set_radius(float v) { radius = v; }
+void MVGCircle::set_radius(float v) { radius = v; invalidate(true); }
 
 /* MVGEllipse */
 
 vec2 MVGEllipse::get_origin() { return origin; }
-void MVGEllipse::set_origin(vec2 v) { origin = v; }
+void MVGEllipse::set_origin(vec2 v) { origin = v; invalidate(false); }
 vec2 MVGEllipse::get_halfsize() { return half_size; }
-void MVGEllipse::set_halfsize(vec2 v) { half_size = v; }
+void MVGEllipse::set_halfsize(vec2 v) { half_size = v; invalidate(true); }
 
 /* MVGRect */
 
 vec2 MVGRect::get_origin() { return origin; }
-void MVGRect::set_origin(vec2 v) { origin = v; }
+void MVGRect::set_origin(vec2 v) { origin = v; invalidate(false); }
 vec2 MVGRect::get_halfsize() { return half_size; }
-void MVGRect::set_halfsize(vec2 v) { half_size = v; }
+void MVGRect::set_halfsize(vec2 v) { half_size = v; invalidate(true); }
 float MVGRect::get_radius() { return radius; }
-void MVGRect::set_radius(float v) { radius = v; }
+void MVGRect::set_radius(float v) { radius = v; invalidate(false); }
+
+/*
+ * MVGStore
+ */
+
+static ABrush make_brush(MVGBrush p)
+{
+    color *c = p.colors;
+    vec2 *P = p.points;
+    vec4 C[4] = {
+        { c[0].r, c[0].g, c[0].b, c[0].a },
+        { c[1].r, c[1].g, c[1].b, c[1].a },
+        { c[2].r, c[2].g, c[2].b, c[2].a },
+        { c[3].r, c[3].g, c[3].b, c[3].a },
+    };
+    return ABrush{(float)(int)p.brush_type,
+        { P[0], P[1], P[2], P[3] }, { C[0], C[1], C[2], C[3] } };
+}
+
+MVGStore::MVGStore(MVGCanvas *canvas) :
+    canvas(canvas), arrays(), palette(), edges(), edges_unused(0),
+    dirty(false) {}
+
+size_t MVGStore::size()
+{
+    size_t count = 0;
+    for (auto &a : arrays) {
+        count += a.size();
+    }
+    return count;
+}
+
+void MVGStore::clear()
+{
+    for (auto &a : arrays) {
+        a = MVGStoreArray();
+    }
+    palette.clear();
+    edges.clear();
+    edges_unused = 0;
+    dirty = true;
+}
+
+int MVGStore::brush_num(MVGBrush brush)
+{
+    if (brush.brush_type == MVGBrushNone) {
+        return -1;
+    } else {
+        ABrush tmpl = make_brush(brush);
+        return palette.add_brush(&tmpl);
+    }
+}
+
+MVGStoreArray& MVGStore::array(MVGHandle h)
+{
+    return arrays[h >> handle_bits];
+}
+
+size_t MVGStore::index(MVGHandle h)
+{
+    return array(h).slots[h & ((1u << handle_bits) - 1)];
+}
+
+MVGHandle MVGStore::new_element(store_type type, vec2 pos, vec2 half_size)
+{
+    MVGStoreArray &a = arrays[type];
+    uint32_t slot;
+    if (a.free_slots.size() > 0) {
+        slot = a.free_slots.back();
+        a.free_slots.pop_back();
+        a.slots[slot] = (uint32_t)a.size();
+    } else {
+        slot = (uint32_t)a.slots.size();
+        a.slots.push_back((uint32_t)a.size());
+    }
+
+    MVGHandle h = ((MVGHandle)type << handle_bits) | slot;
+    a.pos.push_back(pos);
+    a.half_size.push_back(half_size);
+    a.z.push_back(0.0f);
+    a.stroke_width.push_back(canvas->stroke_width);
+    a.fill_brush.push_back(brush_num(canvas->fill_brush));
+    a.stroke_brush.push_back(brush_num(canvas->stroke_brush));
+    a.visible.push_back(1);
+    a.handle.push_back(h);
+    dirty = true;
+    return h;
+}
+
+MVGHandle MVGStore::new_circle(vec2 pos, float radius)
+{
+    return new_element(store_circle, pos, vec2(radius));
+}
+
+MVGHandle MVGStore::new_ellipse(vec2 pos, vec2 half_size)
+{
+    return new_element(store_ellipse, pos, half_size);
+}
+
+MVGHandle MVGStore::new_rectangle(vec2 pos, vec2 half_size)
+{
+    return new_rounded_rectangle(pos, half_size, 0.0f);
+}
+
+MVGHandle MVGStore::new_rounded_rectangle(vec2 pos, vec2 half_size, float radius)
+{
+    MVGHandle h = new_element(store_rectangle, pos, half_size);
+    arrays[store_rectangle].radius.push_back(radius);
+    return h;
+}
+
+MVGHandle MVGStore::new_patch(vec2 offset, vec2 size, const AEdge *e, size_t count)
+{
+    MVGHandle h = new_element(store_patch, vec2(0), size / 2.0f);
+    MVGStoreArray &a = arrays[store_patch];
+    a.offset.push_back(offset);
+    a.edge_offset.push_back((int)edges.size());
+    a.edge_count.push_back(add_edges(e, count));
+    return h;
+}
+
+MVGHandle MVGStore::new_path(vec2 offset, vec2 size, const AEdge *e, size_t count)
+{
+    MVGHandle h = new_element(store_path, vec2(0), size / 2.0f);
+    MVGStoreArray &a = arrays[store_path];
+    a.offset.push_back(offset);
+    a.edge_offset.push_back((int)edges.size());
+    a.edge_count.push_back(add_edges(e, count));
+    return h;
+}
+
+int MVGStore::add_edges(const AEdge *e, size_t count)
+{
+    size_t start = edges.size();
+    for (size_t i = 0; i < count; i++) {
+        if (e[i].type == MVGEdgeCubic) {
+            AEdge::cubic_to_quadratics(e[i], canvas->ctx->cubic_tolerance, edges);
+        } else {
+            edges.push_back(e[i]);
+        }
+    }
+    return (int)(edges.size() - start);
+}
+
+void MVGStore::remove(MVGHandle h)
+{
+    MVGStoreArray &a = array(h);
+    uint32_t slot = h & ((1u << handle_bits) - 1);
+    size_t i = a.slots[slot], last = a.size() - 1;
+
+    if (a.edge_count.size() > 0) {
+        edges_unused += a.edge_count[i];
+    }
+
+    /* move the last element into the hole and retarget its slot */
+    auto erase = [&](auto &v) {
+        if (v.size() == 0) return;
+        v[i] = v[last];
+        v.pop_back();
+    };
+    a.slots[a.handle[last] & ((1u << handle_bits) - 1)] = (uint32_t)i;
+    erase(a.pos);
+    erase(a.half_size);
+    erase(a.z);
+    erase(a.stroke_width);
+    erase(a.fill_brush);
+    erase(a.stroke_brush);
+    erase(a.visible);
+    erase(a.handle);
+    erase(a.radius);
+    erase(a.offset);
+    erase(a.edge_offset);
+    erase(a.edge_count);
+    a.free_slots.push_back(slot);
+    dirty = true;
+
+    if (edges_unused > edges.size() / 2) {
+        compact_edges();
+    }
+}
+
+void MVGStore::compact_edges()
+{
+    std::vector<AEdge> compact;
+    compact.reserve(edges.size() - edges_unused);
+    for (auto &a : arrays) {
+        for (size_t i = 0; i < a.edge_offset.size(); i++) {
+            AEdge *e = &edges[a.edge_offset[i]];
+            a.edge_offset[i] = (int)compact.size();
+            compact.insert(compact.end(), e, e + a.edge_count[i]);
+        }
+    }
+    edges = std::move(compact);
+    edges_unused = 0;
+}
+
+vec2 MVGStore::get_position(MVGHandle h) { return array(h).pos[index(h)]; }
+bool MVGStore::is_visible(MVGHandle h) { return array(h).visible[index(h)] != 0; }
+
+void MVGStore::set_position(MVGHandle h, vec2 pos)
+{
+    array(h).pos[index(h)] = pos;
+    dirty = true;
+}
+
+void MVGStore::set_z(MVGHandle h, float z)
+{
+    array(h).z[index(h)] = z;
+    dirty = true;
+}
+
+void MVGStore::set_visible(MVGHandle h, bool visible)
+{
+    array(h).visible[index(h)] = visible;
+    dirty = true;
+}
+
+void MVGStore::set_fill_brush(MVGHandle h, MVGBrush brush)
+{
+    array(h).fill_brush[index(h)] = brush_num(brush);
+    dirty = true;
+}
+
+void MVGStore::set_stroke_brush(MVGHandle h, MVGBrush brush)
+{
+    array(h).stroke_brush[index(h)] = brush_num(brush);
+    dirty = true;
+}
+
+void MVGStore::set_stroke_width(MVGHandle h, float width)
+{
+    array(h).stroke_width[index(h)] = width;
+    dirty = true;
+}
+
+void MVGStore::set_edges(MVGHandle h, const AEdge *e, size_t count)
+{
+    MVGStoreArray &a = array(h);
+    size_t i = index(h);
+
+    /* edges are replaced in place when they fit, otherwise appended */
+    std::vector<AEdge> converted;
+    std::swap(edges, converted);
+    int n = add_edges(e, count);
+    std::swap(edges, converted);
+    if (n <= a.edge_count[i]) {
+        std::copy(converted.begin(), converted.end(),
+            edges.begin() + a.edge_offset[i]);
+        edges_unused += a.edge_count[i] - n;
+    } else {
+        edges_unused += a.edge_count[i];
+        a.edge_offset[i] = (int)edges.size();
+        edges.insert(edges.end(), converted.begin(), converted.end());
+    }
+    a.edge_count[i] = n;
+    dirty = true;
+
+    if (edges_unused > edges.size() / 2) {
+        compact_edges();
+    }
+}
 
 /*
  * MVGCanvas
@@ -597,13 +1191,20 @@ void MVGRect::set_radius(float v) { radius = v; }
 
 MVGCanvas::MVGCanvas(font_manager* manager) :
     objects(), glyph_map(), ctx(std::make_unique<AContext>()),
-    text_renderer_c(*ctx, glyph_map), text_renderer_r(manager), manager(manager),
+    text_renderer_c(*ctx, glyph_map), text_renderer_r(manager),
+    text_renderer_m(nullptr), manager(manager),
     fill_brush{MVGBrushSolid, {vec2(0)}, {color(0,0,0,1)}},
     stroke_brush{MVGBrushSolid, {vec2(0)}, {color(0,0,0,1)}},
-    stroke_width(0.0f), scale(1.0f) {}
+    stroke_width(0.0f), transform(1), transform_inv(1), scale(1.0f),
+    text_mode(MVGText::render_as_text), lod_bitmap_max(64.0f),
+    lod_msdf_max(512.0f), lod_hysteresis(0.15f), retained(false), retained_count(0),
+    index(), dirty_bounds(), viewport_min(0), viewport_max(0), store(this) {}
 
 void MVGCanvas::set_transform(mat3 m)
 {
+    if (m != transform) {
+        retained = false;
+    }
     transform = m;
     transform_inv = glm::inverseTranspose(m);
 }
@@ -620,6 +1221,7 @@ mat3 MVGCanvas::get_inverse_transform()
 
 void MVGCanvas::set_render_mode(MVGText::render_as mode)
 {
+    retained = false;
     text_mode = mode;
 }
 
@@ -628,15 +1230,80 @@ MVGText::render_as MVGCanvas::get_render_mode()
     return text_mode;
 }
 
+void MVGCanvas::set_msdf_manager(font_manager* manager)
+{
+    retained = false;
+    text_renderer_m.manager = manager;
+}
+
+void MVGCanvas::set_text_lod(float bitmap_max, float msdf_max, float hysteresis)
+{
+    retained = false;
+    lod_bitmap_max = bitmap_max;
+    lod_msdf_max = msdf_max;
+    lod_hysteresis = hysteresis;
+}
+
+MVGText::text_lod MVGCanvas::select_lod(MVGText::text_lod lod, float pixel_size)
+{
+    bool msdf = text_renderer_m.manager != nullptr;
+    float up = 1.0f + lod_hysteresis, down = 1.0f - lod_hysteresis;
+
+    /* without a previous level, pick by the bounds alone */
+    if (lod == MVGText::lod_none) {
+        if (pixel_size <= lod_bitmap_max) return MVGText::lod_bitmap;
+        if (msdf && pixel_size <= lod_msdf_max) return MVGText::lod_msdf;
+        return MVGText::lod_outline;
+    }
+    if (lod == MVGText::lod_msdf && !msdf) {
+        lod = MVGText::lod_outline;
+    }
+
+    /* otherwise step up or down only past the bound plus hysteresis */
+    for (;;) {
+        switch (lod) {
+        case MVGText::lod_bitmap:
+            if (pixel_size <= lod_bitmap_max * up) return lod;
+            lod = msdf ? MVGText::lod_msdf : MVGText::lod_outline;
+            break;
+        case MVGText::lod_msdf:
+            if (pixel_size < lod_bitmap_max * down) {
+                lod = MVGText::lod_bitmap;
+            } else if (pixel_size > lod_msdf_max * up) {
+                lod = MVGText::lod_outline;
+            } else {
+                return lod;
+            }
+            break;
+        case MVGText::lod_outline:
+            if (msdf && pixel_size < lod_msdf_max * down) {
+                lod = MVGText::lod_msdf;
+            } else if (!msdf && pixel_size < lod_bitmap_max * down) {
+                lod = MVGText::lod_bitmap;
+            } else {
+                return lod;
+            }
+            break;
+        default:
+            return lod;
+        }
+    }
+}
+
 void MVGCanvas::set_scale(float scale)
 {
     if (scale != this->scale) {
         float factor = scale / this->scale;
         this->scale = scale;
+        retained = false;
+        index.clear();
         /* update strokes on existing shapes */
         for (auto &shape : ctx->shapes) {
             shape.stroke_width = shape.stroke_width * factor;
         }
+        /* stroke width is hashed so shapes are indexed again on demand */
+        ctx->shape_index.clear();
+        ctx->shapes_indexed = 0;
     }
 }
 
@@ -645,21 +1312,18 @@ float MVGCanvas::get_scale()
     return scale;
 }
 
+void MVGCanvas::set_viewport(vec2 min, vec2 max)
+{
+    viewport_min = min;
+    viewport_max = max;
+}
+
 int MVGCanvas::get_brush_num(MVGBrush p)
 {
     if (p.brush_type == MVGBrushNone) {
         return -1;
     } else {
-        color *c = p.colors;
-        vec2 *P = p.points;
-        vec4 C[4] = {
-            { c[0].r, c[0].g, c[0].b, c[0].a },
-            { c[1].r, c[1].g, c[1].b, c[1].a },
-            { c[2].r, c[2].g, c[2].b, c[2].a },
-            { c[3].r, c[3].g, c[3].b, c[3].a },
-        };
-        ABrush tmpl{(float)(int)p.brush_type,
-            { P[0], P[1], P[2], P[3] }, { C[0], C[1], C[2], C[3] } };
+        ABrush tmpl = make_brush(p);
         return ctx->add_brush(&tmpl);
     }
 }
@@ -698,6 +1362,10 @@ void MVGCanvas::clear()
     glyph_map.clear();
     objects.clear();
     ctx->clear();
+    retained = false;
+    index.clear();
+    dirty_bounds.clear();
+    store.clear();
     fill_brush = MVGBrush{MVGBrushSolid, {vec2(0)}, {color(0,0,0,1)}};
     stroke_brush = MVGBrush{MVGBrushSolid, {vec2(0)}, {color(0,0,0,1)}};
     stroke_width = 0;
@@ -779,175 +1447,523 @@ MVGRect* MVGCanvas::new_rounded_rectangle(vec2 pos, vec2 half_size, float radius
     return o;
 }
 
-void MVGCanvas::emit(draw_list &batch)
+/*
+ * MVGDirty
+ */
+
+void MVGDirty::clear()
 {
-    glyph_map.clear();
-    ctx->clear();
+    full = false;
+    for (size_t i = 0; i < buffer_count; i++) {
+        ranges[i].clear();
+    }
+}
 
-    for (auto &o : objects) {
-        if (!o->visible) continue;
-        switch (o->drawable_type) {
-        case drawable_patch: {
-            auto shape = static_cast<MVGPatch*>(o.get());
-            int fill_brush_num = get_brush_num(shape->fill_brush);
-            int stroke_brush_num = get_brush_num(shape->stroke_brush);
-
-            int shape_num = shape->ll_shape_num = ctx->new_shape(shape->offset, shape->size);
-            ctx->shapes[shape_num].fill_brush = (float)fill_brush_num;
-            ctx->shapes[shape_num].stroke_brush = (float)stroke_brush_num;
-            ctx->shapes[shape_num].stroke_width = shape->stroke_width * scale;
-            ctx->shapes[shape_num].stroke_mode = 0.0f; /* interior */
-            ctx->shapes[shape_num].contour_offset = (float)ctx->contours.size();
-            ctx->shapes[shape_num].contour_count = (float)shape->contours.size();
-            for (size_t i = 0; i < shape->contours.size(); i++) {
-                ctx->contours.push_back(shape->contours[i]);
-                ctx->contours.back().edge_offset += ctx->edges.size();
-            }
-            ctx->shapes[shape_num].edge_offset = (float)ctx->edges.size();
-            ctx->shapes[shape_num].edge_count = (float)shape->edges.size();
-            for (size_t i = 0; i < shape->edges.size(); i++) {
-                ctx->edges.push_back(shape->edges[i]);
+void MVGDirty::add(buffer b, size_t offset, size_t length)
+{
+    if (length == 0) return;
+    std::vector<range> &r = ranges[b];
+    if (r.size() > 0 && r.back().offset + r.back().length == offset) {
+        r.back().length += length;
+    } else {
+        r.push_back(range{offset, length});
+    }
+}
+
+void MVGDirty::coalesce()
+{
+    for (size_t i = 0; i < buffer_count; i++) {
+        std::vector<range> &r = ranges[i];
+        if (r.size() < 2) continue;
+        std::sort(r.begin(), r.end(), [](const range &a, const range &b) {
+            return a.offset < b.offset;
+        });
+        size_t j = 0;
+        for (size_t k = 1; k < r.size(); k++) {
+            if (r[k].offset <= r[j].offset + r[j].length) {
+                size_t end = std::max(r[j].offset + r[j].length,
+                    r[k].offset + r[k].length);
+                r[j].length = end - r[j].offset;
+            } else {
+                r[++j] = r[k];
             }
+        }
+        r.resize(j + 1);
+    }
+}
 
-            AShape &llshape = ctx->shapes[shape->ll_shape_num];
-            vec2 pos = shape->get_position() + llshape.offset;
-            vec2 halfSize = llshape.size / 2.0f;
-            float padding = llshape.stroke_width * 0.5f;
-            MVGBrush fill_brush = get_brush((int)llshape.fill_brush);
-            uint32_t c = 0xffffffff;
-            rect(batch, tbo_iid,
-                pos - halfSize - padding, pos + halfSize + padding,
-                shape->get_z(), -vec2(padding), halfSize * 2.0f + padding, c,
-                (float)o->ll_shape_num, transform);
-            break;
+size_t MVGDirty::bytes()
+{
+    size_t total = 0;
+    for (size_t i = 0; i < buffer_count; i++) {
+        for (auto &r : ranges[i]) {
+            total += r.length;
         }
-        case drawable_path: {
-            auto shape = static_cast<MVGPath*>(o.get());
-            int fill_brush_num = get_brush_num(shape->fill_brush);
-            int stroke_brush_num = get_brush_num(shape->stroke_brush);
-
-            int shape_num = shape->ll_shape_num = ctx->new_shape(shape->offset, shape->size);
-            ctx->shapes[shape_num].fill_brush = (float)fill_brush_num;
-            ctx->shapes[shape_num].stroke_brush = (float)stroke_brush_num;
-            ctx->shapes[shape_num].stroke_width = shape->stroke_width * scale;
-            ctx->shapes[shape_num].stroke_mode = 1.0f; /* no interior */
-            ctx->shapes[shape_num].contour_offset = (float)ctx->contours.size();
-            ctx->shapes[shape_num].contour_count = (float)shape->contours.size();
-            for (size_t i = 0; i < shape->contours.size(); i++) {
-                ctx->contours.push_back(shape->contours[i]);
-                ctx->contours.back().edge_offset += ctx->edges.size();
-            }
-            ctx->shapes[shape_num].edge_offset = (float)ctx->edges.size();
-            ctx->shapes[shape_num].edge_count = (float)shape->edges.size();
-            for (size_t i = 0; i < shape->edges.size(); i++) {
-                ctx->edges.push_back(shape->edges[i]);
-            }
+    }
+    return total;
+}
 
-            AShape &llshape = ctx->shapes[shape->ll_shape_num];
-            vec2 pos = shape->get_position() + llshape.offset;
-            vec2 halfSize = llshape.size / 2.0f;
-            float padding = llshape.stroke_width * 0.5f;
-            MVGBrush fill_brush = get_brush((int)llshape.fill_brush);
-            uint32_t c = 0xffffffff;
-            rect(batch, tbo_iid,
-                pos - halfSize - padding, pos + halfSize + padding,
-                shape->get_z(), -vec2(padding), halfSize * 2.0f + padding, c,
-                (float)o->ll_shape_num, transform);
-            break;
+/*
+ * MVGCanvas emit
+ */
+
+static bool quad_extent(MVGDrawable *o, vec2 &pos, vec2 &half_size)
+{
+    switch (o->drawable_type) {
+    case MVGCanvas::drawable_patch:
+    case MVGCanvas::drawable_path: {
+        auto shape = static_cast<MVGEdges*>(o);
+        pos = shape->get_position() + shape->offset;
+        half_size = shape->size / 2.0f;
+        return true;
+    }
+    case MVGCanvas::drawable_circle:
+        pos = o->get_position();
+        half_size = vec2(static_cast<MVGCircle*>(o)->radius);
+        return true;
+    case MVGCanvas::drawable_ellipse:
+        pos = o->get_position();
+        half_size = static_cast<MVGEllipse*>(o)->half_size;
+        return true;
+    case MVGCanvas::drawable_rectangle:
+        pos = o->get_position();
+        half_size = static_cast<MVGRect*>(o)->half_size;
+        return true;
+    default:
+        return false;
+    }
+}
+
+AEdge* MVGCanvas::make_shape(MVGDrawable *o, AShape &s, AEdge &tmp,
+    vec2 &pos, vec2 &half_size)
+{
+    if (!quad_extent(o, pos, half_size)) return nullptr;
+
+    float fill_brush_num = (float)get_brush_num(o->fill_brush);
+    float stroke_brush_num = (float)get_brush_num(o->stroke_brush);
+    float stroke_width = o->stroke_width * scale;
+
+    switch (o->drawable_type) {
+    case drawable_patch:
+    case drawable_path: {
+        auto shape = static_cast<MVGEdges*>(o);
+        float stroke_mode = o->drawable_type == drawable_path ?
+            1.0f /* no interior */ : 0.0f /* interior */;
+        s = AShape{0, (float)shape->contours.size(), 0,
+            (float)shape->edges.size(), shape->offset, shape->size,
+            fill_brush_num, stroke_brush_num, stroke_width, stroke_mode };
+        return shape->edges.data();
+    }
+    case drawable_circle: {
+        auto shape = static_cast<MVGCircle*>(o);
+        s = AShape{0, 0, 0, 1, vec2(0), vec2(shape->radius * 2.0f),
+            fill_brush_num, stroke_brush_num, stroke_width };
+        tmp = AEdge{MVGPrimitiveCircle,{vec2(shape->radius), vec2(shape->radius)}};
+        return &tmp;
+    }
+    case drawable_ellipse: {
+        auto shape = static_cast<MVGEllipse*>(o);
+        s = AShape{0, 0, 0, 1, vec2(0), shape->half_size * 2.0f,
+            fill_brush_num, stroke_brush_num, stroke_width };
+        tmp = AEdge{MVGPrimitiveEllipse,{shape->half_size, shape->half_size}};
+        return &tmp;
+    }
+    case drawable_rectangle: {
+        auto shape = static_cast<MVGRect*>(o);
+        s = AShape{0, 0, 0, 1, vec2(0), shape->half_size * 2.0f,
+            fill_brush_num, stroke_brush_num, stroke_width };
+        tmp = (shape->radius > 0.0f) ?
+            AEdge{MVGPrimitiveRoundedRectangle,{shape->half_size, shape->half_size, vec2(shape->radius)}} :
+            AEdge{MVGPrimitiveRectangle,{shape->half_size, shape->half_size}};
+        return &tmp;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+void MVGCanvas::emit_text(draw_list &batch, MVGText *shape)
+{
+    text_segment &segment = shape->get_text_segment();
+    std::vector<glyph_shape> &shapes = shape->get_glyph_shapes();
+    vec2 size = shape->get_text_size();
+    vec2 offset = shape->get_text_offset();
+    vec2 pos = shape->get_position();
+    segment.x = pos.x + offset.x;
+    segment.y = pos.y + offset.y;
+    bool atlas = shape->get_stroke_width() == 0 &&
+        shape->get_fill_brush().brush_type == MVGBrushSolid;
+    text_renderer_ft *renderer = nullptr;
+    switch (shape->get_render_mode()) {
+    case MVGText::render_as_text:
+        if (atlas) renderer = &text_renderer_r;
+        break;
+    case MVGText::render_as_lod: {
+        float pixel_size = shape->get_size() *
+            (transform[0][0] + transform[1][1]) / 2.0f;
+        shape->lod = select_lod(shape->lod, pixel_size);
+        if (!atlas) break;
+        if (shape->lod == MVGText::lod_bitmap) renderer = &text_renderer_r;
+        if (shape->lod == MVGText::lod_msdf) renderer = &text_renderer_m;
+        break;
+    }
+    default:
+        break;
+    }
+    if (renderer) {
+        /* todo - use fast text renderer (currently disabled) */
+        segment.baseline_shift = -size.y;
+        segment.color = shape->get_fill_brush().colors[0].rgba32();
+        renderer->render(batch, shapes, segment, transform);
+    } else {
+        /* todo - brushes are stored on each glyph shape */
+        segment.color = shape->get_fill_brush().colors[0].rgba32();
+        text_renderer_c.render(batch, shapes, segment, transform);
+    }
+}
+
+void MVGCanvas::emit_object(draw_list &batch, MVGDrawable *o, bool retain)
+{
+    o->dirty = false;
+    o->ll_vertex_offset = (int)((batch.flags & list_instanced) ?
+        batch.instances.size() : batch.vertices.size());
+    if (!o->visible && !retain) return;
+
+    if (o->drawable_type == drawable_text) {
+        if (o->visible) {
+            emit_text(batch, static_cast<MVGText*>(o));
+        }
+        return;
+    }
+
+    AShape s;
+    AEdge tmp;
+    vec2 pos, half_size;
+    AEdge *e = make_shape(o, s, tmp, pos, half_size);
+    int shape_num = o->ll_shape_num = ctx->add_shape(&s, e, false);
+
+    if (s.contour_count > 0) {
+        auto edges = static_cast<MVGEdges*>(o);
+        AShape &llshape = ctx->shapes[shape_num];
+        llshape.contour_offset = (float)ctx->contours.size();
+        llshape.contour_count = s.contour_count;
+        for (auto &c : edges->contours) {
+            ctx->contours.push_back(AContour{
+                c.edge_offset + llshape.edge_offset, c.edge_count});
+        }
+    }
+
+    /* invisible drawables keep their slot with a degenerate quad */
+    float padding = s.stroke_width * 0.5f;
+    vec2 A = pos - half_size - padding, B = pos + half_size + padding;
+    rect(batch, tbo_iid, A, o->visible ? B : A, o->get_z(),
+        -vec2(padding), half_size * 2.0f + padding, 0xffffffff,
+        (float)shape_num, transform);
+}
+
+void MVGCanvas::emit_store(draw_list &batch, const bvh_box *view)
+{
+    static const int edge_types[MVGStore::store_count] = {
+        MVGPrimitiveCircle, MVGPrimitiveEllipse, MVGPrimitiveRectangle,
+        MVGEdgeLinear, MVGEdgeLinear
+    };
+
+    /* palette brush numbers to context brush numbers */
+    std::vector<float> brush_map(store.palette.brushes.size() + 1);
+    brush_map[0] = -1.0f;
+    for (size_t i = 0; i < store.palette.brushes.size(); i++) {
+        brush_map[i + 1] = (float)ctx->add_brush(&store.palette.brushes[i]);
+    }
+    const float *brush = brush_map.data() + 1;
+
+    for (int t = 0; t < MVGStore::store_count; t++) {
+        MVGStoreArray &a = store.arrays[t];
+        size_t n = a.size();
+        bool edges = t == MVGStore::store_patch || t == MVGStore::store_path;
+        float stroke_mode = t == MVGStore::store_path ? 1.0f : 0.0f;
+
+        ctx->shapes.reserve(ctx->shapes.size() + n);
+        if (batch.flags & list_instanced) {
+            batch.instances.reserve(batch.instances.size() + n);
+        } else {
+            batch.vertices.reserve(batch.vertices.size() + n * 4);
+            batch.indices.reserve(batch.indices.size() + n * 6);
         }
-        case drawable_text: {
-            auto shape = static_cast<MVGText*>(o.get());
-            size_t s = glyph_map.size();
-            text_segment &segment = shape->get_text_segment();
-            std::vector<glyph_shape> &shapes = shape->get_glyph_shapes();
-            vec2 size = shape->get_text_size();
-            vec2 offset = shape->get_text_offset();
-            vec2 pos = shape->get_position();
-            segment.x = pos.x + offset.x;
-            segment.y = pos.y + offset.y;
-            if (shape->get_render_mode() == MVGText::render_as_text &&
-                shape->get_stroke_width() == 0 &&
-                shape->get_fill_brush().brush_type == MVGBrushSolid)
-            {
-                /* todo - use fast text renderer (currently disabled) */
-                segment.baseline_shift = -size.y;
-                segment.color = shape->get_fill_brush().colors[0].rgba32();
-                text_renderer_r.render(batch, shapes, segment, transform);
+
+        for (size_t i = 0; i < n; i++) {
+            if (!a.visible[i]) continue;
+
+            vec2 half_size = a.half_size[i];
+            vec2 pos = edges ? a.pos[i] + a.offset[i] : a.pos[i];
+            float stroke_width = a.stroke_width[i] * scale;
+            float padding = stroke_width * 0.5f;
+            vec2 A = pos - half_size - padding, B = pos + half_size + padding;
+            if (view && !view->intersects(bvh_box{A, B})) continue;
+
+            AShape s{0, 0, 0, 1, edges ? a.offset[i] : vec2(0),
+                half_size * 2.0f, brush[a.fill_brush[i]],
+                brush[a.stroke_brush[i]], stroke_width, stroke_mode };
+            AEdge tmp, *e = &tmp;
+            if (edges) {
+                e = &store.edges[a.edge_offset[i]];
+                s.edge_count = (float)a.edge_count[i];
+            } else if (t == MVGStore::store_rectangle && a.radius[i] > 0.0f) {
+                tmp = AEdge{MVGPrimitiveRoundedRectangle,
+                    {half_size, half_size, vec2(a.radius[i])}};
             } else {
-                /* todo - brushes are stored on each glyph shape */
-                segment.color = shape->get_fill_brush().colors[0].rgba32();
-                text_renderer_c.render(batch, shapes, segment, transform);
+                tmp = AEdge{(float)edge_types[t], {half_size, half_size}};
             }
-            break;
+            int shape_num = ctx->add_shape(&s, e, false);
+
+            rect(batch, tbo_iid, A, B, a.z[i], -vec2(padding),
+                half_size * 2.0f + padding, 0xffffffff, (float)shape_num,
+                transform);
         }
-        case drawable_circle: {
-            auto shape = static_cast<MVGCircle*>(o.get());
-            int fill_brush_num = get_brush_num(shape->fill_brush);
-            int stroke_brush_num = get_brush_num(shape->stroke_brush);
-
-            AShape s{0, 0, 0, 1, vec2(0), vec2(shape->radius * 2.0f),
-                (float)fill_brush_num, (float)stroke_brush_num, shape->stroke_width * scale };
-            AEdge e{MVGPrimitiveCircle,{vec2(shape->radius), vec2(shape->radius)}};
-            shape->ll_shape_num = ctx->add_shape(&s, &e, false);
-
-            AShape &llshape = ctx->shapes[shape->ll_shape_num];
-            vec2 pos = shape->get_position();
-            float radius = shape->get_radius();
-            float padding = llshape.stroke_width * 0.5f;
-            MVGBrush fill_brush = get_brush((int)llshape.fill_brush);
-            uint32_t c = 0xffffffff;
-            rect(batch, tbo_iid,
-                pos - radius - padding, pos + radius + padding,
-                shape->get_z(), -vec2(padding), vec2(radius) * 2.0f + padding, c,
-                (float)o->ll_shape_num, transform);
-            break;
+    }
+
+    store.dirty = false;
+}
+
+void MVGCanvas::emit_objects(draw_list &batch, bool retain)
+{
+    glyph_map.clear();
+    ctx->clear();
+
+    if (!retain && viewport_max.x > viewport_min.x &&
+        viewport_max.y > viewport_min.y)
+    {
+        /* canvas space bounds of the viewport corners */
+        bvh_box view = bvh_box::empty();
+        vec2 corners[4] = {
+            viewport_min, vec2(viewport_max.x, viewport_min.y),
+            viewport_max, vec2(viewport_min.x, viewport_max.y)
+        };
+        for (auto &p : corners) {
+            vec3 v = transform_inv * vec3(p, 1.0f);
+            vec2 q = vec2(v.x / v.z, v.y / v.z);
+            view = view.merge(bvh_box{q, q});
         }
-        case drawable_ellipse: {
-            auto shape = static_cast<MVGEllipse*>(o.get());
-            int fill_brush_num = get_brush_num(shape->fill_brush);
-            int stroke_brush_num = get_brush_num(shape->stroke_brush);
-
-            AShape s{0, 0, 0, 1, vec2(0), shape->half_size * 2.0f,
-                (float)fill_brush_num, (float)stroke_brush_num, shape->stroke_width * scale };
-            AEdge e{MVGPrimitiveEllipse,{shape->half_size, shape->half_size}};
-            shape->ll_shape_num = ctx->add_shape(&s, &e, false);
-
-            AShape &llshape = ctx->shapes[shape->ll_shape_num];
-            vec2 pos = shape->get_position();
-            vec2 halfSize = shape->get_halfsize();
-            float padding = llshape.stroke_width * 0.5f;
-            MVGBrush fill_brush = get_brush((int)llshape.fill_brush);
-            uint32_t c = 0xffffffff;
-            rect(batch, tbo_iid,
-                pos - halfSize - padding, pos + halfSize + padding,
-                shape->get_z(), -vec2(padding), halfSize * 2.0f + padding, c,
-                (float)o->ll_shape_num, transform);
-            break;
+
+        std::vector<int> ids;
+        update_index();
+        index.query(view, ids);
+        std::sort(ids.begin(), ids.end());
+        for (int id : ids) {
+            emit_object(batch, objects[id].get(), retain);
         }
-        case drawable_rectangle: {
-            auto shape = static_cast<MVGRect*>(o.get());
-            int fill_brush_num = get_brush_num(shape->fill_brush);
-            int stroke_brush_num = get_brush_num(shape->stroke_brush);
-
-            AShape s{0, 0, 0, 1, vec2(0), shape->half_size * 2.0f,
-                (float)fill_brush_num, (float)stroke_brush_num, shape->stroke_width * scale };
-            AEdge e = (shape->radius > 0.0f) ?
-                AEdge{MVGPrimitiveRoundedRectangle,{shape->half_size, shape->half_size, vec2(shape->radius)}} :
-                AEdge{MVGPrimitiveRectangle,{shape->half_size, shape->half_size}};
-            shape->ll_shape_num = ctx->add_shape(&s, &e, false);
-
-            AShape &llshape = ctx->shapes[shape->ll_shape_num];
-            vec2 pos = shape->get_position();
-            vec2 halfSize = shape->get_halfsize();
-            float padding = llshape.stroke_width * 0.5f;
-            MVGBrush fill_brush = get_brush((int)llshape.fill_brush);
-            uint32_t c = 0xffffffff;
-            rect(batch, tbo_iid,
-                pos - halfSize - padding, pos + halfSize + padding,
-                shape->get_z(), -vec2(padding), halfSize * 2.0f + padding, c,
-                (float)o->ll_shape_num, transform);
-            break;
+        emit_store(batch, &view);
+    } else {
+        for (auto &o : objects) {
+            emit_object(batch, o.get(), retain);
         }
+        emit_store(batch, nullptr);
+    }
+
+    /* bin edges of complex shapes, including glyphs from text_renderer_c */
+    ctx->bin_shapes();
+}
+
+bvh_box MVGCanvas::get_bounds(MVGDrawable *o)
+{
+    vec2 pos, half_size;
+    if (quad_extent(o, pos, half_size)) {
+        vec2 padding = vec2(o->stroke_width * scale * 0.5f);
+        return bvh_box{pos - half_size - padding, pos + half_size + padding};
+    } else {
+        /* text is padded by its size for ascenders and descenders */
+        auto text = static_cast<MVGText*>(o);
+        vec2 p = text->get_position() + text->get_text_offset();
+        vec2 size = text->get_text_size();
+        return bvh_box{p - size.y, p + size + size.y};
+    }
+}
+
+void MVGCanvas::update_index()
+{
+    if (index.size() != objects.size() || index.refits > index.size()) {
+        std::vector<bvh_box> boxes(objects.size());
+        for (size_t i = 0; i < objects.size(); i++) {
+            /* renumber drawables in case objects were reordered */
+            objects[i]->drawable_num = (int)i;
+            objects[i]->bounds_dirty = false;
+            boxes[i] = get_bounds(objects[i].get());
+        }
+        index.build(boxes.data(), boxes.size());
+    } else {
+        for (int id : dirty_bounds) {
+            MVGDrawable *o = objects[id].get();
+            if (!o->bounds_dirty) continue;
+            index.update(id, get_bounds(o));
+            o->bounds_dirty = false;
         }
     }
+    dirty_bounds.clear();
+}
+
+void MVGCanvas::query(vec2 min, vec2 max, std::vector<MVGDrawable*> &out)
+{
+    std::vector<int> ids;
+    update_index();
+    index.query(bvh_box{min, max}, ids);
+    std::sort(ids.begin(), ids.end());
+    for (int id : ids) {
+        out.push_back(objects[id].get());
+    }
+}
+
+static bool contains(MVGDrawable *o, vec2 p, float padding)
+{
+    switch (o->drawable_type) {
+    case MVGCanvas::drawable_circle: {
+        float r = static_cast<MVGCircle*>(o)->radius + padding;
+        return glm::length(p - o->pos) <= r;
+    }
+    case MVGCanvas::drawable_ellipse: {
+        vec2 r = static_cast<MVGEllipse*>(o)->half_size + padding;
+        vec2 d = (p - o->pos) / r;
+        return glm::dot(d, d) <= 1.0f;
+    }
+    default:
+        return true;
+    }
+}
+
+MVGDrawable* MVGCanvas::pick(vec2 pos)
+{
+    std::vector<int> ids;
+    update_index();
+    index.query(pos, ids);
+    std::sort(ids.begin(), ids.end());
+
+    /* topmost visible drawable, circles and ellipses are tested exactly */
+    for (auto i = ids.rbegin(); i != ids.rend(); i++) {
+        MVGDrawable *o = objects[*i].get();
+        if (o->visible && contains(o, pos, o->stroke_width * scale * 0.5f)) {
+            return o;
+        }
+    }
+    return nullptr;
+}
+
+bool MVGCanvas::update_drawable(draw_list &batch, MVGDrawable *o,
+    MVGDirty &dirty)
+{
+    if (o->drawable_type == drawable_text) return false;
+
+    AShape s;
+    AEdge tmp;
+    vec2 pos, half_size;
+    AEdge *e = make_shape(o, s, tmp, pos, half_size);
+
+    int shape_num = o->ll_shape_num;
+    AShape &shape = ctx->shapes[shape_num];
+    if (s.edge_count != shape.edge_count ||
+        s.contour_count != shape.contour_count) {
+        return false;
+    }
+
+    /* cell grids depend on the edges, offset, size and stroke width */
+    int edge_offset = (int)shape.edge_offset;
+    int edge_count = (int)shape.edge_count;
+    bool rebin = edge_count >= AContext::cell_min_edges &&
+        (s.offset != shape.offset || s.size != shape.size ||
+         s.stroke_width != shape.stroke_width ||
+         memcmp(&ctx->edges[edge_offset], e, edge_count * sizeof(AEdge)) != 0);
+    s.cell_offset = shape.cell_offset;
+    s.cell_count = shape.cell_count;
+    s.cell_origin = shape.cell_origin;
+    s.cell_size = shape.cell_size;
+
+    if (ctx->update_shape(shape_num, &s, e)) {
+        dirty.add(MVGDirty::buffer_shapes, shape_num * sizeof(AShape),
+            sizeof(AShape));
+        dirty.add(MVGDirty::buffer_edges, edge_offset * sizeof(AEdge),
+            edge_count * sizeof(AEdge));
+        if (shape.contour_count > 0) {
+            auto edges = static_cast<MVGEdges*>(o);
+            AContour *c = &ctx->contours[(int)shape.contour_offset];
+            for (auto &oc : edges->contours) {
+                *c++ = AContour{oc.edge_offset + edge_offset, oc.edge_count};
+            }
+        }
+        /* new cells are appended, the old grid is unused until rebuild */
+        if (rebin && !ctx->bin_shape(shape_num)) {
+            shape.cell_offset = 0;
+            shape.cell_count = 0;
+        }
+    }
+
+    float padding = s.stroke_width * 0.5f;
+    vec2 A = pos - half_size - padding, B = pos + half_size + padding;
+    if (batch.flags & list_instanced) {
+        batch.instances[o->ll_vertex_offset] = rect_instance(A,
+            o->visible ? B : A, -vec2(padding), half_size * 2.0f + padding,
+            0xffffffff, (float)shape_num, transform);
+        dirty.add(MVGDirty::buffer_instances,
+            o->ll_vertex_offset * sizeof(draw_instance), sizeof(draw_instance));
+    } else {
+        rect_vertices(&batch.vertices[o->ll_vertex_offset], A,
+            o->visible ? B : A, o->get_z(), -vec2(padding),
+            half_size * 2.0f + padding, 0xffffffff, (float)shape_num, transform);
+        dirty.add(MVGDirty::buffer_vertices,
+            o->ll_vertex_offset * sizeof(draw_vertex), 4 * sizeof(draw_vertex));
+    }
+
+    return true;
+}
+
+void MVGCanvas::emit(draw_list &batch)
+{
+    retained = false;
+    emit_objects(batch, false);
+}
+
+void MVGCanvas::emit(draw_list &batch, MVGDirty &dirty)
+{
+    dirty.clear();
+
+    if (retained && retained_count == objects.size() && !store.dirty) {
+        size_t brushes = ctx->brushes.size();
+        size_t cells = ctx->cells.size();
+        size_t cell_edges = ctx->cell_edges.size();
+        bool rebuild = false;
+
+        for (auto &o : objects) {
+            if (!o->dirty) continue;
+            if (!update_drawable(batch, o.get(), dirty)) {
+                rebuild = true;
+                break;
+            }
+            o->dirty = false;
+        }
+
+        if (!rebuild) {
+            dirty.add(MVGDirty::buffer_brushes, brushes * sizeof(ABrush),
+                (ctx->brushes.size() - brushes) * sizeof(ABrush));
+            dirty.add(MVGDirty::buffer_cells, cells * sizeof(ACell),
+                (ctx->cells.size() - cells) * sizeof(ACell));
+            dirty.add(MVGDirty::buffer_cell_edges, cell_edges * sizeof(float),
+                (ctx->cell_edges.size() - cell_edges) * sizeof(float));
+            dirty.coalesce();
+            return;
+        }
+
+        dirty.clear();
+    }
+
+    draw_list_clear(batch);
+    emit_objects(batch, true);
+    retained = true;
+    retained_count = objects.size();
+
+    dirty.full = true;
+    dirty.add(MVGDirty::buffer_shapes, 0, ctx->shapes.size() * sizeof(AShape));
+    dirty.add(MVGDirty::buffer_edges, 0, ctx->edges.size() * sizeof(AEdge));
+    dirty.add(MVGDirty::buffer_brushes, 0, ctx->brushes.size() * sizeof(ABrush));
+    dirty.add(MVGDirty::buffer_cells, 0, ctx->cells.size() * sizeof(ACell));
+    dirty.add(MVGDirty::buffer_cell_edges, 0, ctx->cell_edges.size() * sizeof(float));
+    dirty.add(MVGDirty::buffer_vertices, 0, batch.vertices.size() * sizeof(draw_vertex));
+    dirty.add(MVGDirty::buffer_indices, 0, batch.indices.size() * sizeof(uint));
+    dirty.add(MVGDirty::buffer_instances, 0,
+        batch.instances.size() * sizeof(draw_instance));
 }
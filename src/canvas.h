@@ -45,12 +45,28 @@ enum MVGBrushType {
  * It has been simplified and adopts a data-oriented programming approach.
  * The context output is arrays formatted suitably to download to a GPU.
  *
- * The following 3 arrays are downloaded to the GPU:
+ * The following 5 arrays are downloaded to the GPU:
  *
  * - shapes
  * - edges
  * - brushes
+ * - cells
+ * - cell_edges
  *
+ * Shapes with many edges are binned into a grid of cells so that the
+ * shader only visits the edges that can be nearest to a fragment. cells
+ * contains the edge list offset and count for each cell and cell_edges
+ * contains the edge numbers. Shapes with cell_count zero are not binned.
+ * bin_shapes only bins the shapes added since it was last called; shapes
+ * changed with update_shape are binned again by the caller with bin_shape.
+ *
+ * Cubic edges are converted by new_edge into the smallest number of
+ * quadratic edges that stay within cubic_tolerance of the cubic.
+ *
+ * find_brush and find_shape use hash indices over the fields compared
+ * by brush_equals and shape_equals. brushes are indexed by new_brush and
+ * update_brush. shapes are indexed lazily by find_shape, except for the
+ * last shape which may still be receiving edges, and by update_shape.
  */
 
 struct AEdge {
@@ -58,6 +74,8 @@ struct AEdge {
     vec2 p[4];
 
     static int num_points(int edge_type);
+    static void cubic_to_quadratics(const AEdge &e, float tolerance,
+        std::vector<AEdge> &out);
 };
 
 struct AContour {
@@ -76,6 +94,15 @@ struct AShape {
     float stroke_brush;
     float stroke_width;
     float stroke_mode;
+    float cell_offset;
+    float cell_count;
+    vec2 cell_origin;
+    vec2 cell_size;
+};
+
+struct ACell {
+    float edge_offset;
+    float edge_count;
 };
 
 struct ABrush {
@@ -88,11 +115,28 @@ struct ABrush {
 };
 
 struct AContext {
+    static const int cell_grid = 8;
+    static const int cell_min_edges = 8;
+    static constexpr float default_cubic_tolerance = 0.1f;
+
     std::vector<AShape> shapes;
     std::vector<AContour> contours;
     std::vector<AEdge> edges;
     std::vector<ABrush> brushes;
+    std::vector<ACell> cells;
+    std::vector<float> cell_edges;
+    std::unordered_multimap<size_t,int> brush_index;
+    std::unordered_multimap<size_t,int> shape_index;
+    size_t shapes_indexed;
+    size_t shapes_binned;
     vec2 pos;
+    float cubic_tolerance;
+
+    /* bin_shape scratch, reused between shapes */
+    std::vector<vec2> bin_bounds;
+    std::vector<float> bin_lower;
+
+    AContext();
 
     void clear();
 
@@ -103,17 +147,24 @@ struct AContext {
 
     static bool brush_equals(ABrush *b0, ABrush *b1);
     static bool shape_equals(AShape *s0, AEdge *e0, AShape *s1, AEdge *e1);
+    static size_t brush_hash(ABrush *b);
+    static size_t shape_hash(AShape *s, AEdge *e);
 
     int find_brush(ABrush *b);
     int add_brush(ABrush *b, bool dedup = true);
     bool update_brush(int brush_num, ABrush *b);
 
+    void index_shapes();
     int find_shape(AShape *s, AEdge *e);
     int copy_shape(AShape *shape, AEdge *edges);
     int add_shape(AShape *s, AEdge *e, bool dedup = true);
     bool update_shape(int shape_num, AShape *s, AEdge *e);
 
     int add_glyph(FT_Face ftface, int sz, int dpi, int glyph);
+
+    void bin_shapes();
+    bool bin_shape(int shape_num);
+    int find_cell(const AShape &shape, vec2 origin);
 };
 
 
@@ -170,6 +221,14 @@ struct MVGBrush
 
 /*
  * Drawable is the base class for all canvas objects
+ *
+ * setters mark drawables dirty so a retained emit only rewrites the
+ * shapes, edges and vertices of changed objects. code that writes the
+ * fields directly must also set dirty. ll_vertex_offset is the index of
+ * the first of the four quad vertices in the retained draw list, or of
+ * the instance in instanced draw lists.
+ * setters that change the bounds also queue the drawable so the canvas
+ * spatial index is refitted before the next query.
  */
 
 struct MVGDrawable
@@ -186,6 +245,9 @@ struct MVGDrawable
     MVGBrush fill_brush;
     MVGBrush stroke_brush;
     float stroke_width;
+    bool dirty;
+    bool bounds_dirty;
+    int ll_vertex_offset;
 
     bool is_visible();
     vec2 get_position();
@@ -200,6 +262,8 @@ struct MVGDrawable
     void set_fill_brush(MVGBrush brush);
     void set_stroke_brush(MVGBrush brush);
     void set_stroke_width(float width);
+
+    void invalidate(bool bounds);
 };
 
 struct MVGEdges : MVGDrawable
@@ -230,6 +294,7 @@ struct MVGPatch : MVGEdges
     MVGPatch* new_contour();
     MVGPatch* new_line(vec2 p1, vec2 p2);
     MVGPatch* new_quadratic_curve(vec2 p1, vec2 c1, vec2 p2);
+    MVGPatch* new_cubic_curve(vec2 p1, vec2 c1, vec2 c2, vec2 p2);
 };
 
 /*
@@ -241,6 +306,7 @@ struct MVGPath : MVGEdges
     MVGPath* new_contour();
     MVGPath* new_line(vec2 p1, vec2 p2);
     MVGPath* new_quadratic_curve(vec2 p1, vec2 c1, vec2 p2);
+    MVGPath* new_cubic_curve(vec2 p1, vec2 c1, vec2 c2, vec2 p2);
 };
 
 /*
@@ -295,7 +361,16 @@ struct MVGText : MVGDrawable
 {
     enum render_as {
         render_as_text,
-        render_as_contour
+        render_as_contour,
+        render_as_lod
+    };
+
+    /* level of detail selected by render_as_lod from on-screen size */
+    enum text_lod {
+        lod_none,
+        lod_bitmap,
+        lod_msdf,
+        lod_outline
     };
 
     float size;
@@ -305,6 +380,7 @@ struct MVGText : MVGDrawable
     std::string text;
     std::string lang;
     render_as mode;
+    text_lod lod;
 
     text_segment segment;
     std::vector<glyph_shape> shapes;
@@ -317,6 +393,7 @@ struct MVGText : MVGDrawable
     std::string get_text();
     std::string get_lang();
     render_as get_render_mode();
+    text_lod get_lod();
 
     void set_text_style(MVGTextStyle style);
     void set_size(float size);
@@ -377,6 +454,130 @@ struct MVGRect : MVGPrimitive
     void set_radius(float v);
 };
 
+/*
+ * Store is dense storage for large numbers of canvas primitives
+ *
+ * elements are kept in a structure of arrays per type, and emit visits
+ * each type contiguously without per-object allocations or dispatch.
+ * handles stay valid until removed: they index a slot table mapping to
+ * the dense index, and removal moves the last element into the hole.
+ * brushes are numbers into a deduplicated palette. patch and path edges
+ * are ranges in one edge arena that is compacted when half is unused.
+ * elements are emitted after the canvas objects in type order.
+ */
+
+typedef uint32_t MVGHandle;
+
+struct MVGStoreArray
+{
+    std::vector<vec2> pos;
+    std::vector<vec2> half_size;
+    std::vector<float> z;
+    std::vector<float> stroke_width;
+    std::vector<int> fill_brush;
+    std::vector<int> stroke_brush;
+    std::vector<uint8_t> visible;
+    std::vector<MVGHandle> handle;
+    std::vector<float> radius;       /* rectangles only */
+    std::vector<vec2> offset;        /* patches and paths only */
+    std::vector<int> edge_offset;    /* patches and paths only */
+    std::vector<int> edge_count;     /* patches and paths only */
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> free_slots;
+
+    size_t size() const { return pos.size(); }
+};
+
+struct MVGStore
+{
+    enum store_type {
+        store_circle,
+        store_ellipse,
+        store_rectangle,
+        store_patch,
+        store_path,
+        store_count
+    };
+
+    static const int handle_bits = 24;
+
+    MVGCanvas *canvas;
+    MVGStoreArray arrays[store_count];
+    AContext palette;
+    std::vector<AEdge> edges;
+    size_t edges_unused;
+    bool dirty;
+
+    MVGStore(MVGCanvas *canvas);
+
+    size_t size();
+    void clear();
+
+    /* new elements use the canvas fill brush, stroke brush and width */
+    MVGHandle new_circle(vec2 pos, float radius);
+    MVGHandle new_ellipse(vec2 pos, vec2 half_size);
+    MVGHandle new_rectangle(vec2 pos, vec2 half_size);
+    MVGHandle new_rounded_rectangle(vec2 pos, vec2 half_size, float radius);
+    MVGHandle new_patch(vec2 offset, vec2 size, const AEdge *e, size_t count);
+    MVGHandle new_path(vec2 offset, vec2 size, const AEdge *e, size_t count);
+    void remove(MVGHandle h);
+
+    vec2 get_position(MVGHandle h);
+    bool is_visible(MVGHandle h);
+    void set_position(MVGHandle h, vec2 pos);
+    void set_z(MVGHandle h, float z);
+    void set_visible(MVGHandle h, bool visible);
+    void set_fill_brush(MVGHandle h, MVGBrush brush);
+    void set_stroke_brush(MVGHandle h, MVGBrush brush);
+    void set_stroke_width(MVGHandle h, float width);
+    void set_edges(MVGHandle h, const AEdge *e, size_t count);
+
+    /* internal interfaces */
+    MVGHandle new_element(store_type type, vec2 pos, vec2 half_size);
+    MVGStoreArray& array(MVGHandle h);
+    size_t index(MVGHandle h);
+    int brush_num(MVGBrush brush);
+    int add_edges(const AEdge *e, size_t count);
+    void compact_edges();
+};
+
+/*
+ * Dirty byte ranges per buffer reported by a retained emit
+ *
+ * full is set when the canvas was rebuilt and every buffer must be
+ * uploaded. otherwise ranges hold sorted, non-overlapping byte ranges
+ * of AContext arrays and draw list vertices or instances that changed
+ * since the previous emit. indices only change on a full rebuild.
+ */
+
+struct MVGDirty
+{
+    enum buffer {
+        buffer_shapes,
+        buffer_edges,
+        buffer_brushes,
+        buffer_cells,
+        buffer_cell_edges,
+        buffer_vertices,
+        buffer_indices,
+        buffer_instances,
+        buffer_count
+    };
+
+    struct range {
+        size_t offset;
+        size_t length;
+    };
+
+    bool full;
+    std::vector<range> ranges[buffer_count];
+
+    void clear();
+    void add(buffer b, size_t offset, size_t length);
+    void coalesce();
+    size_t bytes();
+};
+
 /*
  * MVGCanvas API proper
  */
@@ -389,6 +590,7 @@ struct MVGCanvas
     text_shaper_hb text_shaper;
     text_renderer_canvas text_renderer_c;
     text_renderer_ft text_renderer_r;
+    text_renderer_ft text_renderer_m;
     font_manager *manager;
     MVGBrush fill_brush;
     MVGBrush stroke_brush;
@@ -397,6 +599,16 @@ struct MVGCanvas
     mat3 transform_inv;
     float scale;
     MVGText::render_as text_mode;
+    float lod_bitmap_max;
+    float lod_msdf_max;
+    float lod_hysteresis;
+    bool retained;
+    size_t retained_count;
+    bvh_tree index;
+    std::vector<int> dirty_bounds;
+    vec2 viewport_min;
+    vec2 viewport_max;
+    MVGStore store;
 
     MVGCanvas(font_manager* manager);
 
@@ -407,6 +619,20 @@ struct MVGCanvas
     void set_render_mode(MVGText::render_as mode);
     MVGText::render_as get_render_mode();
 
+    /*
+     * text level of detail for render_as_lod. text up to bitmap_max
+     * pixels high uses bitmap glyphs, up to msdf_max uses the msdf
+     * manager if set, and larger text is drawn as outlines. a level
+     * only changes once the size passes its bound by the hysteresis
+     * fraction so zooming near a bound does not flip between levels.
+     */
+    void set_msdf_manager(font_manager* manager);
+    void set_text_lod(float bitmap_max, float msdf_max, float hysteresis);
+    MVGText::text_lod select_lod(MVGText::text_lod lod, float pixel_size);
+
+    /* viewport in transformed coordinates to cull emit, empty disables */
+    void set_viewport(vec2 min, vec2 max);
+
     /* high dpi screen scale to apply to strokes */
     void set_scale(float scale);
     float get_scale();
@@ -430,6 +656,12 @@ struct MVGCanvas
     MVGDrawable* get_drawable(size_t offset);
     void clear();
 
+    /* spatial queries in canvas coordinates, results are in draw order */
+    bvh_box get_bounds(MVGDrawable *o);
+    void update_index();
+    void query(vec2 min, vec2 max, std::vector<MVGDrawable*> &out);
+    MVGDrawable* pick(vec2 pos);
+
     /* brushes are associated with new canvas objects on creation */
     MVGBrush get_fill_brush();
     void set_fill_brush(MVGBrush brush);
@@ -448,6 +680,28 @@ struct MVGCanvas
     MVGRect* new_rectangle(vec2 pos, vec2 half_size);
     MVGRect* new_rounded_rectangle(vec2 pos, vec2 half_size, float radius);
 
-    /* emit canvas to draw list */
+    /* emit canvas to draw list, skipping drawables outside the viewport */
     void emit(draw_list &batch);
+
+    /*
+     * retained emit to a draw list owned by the canvas between calls.
+     * the first call, and any call after objects are added or removed,
+     * the transform, scale or render mode changes, or a dirty drawable
+     * changes its edge count or is text, rebuilds batch completely.
+     * other calls rewrite dirty drawables in place. invisible drawables
+     * keep their slots with degenerate quads. brushes are appended so
+     * replaced brushes remain until the next rebuild. retained emit does
+     * not cull as every drawable keeps its slot. changes to the store
+     * also rebuild.
+     */
+    void emit(draw_list &batch, MVGDirty &dirty);
+
+    /* internal interfaces used by emit */
+    AEdge* make_shape(MVGDrawable *o, AShape &s, AEdge &tmp, vec2 &pos,
+        vec2 &half_size);
+    void emit_objects(draw_list &batch, bool retain);
+    void emit_object(draw_list &batch, MVGDrawable *o, bool retain);
+    void emit_store(draw_list &batch, const bvh_box *view);
+    void emit_text(draw_list &batch, MVGText *text);
+    bool update_drawable(draw_list &batch, MVGDrawable *o, MVGDirty &dirty);
 };
\ No newline at end of file
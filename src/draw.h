@@ -11,6 +11,21 @@ typedef struct {
     float shape;
 } draw_vertex;
 
+/*
+ * instances are axis aligned quads with corners x1,y1 and x2,y2 and
+ * uv coordinates interpolated between u1,v1 and u2,v2. draw lists with
+ * list_instanced set emit one instance per glyph or shape in place of
+ * four vertices and six indices, in mode_instances commands where the
+ * offset and count refer to the instances array. instances have z=0.
+ */
+
+typedef struct {
+    float rect[4];
+    float uv[4];
+    uint color;
+    float shape;
+} draw_instance;
+
 enum { tbo_iid = -1 };
 
 enum {
@@ -20,12 +35,20 @@ enum {
     filter_linear  = (1 << 4),
 };
 
+/*
+ * images carry the bounding rectangle of their modified pixels in modrect
+ * and optionally a list of disjoint dirty rectangles within it, so that
+ * consumers can update several small regions in place of their bounds.
+ * an empty dirty list means the whole modrect is to be updated.
+ */
+
 typedef struct {
     int iid;
     int size[3];
     int modrect[4];
     int flags;
     uint8_t *pixels;
+    std::vector<bin_rect> dirty;
 } draw_image;
 
 enum {
@@ -35,6 +58,7 @@ enum {
 enum {
     mode_triangles = 1,
     mode_lines     = 2,
+    mode_instances = 3,
 };
 
 enum {
@@ -52,11 +76,17 @@ typedef struct {
     uint count;
 } draw_cmd;
 
+enum {
+    list_instanced = (1 << 0),
+};
+
 typedef struct {
     std::vector<draw_image> images;
     std::vector<draw_cmd> cmds;
     std::vector<draw_vertex> vertices;
     std::vector<uint> indices;
+    std::vector<draw_instance> instances;
+    uint flags = 0;
 } draw_list;
 
 inline void draw_list_clear(draw_list &batch)
@@ -65,6 +95,7 @@ inline void draw_list_clear(draw_list &batch)
     batch.cmds.clear();
     batch.vertices.clear();
     batch.indices.clear();
+    batch.instances.clear();
 }
 
 inline void draw_list_viewport(draw_list &batch, uint x, uint y, uint w, uint h)
@@ -90,46 +121,233 @@ inline void draw_list_viewport(draw_list &batch, uint x, uint y, uint w, uint h)
 
 inline uint draw_list_vertex(draw_list &batch, draw_vertex v)
 {
-    auto i = batch.vertices.insert(batch.vertices.end(), v);
-    return (uint)(i - batch.vertices.begin());
+    batch.vertices.push_back(v);
+    return (uint)batch.vertices.size() - 1;
 }
 
-inline void draw_list_indices(draw_list &batch, uint iid, uint mode, uint shader,
-    std::initializer_list<uint> l)
+/* extend the last command or start a new one for count new elements */
+inline void draw_list_command(draw_list &batch, uint iid, uint mode,
+    uint shader, uint start, uint count)
 {
     bool empty = batch.cmds.size() == 0;
-    draw_cmd &last = batch.cmds.back();
-
-    uint start, end;
-
-    start = (uint)batch.indices.size();
-    batch.indices.insert(batch.indices.end(), l.begin(), l.end());
-    end = (uint)batch.indices.size();
 
     if (empty ||
-        last.iid != iid ||
-        last.mode != mode ||
-        last.shader != shader)
+        batch.cmds.back().iid != iid ||
+        batch.cmds.back().mode != mode ||
+        batch.cmds.back().shader != shader)
     {
         uint vp[4];
         if (empty) {
             memset(vp, 0, sizeof(vp));
         } else {
-            memcpy(vp, last.viewport, sizeof(vp));
+            memcpy(vp, batch.cmds.back().viewport, sizeof(vp));
         }
-        batch.cmds.push_back({{ vp[0], vp[1], vp[2], vp[3] }, iid, mode, shader, start, end - start });
+        batch.cmds.push_back({{ vp[0], vp[1], vp[2], vp[3] }, iid, mode, shader, start, count });
     } else {
-        last.count += (end - start);
+        batch.cmds.back().count += count;
     }
 }
 
-inline void draw_list_image_delta(draw_list &batch, image *img, bin_rect delta, int flags)
+inline void draw_list_indices(draw_list &batch, uint iid, uint mode, uint shader,
+    std::initializer_list<uint> l)
 {
-    int w = img->getWidth(), h = img->getHeight(), d = img->getBytesPerPixel();
+    uint start = (uint)batch.indices.size();
+    batch.indices.insert(batch.indices.end(), l.begin(), l.end());
+    draw_list_command(batch, iid, mode, shader, start, (uint)l.size());
+}
 
-    draw_image drim{img->iid, {w,h,d}, { delta.a.x, delta.a.y,
-        (delta.b.x - delta.a.x), (delta.b.y - delta.a.y)
-    }, flags, img->getData()};
+inline void draw_list_instance(draw_list &batch, uint iid, uint shader,
+    draw_instance inst)
+{
+    uint start = (uint)batch.instances.size();
+    batch.instances.push_back(inst);
+    draw_list_command(batch, iid, mode_instances, shader, start, 1);
+}
+
+/* emit a quad as an instance or as two triangles depending on flags */
+inline void draw_list_rect(draw_list &batch, uint iid, uint shader, float z,
+    draw_instance r)
+{
+    if (batch.flags & list_instanced) {
+        draw_list_instance(batch, iid, shader, r);
+        return;
+    }
+
+    uint o0 = draw_list_vertex(batch, {{r.rect[0], r.rect[1], z},
+        {r.uv[0], r.uv[1]}, r.color, r.shape});
+    uint o1 = draw_list_vertex(batch, {{r.rect[2], r.rect[1], z},
+        {r.uv[2], r.uv[1]}, r.color, r.shape});
+    uint o2 = draw_list_vertex(batch, {{r.rect[2], r.rect[3], z},
+        {r.uv[2], r.uv[3]}, r.color, r.shape});
+    uint o3 = draw_list_vertex(batch, {{r.rect[0], r.rect[3], z},
+        {r.uv[0], r.uv[3]}, r.color, r.shape});
+    draw_list_indices(batch, iid, mode_triangles, shader,
+        {o0, o3, o1, o1, o3, o2});
+}
+
+/*
+ * emit a span of quads sharing an image and shader, e.g. a run of
+ * glyphs from one atlas. arrays grow once for the whole span and the
+ * span joins the last command when it has the same image and shader.
+ */
+inline void draw_list_rects(draw_list &batch, uint iid, uint shader, float z,
+    const draw_instance *r, size_t count)
+{
+    if (count == 0) return;
+
+    if (batch.flags & list_instanced) {
+        uint start = (uint)batch.instances.size();
+        batch.instances.insert(batch.instances.end(), r, r + count);
+        draw_list_command(batch, iid, mode_instances, shader, start,
+            (uint)count);
+        return;
+    }
+
+    size_t vo = batch.vertices.size(), io = batch.indices.size();
+    batch.vertices.resize(vo + count * 4);
+    batch.indices.resize(io + count * 6);
+    draw_vertex *v = batch.vertices.data() + vo;
+    uint *idx = batch.indices.data() + io;
+    for (size_t i = 0; i < count; i++, r++, v += 4, idx += 6) {
+        uint o = (uint)(vo + i * 4);
+        v[0] = {{r->rect[0], r->rect[1], z}, {r->uv[0], r->uv[1]}, r->color, r->shape};
+        v[1] = {{r->rect[2], r->rect[1], z}, {r->uv[2], r->uv[1]}, r->color, r->shape};
+        v[2] = {{r->rect[2], r->rect[3], z}, {r->uv[2], r->uv[3]}, r->color, r->shape};
+        v[3] = {{r->rect[0], r->rect[3], z}, {r->uv[0], r->uv[3]}, r->color, r->shape};
+        idx[0] = o; idx[1] = o + 3; idx[2] = o + 1;
+        idx[3] = o + 1; idx[4] = o + 3; idx[5] = o + 2;
+    }
+    draw_list_command(batch, iid, mode_triangles, shader, (uint)io,
+        (uint)count * 6);
+}
+
+/* reserve capacity so that emitting up to these sizes does not allocate */
+inline void draw_list_reserve(draw_list &batch, size_t cmds, size_t vertices,
+    size_t indices, size_t instances)
+{
+    batch.cmds.reserve(cmds);
+    batch.vertices.reserve(vertices);
+    batch.indices.reserve(indices);
+    batch.instances.reserve(instances);
+}
+
+/*
+ * draw_list_arena
+ *
+ * frame arena of draw lists. lists handed out by acquire are owned by
+ * the arena and remain valid until the next reset, which starts a new
+ * frame. lists are recycled across frames keeping their capacity, and
+ * lists acquired beyond those of the previous frame are reserved to the
+ * previous frame's high-water mark, so a steady state frame performs
+ * no allocation.
+ */
+
+struct draw_list_arena
+{
+    std::vector<std::unique_ptr<draw_list>> lists;
+    size_t used = 0;
+    size_t high_water[4] = { 0, 0, 0, 0 };
+
+    draw_list* acquire(uint flags = 0)
+    {
+        if (used == lists.size()) {
+            lists.push_back(std::make_unique<draw_list>());
+            draw_list_reserve(*lists.back(), high_water[0], high_water[1],
+                high_water[2], high_water[3]);
+        }
+        draw_list *batch = lists[used++].get();
+        draw_list_clear(*batch);
+        batch->flags = flags;
+        return batch;
+    }
+
+    void reset()
+    {
+        size_t hw[4] = { 0, 0, 0, 0 };
+        for (size_t i = 0; i < used; i++) {
+            draw_list &batch = *lists[i];
+            hw[0] = std::max(hw[0], batch.cmds.size());
+            hw[1] = std::max(hw[1], batch.vertices.size());
+            hw[2] = std::max(hw[2], batch.indices.size());
+            hw[3] = std::max(hw[3], batch.instances.size());
+        }
+        std::copy(hw, hw + 4, high_water);
+        used = 0;
+    }
+};
+
+/*
+ * add r to a list of disjoint dirty rectangles. rectangles that r
+ * intersects are merged with it, as are rectangles whose bounds with r
+ * are at most a third larger than the two areas, e.g. adjacent glyphs
+ * in an atlas row. when the list is full, r is merged with the rectangle
+ * whose bounds grow least. merged bounds are added again until no more
+ * rectangles merge.
+ */
+inline void draw_rect_union(std::vector<bin_rect> &rects, bin_rect r,
+    size_t max_rects = 16)
+{
+    if (r.width() <= 0 || r.height() <= 0) return;
+
+    for (;;) {
+        size_t n = rects.size(), best = n;
+        for (size_t i = 0; i < n && best == n; i++) {
+            bin_rect u(bin_point(std::min(rects[i].a.x, r.a.x),
+                                 std::min(rects[i].a.y, r.a.y)),
+                       bin_point(std::max(rects[i].b.x, r.b.x),
+                                 std::max(rects[i].b.y, r.b.y)));
+            if (rects[i].intersects(r) ||
+                u.area() * 3 <= (rects[i].area() + r.area()) * 4) {
+                best = i;
+            }
+        }
+        if (best == n && n >= max_rects) {
+            int growth = -1;
+            for (size_t i = 0; i < n; i++) {
+                int g = (std::max(rects[i].b.x, r.b.x) -
+                         std::min(rects[i].a.x, r.a.x)) *
+                        (std::max(rects[i].b.y, r.b.y) -
+                         std::min(rects[i].a.y, r.a.y)) - rects[i].area();
+                if (growth < 0 || g < growth) {
+                    growth = g;
+                    best = i;
+                }
+            }
+        }
+        if (best == n) break;
+        r = bin_rect(bin_point(std::min(rects[best].a.x, r.a.x),
+                               std::min(rects[best].a.y, r.a.y)),
+                     bin_point(std::max(rects[best].b.x, r.b.x),
+                               std::max(rects[best].b.y, r.b.y)));
+        rects.erase(rects.begin() + best);
+    }
+    rects.push_back(r);
+}
+
+/* dirty rectangles of an image, its modrect when the list is empty */
+inline std::vector<bin_rect> draw_image_rects(const draw_image &img)
+{
+    if (img.dirty.size() > 0) return img.dirty;
+    std::vector<bin_rect> rects;
+    if (img.modrect[2] > 0 && img.modrect[3] > 0) {
+        rects.push_back(bin_rect(bin_point(img.modrect[0], img.modrect[1]),
+            bin_point(img.modrect[0] + img.modrect[2],
+                      img.modrect[1] + img.modrect[3])));
+    }
+    return rects;
+}
+
+/*
+ * add an image update to the sorted image list, widening the modified
+ * rectangle of an existing entry with the same iid and merging their
+ * dirty rectangles. an empty rectangle has its origin at the image size
+ * and leaves the entry unchanged.
+ */
+inline void draw_list_image_union(draw_list &batch, const draw_image &drim)
+{
+    int w = drim.size[0], h = drim.size[1];
+    int x1 = drim.modrect[0], y1 = drim.modrect[1];
+    int x2 = x1 + drim.modrect[2], y2 = y1 + drim.modrect[3];
 
     auto i = std::lower_bound(batch.images.begin(), batch.images.end(), drim,
         [](const draw_image &l, const draw_image &r) { return l.iid < r.iid; });
@@ -137,34 +355,369 @@ inline void draw_list_image_delta(draw_list &batch, image *img, bin_rect delta,
     if (i == batch.images.end() || i->iid != drim.iid) {
         i = batch.images.insert(i, drim);
     } else {
-        if (delta.a.x == w && delta.a.y == h) {
+        if (x1 == w && y1 == h) {
             // do nothing
         }
         else if (i->modrect[0] == 0 && i->modrect[1] == 0 &&
             i->modrect[2] == w && i->modrect[3] == h) {
             // set delta
-            i->modrect[0] = delta.a.x;
-            i->modrect[1] = delta.a.y;
-            i->modrect[2] = (delta.b.x - delta.a.x);
-            i->modrect[3] = (delta.b.y - delta.a.y);
+            i->modrect[0] = x1;
+            i->modrect[1] = y1;
+            i->modrect[2] = (x2 - x1);
+            i->modrect[3] = (y2 - y1);
+            i->dirty = drim.dirty;
         }
         else {
             // widen delta
-            int x1 = std::min(i->modrect[0],delta.a.x);
-            int y1 = std::min(i->modrect[1],delta.a.y);
-            int x2 = std::max(i->modrect[0]+i->modrect[2],delta.b.x);
-            int y2 = std::max(i->modrect[1]+i->modrect[3],delta.b.y);
-            i->modrect[0] = x1;
-            i->modrect[1] = y1;
-            i->modrect[2] = x2-x1;
-            i->modrect[3] = y2-y1;
+            if (i->dirty.size() > 0 || drim.dirty.size() > 0) {
+                std::vector<bin_rect> rects = draw_image_rects(*i);
+                for (auto &r : draw_image_rects(drim)) {
+                    draw_rect_union(rects, r);
+                }
+                i->dirty = rects;
+            }
+            int u1 = std::min(i->modrect[0],x1);
+            int v1 = std::min(i->modrect[1],y1);
+            int u2 = std::max(i->modrect[0]+i->modrect[2],x2);
+            int v2 = std::max(i->modrect[1]+i->modrect[3],y2);
+            i->modrect[0] = u1;
+            i->modrect[1] = v1;
+            i->modrect[2] = u2-u1;
+            i->modrect[3] = v2-v1;
         }
     }
 }
 
+inline void draw_list_image_delta(draw_list &batch, image *img, bin_rect delta, int flags)
+{
+    int w = img->getWidth(), h = img->getHeight(), d = img->getBytesPerPixel();
+
+    draw_image drim{img->iid, {w,h,d}, { delta.a.x, delta.a.y,
+        (delta.b.x - delta.a.x), (delta.b.y - delta.a.y)
+    }, flags, img->getData(), {}};
+
+    draw_list_image_union(batch, drim);
+}
+
+/* image update with dirty rectangles within the bounding delta */
+inline void draw_list_image_dirty(draw_list &batch, image *img, bin_rect delta,
+    const std::vector<bin_rect> &dirty, int flags)
+{
+    int w = img->getWidth(), h = img->getHeight(), d = img->getBytesPerPixel();
+
+    draw_image drim{img->iid, {w,h,d}, { delta.a.x, delta.a.y,
+        (delta.b.x - delta.a.x), (delta.b.y - delta.a.y)
+    }, flags, img->getData(), dirty};
+
+    draw_list_image_union(batch, drim);
+}
+
 inline void draw_list_image(draw_list &batch, image *img, int flags)
 {
     bin_rect delta(bin_point((int)img->getWidth(),(int)img->getHeight()),bin_point(0,0));
 
     return draw_list_image_delta(batch, img, delta, flags);
 }
+
+/*
+ * append src to dst, as if the elements of src had been emitted to dst.
+ * vertex indices and command offsets are rebased to the end of the dst
+ * arrays, the first command of src joins the last command of dst when
+ * they have the same viewport, image, mode and shader, and image updates
+ * are unioned by iid. merging sub-lists in a fixed order gives the same
+ * list however the sub-lists were scheduled.
+ *
+ * the merge is split so that the element copies of many sub-lists can
+ * run concurrently: draw_list_merge_commands appends the commands and
+ * images of src in order, given the bases of its elements in dst, and
+ * draw_list_merge_elements copies the elements of src to those bases
+ * in arrays that have already been sized to hold them.
+ */
+
+inline void draw_list_merge_commands(draw_list &dst, const draw_list &src,
+    uint ibase, uint nbase)
+{
+    for (auto cmd : src.cmds) {
+        cmd.offset += cmd.mode == mode_instances ? nbase : ibase;
+        if (dst.cmds.size() > 0) {
+            draw_cmd &last = dst.cmds.back();
+            if (last.iid == cmd.iid && last.mode == cmd.mode &&
+                last.shader == cmd.shader &&
+                last.offset + last.count == cmd.offset &&
+                memcmp(last.viewport, cmd.viewport, sizeof(cmd.viewport)) == 0)
+            {
+                last.count += cmd.count;
+                continue;
+            }
+        }
+        dst.cmds.push_back(cmd);
+    }
+
+    for (auto &drim : src.images) {
+        draw_list_image_union(dst, drim);
+    }
+}
+
+inline void draw_list_merge_elements(draw_list &dst, const draw_list &src,
+    uint vbase, uint ibase, uint nbase)
+{
+    std::copy(src.vertices.begin(), src.vertices.end(),
+        dst.vertices.begin() + vbase);
+    uint *idx = dst.indices.data() + ibase;
+    for (size_t i = 0; i < src.indices.size(); i++) {
+        idx[i] = src.indices[i] + vbase;
+    }
+    std::copy(src.instances.begin(), src.instances.end(),
+        dst.instances.begin() + nbase);
+}
+
+inline void draw_list_merge(draw_list &dst, const draw_list &src)
+{
+    uint vbase = (uint)dst.vertices.size();
+    uint ibase = (uint)dst.indices.size();
+    uint nbase = (uint)dst.instances.size();
+
+    dst.vertices.resize(vbase + src.vertices.size());
+    dst.indices.resize(ibase + src.indices.size());
+    dst.instances.resize(nbase + src.instances.size());
+    draw_list_merge_elements(dst, src, vbase, ibase, nbase);
+    draw_list_merge_commands(dst, src, ibase, nbase);
+}
+
+/* bounding rectangle x1,y1,x2,y2 of the elements drawn by a command */
+inline void draw_list_bounds(const draw_list &batch, const draw_cmd &cmd,
+    float b[4])
+{
+    b[0] = b[1] = 1e30f;
+    b[2] = b[3] = -1e30f;
+    for (uint i = cmd.offset; i < cmd.offset + cmd.count; i++) {
+        if (cmd.mode == mode_instances) {
+            const float *r = batch.instances[i].rect;
+            b[0] = std::min(b[0], std::min(r[0], r[2]));
+            b[1] = std::min(b[1], std::min(r[1], r[3]));
+            b[2] = std::max(b[2], std::max(r[0], r[2]));
+            b[3] = std::max(b[3], std::max(r[1], r[3]));
+        } else {
+            const float *p = batch.vertices[batch.indices[i]].pos;
+            b[0] = std::min(b[0], p[0]);
+            b[1] = std::min(b[1], p[1]);
+            b[2] = std::max(b[2], p[0]);
+            b[3] = std::max(b[3], p[1]);
+        }
+    }
+}
+
+/*
+ * reorder commands so that commands with the same viewport, shader,
+ * image and mode are joined, reducing shader and texture switches.
+ *
+ * a command moves back to join the nearest earlier command with the
+ * same key when its bounds do not overlap the bounds of any command
+ * drawn in between, so blended output is unchanged. commands do not
+ * move across viewport changes and look back at most window commands.
+ * indices and instances are rewritten in the new command order and
+ * vertices are unchanged. batching renumbers the index and instance
+ * arrays, so lists that are updated in place (see MVGDirty) should be
+ * batched into the list that is uploaded and not the retained list.
+ *
+ * returns the number of commands after batching.
+ */
+inline size_t draw_list_batch(draw_list &batch, size_t window = 64)
+{
+    struct bucket { draw_cmd cmd; float b[4]; uint start; };
+
+    size_t n = batch.cmds.size();
+    std::vector<bucket> out;
+    std::vector<uint> assign(n);
+
+    for (size_t i = 0; i < n; i++) {
+        const draw_cmd &c = batch.cmds[i];
+        float b[4];
+        draw_list_bounds(batch, c, b);
+
+        size_t j = out.size(), k = out.size();
+        size_t limit = out.size() > window ? out.size() - window : 0;
+        while (j > limit) {
+            bucket &o = out[--j];
+            if (memcmp(o.cmd.viewport, c.viewport, sizeof(c.viewport)) != 0) {
+                break;
+            }
+            if (o.cmd.shader == c.shader && o.cmd.iid == c.iid &&
+                o.cmd.mode == c.mode) {
+                k = j;
+                break;
+            }
+            if (o.b[0] <= b[2] && b[0] <= o.b[2] &&
+                o.b[1] <= b[3] && b[1] <= o.b[3]) {
+                break;
+            }
+        }
+        if (k == out.size()) {
+            out.push_back({c, { b[0], b[1], b[2], b[3] }, 0});
+            out[k].cmd.count = 0;
+        } else {
+            out[k].b[0] = std::min(out[k].b[0], b[0]);
+            out[k].b[1] = std::min(out[k].b[1], b[1]);
+            out[k].b[2] = std::max(out[k].b[2], b[2]);
+            out[k].b[3] = std::max(out[k].b[3], b[3]);
+        }
+        out[k].cmd.count += c.count;
+        assign[i] = (uint)k;
+    }
+
+    if (out.size() == n) return n;
+
+    /* counting sort of commands by bucket, keeping their order */
+    std::vector<uint> order(n);
+    for (size_t i = 0; i < n; i++) out[assign[i]].start++;
+    uint sum = 0;
+    for (auto &o : out) {
+        uint count = o.start;
+        o.start = sum;
+        sum += count;
+    }
+    for (size_t i = 0; i < n; i++) order[out[assign[i]].start++] = (uint)i;
+
+    std::vector<uint> indices;
+    std::vector<draw_instance> instances;
+    indices.reserve(batch.indices.size());
+    instances.reserve(batch.instances.size());
+    size_t o = 0;
+    for (auto &bk : out) {
+        bool inst = bk.cmd.mode == mode_instances;
+        bk.cmd.offset = (uint)(inst ? instances.size() : indices.size());
+        for (; o < bk.start; o++) {
+            const draw_cmd &c = batch.cmds[order[o]];
+            if (inst) {
+                instances.insert(instances.end(),
+                    batch.instances.begin() + c.offset,
+                    batch.instances.begin() + c.offset + c.count);
+            } else {
+                indices.insert(indices.end(),
+                    batch.indices.begin() + c.offset,
+                    batch.indices.begin() + c.offset + c.count);
+            }
+        }
+    }
+
+    batch.cmds.resize(out.size());
+    for (size_t i = 0; i < out.size(); i++) {
+        batch.cmds[i] = out[i].cmd;
+    }
+    batch.indices.swap(indices);
+    batch.instances.swap(instances);
+
+    return out.size();
+}
+
+/*
+ * compact vertex and index formats
+ *
+ * draw_vertex16 is a 16 byte vertex for upload in place of the 28 byte
+ * draw_vertex: positions are int16 fixed point with pos_scale units per
+ * pixel (z is quantized like x and y), uvs are unorm16 and shape is an
+ * int16. compact indices are uint16 relative to a base vertex for each
+ * command, for use with glDrawElementsBaseVertex.
+ *
+ * draw_list_pack selects formats per list and falls back to the float
+ * vertices or 32-bit indices of the list when values are out of range:
+ * vertices pack when the uvs are in [0,1], shapes are int16 and the
+ * position range allows a scale of at least min_scale; indices pack when
+ * every command spans at most 65536 vertices. the scale is the largest
+ * power of two up to max_scale for which all positions fit. instances
+ * are already compact and are not changed.
+ */
+
+typedef struct {
+    int16_t pos[3];
+    int16_t shape;
+    uint16_t uv[2];
+    uint color;
+} draw_vertex16;
+
+struct draw_list_compact
+{
+    std::vector<draw_vertex16> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<uint> bases;    /* base vertex for each command */
+    float pos_scale = 0;        /* fixed point scale, 0 if float vertices */
+    bool short_indices = false;
+
+    bool packed_vertices() const { return pos_scale > 0; }
+};
+
+inline int draw_list_round(float x)
+{
+    return (int)(x < 0.0f ? x - 0.5f : x + 0.5f);
+}
+
+inline bool draw_list_pack(const draw_list &batch, draw_list_compact &c,
+    float min_scale = 4.0f, float max_scale = 256.0f)
+{
+    c.vertices.clear();
+    c.indices.clear();
+    c.bases.clear();
+    c.pos_scale = 0;
+    c.short_indices = false;
+
+    /* find the position range and check uvs and shapes */
+    float m = 0;
+    bool fits = true;
+    for (auto &v : batch.vertices) {
+        for (int j = 0; j < 3; j++) {
+            m = std::max(m, v.pos[j] < 0.0f ? -v.pos[j] : v.pos[j]);
+        }
+        fits &= v.uv[0] >= 0.0f && v.uv[0] <= 1.0f &&
+            v.uv[1] >= 0.0f && v.uv[1] <= 1.0f &&
+            v.shape >= -32768.0f && v.shape <= 32767.0f &&
+            v.shape == (float)(int)v.shape;
+    }
+    float scale = max_scale;
+    while (scale >= min_scale && m * scale > 32767.0f) scale *= 0.5f;
+
+    if (fits && scale >= min_scale) {
+        c.pos_scale = scale;
+        c.vertices.resize(batch.vertices.size());
+        for (size_t i = 0; i < batch.vertices.size(); i++) {
+            const draw_vertex &v = batch.vertices[i];
+            c.vertices[i] = {
+                { (int16_t)draw_list_round(v.pos[0] * scale),
+                  (int16_t)draw_list_round(v.pos[1] * scale),
+                  (int16_t)draw_list_round(v.pos[2] * scale) },
+                (int16_t)v.shape,
+                { (uint16_t)draw_list_round(v.uv[0] * 65535.0f),
+                  (uint16_t)draw_list_round(v.uv[1] * 65535.0f) },
+                v.color
+            };
+        }
+    }
+
+    /* rebase indices to the lowest vertex of each command */
+    c.bases.resize(batch.cmds.size());
+    c.indices.resize(batch.indices.size());
+    bool short_indices = true;
+    for (size_t i = 0; i < batch.cmds.size() && short_indices; i++) {
+        const draw_cmd &cmd = batch.cmds[i];
+        c.bases[i] = 0;
+        if (cmd.mode == mode_instances || cmd.count == 0) continue;
+        const uint *idx = batch.indices.data() + cmd.offset;
+        uint lo = idx[0], hi = idx[0];
+        for (uint j = 1; j < cmd.count; j++) {
+            lo = std::min(lo, idx[j]);
+            hi = std::max(hi, idx[j]);
+        }
+        short_indices = hi - lo <= 65535;
+        c.bases[i] = lo;
+        for (uint j = 0; j < cmd.count; j++) {
+            c.indices[cmd.offset + j] = (uint16_t)(idx[j] - lo);
+        }
+    }
+    if (short_indices) {
+        c.short_indices = true;
+    } else {
+        c.indices.clear();
+        std::fill(c.bases.begin(), c.bases.end(), 0);
+    }
+
+    return c.packed_vertices() || c.short_indices;
+}
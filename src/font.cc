@@ -308,9 +308,25 @@ font_data font_manager::createFontRecord(std::string psName,
         fontStretch, fontSpacing);
 }
 
+bool font_manager::isFontFile(std::string path)
+{
+    /* TrueType and OpenType fonts and collections, by extension */
+    static const char* exts[] = { ".ttf", ".otf", ".ttc", ".otc" };
+    for (const char *ext : exts) {
+        size_t len = strlen(ext);
+        if (path.size() > len && strncasecmp(path.c_str() +
+            path.size() - len, ext, len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void font_manager::indexFace(font_face *face)
 {
-    fontPathMap[face->path] = face->font_id;
+    /* the path of a collection finds its first face */
+    fontPathMap.insert(std::pair<std::string,size_t>(face->path,
+        face->font_id));
     fontNameMap[face->name] = face->font_id;
     auto ffi = fontFamilyMap.find(face->fontData.familyName);
     if (ffi == fontFamilyMap.end()) {
@@ -428,7 +444,8 @@ std::string font_spec::toString() const
 /* Font Manager (FreeType) */
 
 font_manager_ft::font_manager_ft(std::string fontDir) : font_manager(),
-    color_enabled(false), msdf_enabled(false), msdf_autoload(false)
+    color_enabled(false), msdf_enabled(false), msdf_autoload(false),
+    msdf_rca(false), multithreading(false), mutex()
 {
     FT_Error fterr;
     if ((fterr = FT_Init_FreeType(&ftlib))) {
@@ -452,13 +469,11 @@ static std::vector<std::string> sortList(std::vector<std::string> l)
     return l;
 }
 
-static std::vector<std::string> endsWith(std::vector<std::string> l,
-    std::string ext)
+static std::vector<std::string> fontFiles(std::vector<std::string> l)
 {
     std::vector<std::string> list;
     for (auto &p : l) {
-        size_t i = p.find(ext);
-        if (i == p.size() - ext.size()) {
+        if (font_manager::isFontFile(p)) {
             list.push_back(p);
         }
     }
@@ -467,20 +482,42 @@ static std::vector<std::string> endsWith(std::vector<std::string> l,
 
 void font_manager_ft::scanFontDir(std::string dir)
 {
-    for (auto &p : sortList(endsWith(file::list(dir), ".ttf"))) {
+    for (auto &p : sortList(fontFiles(file::list(dir)))) {
         scanFontPath(p);
     }
 }
 
-void font_manager_ft::scanFontPath(std::string path)
+std::shared_ptr<file> font_manager_ft::mapFontFile(std::string path)
+{
+    std::lock_guard<std::mutex> lock(file_mutex);
+
+    /* faces from the same file share one mapping and its page cache pages */
+    auto fi = fontFileMap.find(path);
+    if (fi != fontFileMap.end()) {
+        file_ptr fontFile = fi->second.lock();
+        if (fontFile) return fontFile;
+    }
+
+    file_ptr fontFile = file::getFile(path);
+    if (!fontFile->getBuffer()) {
+        Error("error: failed to map font: path=%s\n", path.c_str());
+        return file_ptr();
+    }
+    fontFileMap[path] = fontFile;
+    return fontFile;
+}
+
+FT_Face font_manager_ft::openFontFace(file_ptr fontFile, int face_index)
 {
     FT_Error fterr;
     FT_Face ftface;
 
-    if ((fterr = FT_New_Face(ftlib, path.c_str(), 0, &ftface))) {
-        Error("error: FT_New_Face failed: fterr=%d, path=%s\n",
-            fterr, path.c_str());
-        return;
+    /* FreeType reads from the mapping in place which must outlive the face */
+    if ((fterr = FT_New_Memory_Face(ftlib, (const FT_Byte*)fontFile->getBuffer(),
+        (FT_Long)fontFile->getLength(), face_index, &ftface))) {
+        Error("error: FT_New_Memory_Face failed: fterr=%d, path=%s\n",
+            fterr, fontFile->getPath().c_str());
+        return nullptr;
     }
 
     for (int i = 0; i < ftface->num_charmaps; i++)
@@ -492,10 +529,33 @@ void font_manager_ft::scanFontPath(std::string path)
         break;
     }
 
-    size_t font_id = faces.size();
-    faces.push_back(std::unique_ptr<font_face_ft>
-        (new font_face_ft(this, ftface, (int)faces.size(), path)));
-    indexFace(faces[font_id].get());
+    return ftface;
+}
+
+void font_manager_ft::scanFontPath(std::string path)
+{
+    file_ptr fontFile;
+    FT_Face ftface;
+    int num_faces = 1;
+
+    if (!(fontFile = mapFontFile(path))) {
+        return;
+    }
+
+    /* collections hold num_faces faces that all share the one mapping */
+    for (int face_index = 0; ; face_index++) {
+        if (!(ftface = openFontFace(fontFile, face_index))) {
+            return;
+        }
+        if (face_index == 0) {
+            num_faces = (int)ftface->num_faces;
+        }
+        size_t font_id = faces.size();
+        faces.push_back(std::unique_ptr<font_face_ft>(new font_face_ft(this,
+            ftface, (int)faces.size(), path, fontFile, face_index)));
+        indexFace(faces[font_id].get());
+        if (face_index + 1 >= num_faces) break;
+    }
 }
 
 size_t font_manager_ft::fontCount() { return faces.size(); }
@@ -533,6 +593,7 @@ void font_manager_ft::importAtlas(font_atlas *atlas)
 font_atlas* font_manager_ft::getNewAtlas(font_face *face)
 {
     auto atlas = std::unique_ptr<font_atlas>(new font_atlas(0, 0, 0));
+    atlas->multithreading.store(multithreading, std::memory_order_release);
 
     /* find or create atlas list for this face */
     auto ai = faceAtlasMap.find(face);
@@ -544,6 +605,9 @@ font_atlas* font_manager_ft::getNewAtlas(font_face *face)
     /* if this is the first atlas for this face, then we attempt to load
      * the atlas; if unsuccessful we allocate backing store manually. */
     if (face && msdf_enabled && msdf_autoload && ai->second.size() == 0) {
+        if (msdf_rca) {
+            atlas->image_type = font_atlas::rca_file;
+        }
         atlas->load(this, face);
         importAtlas(atlas.get());
     }
@@ -597,7 +661,32 @@ glyph_renderer* font_manager_ft::getGlyphRenderer(font_face *face, int glyph)
                            static_cast<glyph_renderer*>(&outline);
 }
 
+void font_manager_ft::set_multithreading(bool enable)
+{
+    /*
+     * when set, lookups are serialized by the manager lock, which also
+     * covers glyph rendering and atlas allocation on a miss, and atlases
+     * lock around bin allocation and delta tracking so that renderers
+     * can take atlas deltas while other threads are adding glyphs.
+     */
+    std::lock_guard<std::mutex> lock(mutex);
+    multithreading.store(enable, std::memory_order_release);
+    for (auto &atlas : everyAtlas) {
+        atlas->multithreading.store(enable, std::memory_order_release);
+    }
+}
+
 glyph_entry* font_manager_ft::lookup(font_face *face, int font_size, int glyph)
+{
+    if (multithreading.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lookup_glyph(face, font_size, glyph);
+    }
+    return lookup_glyph(face, font_size, glyph);
+}
+
+glyph_entry* font_manager_ft::lookup_glyph(font_face *face, int font_size,
+    int glyph)
 {
     atlas_entry ae;
 
@@ -632,9 +721,18 @@ glyph_entry* font_manager_ft::lookup(font_face *face, int font_size, int glyph)
 
 /* Font Face (FreeType) */
 
-font_face_ft::font_face_ft(font_manager_ft* manager, FT_Face ftface, int font_id, std::string path) :
-    font_face(font_id, path, FT_Get_Postscript_Name(ftface)), manager(manager),
-    ftface(ftface), hbfont_cache(nullptr), hbfont_size(0)
+static std::string face_name(FT_Face ftface)
+{
+    /* PostScript names are optional in OpenType collections */
+    const char *psname = FT_Get_Postscript_Name(ftface);
+    return psname ? psname : ftface->family_name ? ftface->family_name : "";
+}
+
+font_face_ft::font_face_ft(font_manager_ft* manager, FT_Face ftface, int font_id,
+    std::string path, file_ptr fontFile, int face_index) :
+    font_face(font_id, path, face_name(ftface), face_index),
+    manager(manager), ftface(ftface), hbfont_cache(nullptr), hbfont_size(0),
+    fontFile(fontFile)
 {
     fontData = font_manager::createFontRecord(name,
         ftface->family_name, ftface->style_name);
@@ -684,23 +782,13 @@ int font_face_ft::get_height(int font_size)
 
 font_face_ft* font_face_ft::dup_thread()
 {
-    FT_Error fterr;
     FT_Face ftface;
 
-    if ((fterr = FT_New_Face(manager->ftlib, path.c_str(), 0, &ftface))) {
-        Error("error: FT_New_Face failed: fterr=%d, path=%s\n",
-            fterr, path.c_str());
+    /* the copy gets its own FT_Face over the same mapping */
+    if (!(ftface = manager->openFontFace(fontFile, face_index))) {
         return nullptr;
     }
 
-    for (int i = 0; i < ftface->num_charmaps; i++)
-        if (((ftface->charmaps[i]->platform_id == 0) &&
-            (ftface->charmaps[i]->encoding_id == 3))
-         || ((ftface->charmaps[i]->platform_id == 3) &&
-            (ftface->charmaps[i]->encoding_id == 1))) {
-        FT_Set_Charmap(ftface, ftface->charmaps[i]);
-        break;
-    }
-
-    return new font_face_ft(manager, ftface, font_id, path);
-}
\ No newline at end of file
+    return new font_face_ft(manager, ftface, font_id, path, fontFile,
+        face_index);
+}
@@ -21,6 +21,8 @@ struct glyph_renderer;
 struct font_face_ft;
 struct font_manager_ft;
 
+struct file;
+
 extern const std::string font_family_any;
 extern const std::string font_style_any;
 
@@ -181,13 +183,15 @@ struct font_data
 
 struct font_face
 {
-    int font_id;
+    int font_id = 0;
+    int face_index = 0;
     std::string path;
     std::string name;
     font_data fontData;
 
     font_face() = default;
-    font_face(int font_id, std::string path, std::string name);
+    font_face(int font_id, std::string path, std::string name,
+        int face_index = 0);
     virtual ~font_face() = default;
 
     const font_data& getFontData() const { return fontData; }
@@ -195,8 +199,9 @@ struct font_face
     std::string get_style_name() const { return fontData.styleName; }
 };
 
-inline font_face::font_face(int font_id, std::string path, std::string name) :
-    font_id(font_id), path(path), name(name) {}
+inline font_face::font_face(int font_id, std::string path, std::string name,
+    int face_index) :
+    font_id(font_id), face_index(face_index), path(path), name(name) {}
 
 
 /*
@@ -276,6 +281,7 @@ struct font_manager
         font_stretch fontStretch, font_spacing fontSpacing);
     static font_data createFontRecord(std::string psName,
         std::string familyName, std::string styleName);
+    static bool isFontFile(std::string path);
 
     std::vector<font_face*> allFonts;
     std::map<std::string,size_t> fontPathMap;
@@ -311,9 +317,11 @@ struct font_face_ft : font_face
     hb_font_t *hbfont_cache;
     int hbfont_size;
     font_manager_ft* manager;
+    std::shared_ptr<file> fontFile;
 
     font_face_ft() = default;
-    font_face_ft(font_manager_ft* manager, FT_Face ftface, int font_id, std::string path);
+    font_face_ft(font_manager_ft* manager, FT_Face ftface, int font_id,
+        std::string path, std::shared_ptr<file> fontFile, int face_index);
     virtual ~font_face_ft();
 
     FT_Size_Metrics* get_metrics(int font_size);
@@ -330,16 +338,26 @@ struct font_manager_ft : font_manager
     bool color_enabled;
     bool msdf_enabled;
     bool msdf_autoload;
+    bool msdf_rca;          /* autoload range coded atlas images */
 
     std::vector<std::unique_ptr<font_face_ft>> faces;
     std::vector<std::unique_ptr<font_atlas>> everyAtlas;
     std::map<font_face*,std::vector<font_atlas*>> faceAtlasMap;
     font_atlas* defaulAtlas;
     std::map<glyph_key,glyph_entry> glyph_map;
+    std::atomic<bool> multithreading;
+    std::mutex mutex;
+
+    /* one shared read-only mapping per font file, released with its faces */
+    std::map<std::string,std::weak_ptr<file>> fontFileMap;
+    std::mutex file_mutex;
 
     font_manager_ft(std::string fontDir = "");
     virtual ~font_manager_ft();
 
+    /* serialize lookup and atlas updates for renderers on many threads */
+    void set_multithreading(bool enable);
+
     virtual void scanFontDir(std::string dir);
     virtual void scanFontPath(std::string path);
     virtual size_t fontCount();
@@ -351,6 +369,11 @@ struct font_manager_ft : font_manager
     virtual glyph_renderer* getGlyphRenderer(font_face *face, int glyph);
     virtual glyph_entry* lookup(font_face *face, int font_size, int glyph);
 
+    glyph_entry* lookup_glyph(font_face *face, int font_size, int glyph);
+
+    std::shared_ptr<file> mapFontFile(std::string path);
+    FT_Face openFontFace(std::shared_ptr<file> fontFile, int face_index);
+
     const std::vector<std::unique_ptr<font_face_ft>>& getFontList() { return faces; }
 };
 
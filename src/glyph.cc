@@ -90,8 +90,9 @@ font_atlas::font_atlas(size_t width, size_t height, size_t depth) :
     width(width), height(height), depth(depth),
     glyph_map(), pixels(nullptr), uv1x1(1.0f / (float)width),
     bp(bin_point((int)width, (int)height)),
-    delta(bin_point((int)width,(int)height),bin_point(0,0)),
-    multithreading(false), mutex()
+    delta(bin_point((int)width,(int)height),bin_point(0,0)), dirty(),
+    multithreading(false), mutex(), img(), image_type(png_file),
+    png_options()
 {
     if (width && height && depth) {
         create_pixels();
@@ -170,6 +171,7 @@ void font_atlas::reset_bins()
 {
     bp.set_bin_size(bin_point((int)width,(int)height));
     delta = bin_rect(bin_point((int)width,(int)height),bin_point(0,0));
+    dirty.clear();
     glyph_map.clear();
 }
 
@@ -248,12 +250,14 @@ void font_atlas::expand_delta(bin_rect b)
      * expand the delta rectangle.
      *
      * This interface is called after find_region with each newly
-     * allocated region, to keep track of the minimum update rectangle.
+     * allocated region, to keep track of the minimum update rectangle
+     * and of the list of dirty rectangles within it.
      */
     delta.a.x = std::min(delta.a.x,b.a.x);
     delta.a.y = std::min(delta.a.y,b.a.y);
     delta.b.x = std::max(delta.b.x,b.b.x);
     delta.b.y = std::max(delta.b.y,b.b.y);
+    draw_rect_union(dirty, b);
 }
 
 bin_rect font_atlas::get_delta()
@@ -264,8 +268,38 @@ bin_rect font_atlas::get_delta()
      * This interface is called to get the smalled possible update
      * rectangle to use with APIs such as glTexSubImage2D.
      */
+    if (multithreading) {
+        mutex.lock();
+    }
     bin_rect r = delta;
     delta = bin_rect(bin_point((int)width,(int)height),bin_point(0,0));
+    dirty.clear();
+    if (multithreading) {
+        mutex.unlock();
+    }
+    return r;
+}
+
+bin_rect font_atlas::get_delta(std::vector<bin_rect> &rects)
+{
+    /*
+     * return the delta rectangle and the dirty rectangles within it,
+     * and reset both to their smallest value.
+     *
+     * The dirty rectangles allow several small glTexSubImage2D updates
+     * in place of one update of their bounds, which for glyphs added
+     * to different rows of the atlas is mostly unmodified pixels.
+     */
+    if (multithreading) {
+        mutex.lock();
+    }
+    bin_rect r = delta;
+    delta = bin_rect(bin_point((int)width,(int)height),bin_point(0,0));
+    rects.clear();
+    rects.swap(dirty);
+    if (multithreading) {
+        mutex.unlock();
+    }
     return r;
 }
 
@@ -322,9 +356,13 @@ atlas_entry font_atlas::lookup(font_face *face, int font_size, int glyph,
 
 std::string font_atlas::get_path(font_face *face, file_type type)
 {
+    /* faces after the first in a collection get their own atlas files */
+    std::string base = face->face_index == 0 ? face->path :
+        face->path + "." + std::to_string(face->face_index);
     switch (type) {
-    case csv_file: return face->path + ".atlas.csv";
-    case png_file: return face->path + ".atlas.png";
+    case csv_file: return base + ".atlas.csv";
+    case png_file: return base + ".atlas.png";
+    case rca_file: return base + ".atlas.rca";
     case ttf_file:
     default: return face->path;
     }
@@ -373,7 +411,7 @@ void font_atlas::load_map(font_manager *manager, font_face *face, FILE *in)
 
 void font_atlas::save(font_manager *manager, font_face *face)
 {
-    std::string img_path = get_path(face, png_file);
+    std::string img_path = get_path(face, image_type);
     std::string csv_path = get_path(face, csv_file);
     FILE *fcsv = fopen(csv_path.c_str(), "w");
     if (fcsv == nullptr) {
@@ -382,12 +420,41 @@ void font_atlas::save(font_manager *manager, font_face *face)
     }
     save_map(manager, face, fcsv);
     fclose(fcsv);
-    image::saveToFile(img_path, img);
+    if (image_type == png_file) {
+        image::PNG.save(img.get(), img_path, png_options);
+    } else {
+        image::saveToFile(img_path, img);
+    }
 }
 
+/*
+ * decode atlas images directly into the atlas pixels, reusing the
+ * existing backing store if the size and depth match.
+ */
+struct font_atlas_dest : image_dest
+{
+    font_atlas *atlas;
+
+    font_atlas_dest(font_atlas *atlas) : atlas(atlas) {}
+
+    uint8_t* get(uint width, uint height, pixel_format format, size_t &stride)
+    {
+        size_t depth = image::getBytesPerPixel(format);
+        if (!atlas->pixels || atlas->width != width ||
+            atlas->height != height || atlas->depth != depth) {
+            atlas->width = width;
+            atlas->height = height;
+            atlas->depth = depth;
+            atlas->create_pixels();
+        }
+        stride = (size_t)width * depth;
+        return atlas->pixels;
+    }
+};
+
 void font_atlas::load(font_manager *manager, font_face *face)
 {
-    std::string img_path = get_path(face, png_file);
+    std::string img_path = get_path(face, image_type);
     std::string csv_path = get_path(face, csv_file);
     if (!file::fileExists(img_path) || !file::fileExists(csv_path)) {
         return;
@@ -397,15 +464,20 @@ void font_atlas::load(font_manager *manager, font_face *face)
         Error("error: fopen: %s: %s\n", csv_path.c_str(), strerror(errno));
         exit(1);
     }
-    image_ptr load_img = image::createFromFile(img_path);
-    if (!load_img) {
+    pixel_format format = depth == GRAY_DEPTH ?
+        pixel_format_alpha : pixel_format_rgba;
+    font_atlas_dest dest(this);
+    image_io *io = image::getImageIOFromExt(img_path);
+    if (!io->load(file::getFile(img_path), format, &dest)) {
+        Error("error: could not load %s\n", img_path.c_str());
+        if (pixels) {
+            clear_pixels();
+            uv_pixel();
+        }
+        reset_bins();
+        fclose(fcsv);
         return;
     }
-    img = load_img;
-    pixels = img->move();
-    width = img->getWidth();
-    height = img->getHeight();
-    depth = img->getBytesPerPixel();
     reset_bins();
     uv_pixel();
     load_map(manager, face, fcsv);
@@ -428,13 +500,19 @@ void text_shaper_ft::shape(std::vector<glyph_shape> &shapes,
     /* we need to set up our font metrics */
     face->get_metrics(segment.font_size);
 
-    /* shape text with FreeType (does not apply glyph-glyph kerning) */
+    /* decode text to code points and their byte offsets in one pass */
     const char* text = segment.text.c_str();
     size_t text_len = segment.text.size();
-    for (size_t i = 0; i < text_len; i += utf8_codelen(text + i)) {
+    codes.resize(text_len);
+    offsets.resize(text_len);
+    size_t count = utf8_to_utf32_n(text, text_len, codes.data(), offsets.data());
 
-        uint32_t codepoint = utf8_to_utf32(text + i);
+    /* shape text with FreeType (does not apply glyph-glyph kerning) */
+    for (size_t j = 0; j < count; j++) {
+
+        uint32_t codepoint = codes[j];
         uint32_t glyph = FT_Get_Char_Index(ftface, codepoint);
+        size_t i = offsets[j];
 
         if (ftface->num_fixed_sizes > 0) {
             //FT_Bitmap_Size *bsize = &ftface->available_sizes[ftface->num_fixed_sizes-1];
@@ -731,6 +809,40 @@ atlas_entry glyph_renderer_color_ft::render(font_atlas *atlas, font_face_ft *fac
  * text renderer
  */
 
+/* emit a run of glyph quads from one atlas with one image update */
+static void emit_glyphs(draw_list &batch, font_atlas *atlas,
+    std::vector<draw_instance> &quads, std::vector<bin_rect> &dirty)
+{
+    if (!atlas || quads.size() == 0) return;
+    draw_list_rects(batch, atlas->get_image()->iid,
+        atlas->depth == 4 ? shader_msdf : shader_simple, 0,
+        quads.data(), quads.size());
+    bin_rect delta = atlas->get_delta(dirty);
+    draw_list_image_dirty(batch, atlas->get_image(), delta, dirty,
+        st_clamp | atlas_image_filter(atlas));
+    quads.clear();
+}
+
+glyph_entry* text_renderer_ft::lookup(font_face *face, int font_size,
+    int glyph)
+{
+    /*
+     * manager entries are never removed, so renderers on worker threads
+     * can keep pointers to them and only take the manager lock on a miss.
+     */
+    if (!local_cache) {
+        return manager->lookup(face, font_size, glyph);
+    }
+    glyph_key key(face->font_id, font_size, glyph);
+    auto gi = glyph_cache.find(key);
+    if (gi != glyph_cache.end()) {
+        return gi->second;
+    }
+    glyph_entry *ge = manager->lookup(face, font_size, glyph);
+    glyph_cache.insert(gi, std::pair<glyph_key,glyph_entry*>(key, ge));
+    return ge;
+}
+
 void text_renderer_ft::render(draw_list &batch,
     std::vector<glyph_shape> &shapes,
     text_segment &segment, glm::mat3 m)
@@ -744,8 +856,10 @@ void text_renderer_ft::render(draw_list &batch,
 
     /* lookup glyphs in font atlas, creating them if they don't exist */
     float dx = 0, dy = 0;
+    font_atlas *atlas = nullptr;
+    quads.clear();
     for (auto &shape : shapes) {
-        glyph_entry *ge = manager->lookup(face, font_size, shape.glyph);
+        glyph_entry *ge = lookup(face, font_size, shape.glyph);
         if (!ge) continue;
         /* create polygons in vertex array */
         glm::vec3 v = glm::vec3(segment.x, segment.y, 1.0f) * m;
@@ -757,19 +871,14 @@ void text_renderer_ft::render(draw_list &batch,
         if (ge->w > 0 && ge->h > 0) {
             float u1 = ge->uv[0], v1 = ge->uv[1];
             float u2 = ge->uv[2], v2 = ge->uv[3];
-            uint o = (int)batch.vertices.size();
             uint c = segment.color; /* black -> white for emoji */
             shape.pos[0] = {x1, y1, 0};
             shape.pos[1] = {x2, y2, 0};
-            uint o0 = draw_list_vertex(batch, {{x1, y1, 0}, {u1, v1}, c});
-            uint o1 = draw_list_vertex(batch, {{x2, y1, 0}, {u2, v1}, c});
-            uint o2 = draw_list_vertex(batch, {{x2, y2, 0}, {u2, v2}, c});
-            uint o3 = draw_list_vertex(batch, {{x1, y2, 0}, {u1, v2}, c});
-            draw_list_indices(batch, ge->atlas->get_image()->iid, mode_triangles,
-                ge->atlas->depth == 4 ? shader_msdf : shader_simple,
-                {o0, o3, o1, o1, o3, o2});
-            draw_list_image_delta(batch, ge->atlas->get_image(), ge->atlas->get_delta(),
-                st_clamp | atlas_image_filter(ge->atlas));
+            if (ge->atlas != atlas) {
+                emit_glyphs(batch, atlas, quads, dirty);
+                atlas = ge->atlas;
+            }
+            quads.push_back({{x1, y1, x2, y2}, {u1, v1, u2, v2}, c, 0});
         }
         /* TODO - 1/4th pixel glyph caching and sub-pixel advance precision */
         dx += shape.x_advance/64.0f * scale + tracking;
@@ -783,4 +892,5 @@ void text_renderer_ft::render(draw_list &batch,
                 shape.pos[0].x, shape.pos[0].y, shape.pos[1].x, shape.pos[1].y);
         }
     }
+    emit_glyphs(batch, atlas, quads, dirty);
 }
\ No newline at end of file
@@ -94,6 +94,7 @@ struct font_atlas
     float uv1x1;
     bin_packer bp;
     bin_rect delta;
+    std::vector<bin_rect> dirty;
     std::atomic<bool> multithreading;
     std::mutex mutex;
     std::shared_ptr<image> img;
@@ -131,8 +132,9 @@ struct font_atlas
     /* create entry uvs */
     void create_uvs(float uv[4], bin_rect r);
 
-    /* tracking minimum required update rectangle */
+    /* tracking minimum required update rectangle and dirty rectangles */
     bin_rect get_delta();
+    bin_rect get_delta(std::vector<bin_rect> &rects);
     void expand_delta(bin_rect b);
 
     /* persistance */
@@ -140,7 +142,15 @@ struct font_atlas
         ttf_file,
         csv_file,
         png_file,
+        rca_file,
     };
+
+    /* image format used by save and load, png unless rca is chosen */
+    file_type image_type;
+
+    /* compression options used when saving png images */
+    image_png_options png_options;
+
     std::string get_path(font_face *face, file_type type);
     void save_map(font_manager *manager, font_face *face, FILE *out);
     void load_map(font_manager *manager, font_face *face, FILE *in);
@@ -239,6 +249,9 @@ struct text_shaper
 
 struct text_shaper_ft : text_shaper
 {
+    std::vector<uint32_t> codes;    /* code point scratch */
+    std::vector<uint32_t> offsets;  /* code point byte offset scratch */
+
     virtual void shape(std::vector<glyph_shape> &shapes, text_segment &segment);
 };
 
@@ -310,14 +323,20 @@ struct text_renderer_ft : text_renderer
 {
     font_manager* manager;
     std::unique_ptr<glyph_renderer> renderer;
+    std::vector<draw_instance> quads;   /* glyph run scratch */
+    std::vector<bin_rect> dirty;        /* atlas dirty rect scratch */
+    bool local_cache;                   /* cache manager entries locally */
+    std::map<glyph_key,glyph_entry*> glyph_cache;
 
-    text_renderer_ft(font_manager* manager);
+    text_renderer_ft(font_manager* manager, bool local_cache = false);
     virtual ~text_renderer_ft() = default;
 
+    glyph_entry* lookup(font_face *face, int font_size, int glyph);
+
     void render(draw_list &batch,
         std::vector<glyph_shape> &shapes,
         text_segment &segment, glm::mat3 m = glm::mat3(1));
 };
 
-inline text_renderer_ft::text_renderer_ft(font_manager* manager) :
-    manager(manager) {}
\ No newline at end of file
+inline text_renderer_ft::text_renderer_ft(font_manager* manager,
+    bool local_cache) : manager(manager), local_cache(local_cache) {}
\ No newline at end of file
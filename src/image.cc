@@ -9,12 +9,16 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 #include "logger.h"
 #include "image.h"
 #include "file.h"
+#include "worker.h"
+#include "bitcode.h"
 
 #include <png.h>
+#include <zlib.h>
 
 #include <string.h>
 #include <setjmp.h>
@@ -24,6 +28,7 @@ static char class_name[] = "image";
 int image::iid_seq = 0;
 
 image_io_png  image::PNG;
+image_io_rca  image::RCA;
 
 const char* image::formatname[] = {
     "None",
@@ -43,9 +48,14 @@ image_io* image::getImageIO(unsigned char magic[8])
     static const unsigned char PNG_MAGIC[] = {
         0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A
     };
+    static const unsigned char RCA_MAGIC[] = {
+        0x89, 0x52, 0x43, 0x41, 0x0D, 0x0A, 0x1A, 0x0A
+    };
 
     if (memcmp(magic, PNG_MAGIC, sizeof(PNG_MAGIC)) == 0) {
         return &PNG;
+    } else if (memcmp(magic, RCA_MAGIC, sizeof(RCA_MAGIC)) == 0) {
+        return &RCA;
     } else {
         return NULL;
     }
@@ -112,6 +122,8 @@ image_io* image::getImageIOFromExt(std::string pathname)
     std::string type = pathname.substr(dotoffset + 1);
     if (type == "png") {
         return &PNG;
+    } else if (type == "rca") {
+        return &RCA;
     } else {
         return NULL;
     }
@@ -210,11 +222,19 @@ void image::convertFormat(pixel_format newformat)
         formatname[format], formatname[newformat]);
     size_t size = (size_t)width * height * getBytesPerPixel(newformat);
     uint8_t *newpixels = new uint8_t[size];
-    uint8_t *src = pixels, *dest = newpixels;
+    convertPixels(format, pixels, newformat, newpixels, (size_t)width * height);
+    delete [] pixels;
+    format = newformat;
+    pixels = newpixels;
+}
+
+void image::convertPixels(pixel_format srcformat, const uint8_t *src,
+    pixel_format destformat, uint8_t *dest, size_t count)
+{
     uint8_t c[4] = {};
-    for (uint i=0; i < width * height; i++) {
+    for (size_t i = 0; i < count; i++) {
         // load source pixel
-        switch (format) {
+        switch (srcformat) {
             case pixel_format_rgba:                 
                 c[0] = *(src++);
                 c[1] = *(src++);
@@ -234,16 +254,16 @@ void image::convertFormat(pixel_format newformat)
                 c[3] = 0xff;
                 break;
             case pixel_format_rgb555:
-                c[0] = (*((ushort*)src) & 0x7c00)>>7;
-                c[1] = (*((ushort*)src) & 0x3e0)>>2;
-                c[2] = (*((ushort*)src) & 0x1f)<<3;
+                c[0] = (*((const ushort*)src) & 0x7c00)>>7;
+                c[1] = (*((const ushort*)src) & 0x3e0)>>2;
+                c[2] = (*((const ushort*)src) & 0x1f)<<3;
                 c[3] = 0xff;
                 src += 2;
                 break;
             case pixel_format_rgb565:
-                c[0] = (*((ushort*)src) & 0xf800)>>8;
-                c[1] = (*((ushort*)src) & 0x7e0)>>3;
-                c[2] = (*((ushort*)src) & 0x1f)<<3;
+                c[0] = (*((const ushort*)src) & 0xf800)>>8;
+                c[1] = (*((const ushort*)src) & 0x7e0)>>3;
+                c[2] = (*((const ushort*)src) & 0x1f)<<3;
                 c[3] = 0xff;
                 src += 2;
                 break;
@@ -259,7 +279,7 @@ void image::convertFormat(pixel_format newformat)
                 break;
         }
         // store dest pixel
-        switch (newformat) {
+        switch (destformat) {
             case pixel_format_rgba:
                 *(dest++) = c[0];
                 *(dest++) = c[1];
@@ -297,9 +317,6 @@ void image::convertFormat(pixel_format newformat)
                 break;
         }
     }
-    delete [] pixels;
-    format = newformat;
-    pixels = newpixels;
 }
 
 static void image_io_png_png_read_pixels(png_structp png_ptr, png_bytep pixels,
@@ -315,111 +332,220 @@ static void image_io_png_png_read_pixels(png_structp png_ptr, png_bytep pixels,
     }
 }
 
-image* image_io_png::load(file_ptr rsrc, pixel_format optformat)
+/*
+ * decode rows directly into the destination when libpng transforms can
+ * produce the requested format, otherwise decode rows as RGBA into a
+ * scratch row (or image, if interlaced) and convert them. setjmp is in
+ * its own frame so that the scratch vector is owned by the caller.
+ */
+static bool image_io_png_decode(png_structp png_ptr, png_infop info_ptr,
+    pixel_format format, image_dest *dest, std::vector<uint8_t> &scratch)
 {
-    png_structp png_ptr;
-    png_infop info_ptr;
-    int bit_depth, color_type;
-    int i;
-    size_t row_stride;
-    png_bytepp row_arr = NULL;
-    
-    uint width, height;
-    pixel_format format;
-    uint8_t *pixels = NULL;
-    
-    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (png_ptr == NULL) {
-        Debug("%s: error creating png read struct\n", __func__);
-        return NULL;
-    }
-
-    info_ptr = png_create_info_struct(png_ptr);
-    if (info_ptr == NULL) {
-        Debug("%s: error creating png infostruct\n", __func__);
-        png_destroy_read_struct(&png_ptr, NULL, NULL);
-        return NULL;
-    }
-
     if (setjmp(png_jmpbuf(png_ptr))) {
         Debug("%s: error decompressing png\n", __func__);
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        free(row_arr);
-        free(pixels);
-        return NULL;
+        return false;
     }
 
-    png_set_read_fn(png_ptr, rsrc.get(), image_io_png_png_read_pixels);
     png_set_sig_bytes(png_ptr, 0);
 
     /* read all the info up to the image pixels  */
     png_read_info(png_ptr, info_ptr);
 
-    png_uint_32 pwidth, pheight;
-    png_get_IHDR(png_ptr, info_ptr, &pwidth, &pheight, &bit_depth, &color_type,
-        NULL, NULL, NULL);
-    width = pwidth;
-    height = pheight;
+    png_uint_32 width, height;
+    int bit_depth, color_type, interlace_type;
+    png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
+        &interlace_type, NULL, NULL);
 
-    /* Set up some transforms. */
-    if (color_type & PNG_COLOR_MASK_ALPHA) {
-        format = pixel_format_rgba;
-    } else {
-        format = pixel_format_rgb;
+    bool color = (color_type & PNG_COLOR_MASK_COLOR) != 0;
+    bool alpha = (color_type & PNG_COLOR_MASK_ALPHA) != 0 ||
+        png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS);
+
+    /* default to the format of the file */
+    if (format == pixel_format_none) {
+        format = alpha ? pixel_format_rgba : pixel_format_rgb;
     }
+
+    /* Set up some transforms. */
     if (bit_depth > 8) {
         png_set_strip_16(png_ptr);
     }
-    if (color_type == PNG_COLOR_TYPE_GRAY ||
-        color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-        png_set_gray_to_rgb(png_ptr);
-    }
-    if (color_type == PNG_COLOR_TYPE_PALETTE) {
-        png_set_palette_to_rgb(png_ptr);
+    png_set_expand(png_ptr);
+
+    /* alpha images are saved as gray, so gray without alpha is direct */
+    pixel_format decode;
+    switch (format) {
+    case pixel_format_rgb:
+        if (!color) png_set_gray_to_rgb(png_ptr);
+        if (alpha) png_set_strip_alpha(png_ptr);
+        decode = pixel_format_rgb;
+        break;
+    case pixel_format_luminance:
+        if (color) png_set_rgb_to_gray_fixed(png_ptr, 1, -1, -1);
+        if (alpha) png_set_strip_alpha(png_ptr);
+        decode = pixel_format_luminance;
+        break;
+    case pixel_format_alpha:
+        if (!color && !alpha) {
+            decode = pixel_format_alpha;
+            break;
+        }
+        /* fall through */
+    default:
+        if (!color) png_set_gray_to_rgb(png_ptr);
+        if (!alpha) png_set_add_alpha(png_ptr, 0xff, PNG_FILLER_AFTER);
+        decode = pixel_format_rgba;
+        break;
     }
+    int passes = png_set_interlace_handling(png_ptr);
 
     /* Update the png info struct.*/
     png_read_update_info(png_ptr, info_ptr);
 
-    /* Rowsize in bytes. */
-    row_stride = png_get_rowbytes(png_ptr, info_ptr);
-
-    /* Allocate the image_pixels buffer. */
-    if ((pixels = new uint8_t[row_stride * height]) == NULL) {
-        Debug("%s: error allocating memory\n", __func__);
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        return NULL;
+    size_t row_stride = png_get_rowbytes(png_ptr, info_ptr);
+    if (row_stride != (size_t)width * image::getBytesPerPixel(decode)) {
+        Debug("%s: unexpected row size %zu\n", __func__, row_stride);
+        return false;
     }
 
-    /* allocate row pointers */
-    if ((row_arr = (png_bytepp) malloc(height * sizeof(png_bytep))) == NULL) {
-        Debug("%s: error allocating memory\n", __func__);
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        free(pixels);
-        return NULL;
+    size_t stride = (size_t)width * image::getBytesPerPixel(format);
+    uint8_t *pixels = dest->get(width, height, format, stride);
+    if (!pixels) {
+        return false;
     }
 
-    /* set the individual row_arr to point at the correct offsets */
-    for (i = 0; i < (int) height; ++i) {
-        row_arr[i] = pixels + i * row_stride;
+    if (decode == format) {
+        for (int pass = 0; pass < passes; pass++) {
+            for (png_uint_32 y = 0; y < height; y++) {
+                png_read_row(png_ptr, pixels + y * stride, NULL);
+            }
+        }
+    } else if (passes == 1) {
+        scratch.resize(row_stride);
+        for (png_uint_32 y = 0; y < height; y++) {
+            png_read_row(png_ptr, scratch.data(), NULL);
+            image::convertPixels(decode, scratch.data(), format,
+                pixels + y * stride, width);
+        }
+    } else {
+        scratch.resize(row_stride * height);
+        for (int pass = 0; pass < passes; pass++) {
+            for (png_uint_32 y = 0; y < height; y++) {
+                png_read_row(png_ptr, &scratch[y * row_stride], NULL);
+            }
+        }
+        for (png_uint_32 y = 0; y < height; y++) {
+            image::convertPixels(decode, &scratch[y * row_stride], format,
+                pixels + y * stride, width);
+        }
     }
 
-    /* now we can go ahead and just read the whole image */
-    png_read_image(png_ptr, row_arr);
-
     /* and we're done!  (png_read_end() can be omitted if no processing of
      * post-IDAT text/time/etc. is desired) */
 
+    return true;
+}
+
+bool image_io_png::load(file_ptr rsrc, pixel_format format, image_dest *dest)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    std::vector<uint8_t> scratch;
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (png_ptr == NULL) {
+        Debug("%s: error creating png read struct\n", __func__);
+        return false;
+    }
+
+    info_ptr = png_create_info_struct(png_ptr);
+    if (info_ptr == NULL) {
+        Debug("%s: error creating png infostruct\n", __func__);
+        png_destroy_read_struct(&png_ptr, NULL, NULL);
+        return false;
+    }
+
+    png_set_read_fn(png_ptr, rsrc.get(), image_io_png_png_read_pixels);
+
+    bool ok = image_io_png_decode(png_ptr, info_ptr, format, dest, scratch);
+
     /* Clean up. */
-    free(row_arr);
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
     rsrc->close();
-    
-    return new image(rsrc, width, height, format, pixels);
+
+    return ok;
+}
+
+/* destination that must match the size of caller memory */
+struct image_dest_buffer : image_dest
+{
+    uint8_t *pixels;
+    uint width, height;
+    size_t stride;
+
+    image_dest_buffer(uint8_t *pixels, uint width, uint height, size_t stride)
+        : pixels(pixels), width(width), height(height), stride(stride) {}
+
+    uint8_t* get(uint w, uint h, pixel_format format, size_t &s)
+    {
+        if (w != width || h != height) {
+            Debug("%s: image size %ux%u does not match buffer %ux%u\n",
+                __func__, w, h, width, height);
+            return nullptr;
+        }
+        s = stride;
+        return pixels;
+    }
+};
+
+bool image_io_png::load(file_ptr rsrc, pixel_format format, uint8_t *pixels,
+    uint width, uint height, size_t stride)
+{
+    image_dest_buffer dest(pixels, width, height, stride);
+    return load(rsrc, format, &dest);
+}
+
+/* destination that allocates a new image */
+struct image_dest_image : image_dest
+{
+    image *img;
+
+    image_dest_image() : img(nullptr) {}
+
+    uint8_t* get(uint width, uint height, pixel_format format, size_t &stride)
+    {
+        img = new image();
+        img->width = width;
+        img->height = height;
+        img->format = format;
+        img->pixels = new uint8_t[stride * height];
+        img->ownData = true;
+        return img->pixels;
+    }
+};
+
+image* image_io_png::load(file_ptr rsrc, pixel_format optformat)
+{
+    image_dest_image dest;
+    if (!load(rsrc, optformat, &dest)) {
+        delete dest.img;
+        return NULL;
+    }
+    dest.img->rsrc = rsrc;
+    return dest.img;
 }
 
 void image_io_png::save(image* image, std::string filename)
 {
+    save(image, filename, image_png_options());
+}
+
+bool image_io_png::save(image* image, std::string filename,
+    const image_png_options &opts)
+{
+    if (opts.num_threads > 0) {
+        return save_parallel(image, filename, opts);
+    }
+
     FILE *outfile;
     png_structp png_ptr;
     png_infop info_ptr;
@@ -427,14 +553,14 @@ void image_io_png::save(image* image, std::string filename)
     
     if ((outfile = fopen(filename.c_str(), "wb")) == NULL) {
         Debug("%s: error opening file %s\n", filename.c_str(), __func__);
-        return;
+        return false;
     }
 
     png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (png_ptr == NULL) {
         Debug("%s: error creating png write struct\n", __func__);
         fclose(outfile);
-        return;
+        return false;
     }
 
     info_ptr = png_create_info_struct(png_ptr);
@@ -442,7 +568,7 @@ void image_io_png::save(image* image, std::string filename)
         Debug("%s: error creating png info struct\n", __func__);
         fclose(outfile);
         png_destroy_write_struct(&png_ptr, NULL);
-        return;
+        return false;
      }
 
     if (setjmp(png_jmpbuf(png_ptr))) {
@@ -450,7 +576,7 @@ void image_io_png::save(image* image, std::string filename)
         png_destroy_write_struct(&png_ptr, &info_ptr);
         fclose(outfile);
         free(row_arr);
-        return;
+        return false;
     }
 
     uint8_t color_type;
@@ -463,9 +589,14 @@ void image_io_png::save(image* image, std::string filename)
             Debug("%s pixel format not supported\n", __func__);
             fclose(outfile);
             png_destroy_write_struct(&png_ptr, NULL);
-            return;
+            return false;
     }
     png_init_io(png_ptr, outfile);
+    png_set_compression_level(png_ptr, opts.compression_level);
+    png_set_compression_strategy(png_ptr, opts.compression_strategy);
+    if (opts.filters != image_png_filter_default) {
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, opts.filters);
+    }
     png_set_IHDR(png_ptr, info_ptr, image->getWidth(), image->getHeight(), 8,
             color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
             PNG_FILTER_TYPE_BASE);
@@ -485,4 +616,557 @@ void image_io_png::save(image* image, std::string filename)
     free(row_arr);
     png_destroy_write_struct(&png_ptr, &info_ptr);
     fclose(outfile);
+
+    return true;
+}
+
+/*
+ * parallel png encoder
+ *
+ * rows are filtered into one buffer in the first pass. in the second
+ * pass each band is deflated as raw deflate data, primed with the last
+ * 32KiB of filtered rows before it, and ended with a sync flush so that
+ * the bands concatenate into one zlib stream. the adler32 checksums of
+ * the bands are combined for the zlib trailer.
+ */
+
+static const size_t png_window_size = 32768;
+
+struct png_band
+{
+    size_t y1, y2;
+    std::vector<uint8_t> out;
+    uLong adler;
+    bool ok;
+};
+
+struct png_encoder
+{
+    uint width, height, bpp;
+    size_t row_stride;
+    const uint8_t *pixels;
+    int level, strategy, filters;
+    std::vector<uint8_t> filtered;
+    std::vector<png_band> bands;
+    bool deflating;
+
+    void filter_rows(png_band &band);
+    void deflate_rows(png_band &band, bool last);
+};
+
+struct png_encoder_worker : pool_worker<size_t>
+{
+    png_encoder *encoder;
+
+    png_encoder_worker(png_encoder *encoder) : encoder(encoder) {}
+
+    virtual void operator()(size_t &band_num)
+    {
+        png_band &band = encoder->bands[band_num];
+        if (encoder->deflating) {
+            encoder->deflate_rows(band, band_num == encoder->bands.size() - 1);
+        } else {
+            encoder->filter_rows(band);
+        }
+    }
+};
+
+static inline uint8_t png_paeth(int a, int b, int c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (uint8_t)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+static size_t png_filter(int type, const uint8_t *row, const uint8_t *prev,
+    size_t bpp, size_t n, uint8_t *out)
+{
+    size_t sum = 0, i = 0;
+    uint8_t *d = out + 1;
+    out[0] = (uint8_t)type;
+    if (!prev && (type == 2 || type == 4)) {
+        type = type == 2 ? 0 : 1; /* up is none and paeth is sub */
+    }
+    switch (type) {
+    case 0:
+        memcpy(d, row, n);
+        break;
+    case 1:
+        for (; i < bpp; i++) d[i] = row[i];
+        for (; i < n; i++) d[i] = (uint8_t)(row[i] - row[i - bpp]);
+        break;
+    case 2:
+        for (; i < n; i++) d[i] = (uint8_t)(row[i] - prev[i]);
+        break;
+    case 3:
+        if (prev) {
+            for (; i < bpp; i++) d[i] = (uint8_t)(row[i] - (prev[i] >> 1));
+            for (; i < n; i++) {
+                d[i] = (uint8_t)(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+            }
+        } else {
+            for (; i < bpp; i++) d[i] = row[i];
+            for (; i < n; i++) d[i] = (uint8_t)(row[i] - (row[i - bpp] >> 1));
+        }
+        break;
+    case 4:
+        for (; i < bpp; i++) d[i] = (uint8_t)(row[i] - prev[i]);
+        for (; i < n; i++) {
+            d[i] = (uint8_t)(row[i] -
+                png_paeth(row[i - bpp], prev[i], prev[i - bpp]));
+        }
+        break;
+    }
+    for (i = 0; i < n; i++) {
+        sum += d[i] < 128 ? d[i] : 256 - d[i];
+    }
+    return sum;
+}
+
+void png_encoder::filter_rows(png_band &band)
+{
+    std::vector<uint8_t> trial(row_stride + 1);
+    for (size_t y = band.y1; y < band.y2; y++) {
+        const uint8_t *row = pixels + y * row_stride;
+        const uint8_t *prev = y > 0 ? row - row_stride : nullptr;
+        uint8_t *out = &filtered[y * (row_stride + 1)];
+        size_t best = SIZE_MAX;
+        for (int type = 0; type < 5; type++) {
+            int flag = image_png_filter_none << type;
+            if (!(filters & flag)) continue;
+            if (filters == flag) {
+                png_filter(type, row, prev, bpp, row_stride, out);
+                break;
+            }
+            size_t sum = png_filter(type, row, prev, bpp, row_stride,
+                trial.data());
+            if (sum < best) {
+                best = sum;
+                std::copy(trial.begin(), trial.end(), out);
+            }
+        }
+    }
+}
+
+void png_encoder::deflate_rows(png_band &band, bool last)
+{
+    size_t start = band.y1 * (row_stride + 1);
+    size_t len = (band.y2 - band.y1) * (row_stride + 1);
+    size_t dict = std::min(start, png_window_size);
+    z_stream z = {};
+
+    band.ok = false;
+    band.adler = adler32(1, &filtered[start], (uInt)len);
+    if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+        return;
+    }
+    if (dict > 0) {
+        deflateSetDictionary(&z, &filtered[start - dict], (uInt)dict);
+    }
+    band.out.resize(deflateBound(&z, (uLong)len) + 16);
+    z.next_in = &filtered[start];
+    z.avail_in = (uInt)len;
+    z.next_out = band.out.data();
+    z.avail_out = (uInt)band.out.size();
+    int ret = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+    band.ok = last ? ret == Z_STREAM_END : ret == Z_OK && z.avail_out > 0;
+    band.out.resize(z.total_out);
+    deflateEnd(&z);
+}
+
+static void png_write_chunk(FILE *out, const char *type,
+    const uint8_t *d1, size_t l1, const uint8_t *d2 = nullptr, size_t l2 = 0,
+    const uint8_t *d3 = nullptr, size_t l3 = 0)
+{
+    uint32_t len = (uint32_t)(l1 + l2 + l3);
+    uint8_t hdr[8] = {
+        (uint8_t)(len >> 24), (uint8_t)(len >> 16), (uint8_t)(len >> 8),
+        (uint8_t)len, (uint8_t)type[0], (uint8_t)type[1], (uint8_t)type[2],
+        (uint8_t)type[3]
+    };
+    uLong crc = crc32(0, hdr + 4, 4);
+    if (l1) crc = crc32(crc, d1, (uInt)l1);
+    if (l2) crc = crc32(crc, d2, (uInt)l2);
+    if (l3) crc = crc32(crc, d3, (uInt)l3);
+    uint8_t trl[4] = {
+        (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8),
+        (uint8_t)crc
+    };
+    fwrite(hdr, 1, 8, out);
+    if (l1) fwrite(d1, 1, l1, out);
+    if (l2) fwrite(d2, 1, l2, out);
+    if (l3) fwrite(d3, 1, l3, out);
+    fwrite(trl, 1, 4, out);
+}
+
+bool image_io_png::save_parallel(image* image, std::string filename,
+    const image_png_options &opts)
+{
+    static const uint8_t PNG_SIGNATURE[] = {
+        0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A
+    };
+
+    uint8_t color_type;
+    switch (image->getpixel_format()) {
+        case pixel_format_alpha: color_type = PNG_COLOR_TYPE_GRAY; break;
+        case pixel_format_luminance: color_type = PNG_COLOR_TYPE_GRAY; break;
+        case pixel_format_rgb: color_type = PNG_COLOR_TYPE_RGB; break;
+        case pixel_format_rgba: color_type = PNG_COLOR_TYPE_RGB_ALPHA; break;
+        default:
+            Debug("%s pixel format not supported\n", __func__);
+            return false;
+    }
+
+    png_encoder enc;
+    enc.width = image->getWidth();
+    enc.height = image->getHeight();
+    enc.bpp = image->getBytesPerPixel();
+    enc.row_stride = (size_t)enc.width * enc.bpp;
+    enc.pixels = image->getData();
+    enc.level = opts.compression_level;
+    enc.strategy = opts.compression_strategy;
+    enc.filters = opts.filters != image_png_filter_default ?
+        opts.filters : image_png_filter_all;
+    enc.filtered.resize((enc.row_stride + 1) * enc.height);
+    enc.deflating = false;
+    if (enc.height == 0 || enc.width == 0) {
+        return false;
+    }
+
+    /* at least a window of data per band, and a few bands per thread */
+    size_t num_threads = opts.num_threads;
+    size_t band_rows = std::max<size_t>((png_window_size + enc.row_stride) /
+        (enc.row_stride + 1), enc.height / (std::max<size_t>(num_threads, 1) * 4));
+    for (size_t y = 0; y < enc.height; y += band_rows) {
+        enc.bands.push_back(png_band{y, std::min<size_t>(y + band_rows,
+            enc.height), {}, 1, false});
+    }
+
+    pool_executor<size_t,png_encoder_worker> pool(num_threads,
+        enc.bands.size(), [&enc](){ return new png_encoder_worker(&enc); });
+    png_encoder_worker worker(&enc);
+    for (bool deflating : { false, true }) {
+        enc.deflating = deflating;
+        for (size_t i = 0; i < enc.bands.size(); i++) {
+            if (num_threads > 0) {
+                pool.enqueue(i);
+            } else {
+                worker(i);
+            }
+        }
+        pool.run();
+    }
+
+    /* zlib header with the level hint, and combined adler32 trailer */
+    int flevel = enc.level < 0 || enc.level == 6 ? 2 :
+        enc.level < 2 ? 0 : enc.level < 6 ? 1 : 3;
+    uint8_t zhdr[2] = { 0x78, (uint8_t)(flevel << 6) };
+    zhdr[1] += (uint8_t)(31 - ((zhdr[0] << 8) | zhdr[1]) % 31);
+    uLong adler = 1;
+    for (auto &band : enc.bands) {
+        if (!band.ok) {
+            Debug("%s: error compressing png band\n", __func__);
+            return false;
+        }
+        adler = adler32_combine(adler, band.adler,
+            (z_off_t)((band.y2 - band.y1) * (enc.row_stride + 1)));
+    }
+    uint8_t ztrl[4] = {
+        (uint8_t)(adler >> 24), (uint8_t)(adler >> 16), (uint8_t)(adler >> 8),
+        (uint8_t)adler
+    };
+
+    FILE *outfile;
+    if ((outfile = fopen(filename.c_str(), "wb")) == NULL) {
+        Debug("%s: error opening file %s\n", __func__, filename.c_str());
+        return false;
+    }
+    uint8_t ihdr[13] = {
+        (uint8_t)(enc.width >> 24), (uint8_t)(enc.width >> 16),
+        (uint8_t)(enc.width >> 8), (uint8_t)enc.width,
+        (uint8_t)(enc.height >> 24), (uint8_t)(enc.height >> 16),
+        (uint8_t)(enc.height >> 8), (uint8_t)enc.height,
+        8, color_type, 0, 0, 0
+    };
+    fwrite(PNG_SIGNATURE, 1, sizeof(PNG_SIGNATURE), outfile);
+    png_write_chunk(outfile, "IHDR", ihdr, sizeof(ihdr));
+    for (size_t i = 0; i < enc.bands.size(); i++) {
+        bool first = i == 0, last = i == enc.bands.size() - 1;
+        png_write_chunk(outfile, "IDAT", zhdr, first ? 2 : 0,
+            enc.bands[i].out.data(), enc.bands[i].out.size(),
+            ztrl, last ? 4 : 0);
+    }
+    png_write_chunk(outfile, "IEND", nullptr, 0);
+    bool ok = ferror(outfile) == 0;
+    fclose(outfile);
+
+    return ok;
+}
+
+/*
+ * range coded atlas images
+ *
+ * the stream is an 8 byte magic, 32-bit width, height, depth, payload
+ * length and adler32 of the fields before it and the payload, then the
+ * payload: the range coded residuals of each channel of each pixel in
+ * row order.
+ * the model is shared by the encoder and decoder: the prediction is the
+ * LOCO-I median of the west, north and north-west neighbours, and the
+ * context is the channel and a bucket of the local gradient, with flat
+ * regions split into empty and filled. out of image neighbours are zero.
+ */
+
+static const uint8_t image_rca_magic[] = {
+    0x89, 0x52, 0x43, 0x41, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+static const size_t image_rca_header = sizeof(image_rca_magic) + 20;
+static const size_t image_rca_buckets = 9;
+
+typedef RangeCoder32 image_rca_coder;
+
+/*
+ * upper bound of the symbols a payload can hold. adaptive frequencies
+ * stay below MaxRange and every symbol keeps a frequency of at least one,
+ * so each symbol costs more than 255/MaxRange bits.
+ */
+static uint64_t image_rca_max_symbols(size_t length)
+{
+    return (uint64_t)length * 8 * image_rca_coder::MaxRange / 255;
+}
+
+struct image_rca_model
+{
+    std::vector<FreqTable> tables;
+    std::vector<size_t> counts;
+
+    image_rca_model(size_t depth) :
+        tables(depth * image_rca_buckets, FreqTable(256)),
+        counts(depth * image_rca_buckets, 0) {}
+};
+
+static inline int image_rca_predict(int w, int n, int nw)
+{
+    int lo = std::min(w, n), hi = std::max(w, n);
+    return nw >= hi ? lo : nw <= lo ? hi : w + n - nw;
+}
+
+static inline size_t image_rca_bucket(int w, int n, int nw, int ne)
+{
+    int a = abs(w - nw) + abs(n - nw) + abs(ne - n);
+    if (a == 0) return w == 0 ? 0 : 1;
+    return a < 3 ? 2 : a < 8 ? 3 : a < 16 ? 4 : a < 32 ? 5 :
+           a < 64 ? 6 : a < 128 ? 7 : 8;
+}
+
+static pixel_format image_rca_format(uint depth)
+{
+    switch (depth) {
+    case 1: return pixel_format_alpha;
+    case 3: return pixel_format_rgb;
+    case 4: return pixel_format_rgba;
+    default: return pixel_format_none;
+    }
+}
+
+/*
+ * code one row. the row and the row above are in the stored format, and
+ * the row above is all zero for the first row. Coder is the encoder when
+ * encode is true, otherwise symbols are decoded into row.
+ */
+template <bool encode>
+static void image_rca_row(image_rca_coder &c, image_rca_model &m,
+    uint8_t *row, const uint8_t *prev, uint width, uint depth)
+{
+    for (uint x = 0; x < width; x++) {
+        for (uint ch = 0; ch < depth; ch++) {
+            size_t i = (size_t)x * depth + ch;
+            int w = x > 0 ? row[i - depth] : 0;
+            int n = prev[i];
+            int nw = x > 0 ? prev[i - depth] : 0;
+            int ne = x + 1 < width ? prev[i + depth] : n;
+            size_t ctx = ch * image_rca_buckets + image_rca_bucket(w, n, nw, ne);
+            FreqTable &t = m.tables[ctx];
+            int pred = image_rca_predict(w, n, nw);
+            size_t sym;
+            if (encode) {
+                sym = (uint8_t)(row[i] - pred);
+                c.EncodeRange(sym ? (uint32_t)t.CumFreq[sym-1] : 0,
+                    (uint32_t)t.CumFreq[sym], (uint32_t)t.CumFreq.back());
+            } else {
+                size_t count = c.GetCurrentCount((uint32_t)t.CumFreq.back());
+                auto si = std::upper_bound(t.CumFreq.begin(), t.CumFreq.end(),
+                    count);
+                sym = std::min<size_t>(si - t.CumFreq.begin(), 255);
+                c.RemoveRange(sym ? (uint32_t)t.CumFreq[sym-1] : 0,
+                    (uint32_t)t.CumFreq[sym], (uint32_t)t.CumFreq.back());
+                row[i] = (uint8_t)(sym + pred);
+            }
+            t.Update(FreqModeDynPerInterval, sym, c.MaxRange, ++m.counts[ctx]);
+        }
+    }
+}
+
+void image_io_rca::encode(std::vector<uint8_t> &out, image* image)
+{
+    uint width = image->getWidth(), height = image->getHeight();
+    uint depth = image->getBytesPerPixel();
+    size_t row_stride = (size_t)width * depth;
+
+    vector_writer pw;
+    bitcode_writer pb(&pw);
+    image_rca_coder c(&pb);
+    image_rca_model m(depth);
+    std::vector<uint8_t> zero(row_stride);
+    for (uint y = 0; y < height; y++) {
+        uint8_t *row = image->getData() + y * row_stride;
+        image_rca_row<true>(c, m, row, y > 0 ? row - row_stride :
+            zero.data(), width, depth);
+    }
+    c.Flush();
+    pb.flush();
+    std::vector<uint8_t> &payload = pw.buffer;
+
+    vector_writer vw;
+    bitcode_writer bw(&vw);
+    for (size_t i = 0; i < sizeof(image_rca_magic); i++) {
+        bw.write_fixed(image_rca_magic[i], 8);
+    }
+    bw.write_fixed(width, 32);
+    bw.write_fixed(height, 32);
+    bw.write_fixed(depth, 32);
+    bw.write_fixed(payload.size(), 32);
+    bw.flush();
+    uLong sum = adler32(1, &vw.buffer[sizeof(image_rca_magic)], 16);
+    sum = adler32(sum, payload.data(), (uInt)payload.size());
+    bw.write_fixed(sum, 32);
+    bw.flush();
+
+    out.swap(vw.buffer);
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+bool image_io_rca::decode(const std::vector<uint8_t> &in, pixel_format format,
+    image_dest *dest)
+{
+    vector_reader vr(in);
+    bitcode_reader br(&vr);
+
+    if (in.size() < image_rca_header) {
+        Debug("%s: short read\n", __func__);
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(image_rca_magic); i++) {
+        if (br.read_fixed(8) != image_rca_magic[i]) {
+            Debug("%s: bad magic\n", __func__);
+            return false;
+        }
+    }
+    uint width = (uint)br.read_fixed(32);
+    uint height = (uint)br.read_fixed(32);
+    uint depth = (uint)br.read_fixed(32);
+    size_t length = (size_t)br.read_fixed(32);
+    uLong sum = (uLong)br.read_fixed(32);
+    pixel_format stored = image_rca_format(depth);
+    if (stored == pixel_format_none || width == 0 || height == 0) {
+        Debug("%s: bad header %ux%ux%u\n", __func__, width, height, depth);
+        return false;
+    }
+    if (length != in.size() - image_rca_header) {
+        Debug("%s: bad payload length %zu\n", __func__, length);
+        return false;
+    }
+    if (sum != adler32(adler32(1, &in[sizeof(image_rca_magic)], 16),
+            &in[image_rca_header], (uInt)length)) {
+        Debug("%s: bad checksum\n", __func__);
+        return false;
+    }
+    if ((uint64_t)width * height * depth > image_rca_max_symbols(length)) {
+        Debug("%s: payload too short for %ux%ux%u\n", __func__,
+            width, height, depth);
+        return false;
+    }
+
+    /* default to the stored format */
+    if (format == pixel_format_none) {
+        format = stored;
+    }
+
+    size_t stride = (size_t)width * image::getBytesPerPixel(format);
+    uint8_t *pixels = dest->get(width, height, format, stride);
+    if (!pixels) {
+        return false;
+    }
+
+    /* decode directly into the destination when it is in the stored
+     * format, otherwise into alternating scratch rows that are converted */
+    size_t row_stride = (size_t)width * depth;
+    bool direct = format == stored ||
+        (format == pixel_format_luminance && stored == pixel_format_alpha);
+    std::vector<uint8_t> zero(row_stride), scratch(direct ? 0 : row_stride * 2);
+    image_rca_coder c(&br);
+    image_rca_model m(depth);
+    c.Prime();
+    for (uint y = 0; y < height && !br.eof; y++) {
+        uint8_t *row = direct ? pixels + y * stride :
+            &scratch[(y & 1) * row_stride];
+        const uint8_t *prev = y == 0 ? zero.data() : direct ?
+            row - stride : &scratch[((y - 1) & 1) * row_stride];
+        image_rca_row<false>(c, m, row, prev, width, depth);
+        if (!direct) {
+            image::convertPixels(stored, row, format, pixels + y * stride, width);
+        }
+    }
+    if (br.eof) {
+        Debug("%s: read past end of payload\n", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+bool image_io_rca::load(file_ptr rsrc, pixel_format format, image_dest *dest)
+{
+    std::vector<uint8_t> buf;
+    ssize_t len = rsrc->getLength();
+    if (len <= 0) {
+        Debug("%s: error reading %s\n", __func__, rsrc->getPath().c_str());
+        return false;
+    }
+    buf.resize(len);
+    if (rsrc->read(buf.data(), buf.size()) != len) {
+        Debug("%s: error reading %s\n", __func__, rsrc->getPath().c_str());
+        rsrc->close();
+        return false;
+    }
+    rsrc->close();
+    return decode(buf, format, dest);
+}
+
+image* image_io_rca::load(file_ptr rsrc, pixel_format optformat)
+{
+    image_dest_image dest;
+    if (!load(rsrc, optformat, &dest)) {
+        delete dest.img;
+        return NULL;
+    }
+    dest.img->rsrc = rsrc;
+    return dest.img;
+}
+
+void image_io_rca::save(image* image, std::string filename)
+{
+    FILE *outfile;
+    std::vector<uint8_t> buf;
+
+    if (image_rca_format(image->getBytesPerPixel()) == pixel_format_none) {
+        Debug("%s pixel format not supported\n", __func__);
+        return;
+    }
+    encode(buf, image);
+    if ((outfile = fopen(filename.c_str(), "wb")) == NULL) {
+        Debug("%s: error opening file %s\n", __func__, filename.c_str());
+        return;
+    }
+    fwrite(buf.data(), 1, buf.size(), outfile);
+    fclose(outfile);
 }
@@ -13,6 +13,8 @@ typedef std::shared_ptr<file> file_ptr;
 
 struct image_io;
 struct image_io_png;
+struct image_io_rca;
+struct image_dest;
 
 /* pixel_format */
 
@@ -37,6 +39,7 @@ public:
     static const char* formatname[];
 
     static image_io_png PNG;
+    static image_io_rca RCA;
 
     static int iid_seq;
 
@@ -79,6 +82,8 @@ public:
         
     void create(pixel_format format, uint width, uint height);
     void convertFormat(pixel_format newformat);
+    static void convertPixels(pixel_format srcformat, const uint8_t *src,
+        pixel_format destformat, uint8_t *dest, size_t count);
     
     static image_io* getImageIO(unsigned char magic[8]);
     static image_io* getImageIO(std::string filename);
@@ -117,20 +122,120 @@ inline image::image(file_ptr rsrc, uint width, uint height,
     }
 }
 
+/*
+ * image_dest
+ *
+ * caller memory for streaming decode. get is called once the image size
+ * is known and returns the destination of the first row, with rows stride
+ * bytes apart, or nullptr to abort the load. rows are then decoded in the
+ * requested format directly into the destination, so that an image can
+ * be loaded into an existing atlas or a mapped upload buffer.
+ */
+
+struct image_dest
+{
+    virtual ~image_dest() {}
+    virtual uint8_t* get(uint width, uint height, pixel_format format,
+        size_t &stride) = 0;
+};
+
 /* image_io */
 
 struct image_io
 {
 public:
     virtual image* load(file_ptr rsrc, pixel_format optformat) = 0;
+    virtual bool load(file_ptr rsrc, pixel_format format, image_dest *dest) = 0;
     virtual void save(image* image, std::string filename) = 0;
     
     virtual ~image_io() {}
 };
 
+/*
+ * png compression options
+ *
+ * filter values are the libpng PNG_FILTER_* flags and strategy values are
+ * the zlib Z_* strategies. with several filters enabled, each row uses
+ * the filter with the smallest sum of absolute differences.
+ */
+
+enum image_png_filter
+{
+    image_png_filter_default = 0x00,
+    image_png_filter_none    = 0x08,
+    image_png_filter_sub     = 0x10,
+    image_png_filter_up      = 0x20,
+    image_png_filter_avg     = 0x40,
+    image_png_filter_paeth   = 0x80,
+    image_png_filter_all     = 0xf8,
+};
+
+enum image_png_strategy
+{
+    image_png_strategy_default  = 0,
+    image_png_strategy_filtered = 1,
+    image_png_strategy_huffman  = 2,
+    image_png_strategy_rle      = 3,
+};
+
+struct image_png_options
+{
+    int compression_level;    /* zlib level 0-9, -1 for the zlib default */
+    int compression_strategy; /* image_png_strategy */
+    int filters;              /* image_png_filter flags */
+    size_t num_threads;       /* deflate bands of rows in parallel if > 0 */
+
+    image_png_options();
+};
+
+inline image_png_options::image_png_options() :
+    compression_level(-1), compression_strategy(image_png_strategy_default),
+    filters(image_png_filter_default), num_threads(0) {}
+
 struct image_io_png : public image_io
 {
 public:
     image* load(file_ptr rsrc, pixel_format optformat);
+
+    /* save with the default options, or with the given options */
     void save(image* image, std::string filename);
+    bool save(image* image, std::string filename,
+        const image_png_options &opts);
+
+    /*
+     * parallel encoder: filters and deflates bands of rows concurrently,
+     * each band primed with the last 32KiB of the previous band, then
+     * stitches the bands into one zlib stream split across IDAT chunks.
+     */
+    bool save_parallel(image* image, std::string filename,
+        const image_png_options &opts);
+
+    /* streaming decode into caller memory, returns false on error */
+    bool load(file_ptr rsrc, pixel_format format, image_dest *dest);
+    bool load(file_ptr rsrc, pixel_format format, uint8_t *pixels,
+        uint width, uint height, size_t stride);
+};
+
+/*
+ * image_io_rca
+ *
+ * range coded atlas images, using the range coder and adaptive frequency
+ * tables in bitcode.h. each channel is predicted from its west, north and
+ * north-west neighbours (LOCO-I median edge detector) and the residual is
+ * coded with an order-1 context chosen from the local gradient, so that
+ * the empty space and flat interiors of coverage atlases cost a fraction
+ * of a bit per pixel. supports alpha, luminance, rgb and rgba images.
+ */
+
+struct image_io_rca : public image_io
+{
+public:
+    image* load(file_ptr rsrc, pixel_format optformat);
+    bool load(file_ptr rsrc, pixel_format format, image_dest *dest);
+    void save(image* image, std::string filename);
+
+    /* in memory codec, decode returns false on a malformed stream */
+    static void encode(std::vector<uint8_t> &out, image* image);
+    static bool decode(const std::vector<uint8_t> &in, pixel_format format,
+        image_dest *dest);
 };
@@ -32,6 +32,7 @@
 #include "draw.h"
 #include "font.h"
 #include "glyph.h"
+#include "worker.h"
 #include "multi.h"
 #include "logger.h"
 
@@ -184,4 +185,95 @@ void glyph_renderer_multi::shutdown()
         workers[i]->thread.join();
     }
     workers.clear();
-}
\ No newline at end of file
+}
+/*
+ * text_renderer_worker
+ */
+
+text_renderer_worker::text_renderer_worker(text_renderer_mt *master) :
+    master(master), renderer(master->manager, true) {}
+
+void text_renderer_worker::operator()(size_t &chunk_num)
+{
+    draw_list &chunk = *master->chunks[chunk_num];
+
+    if (master->merging) {
+        uint *b = &master->bases[chunk_num * 3];
+        draw_list_merge_elements(*master->batch, chunk, b[0], b[1], b[2]);
+        return;
+    }
+
+    size_t begin = chunk_num * master->chunk_size;
+    size_t end = std::min(begin + master->chunk_size, master->segments->size());
+    for (size_t i = begin; i < end; i++) {
+        renderer.render(chunk, (*master->shapes)[i], (*master->segments)[i],
+            master->m);
+    }
+}
+
+/*
+ * text_renderer_mt
+ */
+
+text_renderer_mt::text_renderer_mt(font_manager_ft* manager,
+    size_t num_threads, size_t chunk_size) :
+    manager(manager), chunk_size(chunk_size), arena(), chunks(), bases(),
+    batch(nullptr), merging(false), segments(nullptr), shapes(nullptr), m(1),
+    pool()
+{
+    manager->set_multithreading(true);
+    pool = std::make_unique<pool_executor<size_t,text_renderer_worker>>
+        (std::max(num_threads, (size_t)1), 1024, [this](){
+            return new text_renderer_worker(this);
+        });
+}
+
+void text_renderer_mt::dispatch(size_t num_chunks)
+{
+    for (size_t i = 0; i < num_chunks; i++) {
+        if (!pool->enqueue(i)) {
+            pool->run();
+            pool->enqueue(i);
+        }
+    }
+    pool->run();
+}
+
+void text_renderer_mt::render(draw_list &batch,
+    std::vector<std::vector<glyph_shape>> &shapes,
+    std::vector<text_segment> &segments, glm::mat3 m)
+{
+    size_t num_chunks = (segments.size() + chunk_size - 1) / chunk_size;
+
+    this->batch = &batch;
+    this->segments = &segments;
+    this->shapes = &shapes;
+    this->m = m;
+
+    /* render chunks into sub-lists */
+    arena.reset();
+    chunks.clear();
+    for (size_t i = 0; i < num_chunks; i++) {
+        chunks.push_back(arena.acquire(batch.flags));
+    }
+    merging = false;
+    dispatch(num_chunks);
+
+    /* merge commands and images in segment order, then copy elements */
+    uint vbase = (uint)batch.vertices.size();
+    uint ibase = (uint)batch.indices.size();
+    uint nbase = (uint)batch.instances.size();
+    bases.clear();
+    for (auto chunk : chunks) {
+        bases.insert(bases.end(), { vbase, ibase, nbase });
+        draw_list_merge_commands(batch, *chunk, ibase, nbase);
+        vbase += (uint)chunk->vertices.size();
+        ibase += (uint)chunk->indices.size();
+        nbase += (uint)chunk->instances.size();
+    }
+    batch.vertices.resize(vbase);
+    batch.indices.resize(ibase);
+    batch.instances.resize(nbase);
+    merging = true;
+    dispatch(num_chunks);
+}
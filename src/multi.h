@@ -128,3 +128,58 @@ struct glyph_renderer_multi
     void run();
     void shutdown();
 };
+
+/*
+ * text_renderer_worker
+ */
+
+struct text_renderer_mt;
+
+struct text_renderer_worker : pool_worker<size_t>
+{
+    text_renderer_mt *master;
+    text_renderer_ft renderer;
+
+    text_renderer_worker(text_renderer_mt *master);
+
+    virtual void operator()(size_t &chunk_num);
+};
+
+/*
+ * text_renderer_mt
+ *
+ * renders a list of shaped text segments into one draw list using a
+ * pool of threads. segments are split into chunks of chunk_size that
+ * are rendered into sub-lists from a frame arena, then the sub-lists
+ * are merged in segment order, copying the elements of each sub-list
+ * on the pool into the output arrays. chunk boundaries do not depend on the
+ * number of threads, and merging joins commands across the boundaries,
+ * so the merged list has the same commands, vertices and indices as a
+ * sequential render. glyphs missing from the atlas are rendered under
+ * the manager lock, so their atlas positions depend on thread timing.
+ */
+
+struct text_renderer_mt
+{
+    static const size_t default_chunk_size = 64;
+
+    font_manager_ft*                  manager;
+    size_t                            chunk_size;
+    draw_list_arena                   arena;
+    std::vector<draw_list*>           chunks;
+    std::vector<uint>                 bases;  /* vertex, index, instance */
+    draw_list*                        batch;
+    bool                              merging;
+    std::vector<text_segment>*        segments;
+    std::vector<std::vector<glyph_shape>>* shapes;
+    glm::mat3                         m;
+    std::unique_ptr<pool_executor<size_t,text_renderer_worker>> pool;
+
+    text_renderer_mt(font_manager_ft* manager, size_t num_threads,
+        size_t chunk_size = default_chunk_size);
+
+    void dispatch(size_t num_chunks);
+    void render(draw_list &batch,
+        std::vector<std::vector<glyph_shape>> &shapes,
+        std::vector<text_segment> &segments, glm::mat3 m = glm::mat3(1));
+};
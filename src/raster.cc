@@ -0,0 +1,500 @@
+// See LICENSE for license details.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <cfloat>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "glm/glm.hpp"
+
+#include "binpack.h"
+#include "image.h"
+#include "draw.h"
+#include "worker.h"
+#include "raster.h"
+#include "logger.h"
+
+/*
+ * raster texture
+ */
+
+static glm::vec4 unpack_color(uint32_t c)
+{
+    return glm::vec4((c & 0xff) / 255.0f, ((c >> 8) & 0xff) / 255.0f,
+        ((c >> 16) & 0xff) / 255.0f, ((c >> 24) & 0xff) / 255.0f);
+}
+
+glm::vec4 raster_texture::fetch(int x, int y) const
+{
+    x = std::max(0, std::min(width - 1, x));
+    y = std::max(0, std::min(height - 1, y));
+    const uint8_t *p = &pixels[((size_t)y * width + x) * depth];
+    switch (depth) {
+    case 1: return glm::vec4(1.0f, 1.0f, 1.0f, p[0] / 255.0f);
+    case 4: return glm::vec4(p[0] / 255.0f, p[1] / 255.0f,
+                             p[2] / 255.0f, p[3] / 255.0f);
+    }
+    return glm::vec4(1.0f);
+}
+
+glm::vec4 raster_texture::sample(glm::vec2 uv) const
+{
+    if (flags & filter_nearest) {
+        return fetch((int)floorf(uv.x * width), (int)floorf(uv.y * height));
+    }
+
+    /* bilinear filter with texel centers at half-pixel offsets */
+    float fx = uv.x * width - 0.5f, fy = uv.y * height - 0.5f;
+    float x0 = floorf(fx), y0 = floorf(fy);
+    float tx = fx - x0, ty = fy - y0;
+    int ix = (int)x0, iy = (int)y0;
+    glm::vec4 c00 = fetch(ix, iy), c10 = fetch(ix + 1, iy);
+    glm::vec4 c01 = fetch(ix, iy + 1), c11 = fetch(ix + 1, iy + 1);
+    return (c00 * (1.0f - tx) + c10 * tx) * (1.0f - ty) +
+           (c01 * (1.0f - tx) + c11 * tx) * ty;
+}
+
+/*
+ * raster worker
+ */
+
+void raster_worker::operator()(size_t &tile_num)
+{
+    rasterizer->render_tile(rasterizer->tiles[tile_num]);
+}
+
+/*
+ * draw rasterizer
+ */
+
+draw_rasterizer::draw_rasterizer(int width, int height, size_t num_threads) :
+    width(width), height(height),
+    tiles_x((width + tile_size - 1) / tile_size),
+    tiles_y((height + tile_size - 1) / tile_size),
+    gamma(1.0f), clear_color(0xffffffff),
+    target(image::createBitmap(width, height, pixel_format_rgba)),
+    textures(), shaders(), tiles(), prims(), batch(nullptr), pool()
+{
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x = tx * tile_size, y = ty * tile_size;
+            tiles.push_back({x, y, std::min(tile_size, width - x),
+                std::min(tile_size, height - y), {}});
+        }
+    }
+    if (num_threads > 0) {
+        pool = std::make_unique<pool_executor<size_t,raster_worker>>
+            (num_threads, tiles.size(), [this](){
+                return new raster_worker(this);
+            });
+    }
+}
+
+image_ptr draw_rasterizer::get_image()
+{
+    return target;
+}
+
+void draw_rasterizer::set_clear_color(uint32_t color)
+{
+    clear_color = color;
+}
+
+void draw_rasterizer::set_shader(uint shader, raster_shader *s)
+{
+    if (s) {
+        shaders[shader] = s;
+    } else {
+        shaders.erase(shader);
+    }
+}
+
+void draw_rasterizer::update_images(draw_list &batch)
+{
+    for (auto &img : batch.images) {
+        int w = img.size[0], h = img.size[1], d = img.size[2];
+        auto ti = textures.find(img.iid);
+        bool create = ti == textures.end() || ti->second.width != w ||
+            ti->second.height != h || ti->second.depth != d;
+
+        if (create) {
+            raster_texture &tex = textures[img.iid];
+            tex.iid = img.iid;
+            tex.width = w;
+            tex.height = h;
+            tex.depth = d;
+            tex.flags = img.flags;
+            tex.pixels.assign(img.pixels, img.pixels + (size_t)w * h * d);
+            continue;
+        }
+
+        /* skip update if the modified rectangle is empty */
+        raster_texture &tex = ti->second;
+        int x1 = std::max(0, img.modrect[0]);
+        int y1 = std::max(0, img.modrect[1]);
+        int x2 = std::min(w, img.modrect[0] + img.modrect[2]);
+        int y2 = std::min(h, img.modrect[1] + img.modrect[3]);
+        tex.flags = img.flags;
+        if (x2 <= x1 || y2 <= y1) continue;
+
+        /* copy each dirty rectangle, or the modified rectangle */
+        for (auto &r : draw_image_rects(img)) {
+            int u1 = std::max(x1, r.a.x), v1 = std::max(y1, r.a.y);
+            int u2 = std::min(x2, r.b.x), v2 = std::min(y2, r.b.y);
+            for (int y = v1; y < v2; y++) {
+                size_t o = ((size_t)y * w + u1) * d;
+                memcpy(&tex.pixels[o], &img.pixels[o], (size_t)(u2 - u1) * d);
+            }
+        }
+    }
+}
+
+void draw_rasterizer::bin_prims(draw_list &batch)
+{
+    prims.clear();
+    for (auto &tile : tiles) {
+        tile.prims.clear();
+    }
+
+    for (uint c = 0; c < (uint)batch.cmds.size(); c++) {
+        draw_cmd &cmd = batch.cmds[c];
+        uint stride = cmd.mode == mode_lines ? 2 :
+                      cmd.mode == mode_instances ? 1 : 3;
+
+        /* viewport is a clip rectangle, zero size means the whole target */
+        int vx1 = 0, vy1 = 0, vx2 = width, vy2 = height;
+        if (cmd.viewport[2] > 0 && cmd.viewport[3] > 0) {
+            vx1 = std::max(vx1, (int)cmd.viewport[0]);
+            vy1 = std::max(vy1, (int)cmd.viewport[1]);
+            vx2 = std::min(vx2, (int)(cmd.viewport[0] + cmd.viewport[2]));
+            vy2 = std::min(vy2, (int)(cmd.viewport[1] + cmd.viewport[3]));
+        }
+
+        for (uint i = 0; i + stride <= cmd.count; i += stride) {
+            raster_prim prim{c, cmd.mode, { 0, 0, 0 }, INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+            float minx = FLT_MAX, miny = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX;
+            if (cmd.mode == mode_instances) {
+                draw_instance &r = batch.instances[cmd.offset + i];
+                prim.idx[0] = cmd.offset + i;
+                minx = std::min(r.rect[0], r.rect[2]);
+                miny = std::min(r.rect[1], r.rect[3]);
+                maxx = std::max(r.rect[0], r.rect[2]);
+                maxy = std::max(r.rect[1], r.rect[3]);
+            } else {
+                for (uint j = 0; j < stride; j++) {
+                    uint idx = batch.indices[cmd.offset + i + j];
+                    draw_vertex &v = batch.vertices[idx];
+                    prim.idx[j] = idx;
+                    minx = std::min(minx, v.pos[0]);
+                    miny = std::min(miny, v.pos[1]);
+                    maxx = std::max(maxx, v.pos[0]);
+                    maxy = std::max(maxy, v.pos[1]);
+                }
+            }
+            prim.x0 = std::max(vx1, (int)floorf(minx));
+            prim.y0 = std::max(vy1, (int)floorf(miny));
+            prim.x1 = std::min(vx2, (int)ceilf(maxx) + 1);
+            prim.y1 = std::min(vy2, (int)ceilf(maxy) + 1);
+            if (prim.x1 <= prim.x0 || prim.y1 <= prim.y0) continue;
+
+            uint prim_num = (uint)prims.size();
+            prims.push_back(prim);
+
+            int tx1 = prim.x0 / tile_size, tx2 = (prim.x1 - 1) / tile_size;
+            int ty1 = prim.y0 / tile_size, ty2 = (prim.y1 - 1) / tile_size;
+            for (int ty = ty1; ty <= ty2; ty++) {
+                for (int tx = tx1; tx <= tx2; tx++) {
+                    tiles[ty * tiles_x + tx].prims.push_back(prim_num);
+                }
+            }
+        }
+    }
+}
+
+void draw_rasterizer::render(draw_list &batch)
+{
+    this->batch = &batch;
+
+    update_images(batch);
+    bin_prims(batch);
+
+    if (pool) {
+        for (size_t i = 0; i < tiles.size(); i++) {
+            pool->enqueue(i);
+        }
+        pool->run();
+    } else {
+        for (auto &tile : tiles) {
+            render_tile(tile);
+        }
+    }
+
+    this->batch = nullptr;
+}
+
+void draw_rasterizer::render_tile(raster_tile &tile)
+{
+    uint32_t *pixels = (uint32_t*)target->getData();
+    for (int y = tile.y; y < tile.y + tile.h; y++) {
+        std::fill(pixels + (size_t)y * width + tile.x,
+            pixels + (size_t)y * width + tile.x + tile.w, clear_color);
+    }
+    for (auto prim_num : tile.prims) {
+        raster_prim &prim = prims[prim_num];
+        switch (prim.mode) {
+        case mode_triangles: render_triangle(tile, prim); break;
+        case mode_lines: render_line(tile, prim); break;
+        case mode_instances: render_instance(tile, prim); break;
+        }
+    }
+}
+
+static float edge_fn(glm::vec2 a, glm::vec2 b, glm::vec2 p)
+{
+    return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+static bool edge_tie(glm::vec2 a, glm::vec2 b)
+{
+    /*
+     * pixels exactly on a shared edge belong to one triangle only. the
+     * two triangles traverse the edge in opposite directions, so picking
+     * pixels by edge direction avoids blending them twice.
+     */
+    float dx = b.x - a.x, dy = b.y - a.y;
+    return dy > 0 || (dy == 0 && dx < 0);
+}
+
+void draw_rasterizer::render_triangle(raster_tile &tile, raster_prim &prim)
+{
+    draw_cmd &cmd = batch->cmds[prim.cmd];
+    draw_vertex *v[3] = {
+        &batch->vertices[prim.idx[0]],
+        &batch->vertices[prim.idx[1]],
+        &batch->vertices[prim.idx[2]]
+    };
+    glm::vec2 p[3];
+    for (int i = 0; i < 3; i++) {
+        p[i] = glm::vec2(v[i]->pos[0], v[i]->pos[1]);
+    }
+
+    /* normalize winding so that the area is positive */
+    float area = edge_fn(p[0], p[1], p[2]);
+    if (area == 0) return;
+    if (area < 0) {
+        std::swap(p[1], p[2]);
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+
+    /* vertex attributes and constant screen-space uv derivatives */
+    glm::vec4 c[3];
+    glm::vec2 uv[3];
+    for (int i = 0; i < 3; i++) {
+        c[i] = unpack_color(v[i]->color);
+        uv[i] = glm::vec2(v[i]->uv[0], v[i]->uv[1]);
+    }
+    float dw0dx = p[1].y - p[2].y, dw1dx = p[2].y - p[0].y, dw2dx = p[0].y - p[1].y;
+    float dw0dy = p[2].x - p[1].x, dw1dy = p[0].x - p[2].x, dw2dy = p[1].x - p[0].x;
+    glm::vec2 duv(
+        (uv[0].x * dw0dx + uv[1].x * dw1dx + uv[2].x * dw2dx) / area,
+        (uv[0].y * dw0dy + uv[1].y * dw1dy + uv[2].y * dw2dy) / area);
+    bool tie[3] = {
+        edge_tie(p[1], p[2]), edge_tie(p[2], p[0]), edge_tie(p[0], p[1])
+    };
+
+    int x0 = std::max(prim.x0, tile.x), x1 = std::min(prim.x1, tile.x + tile.w);
+    int y0 = std::max(prim.y0, tile.y), y1 = std::min(prim.y1, tile.y + tile.h);
+
+    /* covered fragments are gathered per row and shaded as a span */
+    raster_fragment frag[tile_size];
+    glm::vec4 out[tile_size];
+    int xs[tile_size];
+
+    for (int y = y0; y < y1; y++) {
+        glm::vec2 q((float)x0 + 0.5f, (float)y + 0.5f);
+        float w0 = edge_fn(p[1], p[2], q);
+        float w1 = edge_fn(p[2], p[0], q);
+        float w2 = edge_fn(p[0], p[1], q);
+        size_t n = 0;
+        for (int x = x0; x < x1; x++, w0 += dw0dx, w1 += dw1dx, w2 += dw2dx) {
+            if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+            if ((w0 == 0 && !tie[0]) || (w1 == 0 && !tie[1]) ||
+                (w2 == 0 && !tie[2])) continue;
+            float l0 = w0 / area, l1 = w1 / area, l2 = w2 / area;
+            frag[n].uv = uv[0] * l0 + uv[1] * l1 + uv[2] * l2;
+            frag[n].duv = duv;
+            frag[n].color = c[0] * l0 + c[1] * l1 + c[2] * l2;
+            frag[n].shape = v[0]->shape;
+            xs[n++] = x;
+        }
+        shade_span(cmd, frag, out, n);
+        for (size_t i = 0; i < n; i++) {
+            blend(xs[i], y, out[i]);
+        }
+    }
+}
+
+void draw_rasterizer::render_line(raster_tile &tile, raster_prim &prim)
+{
+    draw_cmd &cmd = batch->cmds[prim.cmd];
+    draw_vertex *v0 = &batch->vertices[prim.idx[0]];
+    draw_vertex *v1 = &batch->vertices[prim.idx[1]];
+    glm::vec2 p0(v0->pos[0], v0->pos[1]), p1(v1->pos[0], v1->pos[1]);
+    glm::vec4 c0 = unpack_color(v0->color), c1 = unpack_color(v1->color);
+    glm::vec2 uv0(v0->uv[0], v0->uv[1]), uv1(v1->uv[0], v1->uv[1]);
+
+    /* one pixel wide lines stepping along the major axis */
+    glm::vec2 d = p1 - p0;
+    int steps = (int)ceilf(std::max(fabsf(d.x), fabsf(d.y)));
+    if (steps == 0) return;
+
+    raster_fragment frag;
+    frag.duv = (uv1 - uv0) / (float)steps;
+    frag.shape = v0->shape;
+
+    for (int i = 0; i < steps; i++) {
+        float t = (i + 0.5f) / steps;
+        glm::vec2 q = p0 + d * t;
+        int x = (int)floorf(q.x), y = (int)floorf(q.y);
+        if (x < std::max(prim.x0, tile.x) || x >= std::min(prim.x1, tile.x + tile.w) ||
+            y < std::max(prim.y0, tile.y) || y >= std::min(prim.y1, tile.y + tile.h)) {
+            continue;
+        }
+        frag.uv = uv0 + (uv1 - uv0) * t;
+        frag.color = c0 + (c1 - c0) * t;
+        glm::vec4 out;
+        shade_span(cmd, &frag, &out, 1);
+        blend(x, y, out);
+    }
+}
+
+void draw_rasterizer::render_instance(raster_tile &tile, raster_prim &prim)
+{
+    draw_cmd &cmd = batch->cmds[prim.cmd];
+    draw_instance &r = batch->instances[prim.idx[0]];
+    glm::vec2 p0(r.rect[0], r.rect[1]), p1(r.rect[2], r.rect[3]);
+    glm::vec2 uv0(r.uv[0], r.uv[1]), uv1(r.uv[2], r.uv[3]);
+    if (p0.x == p1.x || p0.y == p1.y) return;
+
+    /* uv is linear in x and y so derivatives are constant */
+    if (p0.x > p1.x) {
+        std::swap(p0.x, p1.x);
+        std::swap(uv0.x, uv1.x);
+    }
+    if (p0.y > p1.y) {
+        std::swap(p0.y, p1.y);
+        std::swap(uv0.y, uv1.y);
+    }
+    glm::vec2 duv = (uv1 - uv0) / (p1 - p0);
+
+    int x0 = std::max(prim.x0, tile.x), x1 = std::min(prim.x1, tile.x + tile.w);
+    int y0 = std::max(prim.y0, tile.y), y1 = std::min(prim.y1, tile.y + tile.h);
+
+    raster_fragment frag[tile_size];
+    glm::vec4 out[tile_size];
+    int xs[tile_size];
+    glm::vec4 color = unpack_color(r.color);
+
+    /* pixel centers on the right or bottom edge are inside as with the
+     * o0,o3,o1 o1,o3,o2 triangles emitted for quads */
+    for (int y = y0; y < y1; y++) {
+        float qy = (float)y + 0.5f;
+        if (qy <= p0.y || qy > p1.y) continue;
+        size_t n = 0;
+        for (int x = x0; x < x1; x++) {
+            float qx = (float)x + 0.5f;
+            if (qx <= p0.x || qx > p1.x) continue;
+            frag[n].uv = uv0 + (glm::vec2(qx, qy) - p0) * duv;
+            frag[n].duv = duv;
+            frag[n].color = color;
+            frag[n].shape = r.shape;
+            xs[n++] = x;
+        }
+        shade_span(cmd, frag, out, n);
+        for (size_t i = 0; i < n; i++) {
+            blend(xs[i], y, out[i]);
+        }
+    }
+}
+
+static float gamma_correct(float c, float gamma)
+{
+    return gamma == 1.0f ? c : powf(c, 1.0f/gamma);
+}
+
+static float median(float r, float g, float b)
+{
+    return std::max(std::min(r, g), std::min(std::max(r, g), b));
+}
+
+glm::vec4 draw_rasterizer::shade(draw_cmd &cmd, raster_fragment &frag)
+{
+    auto ti = textures.find((int)cmd.iid);
+    const raster_texture *tex = ti != textures.end() ? &ti->second : nullptr;
+
+    switch (cmd.shader) {
+    case shader_simple: {
+        /* untextured geometry uses the vertex color */
+        glm::vec4 t = tex ? tex->sample(frag.uv) : glm::vec4(1.0f);
+        return frag.color * glm::vec4(gamma_correct(t.r, gamma),
+            gamma_correct(t.g, gamma), gamma_correct(t.b, gamma), t.a);
+    }
+    case shader_msdf: {
+        if (!tex) break;
+        glm::vec4 t = tex->sample(frag.uv);
+        float dx = frag.duv.x * tex->width;
+        float dy = frag.duv.y * tex->height;
+        float to_pixels = 16.0f / sqrtf(dx * dx + dy * dy);
+        float sig_dist = median(t.r, t.g, t.b) - 0.5f;
+        float alpha = std::max(0.0f, std::min(1.0f, sig_dist * to_pixels + 0.5f));
+        return glm::vec4(gamma_correct(frag.color.r, gamma),
+            gamma_correct(frag.color.g, gamma),
+            gamma_correct(frag.color.b, gamma), alpha);
+    }
+    }
+
+    /* other shaders without a raster_shader are not rasterized */
+    return glm::vec4(0.0f);
+}
+
+void draw_rasterizer::shade_span(draw_cmd &cmd, raster_fragment *frag,
+    glm::vec4 *out, size_t count)
+{
+    if (count == 0) return;
+    auto si = shaders.find(cmd.shader);
+    if (si != shaders.end()) {
+        si->second->shade(frag, out, count, gamma);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = shade(cmd, frag[i]);
+        }
+    }
+}
+
+void draw_rasterizer::blend(int x, int y, glm::vec4 src)
+{
+    /* equivalent to glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) */
+    uint8_t *dst = target->getData() + ((size_t)y * width + x) * 4;
+    float a = std::max(0.0f, std::min(1.0f, src.a));
+    for (int i = 0; i < 4; i++) {
+        float s = std::max(0.0f, std::min(1.0f, src[i]));
+        float d = dst[i] / 255.0f;
+        dst[i] = (uint8_t)((s * a + d * (1.0f - a)) * 255.0f + 0.5f);
+    }
+}
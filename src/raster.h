@@ -0,0 +1,136 @@
+// See LICENSE for license details.
+
+#pragma once
+
+/*
+ * Software Rasterizer
+ *
+ * Headless CPU consumer for draw lists. It executes the same draw_list
+ * that is uploaded by the OpenGL examples, but renders into an RGBA
+ * image so that output can be saved with image::saveToFile or compared
+ * with golden images on machines without a GPU.
+ *
+ * - draw_image entries are copied into textures, applying modrect deltas
+ *   or the dirty rectangles within them
+ * - draw_cmd viewports are treated as clip rectangles in target pixels
+ * - vertex positions are target pixels with origin top left, which is
+ *   the same convention as the orthographic projection in the examples
+ * - mode_instances commands draw each draw_instance as a quad covering
+ *   the same pixels as its two triangle equivalent
+ * - shader_simple and shader_msdf are evaluated per pixel
+ * - other shaders are evaluated by a raster_shader registered with
+ *   set_shader, e.g. canvas_shader in shade.h for shader_canvas
+ *
+ * The target is divided into square tiles. Primitives are binned into
+ * the tiles that their bounding box touches, in draw list order, then
+ * tiles are rasterized concurrently on the worker pool. Each tile is
+ * only touched by one thread so the result does not depend on the
+ * number of threads.
+ */
+
+struct raster_texture
+{
+    int iid;
+    int width, height, depth;
+    int flags;
+    std::vector<uint8_t> pixels;
+
+    glm::vec4 fetch(int x, int y) const;
+    glm::vec4 sample(glm::vec2 uv) const;
+};
+
+struct raster_prim
+{
+    uint cmd;
+    uint mode;
+    uint idx[3];    /* vertex indices, or the instance in idx[0] */
+    int x0, y0, x1, y1;
+};
+
+struct raster_tile
+{
+    int x, y, w, h;
+    std::vector<uint> prims;
+};
+
+struct raster_fragment
+{
+    glm::vec2 uv;
+    glm::vec2 duv;
+    glm::vec4 color;
+    float shape;
+};
+
+/*
+ * raster_shader protocol
+ *
+ * custom shaders are called with spans of fragments from one row of one
+ * primitive, so implementations can fetch per-primitive state once and
+ * then loop across pixels. shade may be called concurrently from tiles.
+ */
+
+struct raster_shader
+{
+    virtual ~raster_shader() = default;
+    virtual void shade(raster_fragment *frag, glm::vec4 *out, size_t count,
+        float gamma) = 0;
+};
+
+struct draw_rasterizer;
+
+struct raster_worker : pool_worker<size_t>
+{
+    draw_rasterizer *rasterizer;
+
+    raster_worker(draw_rasterizer *rasterizer);
+
+    virtual void operator()(size_t &tile_num);
+};
+
+inline raster_worker::raster_worker(draw_rasterizer *rasterizer) :
+    rasterizer(rasterizer) {}
+
+struct draw_rasterizer
+{
+    static const int tile_size = 64;
+
+    int width, height;
+    int tiles_x, tiles_y;
+    float gamma;
+    uint32_t clear_color;
+    image_ptr target;
+    std::map<int,raster_texture> textures;
+    std::map<uint,raster_shader*> shaders;
+    std::vector<raster_tile> tiles;
+    std::vector<raster_prim> prims;
+    draw_list *batch;
+    std::unique_ptr<pool_executor<size_t,raster_worker>> pool;
+
+    draw_rasterizer(int width, int height, size_t num_threads = 0);
+
+    /* returns the render target */
+    image_ptr get_image();
+
+    /* background color used to clear the target, packed as in draw_vertex */
+    void set_clear_color(uint32_t color);
+
+    /* evaluate a shader with a raster_shader, owned by the caller */
+    void set_shader(uint shader, raster_shader *s);
+
+    /* copy draw_image pixels into textures using modrect or dirty rects */
+    void update_images(draw_list &batch);
+
+    /* clear the target and execute draw_cmds */
+    void render(draw_list &batch);
+
+    /* internal interfaces */
+    void bin_prims(draw_list &batch);
+    void render_tile(raster_tile &tile);
+    void render_triangle(raster_tile &tile, raster_prim &prim);
+    void render_line(raster_tile &tile, raster_prim &prim);
+    void render_instance(raster_tile &tile, raster_prim &prim);
+    glm::vec4 shade(draw_cmd &cmd, raster_fragment &frag);
+    void shade_span(draw_cmd &cmd, raster_fragment *frag, glm::vec4 *out,
+        size_t count);
+    void blend(int x, int y, glm::vec4 src);
+};
@@ -0,0 +1,489 @@
+// See LICENSE for license details.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <cfloat>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "glm/glm.hpp"
+
+#include "binpack.h"
+#include "image.h"
+#include "color.h"
+#include "utf8.h"
+#include "draw.h"
+#include "font.h"
+#include "glyph.h"
+#include "bvh.h"
+#include "canvas.h"
+#include "worker.h"
+#include "raster.h"
+#include "shade.h"
+
+/*
+ * scalar helpers with GLSL semantics
+ */
+
+static float clampf(float x, float a, float b)
+{
+    return std::max(a, std::min(b, x));
+}
+
+static float signf(float x)
+{
+    return x > 0 ? 1.0f : x < 0 ? -1.0f : 0.0f;
+}
+
+static float non_zero_sign(float x)
+{
+    return x > 0 ? 1.0f : -1.0f;
+}
+
+static float cross(vec2 a, vec2 b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+static float smoothstep(float e0, float e1, float x)
+{
+    float t = e0 == e1 ? (x < e0 ? 0.0f : 1.0f) :
+        clampf((x - e0) / (e1 - e0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+static float gamma_correct(float c, float gamma)
+{
+    return gamma == 1.0f ? c : powf(c, 1.0f/gamma);
+}
+
+static vec2 normalize_or_zero(vec2 v)
+{
+    float l = glm::length(v);
+    return l > 0 ? v / l : vec2(0);
+}
+
+/*
+ * Copyright © 2013 Inigo Quilez, MIT License
+ *
+ * Analytical distance to an 2D ellipse, see sdEllipse in canvas.fsh
+ */
+
+static float sd_ellipse(vec2 p, vec2 ab)
+{
+    p = vec2(fabsf(p.x), fabsf(p.y));
+    if (p.x > p.y) {
+        p = vec2(p.y, p.x);
+        ab = vec2(ab.y, ab.x);
+    }
+
+    float l = ab.y*ab.y - ab.x*ab.x;
+
+    float m = ab.x*p.x/l;
+    float n = ab.y*p.y/l;
+    float m2 = m*m;
+    float n2 = n*n;
+
+    float c = (m2 + n2 - 1.0f)/3.0f;
+    float c3 = c*c*c;
+
+    float q = c3 + m2*n2*2.0f;
+    float d = c3 + m2*n2;
+    float g = m + m*n2;
+
+    float co;
+
+    if (d < 0.0f) {
+        float h = acosf(q/c3)/3.0f;
+        float s = cosf(h);
+        float t = sinf(h)*sqrtf(3.0f);
+        float rx = sqrtf(-c*(s + t + 2.0f) + m2);
+        float ry = sqrtf(-c*(s - t + 2.0f) + m2);
+        co = (ry + signf(l)*rx + fabsf(g)/(rx*ry) - m)/2.0f;
+    } else {
+        float h = 2.0f*m*n*sqrtf(d);
+        float s = signf(q+h)*powf(fabsf(q+h), 1.0f/3.0f);
+        float u = signf(q-h)*powf(fabsf(q-h), 1.0f/3.0f);
+        float rx = -s - u - c*4.0f + 2.0f*m2;
+        float ry = (s - u)*sqrtf(3.0f);
+        float rm = sqrtf(rx*rx + ry*ry);
+        co = (ry/sqrtf(rm-rx) + 2.0f*g/rm - m)/2.0f;
+    }
+
+    float si = sqrtf(1.0f - co*co);
+
+    vec2 r = ab * vec2(co,si);
+
+    return glm::length(r-p) * signf(r.y-p.y);
+}
+
+/*
+ * Copyright © 2016 Viktor Chlumsky, MIT License
+ *
+ * Signed distance to quadratic Bézier curves, see msdfgen port in canvas.fsh
+ */
+
+static int solve_quadratic(float x[3], float a, float b, float c)
+{
+    if (fabsf(a) < 1e-14f) {
+        if (fabsf(b) < 1e-14f) {
+            if (c == 0) return -1;
+            return 0;
+        }
+        x[0] = -c/b;
+        return 1;
+    }
+    float dscr = b*b-4*a*c;
+    if (dscr > 0) {
+        dscr = sqrtf(dscr);
+        x[0] = (-b+dscr)/(2*a);
+        x[1] = (-b-dscr)/(2*a);
+        return 2;
+    } else if (dscr == 0) {
+        x[0] = -b/(2*a);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+static int solve_cubic_normed(float x[3], float a, float b, float c)
+{
+    float a2 = a*a;
+    float q  = (a2 - 3*b)/9;
+    float r  = (a*(2*a2-9*b) + 27*c)/54;
+    float r2 = r*r;
+    float q3 = q*q*q;
+    float A, B;
+    if (r2 < q3) {
+        float t = clampf(r/sqrtf(q3), -1.0f, 1.0f);
+        t = acosf(t);
+        a /= 3; q = -2*sqrtf(q);
+        x[0] = q*cosf(t/3)-a;
+        x[1] = q*cosf((t+2*(float)M_PI)/3)-a;
+        x[2] = q*cosf((t-2*(float)M_PI)/3)-a;
+        return 3;
+    } else {
+        A = -powf(fabsf(r)+sqrtf(r2-q3), 1/3.0f);
+        if (r < 0) A = -A;
+        B = A == 0 ? 0 : q/A;
+        a /= 3;
+        x[0] = (A+B)-a;
+        x[1] = -0.5f*(A+B)-a;
+        x[2] = 0.5f*sqrtf(3.0f)*(A-B);
+        if (fabsf(x[2]) < 1e-14f) {
+            return 2;
+        }
+        return 1;
+    }
+}
+
+static int solve_cubic(float x[3], float a, float b, float c, float d)
+{
+    if (fabsf(a) < 1e-14f) {
+        return solve_quadratic(x, b, c, d);
+    } else {
+        return solve_cubic_normed(x, b/a, c/a, d/a);
+    }
+}
+
+static vec2 direction_quadratic(const vec2 p[4], float cos_theta)
+{
+    vec2 tangent = glm::mix(p[1]-p[0], p[2]-p[1], cos_theta);
+    if (tangent.x == 0 && tangent.y == 0) {
+        return p[2]-p[0];
+    }
+    return tangent;
+}
+
+static float sd_quadratic(vec2 origin, const vec2 p[4], float &dir)
+{
+    vec2 qa = p[0]-origin;
+    vec2 ab = p[1]-p[0];
+    vec2 br = p[2]-p[1]-ab;
+    float a = glm::dot(br, br);
+    float b = 3*glm::dot(ab, br);
+    float c = 2*glm::dot(ab, ab)+glm::dot(qa, br);
+    float d = glm::dot(qa, ab);
+    float t[3];
+    int solutions = solve_cubic(t, a, b, c, d);
+
+    vec2 ep_dir = direction_quadratic(p, 0);
+    float min_distance = non_zero_sign(cross(ep_dir, qa))*glm::length(qa);
+    float cos_theta = -glm::dot(qa, ep_dir)/glm::dot(ep_dir, ep_dir);
+    {
+        ep_dir = direction_quadratic(p, 1);
+        float distance = non_zero_sign(cross(ep_dir, p[2]-origin))*
+            glm::length(p[2]-origin);
+        if (fabsf(distance) < fabsf(min_distance)) {
+            min_distance = distance;
+            cos_theta = glm::dot(origin-p[1], ep_dir)/glm::dot(ep_dir, ep_dir);
+        }
+    }
+    for (int i = 0; i < solutions; ++i) {
+        if (t[i] > 0 && t[i] < 1) {
+            vec2 qe = p[0]+2*t[i]*ab+t[i]*t[i]*br-origin;
+            float distance = non_zero_sign(cross(p[2]-p[0], qe))*glm::length(qe);
+            if (fabsf(distance) <= fabsf(min_distance)) {
+                min_distance = distance;
+                cos_theta = t[i];
+            }
+        }
+    }
+
+    if (cos_theta >= 0 && cos_theta <= 1) {
+        dir = 0;
+    } else if (cos_theta < .5f) {
+        dir = fabsf(glm::dot(normalize_or_zero(direction_quadratic(p, 0)),
+            normalize_or_zero(qa)));
+    } else {
+        dir = fabsf(glm::dot(normalize_or_zero(direction_quadratic(p, 1)),
+            normalize_or_zero(p[2]-origin)));
+    }
+    return min_distance;
+}
+
+static float sd_rect(vec2 center, vec2 half_size, vec2 origin)
+{
+    float ex = fabsf(origin.x - center.x) - half_size.x;
+    float ey = fabsf(origin.y - center.y) - half_size.y;
+    float ox = std::max(ex, 0.0f), oy = std::max(ey, 0.0f);
+    float outside = sqrtf(ox * ox + oy * oy);
+    float inside = std::min(std::max(ex, ey), 0.0f);
+    return -outside - inside;
+}
+
+/*
+ * canvas shader
+ */
+
+void canvas_shader::distance_edge(const AEdge &edge, const vec2 *origin,
+    float *dist, float *dir, size_t count)
+{
+    const vec2 *p = edge.p;
+
+    switch ((int)edge.type) {
+    case MVGEdgeLinear: {
+        /* branch-free form of sdLinear */
+        vec2 ab = p[1] - p[0];
+        float ab2 = glm::dot(ab, ab), ab_len = sqrtf(ab2);
+        vec2 n = ab_len == 0 ? vec2(0, -1) : vec2(ab.y, -ab.x) / ab_len;
+        vec2 abn = ab_len == 0 ? vec2(0) : ab / ab_len;
+        for (size_t i = 0; i < count; i++) {
+            float aqx = origin[i].x - p[0].x, aqy = origin[i].y - p[0].y;
+            float t = (aqx * ab.x + aqy * ab.y) / ab2;
+            float eqx = (t > .5f ? p[1].x : p[0].x) - origin[i].x;
+            float eqy = (t > .5f ? p[1].y : p[0].y) - origin[i].y;
+            float ep = sqrtf(eqx * eqx + eqy * eqy);
+            float ortho = n.x * aqx + n.y * aqy;
+            bool use_ortho = t > 0 && t < 1 && fabsf(ortho) < ep;
+            float ep_sign = (aqx * ab.y - aqy * ab.x) > 0 ? 1.0f : -1.0f;
+            float ep_dir = ep > 0 ? fabsf(abn.x * eqx + abn.y * eqy) / ep : 0.0f;
+            dist[i] = use_ortho ? ortho : ep_sign * ep;
+            dir[i] = use_ortho ? 0.0f : ep_dir;
+        }
+        break;
+    }
+    case MVGEdgeQuadratic:
+        /* scalar, each pixel branches on the roots of its own cubic */
+        for (size_t i = 0; i < count; i++) {
+            dist[i] = sd_quadratic(origin[i], p, dir[i]);
+        }
+        break;
+    case MVGEdgeCubic:
+        /* cubic edges are converted to quadratic edges by AContext */
+        for (size_t i = 0; i < count; i++) {
+            dist[i] = dir[i] = 0.0f;
+        }
+        break;
+    case MVGPrimitiveRectangle:
+        for (size_t i = 0; i < count; i++) {
+            dist[i] = sd_rect(p[0], p[1], origin[i]);
+            dir[i] = 0.0f;
+        }
+        break;
+    case MVGPrimitiveCircle: {
+        vec2 center = p[0];
+        float radius = p[1].x;
+        for (size_t i = 0; i < count; i++) {
+            float dx = origin[i].x - center.x, dy = origin[i].y - center.y;
+            dist[i] = radius - sqrtf(dx * dx + dy * dy);
+            dir[i] = 0.0f;
+        }
+        break;
+    }
+    case MVGPrimitiveEllipse:
+        for (size_t i = 0; i < count; i++) {
+            dist[i] = sd_ellipse(origin[i] - p[0], p[1]);
+            dir[i] = 0.0f;
+        }
+        break;
+    case MVGPrimitiveRoundedRectangle: {
+        vec2 center = p[0], half_size = p[1];
+        float radius = p[2].x;
+        vec2 r1 = half_size - vec2(radius, 0);
+        vec2 r2 = half_size - vec2(0, radius);
+        for (size_t i = 0; i < count; i++) {
+            float d1 = sd_rect(center, r1, origin[i]);
+            float d2 = sd_rect(center, r2, origin[i]);
+            float cx = fabsf(origin[i].x - center.x) - half_size.x + radius;
+            float cy = fabsf(origin[i].y - center.y) - half_size.y + radius;
+            float c1 = radius - sqrtf(cx * cx + cy * cy);
+            dist[i] = std::max(std::max(d1, d2), c1);
+            dir[i] = 0.0f;
+        }
+        break;
+    }
+    default:
+        for (size_t i = 0; i < count; i++) {
+            dist[i] = FLT_MAX;
+            dir[i] = 0.0f;
+        }
+        break;
+    }
+}
+
+void canvas_shader::distance_shape(const AShape &shape, const vec2 *origin,
+    float *dist, size_t count)
+{
+    /* split lanes into runs of fragments that share a cell */
+    size_t i = 0;
+    while (i < count) {
+        int cell_num = ctx->find_cell(shape, origin[i]);
+        size_t j = i + 1;
+        while (j < count && ctx->find_cell(shape, origin[j]) == cell_num) j++;
+        distance_cell(shape, cell_num, origin + i, dist + i, j - i);
+        i = j;
+    }
+}
+
+void canvas_shader::distance_cell(const AShape &shape, int cell_num,
+    const vec2 *origin, float *dist, size_t count)
+{
+    float d[lanes], dir[lanes], min_dir[lanes];
+
+    for (size_t i = 0; i < count; i++) {
+        dist[i] = FLT_MAX;
+        min_dir[i] = FLT_MAX;
+    }
+
+    /* visit edges in the cell or all edges outside of the grid */
+    const float *edge_list = nullptr;
+    int edge_offset = (int)shape.edge_offset;
+    int edge_count = (int)shape.edge_count;
+    if (cell_num >= 0) {
+        const ACell &cell = ctx->cells[cell_num];
+        edge_list = ctx->cell_edges.data() + (int)cell.edge_offset;
+        edge_count = (int)cell.edge_count;
+    }
+
+    for (int j = 0; j < edge_count; j++) {
+        int edge_num = edge_list ? (int)edge_list[j] : edge_offset + j;
+        distance_edge(ctx->edges[edge_num], origin, d, dir, count);
+        for (size_t i = 0; i < count; i++) {
+            float ad = fabsf(d[i]), am = fabsf(dist[i]);
+            bool closer = ad < am || (ad == am && dir[i] < min_dir[i]);
+            dist[i] = closer ? d[i] : dist[i];
+            min_dir[i] = closer ? dir[i] : min_dir[i];
+        }
+    }
+}
+
+void canvas_shader::brush_color(int brush_num, const vec2 *origin,
+    vec4 *color, size_t count)
+{
+    /* color contains the vertex color which is used without a brush */
+    if (brush_num < 0 || brush_num >= (int)ctx->brushes.size()) return;
+
+    const ABrush &brush = ctx->brushes[brush_num];
+    switch ((int)brush.type) {
+    case MVGBrushSolid:
+        for (size_t i = 0; i < count; i++) {
+            color[i] = brush.c[0];
+        }
+        break;
+    case MVGBrushAxial: {
+        float x0 = brush.p[0].x, y0 = brush.p[0].y;
+        float x1 = brush.p[1].x, y1 = brush.p[1].y;
+        float l = (x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0);
+        for (size_t i = 0; i < count; i++) {
+            float t = ((x1 - x0) * (origin[i].x - x0) +
+                       (y1 - y0) * (origin[i].y - y0)) / l;
+            t = clampf(t, 0.0f, 1.0f);
+            color[i] = (1-t) * brush.c[0] + t * brush.c[1];
+        }
+        break;
+    }
+    case MVGBrushRadial: {
+        float l1 = glm::length(brush.p[0]);
+        float l2 = glm::length(brush.p[1]);
+        for (size_t i = 0; i < count; i++) {
+            float t = (glm::length(origin[i]) - l1)/(l2 - l1);
+            t = clampf(t, 0.0f, 1.0f);
+            color[i] = (1-t) * brush.c[0] + t * brush.c[1];
+        }
+        break;
+    }
+    }
+}
+
+void canvas_shader::shade_lanes(raster_fragment *frag, glm::vec4 *out,
+    size_t count, float gamma)
+{
+    int shape_num = (int)frag[0].shape;
+    if (shape_num < 0 || shape_num >= (int)ctx->shapes.size()) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = vec4(0);
+        }
+        return;
+    }
+
+    const AShape &shape = ctx->shapes[shape_num];
+    vec2 origin[lanes];
+    vec4 fill[lanes], stroke[lanes];
+    float dist[lanes];
+
+    for (size_t i = 0; i < count; i++) {
+        origin[i] = frag[i].uv;
+        fill[i] = stroke[i] = frag[i].color;
+    }
+
+    brush_color((int)shape.fill_brush, origin, fill, count);
+    brush_color((int)shape.stroke_brush, origin, stroke, count);
+    distance_shape(shape, origin, dist, count);
+
+    float w = shape.stroke_width/2.0f;
+    for (size_t i = 0; i < count; i++) {
+        float d = shape.stroke_mode > 0 ? -fabsf(dist[i]) : dist[i];
+        float dx = frag[i].duv.x, dy = frag[i].duv.y;
+        float ps = sqrtf(dx*dx + dy*dy);
+        float alpha = smoothstep(-w-ps, -w+ps, d);
+        vec4 c = shape.stroke_width == 0 ? fill[i] :
+            glm::mix(stroke[i], fill[i], smoothstep(w-ps, w+ps, d));
+        out[i] = vec4(gamma_correct(c.r, gamma), gamma_correct(c.g, gamma),
+            gamma_correct(c.b, gamma), alpha * c.a);
+    }
+}
+
+void canvas_shader::shade(raster_fragment *frag, glm::vec4 *out,
+    size_t count, float gamma)
+{
+    for (size_t i = 0; i < count; i += lanes) {
+        shade_lanes(frag + i, out + i, std::min(lanes, count - i), gamma);
+    }
+}
@@ -0,0 +1,57 @@
+// See LICENSE for license details.
+
+#pragma once
+
+/*
+ * CPU Canvas Shader
+ *
+ * Port of shaders/canvas.fsh that evaluates the AShape, AEdge and ABrush
+ * arrays of an AContext directly, so MVGCanvas scenes can be rendered
+ * with draw_rasterizer into images without a GPU. Output follows the
+ * GLSL shader so it can also serve as a reference for the GPU path.
+ *
+ * - signed distance to linear and quadratic edges, rectangles, circles,
+ *   ellipses and rounded rectangles
+ * - solid, axial and radial brushes for fill and stroke
+ * - cell grids from AContext::bin_shapes limit the edges visited
+ *
+ * Spans are evaluated in groups of lanes. Each edge and brush is fetched
+ * once per group and then applied to all pixels in the group with short
+ * loops over plain float arrays, which the compiler can vectorize for
+ * linear edges, primitives and brushes. Quadratic edges are evaluated
+ * per pixel because the closest point is found by solving a cubic whose
+ * root count differs between pixels, so curved outlines shade at scalar
+ * speed. Tiles are shaded concurrently by the rasterizer.
+ *
+ * Usage:
+ *
+ *   canvas_shader shader(canvas.ctx.get());
+ *   rasterizer.set_shader(shader_canvas, &shader);
+ */
+
+struct canvas_shader : raster_shader
+{
+    static const size_t lanes = 16;
+
+    AContext *ctx;
+
+    canvas_shader(AContext *ctx);
+    virtual ~canvas_shader() = default;
+
+    virtual void shade(raster_fragment *frag, glm::vec4 *out, size_t count,
+        float gamma);
+
+    /* internal interfaces, count is at most lanes */
+    void shade_lanes(raster_fragment *frag, glm::vec4 *out, size_t count,
+        float gamma);
+    void brush_color(int brush_num, const vec2 *origin, vec4 *color,
+        size_t count);
+    void distance_shape(const AShape &shape, const vec2 *origin, float *dist,
+        size_t count);
+    void distance_cell(const AShape &shape, int cell_num, const vec2 *origin,
+        float *dist, size_t count);
+    void distance_edge(const AEdge &edge, const vec2 *origin, float *dist,
+        float *dir, size_t count);
+};
+
+inline canvas_shader::canvas_shader(AContext *ctx) : ctx(ctx) {}
@@ -0,0 +1,682 @@
+// See LICENSE for license details.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cctype>
+
+#include "file.h"
+#include "logger.h"
+#include "unicode.h"
+
+static const char* category_names[] = {
+    "Lu", "Ll", "Lt", "Lm", "Lo", "Mn", "Mc", "Me", "Nd", "Nl",
+    "No", "Pc", "Pd", "Ps", "Pe", "Pi", "Pf", "Po", "Sm", "Sc",
+    "Sk", "So", "Zs", "Zl", "Zp", "Cc", "Cf", "Cs", "Co", "Cn",
+};
+
+static const char* bidi_names[] = {
+    "L", "LRE", "LRO", "R", "AL", "RLE", "RLO", "PDF", "EN", "ES",
+    "ET", "AN", "CS", "NSM", "BN", "B", "S", "WS", "ON", "LRI",
+    "FSI", "PDI", "RLI",
+};
+
+/* Hangul syllable names are composed from the names of their jamo */
+static const uint32_t hangul_base = 0xac00, hangul_count = 11172;
+static const uint32_t hangul_v_count = 21, hangul_t_count = 28;
+
+static const char* hangul_l[] = {
+    "G", "GG", "N", "D", "DD", "R", "M", "B", "BB", "S", "SS", "", "J",
+    "JJ", "C", "K", "T", "P", "H",
+};
+
+static const char* hangul_v[] = {
+    "A", "AE", "YA", "YAE", "EO", "E", "YEO", "YE", "O", "WA", "WAE",
+    "OE", "YO", "U", "WEO", "WE", "WI", "YU", "EU", "YI", "I",
+};
+
+static const char* hangul_t[] = {
+    "", "G", "GG", "GS", "N", "NJ", "NH", "D", "L", "LG", "LM", "LB",
+    "LS", "LT", "LP", "LH", "M", "B", "BS", "S", "SS", "NG", "J", "C",
+    "K", "T", "P", "H",
+};
+
+static const unicode_db_record unassigned_record = {
+    unicode_category_Cn, unicode_bidi_L, 0, unicode_name_none,
+    unicode_db::no_block, 0
+};
+
+/*
+ * unicode_db
+ */
+
+unicode_db::unicode_db() :
+    db_file(), base(nullptr), header(nullptr), prop_pages(nullptr),
+    prop_entries(nullptr), records(nullptr), name_pages(nullptr),
+    name_entries(nullptr), name_offsets(nullptr), name_codes(nullptr),
+    name_data(nullptr), word_offsets(nullptr), word_data(nullptr),
+    ngram_offsets(nullptr), ngram_data(nullptr), blocks(nullptr) {}
+
+bool unicode_db::open(std::string path)
+{
+    file_ptr f = file::getFile(path);
+    const void *data = f->getBuffer();
+    if (!data || !load(data, (size_t)f->getLength())) {
+        Error("%s: failed to load unicode database: %s\n", __func__,
+            path.c_str());
+        return false;
+    }
+    db_file = f;
+    return true;
+}
+
+/* sections in file order. each extends to the start of the next one */
+enum {
+    section_prop_pages, section_prop_entries, section_records,
+    section_name_pages, section_name_entries, section_name_offsets,
+    section_name_codes, section_name_data, section_word_offsets,
+    section_word_data, section_ngram_offsets, section_ngram_data,
+    section_blocks, section_count
+};
+
+/* stage 1 page ids must select a page within the stage 2 section */
+static bool check_pages(const uint16_t *pages, size_t num_pages,
+    size_t entries_size)
+{
+    size_t num_entry_pages = entries_size / 2 >> unicode_db::page_shift;
+    for (size_t i = 0; i < num_pages; i++) {
+        if (pages[i] >= num_entry_pages) return false;
+    }
+    return true;
+}
+
+static bool check_ids(const uint16_t *ids, size_t count, size_t limit)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (ids[i] >= limit) return false;
+    }
+    return true;
+}
+
+/* offset tables have count + 1 ascending offsets within their data */
+static bool check_offsets(const uint32_t *offsets, size_t count,
+    size_t data_size)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (offsets[i] > offsets[i + 1]) return false;
+    }
+    return offsets[count] <= data_size;
+}
+
+bool unicode_db::load(const void *data, size_t length)
+{
+    const unicode_db_header *h = (const unicode_db_header*)data;
+
+    if (length < sizeof(unicode_db_header) || h->magic != magic ||
+        h->version != version || h->page_shift != page_shift ||
+        h->num_pages != (max_code >> page_shift) || h->length != length ||
+        h->num_ngrams > 256) {
+        return false;
+    }
+    uint32_t sections[section_count + 1] = {
+        h->prop_pages, h->prop_entries, h->records, h->name_pages,
+        h->name_entries, h->name_offsets, h->name_codes, h->name_data,
+        h->word_offsets, h->word_data, h->ngram_offsets, h->ngram_data,
+        h->blocks, (uint32_t)length
+    };
+    size_t size[section_count];
+    for (size_t i = 0; i < section_count; i++) {
+        if (sections[i] < sizeof(unicode_db_header) ||
+            sections[i] > sections[i + 1] || (sections[i] & 3) != 0) {
+            return false;
+        }
+        size[i] = sections[i + 1] - sections[i];
+    }
+
+    /* sizes of the sections, then every index stored in them */
+    const uint8_t *p = (const uint8_t*)data;
+    size_t num_pages = h->num_pages, num_records = h->num_records;
+    size_t num_names = h->num_names, num_words = h->num_words;
+    size_t num_ngrams = h->num_ngrams, num_blocks = h->num_blocks;
+    if (size[section_prop_pages] < num_pages * 2 ||
+        size[section_records] < num_records * sizeof(unicode_db_record) ||
+        size[section_name_pages] < num_pages * 2 ||
+        size[section_name_offsets] < (num_names + 1) * 4 ||
+        size[section_name_codes] < num_names * 4 ||
+        size[section_word_offsets] < (num_words + 1) * 4 ||
+        size[section_ngram_offsets] < (num_ngrams + 1) * 4 ||
+        size[section_blocks] < num_blocks * sizeof(unicode_db_block)) {
+        return false;
+    }
+    const uint16_t *pp = (const uint16_t*)(p + h->prop_pages);
+    const uint16_t *pe = (const uint16_t*)(p + h->prop_entries);
+    const uint16_t *np = (const uint16_t*)(p + h->name_pages);
+    const uint16_t *ne = (const uint16_t*)(p + h->name_entries);
+    const uint32_t *no = (const uint32_t*)(p + h->name_offsets);
+    const uint32_t *wo = (const uint32_t*)(p + h->word_offsets);
+    const uint32_t *go = (const uint32_t*)(p + h->ngram_offsets);
+    if (!check_pages(pp, num_pages, size[section_prop_entries]) ||
+        !check_ids(pe, size[section_prop_entries] / 2, num_records) ||
+        !check_pages(np, num_pages, size[section_name_entries]) ||
+        !check_ids(ne, size[section_name_entries] / 2, num_names) ||
+        !check_offsets(no, num_names, size[section_name_data]) ||
+        !check_offsets(wo, num_words, size[section_word_data]) ||
+        !check_offsets(go, num_ngrams, size[section_ngram_data])) {
+        return false;
+    }
+    const unicode_db_record *r = (const unicode_db_record*)(p + h->records);
+    for (size_t i = 0; i < num_records; i++) {
+        if (r[i].category > unicode_category_Cn ||
+            r[i].bidi > unicode_bidi_RLI ||
+            r[i].name_kind > unicode_name_hangul ||
+            (r[i].block != no_block && r[i].block >= num_blocks)) {
+            return false;
+        }
+    }
+    const unicode_db_block *b = (const unicode_db_block*)(p + h->blocks);
+    for (size_t i = 0; i < num_blocks; i++) {
+        if (b[i].name >= num_names) return false;
+    }
+    const uint8_t *wd = p + h->word_data;
+    for (size_t i = 0; i < wo[num_words]; i++) {
+        if (wd[i] >= num_ngrams) return false;
+    }
+
+    /* word ids of names must end within the name and select a word */
+    const uint8_t *nd = p + h->name_data;
+    for (size_t name = 0; name < num_names; name++) {
+        uint32_t word = 0, shift = 0;
+        for (uint32_t i = no[name]; i < no[name + 1]; i++) {
+            if (shift > 28) return false;
+            word |= (uint32_t)(nd[i] & 0x7f) << shift;
+            shift += 7;
+            if (nd[i] & 0x80) continue;
+            if (word >= num_words) return false;
+            word = shift = 0;
+        }
+        if (shift != 0) return false;
+    }
+
+    base = (const uint8_t*)data;
+    header = h;
+    prop_pages = (const uint16_t*)(base + h->prop_pages);
+    prop_entries = (const uint16_t*)(base + h->prop_entries);
+    records = (const unicode_db_record*)(base + h->records);
+    name_pages = (const uint16_t*)(base + h->name_pages);
+    name_entries = (const uint16_t*)(base + h->name_entries);
+    name_offsets = (const uint32_t*)(base + h->name_offsets);
+    name_codes = (const uint32_t*)(base + h->name_codes);
+    name_data = base + h->name_data;
+    word_offsets = (const uint32_t*)(base + h->word_offsets);
+    word_data = base + h->word_data;
+    ngram_offsets = (const uint32_t*)(base + h->ngram_offsets);
+    ngram_data = base + h->ngram_data;
+    blocks = (const unicode_db_block*)(base + h->blocks);
+
+    return true;
+}
+
+const unicode_db_record& unicode_db::record(uint32_t code) const
+{
+    if (code >= max_code) return unassigned_record;
+    const uint32_t mask = (1 << page_shift) - 1;
+    size_t page = prop_pages[code >> page_shift];
+    return records[prop_entries[(page << page_shift) | (code & mask)]];
+}
+
+unicode_category unicode_db::category(uint32_t code) const
+{
+    return record(code).category;
+}
+
+unicode_bidi unicode_db::bidi(uint32_t code) const
+{
+    return record(code).bidi;
+}
+
+int unicode_db::combining_class(uint32_t code) const
+{
+    return record(code).ccc;
+}
+
+std::string unicode_db::name(uint32_t code) const
+{
+    const unicode_db_record &r = record(code);
+    const uint32_t mask = (1 << page_shift) - 1;
+    std::string str;
+    char buf[16];
+
+    if (r.name_kind == unicode_name_none) return str;
+
+    size_t page = name_pages[code >> page_shift];
+    size_t name = name_entries[(page << page_shift) | (code & mask)];
+
+    switch (r.name_kind) {
+    case unicode_name_plain:
+        decode_name(name, str);
+        break;
+    case unicode_name_code:
+        decode_name(name, str);
+        snprintf(buf, sizeof(buf), "%04X", code);
+        str.append(buf);
+        break;
+    case unicode_name_hangul:
+        decode_name(name, str);
+        if (code >= hangul_base && code < hangul_base + hangul_count) {
+            uint32_t s = code - hangul_base;
+            uint32_t l = s / (hangul_v_count * hangul_t_count);
+            uint32_t v = (s % (hangul_v_count * hangul_t_count)) /
+                hangul_t_count;
+            uint32_t t = s % hangul_t_count;
+            str.append(hangul_l[l]);
+            str.append(hangul_v[v]);
+            str.append(hangul_t[t]);
+        }
+        break;
+    default:
+        break;
+    }
+    return str;
+}
+
+int unicode_db::block(uint32_t code) const
+{
+    uint16_t block = record(code).block;
+    return block == no_block ? -1 : block;
+}
+
+size_t unicode_db::num_blocks() const
+{
+    return header->num_blocks;
+}
+
+const unicode_db_block& unicode_db::block_at(size_t block) const
+{
+    return blocks[block];
+}
+
+std::string unicode_db::block_name(size_t block) const
+{
+    std::string str;
+    decode_name(blocks[block].name, str);
+    return str;
+}
+
+bool unicode_db::is_mark(uint32_t code) const
+{
+    unicode_category c = category(code);
+    return c == unicode_category_Mn || c == unicode_category_Mc ||
+           c == unicode_category_Me;
+}
+
+bool unicode_db::is_space(uint32_t code) const
+{
+    unicode_category c = category(code);
+    return c == unicode_category_Zs || c == unicode_category_Zl ||
+           c == unicode_category_Zp;
+}
+
+size_t unicode_db::num_names() const
+{
+    return header->num_names;
+}
+
+uint32_t unicode_db::name_code(size_t name) const
+{
+    return name_codes[name];
+}
+
+/* little-endian base 128 word id */
+uint32_t unicode_db::next_word(uint32_t &i) const
+{
+    uint32_t word = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t b = name_data[i++];
+        word |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return word;
+    }
+}
+
+void unicode_db::decode_word(size_t word, std::string &out) const
+{
+    for (uint32_t j = word_offsets[word]; j < word_offsets[word + 1]; j++) {
+        uint8_t sym = word_data[j];
+        out.append((const char*)ngram_data + ngram_offsets[sym],
+            ngram_offsets[sym + 1] - ngram_offsets[sym]);
+    }
+}
+
+void unicode_db::decode_name(size_t name, std::string &out) const
+{
+    uint32_t i = name_offsets[name], end = name_offsets[name + 1];
+    for (bool first = true; i < end; first = false) {
+        if (!first) out.append(1, ' ');
+        decode_word(next_word(i), out);
+    }
+}
+
+void unicode_db::search(std::vector<std::string> terms,
+    std::vector<size_t> &names) const
+{
+    /*
+     * terms in quotes match whole words and others match within words,
+     * ignoring case.
+     */
+    std::vector<bool> exact;
+    for (auto &t : terms) {
+        bool quoted = t.size() > 1 && t[0] == '"';
+        if (quoted) t = t.substr(1, t.size() - (t.back() == '"' ? 2 : 1));
+        std::transform(t.begin(), t.end(), t.begin(),
+            [](unsigned char c){ return std::tolower(c); });
+        exact.push_back(quoted);
+    }
+    if (terms.size() == 0 || terms.size() > 64) return;
+
+    /* match the terms against each distinct word once */
+    std::vector<uint64_t> word_terms(header->num_words);
+    std::string word;
+    for (size_t w = 0; w < word_terms.size(); w++) {
+        word.clear();
+        decode_word(w, word);
+        std::transform(word.begin(), word.end(), word.begin(),
+            [](unsigned char c){ return std::tolower(c); });
+        for (size_t t = 0; t < terms.size(); t++) {
+            bool match = exact[t] ? word == terms[t] :
+                word.find(terms[t]) != std::string::npos;
+            word_terms[w] |= (uint64_t)match << t;
+        }
+    }
+
+    /* then names whose words match all terms, without decoding them */
+    uint64_t all = terms.size() == 64 ? ~0ull : (1ull << terms.size()) - 1;
+    for (size_t name = 1; name < header->num_names; name++) {
+        if (name_codes[name] == no_code) continue;
+        uint64_t matched = 0;
+        uint32_t i = name_offsets[name], end = name_offsets[name + 1];
+        while (i < end) matched |= word_terms[next_word(i)];
+        if (matched == all) names.push_back(name);
+    }
+}
+
+/*
+ * unicode_db compiler
+ */
+
+/* deduplicate fixed size pages of values into stage 1 and stage 2 tables */
+static void make_pages(std::vector<uint16_t> &values,
+    std::vector<uint16_t> &pages, std::vector<uint16_t> &entries)
+{
+    const size_t page_size = 1 << unicode_db::page_shift;
+    std::map<std::vector<uint16_t>,uint16_t> page_map;
+
+    pages.resize(values.size() / page_size);
+    for (size_t p = 0; p < pages.size(); p++) {
+        std::vector<uint16_t> page(values.begin() + p * page_size,
+            values.begin() + (p + 1) * page_size);
+        auto pi = page_map.find(page);
+        if (pi == page_map.end()) {
+            pi = page_map.insert(page_map.end(), std::pair<std::vector<
+                uint16_t>,uint16_t>(page, (uint16_t)page_map.size()));
+            entries.insert(entries.end(), page.begin(), page.end());
+        }
+        pages[p] = pi->second;
+    }
+}
+
+/* append a section aligned to 4 bytes, returning its offset */
+static uint32_t append(std::vector<uint8_t> &out, const void *data,
+    size_t len)
+{
+    out.resize((out.size() + 3) & ~3);
+    uint32_t offset = (uint32_t)out.size();
+    out.insert(out.end(), (const uint8_t*)data, (const uint8_t*)data + len);
+    return offset;
+}
+
+bool unicode_db::compile(std::string path, std::vector<unicode_entry> &entries,
+    std::vector<unicode_block> &blocks, std::vector<std::string> &ngrams)
+{
+    /* block of each code point */
+    std::vector<uint16_t> code_block(max_code, no_block);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        for (uint32_t c = blocks[i].start; c <= blocks[i].end && c < max_code;
+            c++) {
+            code_block[c] = (uint16_t)i;
+        }
+    }
+
+    /* distinct records, starting with unassigned code points per block */
+    std::vector<unicode_db_record> records;
+    std::map<uint64_t,uint16_t> record_map;
+    auto record_id = [&](unicode_db_record r) -> uint16_t {
+        uint64_t key = (uint64_t)r.category | (uint64_t)r.bidi << 8 |
+            (uint64_t)r.ccc << 16 | (uint64_t)r.name_kind << 24 |
+            (uint64_t)r.block << 32;
+        auto ri = record_map.find(key);
+        if (ri == record_map.end()) {
+            ri = record_map.insert(record_map.end(), std::pair<uint64_t,
+                uint16_t>(key, (uint16_t)records.size()));
+            records.push_back(r);
+        }
+        return ri->second;
+    };
+    std::vector<uint16_t> code_record(max_code);
+    for (uint32_t c = 0; c < max_code; c++) {
+        unicode_db_record r = unassigned_record;
+        r.block = code_block[c];
+        code_record[c] = record_id(r);
+    }
+
+    /* names, with name 0 empty, and one name for each range */
+    std::vector<std::string> names(1);
+    std::vector<uint32_t> name_codes(1, no_code);
+    std::vector<uint16_t> code_name(max_code, 0);
+    for (auto &e : entries) {
+        uint16_t name = 0;
+        if (e.name_kind != unicode_name_none) {
+            name = (uint16_t)names.size();
+            names.push_back(e.name);
+            name_codes.push_back(e.first);
+        }
+        for (uint32_t c = e.first; c <= e.last && c < max_code; c++) {
+            code_record[c] = record_id(unicode_db_record{ e.category, e.bidi,
+                e.ccc, e.name_kind, code_block[c], 0 });
+            code_name[c] = name;
+        }
+    }
+    std::vector<unicode_db_block> db_blocks;
+    for (auto &b : blocks) {
+        db_blocks.push_back(unicode_db_block{ b.start, b.end,
+            (uint32_t)names.size() });
+        names.push_back(b.name);
+        name_codes.push_back(no_code);
+    }
+    if (records.size() > 65536 || names.size() > 65536) {
+        Error("%s: too many records or names: records=%zu names=%zu\n",
+            __func__, records.size(), names.size());
+        return false;
+    }
+
+    /* words of all names, most frequent first */
+    std::map<std::string,size_t> word_freq;
+    std::vector<std::vector<std::string>> name_words;
+    for (auto &n : names) {
+        std::vector<std::string> w;
+        for (size_t i = 0, j; n.size() > 0; i = j + 1) {
+            j = std::min(n.find(' ', i), n.size());
+            w.push_back(n.substr(i, j - i));
+            word_freq[w.back()]++;
+            if (j == n.size()) break;
+        }
+        name_words.push_back(w);
+    }
+    std::vector<std::pair<std::string,size_t>> words(word_freq.begin(),
+        word_freq.end());
+    std::stable_sort(words.begin(), words.end(), [](const std::pair<
+        std::string,size_t> &a, const std::pair<std::string,size_t> &b) {
+        return a.second > b.second;
+    });
+    std::map<std::string,uint32_t> word_map;
+    for (size_t i = 0; i < words.size(); i++) {
+        word_map[words[i].first] = (uint32_t)i;
+    }
+
+    /* n-gram dictionary: every character used, then the given n-grams */
+    std::set<char> chars;
+    for (auto &w : words) chars.insert(w.first.begin(), w.first.end());
+    std::vector<std::string> dict;
+    std::map<std::string,uint8_t> dict_map;
+    size_t dict_max = 1;
+    for (auto c : chars) {
+        dict_map[std::string(1, c)] = (uint8_t)dict.size();
+        dict.push_back(std::string(1, c));
+    }
+    if (dict.size() > 256) {
+        Error("%s: too many distinct characters: %zu\n", __func__,
+            dict.size());
+        return false;
+    }
+    for (auto &ngram : ngrams) {
+        if (dict.size() == 256) break;
+        if (ngram.size() < 2 || ngram.size() > 16 ||
+            dict_map.find(ngram) != dict_map.end()) {
+            continue;
+        }
+        dict_map[ngram] = (uint8_t)dict.size();
+        dict.push_back(ngram);
+        dict_max = std::max(dict_max, ngram.size());
+    }
+
+    /* encode words with the longest n-gram at each position */
+    std::vector<uint32_t> word_offsets;
+    std::vector<uint8_t> word_data;
+    for (auto &w : words) {
+        const std::string &str = w.first;
+        word_offsets.push_back((uint32_t)word_data.size());
+        for (size_t i = 0; i < str.size(); ) {
+            for (size_t j = std::min(str.size() - i, dict_max); j > 0; j--) {
+                auto di = dict_map.find(str.substr(i, j));
+                if (di == dict_map.end()) continue;
+                word_data.push_back(di->second);
+                i += j;
+                break;
+            }
+        }
+    }
+    word_offsets.push_back((uint32_t)word_data.size());
+
+    /* encode names as little-endian base 128 word ids */
+    std::vector<uint32_t> name_offsets;
+    std::vector<uint8_t> name_data;
+    for (auto &w : name_words) {
+        name_offsets.push_back((uint32_t)name_data.size());
+        for (auto &str : w) {
+            uint32_t word = word_map[str];
+            while (word >= 0x80) {
+                name_data.push_back((uint8_t)(word | 0x80));
+                word >>= 7;
+            }
+            name_data.push_back((uint8_t)word);
+        }
+    }
+    name_offsets.push_back((uint32_t)name_data.size());
+
+    std::vector<uint32_t> ngram_offsets;
+    std::vector<uint8_t> ngram_data;
+    for (auto &d : dict) {
+        ngram_offsets.push_back((uint32_t)ngram_data.size());
+        ngram_data.insert(ngram_data.end(), d.begin(), d.end());
+    }
+    ngram_offsets.push_back((uint32_t)ngram_data.size());
+
+    /* two-level tables */
+    std::vector<uint16_t> prop_pages, prop_entries, name_pages, name_entries;
+    make_pages(code_record, prop_pages, prop_entries);
+    make_pages(code_name, name_pages, name_entries);
+
+    /* lay out the sections after the header */
+    std::vector<uint8_t> out(sizeof(unicode_db_header));
+    unicode_db_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = magic;
+    h.version = version;
+    h.page_shift = page_shift;
+    h.num_pages = (uint32_t)prop_pages.size();
+    h.prop_pages = append(out, prop_pages.data(), prop_pages.size() * 2);
+    h.prop_entries = append(out, prop_entries.data(), prop_entries.size() * 2);
+    h.records = append(out, records.data(),
+        records.size() * sizeof(unicode_db_record));
+    h.num_records = (uint32_t)records.size();
+    h.name_pages = append(out, name_pages.data(), name_pages.size() * 2);
+    h.name_entries = append(out, name_entries.data(), name_entries.size() * 2);
+    h.name_offsets = append(out, name_offsets.data(), name_offsets.size() * 4);
+    h.name_codes = append(out, name_codes.data(), name_codes.size() * 4);
+    h.name_data = append(out, name_data.data(), name_data.size());
+    h.num_names = (uint32_t)names.size();
+    h.word_offsets = append(out, word_offsets.data(), word_offsets.size() * 4);
+    h.word_data = append(out, word_data.data(), word_data.size());
+    h.num_words = (uint32_t)words.size();
+    h.ngram_offsets = append(out, ngram_offsets.data(),
+        ngram_offsets.size() * 4);
+    h.ngram_data = append(out, ngram_data.data(), ngram_data.size());
+    h.num_ngrams = (uint32_t)dict.size();
+    h.blocks = append(out, db_blocks.data(),
+        db_blocks.size() * sizeof(unicode_db_block));
+    h.num_blocks = (uint32_t)db_blocks.size();
+    out.resize((out.size() + 3) & ~3);
+    h.length = (uint32_t)out.size();
+    memcpy(out.data(), &h, sizeof(h));
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        Error("%s: fopen: %s: %s\n", __func__, path.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    if (fclose(f) != 0) ok = false;
+    if (!ok) {
+        Error("%s: write failed: %s\n", __func__, path.c_str());
+    }
+    return ok;
+}
+
+bool unicode_db::parse_category(const char *str, unicode_category &category)
+{
+    for (size_t i = 0; i < sizeof(category_names)/sizeof(char*); i++) {
+        if (strcmp(str, category_names[i]) == 0) {
+            category = (unicode_category)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool unicode_db::parse_bidi(const char *str, unicode_bidi &bidi)
+{
+    for (size_t i = 0; i < sizeof(bidi_names)/sizeof(char*); i++) {
+        if (strcmp(str, bidi_names[i]) == 0) {
+            bidi = (unicode_bidi)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* unicode_db::category_name(unicode_category category)
+{
+    return category < sizeof(category_names)/sizeof(char*) ?
+        category_names[category] : "";
+}
+
+const char* unicode_db::bidi_name(unicode_bidi bidi)
+{
+    return bidi < sizeof(bidi_names)/sizeof(char*) ? bidi_names[bidi] : "";
+}
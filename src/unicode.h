@@ -0,0 +1,184 @@
+// See LICENSE for license details.
+
+#pragma once
+
+struct file;
+
+/*
+ * unicode_db
+ *
+ * Compiled Unicode character database that is mapped read-only and used
+ * in place. Loading checks every section and index once, so lookups need
+ * no bounds checks. Properties and names of a code
+ * point are found with two-level tables: the high bits of the code point
+ * select a page in stage 1 and the low bits an entry of the deduplicated
+ * stage 2 page. Property entries index a table of distinct records and
+ * name entries index the name table. Names are stored as variable length
+ * ids of their words, most frequent first, and words as one byte codes of
+ * a dictionary of up to 256 n-grams, so any name decodes on its own.
+ * Ranges such as CJK ideographs and Hangul syllables share one name entry
+ * and their names are derived from the code point.
+ *
+ * The database is compiled from UnicodeData.txt and Blocks.txt by uniscan.
+ */
+
+enum unicode_category : uint8_t
+{
+    unicode_category_Lu, unicode_category_Ll, unicode_category_Lt,
+    unicode_category_Lm, unicode_category_Lo, unicode_category_Mn,
+    unicode_category_Mc, unicode_category_Me, unicode_category_Nd,
+    unicode_category_Nl, unicode_category_No, unicode_category_Pc,
+    unicode_category_Pd, unicode_category_Ps, unicode_category_Pe,
+    unicode_category_Pi, unicode_category_Pf, unicode_category_Po,
+    unicode_category_Sm, unicode_category_Sc, unicode_category_Sk,
+    unicode_category_So, unicode_category_Zs, unicode_category_Zl,
+    unicode_category_Zp, unicode_category_Cc, unicode_category_Cf,
+    unicode_category_Cs, unicode_category_Co, unicode_category_Cn,
+};
+
+enum unicode_bidi : uint8_t
+{
+    unicode_bidi_L, unicode_bidi_LRE, unicode_bidi_LRO, unicode_bidi_R,
+    unicode_bidi_AL, unicode_bidi_RLE, unicode_bidi_RLO, unicode_bidi_PDF,
+    unicode_bidi_EN, unicode_bidi_ES, unicode_bidi_ET, unicode_bidi_AN,
+    unicode_bidi_CS, unicode_bidi_NSM, unicode_bidi_BN, unicode_bidi_B,
+    unicode_bidi_S, unicode_bidi_WS, unicode_bidi_ON, unicode_bidi_LRI,
+    unicode_bidi_FSI, unicode_bidi_PDI, unicode_bidi_RLI,
+};
+
+enum unicode_name_kind : uint8_t
+{
+    unicode_name_none,          /* unnamed, e.g. private use */
+    unicode_name_plain,         /* name string */
+    unicode_name_code,          /* prefix string and hex code point */
+    unicode_name_hangul,        /* prefix string and jamo of the syllable */
+};
+
+/* a row, or a <..., First> and <..., Last> range of UnicodeData.txt */
+struct unicode_entry
+{
+    uint32_t first, last;
+    std::string name;
+    unicode_name_kind name_kind;
+    unicode_category category;
+    unicode_bidi bidi;
+    uint8_t ccc;
+};
+
+/* a row of Blocks.txt */
+struct unicode_block
+{
+    uint32_t start, end;
+    std::string name;
+};
+
+/* on-disk layout. section offsets are in bytes from the header */
+struct unicode_db_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t page_shift;
+    uint32_t num_pages;         /* stage 1 entries */
+    uint32_t prop_pages;        /* uint16 page, per stage 1 entry */
+    uint32_t prop_entries;      /* uint16 record id, per page entry */
+    uint32_t records;           /* unicode_db_record */
+    uint32_t num_records;
+    uint32_t name_pages;        /* uint16 page, per stage 1 entry */
+    uint32_t name_entries;      /* uint16 name id, per page entry */
+    uint32_t name_offsets;      /* uint32, num_names + 1 */
+    uint32_t name_codes;        /* uint32 first code point, per name */
+    uint32_t name_data;         /* word ids */
+    uint32_t num_names;
+    uint32_t word_offsets;      /* uint32, num_words + 1 */
+    uint32_t word_data;         /* n-gram codes */
+    uint32_t num_words;
+    uint32_t ngram_offsets;     /* uint32, num_ngrams + 1 */
+    uint32_t ngram_data;
+    uint32_t num_ngrams;
+    uint32_t blocks;            /* unicode_db_block */
+    uint32_t num_blocks;
+    uint32_t length;
+};
+
+struct unicode_db_record
+{
+    unicode_category category;
+    unicode_bidi bidi;
+    uint8_t ccc;
+    unicode_name_kind name_kind;
+    uint16_t block;             /* no_block if outside all blocks */
+    uint16_t reserved;
+};
+
+struct unicode_db_block
+{
+    uint32_t start, end;
+    uint32_t name;
+};
+
+struct unicode_db
+{
+    static constexpr uint32_t magic = 0x31646375; /* "ucd1" */
+    static constexpr uint32_t version = 1;
+    static constexpr uint32_t page_shift = 7;
+    static constexpr uint32_t max_code = 0x110000;
+    static constexpr uint16_t no_block = 0xffff;
+    static constexpr uint32_t no_code = 0xffffffff;
+
+    std::shared_ptr<file> db_file;
+    const uint8_t *base;
+    const unicode_db_header *header;
+    const uint16_t *prop_pages;
+    const uint16_t *prop_entries;
+    const unicode_db_record *records;
+    const uint16_t *name_pages;
+    const uint16_t *name_entries;
+    const uint32_t *name_offsets;
+    const uint32_t *name_codes;
+    const uint8_t *name_data;
+    const uint32_t *word_offsets;
+    const uint8_t *word_data;
+    const uint32_t *ngram_offsets;
+    const uint8_t *ngram_data;
+    const unicode_db_block *blocks;
+
+    unicode_db();
+
+    bool open(std::string path);
+    bool load(const void *data, size_t length);
+    bool is_loaded() const { return header != nullptr; }
+
+    const unicode_db_record& record(uint32_t code) const;
+    unicode_category category(uint32_t code) const;
+    unicode_bidi bidi(uint32_t code) const;
+    int combining_class(uint32_t code) const;
+    std::string name(uint32_t code) const;
+
+    /* blocks, for choosing fallback fonts */
+    int block(uint32_t code) const;
+    size_t num_blocks() const;
+    const unicode_db_block& block_at(size_t block) const;
+    std::string block_name(size_t block) const;
+
+    /* classes used when breaking lines and clustering */
+    bool is_mark(uint32_t code) const;
+    bool is_space(uint32_t code) const;
+
+    /* name table, for search */
+    size_t num_names() const;
+    uint32_t name_code(size_t name) const;
+    void decode_name(size_t name, std::string &out) const;
+    void search(std::vector<std::string> terms,
+        std::vector<size_t> &names) const;
+
+    /* internal interfaces */
+    uint32_t next_word(uint32_t &i) const;
+    void decode_word(size_t word, std::string &out) const;
+
+    static bool compile(std::string path, std::vector<unicode_entry> &entries,
+        std::vector<unicode_block> &blocks, std::vector<std::string> &ngrams);
+    static bool parse_category(const char *str, unicode_category &category);
+    static bool parse_bidi(const char *str, unicode_bidi &bidi);
+    static const char* category_name(unicode_category category);
+    static const char* bidi_name(unicode_bidi bidi);
+};
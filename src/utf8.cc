@@ -1,47 +1,33 @@
 // See LICENSE for license details.
 
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "ztdbits.h"
 #include "utf8.h"
 
+/*
+ * sequence length and lead byte mask indexed by the top five bits of the
+ * lead byte. continuation bytes have length 1 and no mask.
+ */
+
+static const uint8_t utf8_len_table[32] = {
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,2,2,2,2,3,3,4,5
+};
+
+static const uint8_t utf8_mask_table[6] = { 0, 0x7f, 0x3f, 0x1f, 0x0f, 0x07 };
+
 size_t utf8_codelen(const char* s)
 {
-    if (!s) {
-        return 0;
-    } else if ((s[0]&0x80) == 0x0) {
-        return 1;
-    } else if ((s[0]&0xF8) == 0xF8) {
-        return 5;
-    } else if ((s[0]&0xF0) == 0xF0) {
-        return 4;
-    } else if ((s[0]&0xE0) == 0xE0) {
-        return 3;
-    } else if ((s[0]&0xC0) == 0xC0) {
-        return 2;
-    } else {
-        return 1;
-    }
+    return s ? utf8_len_table[(uint8_t)s[0] >> 3] : 0;
 }
 
 size_t utf8_strlen(const char *s)
 {
-    size_t count = 0;
-    while (*s) {
-        size_t c = *s;
-        s++;
-        if ((c&0xC0) == 0xC0) {
-            s++;
-            if ((c&0xE0) == 0xE0) {
-                s++;
-                if ((c&0xF0) == 0xF0) {
-                    s++;
-                    if ((c&0xF8) == 0xF8) {
-                       s++;
-                    }
-                }
-            }
-        }
-        count++;
-    }
-    return count;
+    return utf8_count(s, strlen(s));
 }
 
 enum {
@@ -51,40 +37,24 @@ enum {
 
 uint32_t utf8_to_utf32(const char *s)
 {
-    if (!s) {
-        return -1;
-    } else if ((s[0]&v) == 0x0) {
-        return s[0];
-    } else if ((s[0]&u) == u) {
-        return ((s[0]&p)<<24)|((s[1]&m)<<18)|((s[2]&m)<<12)|((s[3]&m)<<6)|(s[4]&m);
-    } else if ((s[0]&t) == t) {
-        return ((s[0]&o)<<18)|((s[1]&m)<<12)|((s[2]&m)<<6)|(s[3]&m);
-    } else if ((s[0]&r) == r) {
-        return ((s[0]&n)<<12)|((s[1]&m)<<6)|(s[2]&m);
-    } else if ((s[0]&q) == q) {
-        return ((s[0]&m)<<6)|(s[1]&m);
-    } else {
-        return -1;
-    }
+    return s ? (uint32_t)utf8_to_utf32_code(s).code : -1;
 }
 
 utf32_code utf8_to_utf32_code(const char *s)
 {
     if (!s) {
         return { -1, 0 };
-    } else if ((s[0]&v) == 0x0) {
-        return { s[0], 1 };
-    } else if ((s[0]&u) == u) {
-        return { ((s[0]&p)<<24)|((s[1]&m)<<18)|((s[2]&m)<<12)|((s[3]&m)<<6)|(s[4]&m), 5 };
-    } else if ((s[0]&t) == t) {
-        return { ((s[0]&o)<<18)|((s[1]&m)<<12)|((s[2]&m)<<6)|(s[3]&m), 4 };
-    } else if ((s[0]&r) == r) {
-        return { ((s[0]&n)<<12)|((s[1]&m)<<6)|(s[2]&m), 3 };
-    } else if ((s[0]&q) == q) {
-        return { ((s[0]&m)<<6)|(s[1]&m), 2 };
-    } else {
+    }
+    uint8_t c = (uint8_t)s[0];
+    if ((c & q) == v) {
         return { -1, 1 };
     }
+    intptr_t len = utf8_len_table[c >> 3];
+    intptr_t code = c & utf8_mask_table[len];
+    for (intptr_t i = 1; i < len; i++) {
+        code = (code << 6) | (s[i] & m);
+    }
+    return { code, len };
 }
 
 int utf32_to_utf8(char *s, size_t len, uint32_t c)
@@ -122,3 +92,150 @@ int utf32_to_utf8(char *s, size_t len, uint32_t c)
     }
     return -1;
 }
+
+/*
+ * validating decoder
+ *
+ * a DFA over byte classes accepts the well-formed byte sequences listed
+ * in table 3-7 of the Unicode standard. each maximal subpart of an
+ * ill-formed sequence decodes as one U+FFFD replacement character.
+ */
+
+enum {
+    utf8_accept, utf8_reject, utf8_c1, utf8_c2, utf8_c3,
+    utf8_e0, utf8_ed, utf8_f0, utf8_f4
+};
+
+/* 00-7F, 80-8F, 90-9F, A0-BF, C0-C1 F5-FF, C2-DF, E0, E1-EF, ED, F0, F1-F3, F4 */
+static const uint8_t utf8_class_table[256] = {
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+    3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,
+    4,4,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,
+    6,7,7,7,7,7,7,7,7,7,7,7,7,8,7,7,9,10,10,10,11,4,4,4,4,4,4,4,4,4,4,4,
+};
+
+static const uint8_t utf8_lead_mask[12] = {
+    0x7f, 0, 0, 0, 0, 0x1f, 0x0f, 0x0f, 0x0f, 0x07, 0x07, 0x07
+};
+
+enum { A = utf8_accept, X = utf8_reject };
+
+static const uint8_t utf8_dfa[9][12] = {
+    /* accept */ { A, X, X, X, X, utf8_c1, utf8_e0, utf8_c2, utf8_ed, utf8_f0, utf8_c3, utf8_f4 },
+    /* reject */ { X, X, X, X, X, X, X, X, X, X, X, X },
+    /* c1 */     { X, A, A, A, X, X, X, X, X, X, X, X },
+    /* c2 */     { X, utf8_c1, utf8_c1, utf8_c1, X, X, X, X, X, X, X, X },
+    /* c3 */     { X, utf8_c2, utf8_c2, utf8_c2, X, X, X, X, X, X, X, X },
+    /* e0 */     { X, X, X, utf8_c1, X, X, X, X, X, X, X, X },
+    /* ed */     { X, utf8_c1, utf8_c1, X, X, X, X, X, X, X, X, X },
+    /* f0 */     { X, X, utf8_c2, utf8_c2, X, X, X, X, X, X, X, X },
+    /* f4 */     { X, utf8_c2, X, X, X, X, X, X, X, X, X, X },
+};
+
+/*
+ * decodes one sequence starting with a non-ASCII byte at p[i] and
+ * advances i past the bytes that belong to it.
+ */
+static inline uint32_t utf8_decode_one(const uint8_t *p, size_t len, size_t &i)
+{
+    uint8_t c = utf8_class_table[p[i]];
+    uint32_t state = utf8_dfa[utf8_accept][c];
+    uint32_t code = p[i++] & utf8_lead_mask[c];
+    while (state > utf8_reject && i < len) {
+        uint32_t next = utf8_dfa[state][utf8_class_table[p[i]]];
+        if (next == utf8_reject) break;
+        code = (code << 6) | (p[i++] & m);
+        state = next;
+    }
+    return state == utf8_accept ? code : 0xFFFD;
+}
+
+/*
+ * number of leading ASCII bytes, tested sixteen or eight bytes at a time
+ */
+static inline size_t utf8_ascii_prefix(const uint8_t *p, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    while (i + 16 <= len) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(p + i)));
+        if (mask) return i + ctz((uint32_t)mask);
+        i += 16;
+    }
+#endif
+    while (i + 8 <= len) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        if (w & 0x8080808080808080ull) break;
+        i += 8;
+    }
+    while (i < len && p[i] < 0x80) i++;
+    return i;
+}
+
+size_t utf8_to_utf32_n(const char *s, size_t len, uint32_t *codes,
+    uint32_t *offsets)
+{
+    const uint8_t *p = (const uint8_t*)s;
+    size_t i = 0, n = 0;
+
+    while (i < len) {
+        size_t ascii = utf8_ascii_prefix(p + i, len - i);
+        size_t end = i + ascii;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        while (i + 16 <= end) {
+            __m128i b = _mm_loadu_si128((const __m128i*)(p + i));
+            __m128i lo = _mm_unpacklo_epi8(b, zero), hi = _mm_unpackhi_epi8(b, zero);
+            __m128i *out = (__m128i*)(codes + n);
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+            if (offsets) {
+                __m128i o = _mm_add_epi32(_mm_set1_epi32((int)i),
+                    _mm_set_epi32(3, 2, 1, 0));
+                __m128i *oout = (__m128i*)(offsets + n);
+                for (int k = 0; k < 4; k++) {
+                    _mm_storeu_si128(oout + k, o);
+                    o = _mm_add_epi32(o, _mm_set1_epi32(4));
+                }
+            }
+            i += 16;
+            n += 16;
+        }
+#endif
+        for (; i < end; i++, n++) {
+            codes[n] = p[i];
+            if (offsets) offsets[n] = (uint32_t)i;
+        }
+        while (i < len && p[i] >= 0x80) {
+            if (offsets) offsets[n] = (uint32_t)i;
+            codes[n++] = utf8_decode_one(p, len, i);
+        }
+    }
+
+    return n;
+}
+
+size_t utf8_count(const char *s, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)s;
+    size_t i = 0, n = 0;
+
+    while (i < len) {
+        size_t ascii = utf8_ascii_prefix(p + i, len - i);
+        i += ascii;
+        n += ascii;
+        while (i < len && p[i] >= 0x80) {
+            utf8_decode_one(p, len, i);
+            n++;
+        }
+    }
+
+    return n;
+}
@@ -20,6 +20,18 @@ int utf32_to_utf8(char *s, size_t len, uint32_t c);
 struct utf32_code { intptr_t code; intptr_t len; };
 utf32_code utf8_to_utf32_code(const char *s);
 
+/*
+ * validating bulk decode of len bytes. writes one code point, and its
+ * byte offset if offsets is not null, for each sequence. ill-formed
+ * sequences become U+FFFD. codes and offsets need room for len entries.
+ * returns the number of code points.
+ */
+size_t utf8_to_utf32_n(const char *s, size_t len, uint32_t *codes,
+    uint32_t *offsets);
+
+/* number of code points utf8_to_utf32_n would return */
+size_t utf8_count(const char *s, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
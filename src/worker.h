@@ -156,18 +156,25 @@ void pool_worker_thread<ITEM,WORKER>::mainloop()
         /* sleep on dispatcher condition if there is no work */
         if (processing >= total) {
             std::unique_lock<std::mutex> lock(dispatcher.mutex);
-            dispatcher.request.wait(lock);
+            if (dispatcher.running && dispatcher.processing >= dispatcher.total) {
+                dispatcher.request.wait(lock);
+            }
             continue;
         }
 
-        /* dequeue work-item and process it */
-        workitem = dispatcher.processing.fetch_add(1, std::memory_order_seq_cst);
+        /* dequeue work-item, retrying if another worker took it first */
+        workitem = processing;
+        if (!dispatcher.processing.compare_exchange_strong(workitem,
+            workitem + 1, std::memory_order_seq_cst)) {
+            continue;
+        }
         (*worker)(dispatcher.queue[workitem]);
         processed = dispatcher.processed.fetch_add(1, std::memory_order_seq_cst);
 
         /* notify dispatcher when last item has been processed */
         total = dispatcher.total.load(std::memory_order_acquire);
         if (processed == total - 1) {
+            std::unique_lock<std::mutex> lock(dispatcher.mutex);
             dispatcher.response.notify_one();
         }
     }
@@ -221,33 +228,36 @@ bool pool_executor<ITEM,WORKER>::enqueue(const ITEM &item)
 template <typename ITEM, typename WORKER>
 void pool_executor<ITEM,WORKER>::run()
 {
-    /* if no workers or queue empty, do nothing */
-    if (workers.size() == 0 || processed == total) {
+    /* if no workers, do nothing. a queue that workers have already
+     * drained still falls through so that its counters are cleared */
+    if (workers.size() == 0) {
         return;
     }
 
-    /* wake all workers */
+    /*
+     * wake all workers and wait for the response. the lock is held while
+     * testing the predicates so that wakeups are not lost between a test
+     * and a wait, as the worker also takes the lock before notifying.
+     */
+    std::unique_lock<std::mutex> lock(mutex);
     request.notify_all();
-
-    /* while processed less than queue size, wait for response */
     while (processed < total) {
-        std::unique_lock<std::mutex> lock(mutex);
         response.wait(lock);
     }
 
-    /* work queue is processed, take lock and clear queue */
-    mutex.lock();
+    /* work queue is processed, clear queue while holding the lock */
     total.store(0, std::memory_order_release);
     processing.store(0, std::memory_order_release);
     processed.store(0, std::memory_order_release);
-    mutex.unlock();
 }
 
 template <typename ITEM, typename WORKER>
 void pool_executor<ITEM,WORKER>::shutdown()
 {
+    mutex.lock();
     running = false;
     request.notify_all();
+    mutex.unlock();
     for (size_t i = 0; i < workers.size(); i++) {
         workers[i]->thread.join();
     }
@@ -0,0 +1,158 @@
+// See LICENSE for license details.
+
+#pragma once
+
+/*
+ * helpers shared by the tests
+ *
+ * include first, tests always assert, even in release builds.
+ */
+
+#undef NDEBUG
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <climits>
+#include <cfloat>
+#include <cassert>
+#include <cmath>
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <tuple>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "glm/glm.hpp"
+
+#include "binpack.h"
+#include "utf8.h"
+#include "file.h"
+#include "image.h"
+#include "color.h"
+#include "draw.h"
+#include "font.h"
+#include "glyph.h"
+#include "bvh.h"
+#include "canvas.h"
+#include "worker.h"
+#include "raster.h"
+#include "shade.h"
+
+using namespace std::chrono;
+
+static const char *font_paths[] = {
+    "fonts/DejaVuSans.ttf", "fonts/Roboto-Regular.ttf"
+};
+static const char *text_lang = "en";
+static const char *pangram = "The quick brown fox jumps over the lazy dog";
+
+static inline float elapsed_ms(high_resolution_clock::time_point t1,
+    high_resolution_clock::time_point t2)
+{
+    return (float)duration_cast<nanoseconds>(t2 - t1).count() / 1e6f;
+}
+
+static inline double mb_per_sec(size_t bytes,
+    high_resolution_clock::time_point t1, high_resolution_clock::time_point t2)
+{
+    return (double)bytes / 1e3 / elapsed_ms(t1, t2);
+}
+
+static inline uint32_t pixel(image_ptr img, int x, int y)
+{
+    return ((uint32_t*)img->getData())[y * img->getWidth() + x];
+}
+
+static inline MVGBrush solid(float r, float g, float b)
+{
+    return MVGBrush{MVGBrushSolid, { }, { color(r,g,b,1) }};
+}
+
+/* rasterize a batch, with the canvas shader if ctx is not null */
+static inline void render(draw_list &batch, AContext *ctx, int width,
+    int height, std::vector<char> &pixels)
+{
+    std::unique_ptr<canvas_shader> shader;
+    draw_rasterizer r(width, height, 0);
+    if (ctx) {
+        shader = std::make_unique<canvas_shader>(ctx);
+        r.set_shader(shader_canvas, shader.get());
+    }
+    r.render(batch);
+    char *data = (char*)r.get_image()->getData();
+    pixels.assign(data, data + width * height * 4);
+}
+
+static inline void render_text(draw_list &batch, font_manager_ft &manager,
+    font_face *face, const char *str, int font_size, float x, float y,
+    uint color)
+{
+    std::vector<glyph_shape> shapes;
+    text_shaper_hb shaper;
+    text_renderer_ft renderer(&manager);
+    text_segment segment(str, text_lang, face, font_size * 64, x, y, color);
+
+    shaper.shape(shapes, segment);
+    renderer.render(batch, shapes, segment);
+}
+
+/* lines of text at a few sizes and subpixel offsets, wrapping every 32 */
+static inline void render_lines(draw_list &batch, font_manager_ft &manager,
+    font_face *face, int lines, float x, float spacing)
+{
+    text_shaper_hb shaper;
+    text_renderer_ft renderer(&manager);
+    std::vector<glyph_shape> shapes;
+
+    for (int i = 0; i < lines; i++) {
+        text_segment segment(pangram, text_lang, face, (12 + i % 4 * 6) * 64,
+            x + (float)(i % 3) * 0.25f, 20.0f + (float)(i % 32) * spacing,
+            0xff000000);
+        shapes.clear();
+        shaper.shape(shapes, segment);
+        renderer.render(batch, shapes, segment);
+    }
+}
+
+static inline std::string temp_path(const char *name)
+{
+    return file::getTempDir() + "/" + name;
+}
+
+static inline size_t file_size(std::string path)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    size_t size = (size_t)ftell(f);
+    fclose(f);
+    return size;
+}
+
+static inline std::vector<uint8_t> read_file(std::string path)
+{
+    file_ptr f = file::getFile(path);
+    const uint8_t *buf = (const uint8_t*)f->getBuffer();
+    assert(buf);
+    return std::vector<uint8_t>(buf, buf + f->getLength());
+}
+
+static inline void write_file(std::string path, const std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    assert(f);
+    assert(fwrite(data.data(), 1, data.size(), f) == data.size());
+    fclose(f);
+}
@@ -85,12 +85,31 @@ int main()
     }
     const auto t12 = high_resolution_clock::now();
 
+    /* render (loop) into a new draw list per iteration */
+    const auto t13 = high_resolution_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        draw_list fresh;
+        renderer.render(fresh, shapes, segment);
+    }
+    const auto t14 = high_resolution_clock::now();
+
+    /* render (loop) into a draw list from a frame arena */
+    draw_list_arena arena;
+    const auto t15 = high_resolution_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        arena.reset();
+        renderer.render(*arena.acquire(), shapes, segment);
+    }
+    const auto t16 = high_resolution_clock::now();
+
     float r1 = (float)duration_cast<nanoseconds>(t2 - t1).count() / 1e3;
     float r2 = (float)duration_cast<nanoseconds>(t4 - t3).count() / 1e3;
     float r3 = (float)duration_cast<nanoseconds>(t6 - t5).count() / 1e3;
     float r4 = (float)duration_cast<nanoseconds>(t8 - t7).count() / 1e3;
     float r5 = (float)duration_cast<nanoseconds>(t10 - t9).count() / 1e3;
     float r6 = (float)duration_cast<nanoseconds>(t12 - t11).count() / 1e3;
+    float r7 = (float)duration_cast<nanoseconds>(t14 - t13).count() / 1e3;
+    float r8 = (float)duration_cast<nanoseconds>(t16 - t15).count() / 1e3;
 
     printf("shape (cold)               = %12.3f microseconds\n", r1);
     printf("shape (hot)                = %12.3f microseconds\n", r2);
@@ -98,4 +117,6 @@ int main()
     printf("render (hot)               = %12.3f microseconds\n", r4);
     printf("shape time (per glyph)     = %12.3f microseconds\n", r5/(iterations*strlen(test_str_1)));
     printf("render time (per glyph)    = %12.3f microseconds\n", r6/(iterations*strlen(test_str_1)));
+    printf("render new list (per glyph)= %12.3f microseconds\n", r7/(iterations*strlen(test_str_1)));
+    printf("render arena (per glyph)   = %12.3f microseconds\n", r8/(iterations*strlen(test_str_1)));
 }
\ No newline at end of file
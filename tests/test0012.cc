@@ -5,6 +5,8 @@
 #include <cassert>
 
 #include <string>
+#include <random>
+#include <chrono>
 
 #include "bitcode.h"
 
@@ -296,7 +298,158 @@ void test_bitcode()
     test_bitcode_vlu_mixed();
 }
 
+/*
+ * memory reader and bulk decode
+ */
+
+struct symbol { uint64_t val; size_t width; };
+
+static std::vector<symbol> random_symbols(size_t count, int vlu_percent)
+{
+    std::mt19937_64 gen(1);
+    std::vector<symbol> syms(count);
+    for (auto &s : syms) {
+        bool vlu = (int)(gen() % 100) < vlu_percent;
+        s.width = vlu ? 0 : 1 + gen() % 64;
+        s.val = vlu ? gen() & msk(gen() % 57) : gen() & msk(s.width);
+    }
+    return syms;
+}
+
+static void write_symbols(vector_writer &vw, std::vector<symbol> &syms)
+{
+    bitcode_writer bw(&vw);
+    for (auto &s : syms) {
+        if (s.width) bw.write_fixed(s.val, s.width);
+        else bw.write_vlu(s.val);
+    }
+    bw.flush();
+}
+
+void test_bitcode_memory_reader()
+{
+    /* fixed, vlu and interleaved streams that are not byte aligned */
+    for (int vlu_percent : { 0, 100, 50 }) {
+        std::vector<symbol> syms = random_symbols(10000, vlu_percent);
+        vector_writer vw;
+        write_symbols(vw, syms);
+
+        bitcode_memory_reader mr(vw.buffer);
+        vector_reader vr(vw.buffer);
+        bitcode_reader br(&vr);
+        for (auto &s : syms) {
+            assert((s.width ? mr.read_fixed(s.width) : mr.read_vlu()) == s.val);
+            assert((s.width ? br.read_fixed(s.width) : br.read_vlu()) == s.val);
+        }
+        assert(mr.tell() == vw.buffer.size());
+    }
+
+    /* bulk reads match single reads for every width */
+    for (size_t width = 1; width <= 64; width++) {
+        std::vector<uint64_t> out(1001);
+        std::vector<symbol> syms = random_symbols(out.size(), 0);
+        vector_writer vw;
+        bitcode_writer bw(&vw);
+        for (auto &s : syms) bw.write_fixed(s.val & msk(width), width);
+        bw.flush();
+
+        bitcode_memory_reader mr(vw.buffer);
+        mr.read_fixed_n(out.data(), out.size(), width);
+        for (size_t i = 0; i < out.size(); i++) {
+            assert(out[i] == (syms[i].val & msk(width)));
+        }
+
+        vector_reader vr(vw.buffer);
+        bitcode_reader br(&vr);
+        br.read_fixed_n(out.data(), out.size(), width);
+        for (size_t i = 0; i < out.size(); i++) {
+            assert(out[i] == (syms[i].val & msk(width)));
+        }
+    }
+
+    std::vector<symbol> syms = random_symbols(1000, 100);
+    std::vector<uint64_t> out(syms.size());
+    vector_writer vw;
+    write_symbols(vw, syms);
+    bitcode_memory_reader mr(vw.buffer);
+    mr.read_vlu_n(out.data(), out.size());
+    for (size_t i = 0; i < out.size(); i++) {
+        assert(out[i] == syms[i].val);
+    }
+
+    /* writes before the end overwrite without truncating */
+    vector_writer tw;
+    tw.write("abcdef", 6);
+    tw.seek(1);
+    tw.write("XY", 2);
+    assert(tw.buffer.size() == 6 && memcmp(tw.buffer.data(), "aXYdef", 6) == 0);
+
+    printf("\nmemory_reader: PASS\n");
+}
+
+/*
+ * symbols per second for the virtual and memory readers
+ */
+
+template <typename F>
+static void bench(const char *name, size_t count, F fn)
+{
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    fn();
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    double secs = std::chrono::duration<double>(t2 - t1).count();
+    printf("%-27s= %12.3f Msymbols/sec\n", name, count / secs / 1e6);
+}
+
+void bench_bitcode(size_t count)
+{
+    std::vector<uint64_t> out(count);
+    std::vector<uint64_t> in(count);
+    std::mt19937_64 gen(2);
+    for (auto &v : in) v = gen() & msk(gen() % 22);
+
+    vector_writer fw, uw;
+    bitcode_writer fbw(&fw), ubw(&uw);
+    bench("write_fixed(12)", count, [&]() {
+        for (size_t i = 0; i < count; i++) fbw.write_fixed(in[i], 12);
+        fbw.flush();
+    });
+    bench("write_vlu", count, [&]() {
+        for (size_t i = 0; i < count; i++) ubw.write_vlu(in[i]);
+        ubw.flush();
+    });
+
+    vector_reader fr(fw.buffer), ur(uw.buffer);
+    bitcode_reader fbr(&fr), ubr(&ur);
+    bitcode_memory_reader fmr(fw.buffer), umr(uw.buffer);
+    bench("read_fixed(12) (reader)", count, [&]() {
+        for (size_t i = 0; i < count; i++) out[i] = fbr.read_fixed(12);
+    });
+    bench("read_fixed(12) (memory)", count, [&]() {
+        for (size_t i = 0; i < count; i++) out[i] = fmr.read_fixed(12);
+    });
+    fmr.seek(0);
+    bench("read_fixed_n(12) (memory)", count, [&]() {
+        fmr.read_fixed_n(out.data(), count, 12);
+    });
+    for (size_t i = 0; i < count; i++) assert(out[i] == (in[i] & msk(12)));
+
+    bench("read_vlu (reader)", count, [&]() {
+        for (size_t i = 0; i < count; i++) out[i] = ubr.read_vlu();
+    });
+    bench("read_vlu (memory)", count, [&]() {
+        for (size_t i = 0; i < count; i++) out[i] = umr.read_vlu();
+    });
+    umr.seek(0);
+    bench("read_vlu_n (memory)", count, [&]() {
+        umr.read_vlu_n(out.data(), count);
+    });
+    assert(out == in);
+}
+
 int main(int argc, char **argv)
 {
 	test_bitcode();
+	test_bitcode_memory_reader();
+	bench_bitcode(10000000);
 }
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "test.h"
+
+static const char* test_str_1 = "the quick brown fox jumps over the lazy dog";
+static const int width = 640, height = 480;
+
+static void quad(draw_list &batch, float x1, float y1, float x2, float y2,
+    uint color)
+{
+    uint o0 = draw_list_vertex(batch, {{x1, y1, 0}, {0, 0}, color});
+    uint o1 = draw_list_vertex(batch, {{x2, y1, 0}, {0, 0}, color});
+    uint o2 = draw_list_vertex(batch, {{x2, y2, 0}, {0, 0}, color});
+    uint o3 = draw_list_vertex(batch, {{x1, y2, 0}, {0, 0}, color});
+    draw_list_indices(batch, image_none, mode_triangles, shader_simple,
+        {o0, o3, o1, o1, o3, o2});
+}
+
+static void test_quads()
+{
+    draw_list batch;
+    draw_rasterizer rasterizer(width, height);
+
+    /* opaque red, then half transparent blue overlapping it */
+    quad(batch, 10, 10, 110, 110, 0xff0000ff);
+    quad(batch, 60, 60, 160, 160, 0x80ff0000);
+    rasterizer.render(batch);
+
+    image_ptr img = rasterizer.get_image();
+    assert(pixel(img, 5, 5) == 0xffffffff);
+    assert(pixel(img, 20, 20) == 0xff0000ff);
+    assert(pixel(img, 10, 10) == 0xff0000ff);
+    assert(pixel(img, 110, 40) == 0xffffffff);
+
+    /* pixels on the shared diagonal edge must not be blended twice */
+    uint32_t c1 = pixel(img, 80, 80), c2 = pixel(img, 150, 150);
+    assert((c1 & 0xff) == 0x7f && ((c1 >> 16) & 0xff) == 0x80);
+    assert((c2 & 0xff) == 0xff - 0x80 && ((c2 >> 16) & 0xff) == 0xff);
+    for (int x = 110; x < 160; x++) {
+        assert(pixel(img, x, 219 - x) == c2);
+    }
+
+    printf("quads: PASS\n");
+}
+
+static void test_text(const char *font_path, const char *file)
+{
+    font_manager_ft manager;
+    auto face = manager.findFontByPath(font_path);
+
+    std::vector<glyph_shape> shapes;
+    draw_list batch;
+
+    text_shaper_hb shaper;
+    text_renderer_ft renderer(&manager);
+    for (int sz = 8, y = 20; sz <= 48; sz += 4, y += sz + 4) {
+        text_segment segment(test_str_1, text_lang, face,
+            sz * 64, 10, (float)y, 0xff000000);
+        shapes.clear();
+        shaper.shape(shapes, segment);
+        renderer.render(batch, shapes, segment);
+    }
+
+    /* output must be identical whether tiles are rendered serially or not */
+    size_t num_threads = std::thread::hardware_concurrency();
+    draw_rasterizer r1(width, height, 0);
+    draw_rasterizer r2(width, height, num_threads);
+
+    const auto t1 = high_resolution_clock::now();
+    r1.render(batch);
+    const auto t2 = high_resolution_clock::now();
+    r2.render(batch);
+    const auto t3 = high_resolution_clock::now();
+
+    image_ptr i1 = r1.get_image(), i2 = r2.get_image();
+    assert(memcmp(i1->getData(), i2->getData(), width * height * 4) == 0);
+
+    size_t ink = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            ink += pixel(i1, x, y) != 0xffffffff;
+        }
+    }
+    assert(ink > 0);
+
+    float d1 = elapsed_ms(t1, t2), d2 = elapsed_ms(t2, t3);
+    printf("text: PASS (%zu glyph vertices, %zu pixels inked)\n",
+        batch.vertices.size(), ink);
+    printf("render (1 thread)          = %12.3f milliseconds\n", d1);
+    printf("render (%2zu threads)        = %12.3f milliseconds\n", num_threads, d2);
+
+    if (file) {
+        image::saveToFile(file, i2);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *font_path = "fonts/Roboto-Regular.ttf";
+    const char *file = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-file") == 0 && i + 1 < argc) {
+            file = argv[++i];
+        } else if (argv[i][0] != '-') {
+            font_path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [-file <output.png>] [font]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    test_quads();
+    test_text(font_path, file);
+}
@@ -0,0 +1,192 @@
+#include "test.h"
+
+static const int width = 640, height = 480;
+
+static uint32_t red(uint32_t c) { return c & 0xff; }
+
+static void make_scene(MVGCanvas &canvas)
+{
+    canvas.set_transform(mat3(1));
+
+    /* filled circle without a stroke */
+    canvas.set_fill_brush(solid(1,0,0));
+    canvas.set_stroke_width(0.0f);
+    canvas.new_circle(vec2(0), 50.0f)->set_position(vec2(100,100));
+
+    /* filled rectangle with a black stroke */
+    canvas.set_fill_brush(solid(0,0,1));
+    canvas.set_stroke_brush(solid(0,0,0));
+    canvas.set_stroke_width(4.0f);
+    canvas.new_rectangle(vec2(0), vec2(50,30))->set_position(vec2(300,100));
+
+    /* open path with a green stroke */
+    canvas.set_stroke_brush(solid(0,1,0));
+    MVGPath *p1 = canvas.new_path(vec2(0), vec2(100,20));
+    p1->set_position(vec2(200,300));
+    p1->new_line(vec2(0,10), vec2(100,10));
+    MVGPath *p2 = canvas.new_path(vec2(0), vec2(100,100));
+    p2->set_position(vec2(500,300));
+    p2->new_quadratic_curve(vec2(0,0), vec2(0,50), vec2(50,50));
+    p2->new_quadratic_curve(vec2(50,50), vec2(100,50), vec2(100,100));
+
+    /* rounded rectangle with an axial gradient from red to blue */
+    canvas.set_fill_brush(MVGBrush{MVGBrushAxial, { vec2(0,0), vec2(100,0) },
+        { color(1,0,0,1), color(0,0,1,1) }});
+    canvas.set_stroke_width(0.0f);
+    canvas.new_rounded_rectangle(vec2(0), vec2(50,20), 5.0f)
+        ->set_position(vec2(100,400));
+
+    /* ellipse */
+    canvas.set_fill_brush(solid(0,0,0));
+    canvas.new_ellipse(vec2(0), vec2(60,30))->set_position(vec2(500,100));
+}
+
+static void test_scene(const char *file)
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+
+    make_scene(canvas);
+    canvas.emit(batch);
+
+    /* output must be identical whether tiles are rendered serially or not */
+    size_t num_threads = std::thread::hardware_concurrency();
+    canvas_shader shader(canvas.ctx.get());
+    draw_rasterizer r1(width, height, 0);
+    draw_rasterizer r2(width, height, num_threads);
+    r1.set_shader(shader_canvas, &shader);
+    r2.set_shader(shader_canvas, &shader);
+
+    const auto t1 = high_resolution_clock::now();
+    r1.render(batch);
+    const auto t2 = high_resolution_clock::now();
+    r2.render(batch);
+    const auto t3 = high_resolution_clock::now();
+
+    image_ptr img = r1.get_image();
+    assert(memcmp(img->getData(), r2.get_image()->getData(),
+        width * height * 4) == 0);
+
+    /* circle interior, corner of its quad and background */
+    assert(pixel(img, 100, 100) == 0xff0000ff);
+    assert(pixel(img, 140, 140) == 0xffffffff);
+    assert(pixel(img, 5, 5) == 0xffffffff);
+
+    /* rectangle interior, stroke on its top edge and outside the stroke */
+    assert(pixel(img, 300, 100) == 0xffff0000);
+    assert(pixel(img, 300, 70) == 0xff000000);
+    assert(pixel(img, 300, 66) == 0xffffffff);
+
+    /* stroked line has no interior */
+    assert(pixel(img, 200, 299) == 0xff00ff00);
+    assert(pixel(img, 200, 290) == 0xffffffff);
+
+    /* quadratic curves pass through their shared endpoint */
+    assert(pixel(img, 500, 299) == 0xff00ff00);
+
+    /* axial gradient fades from red to blue */
+    assert(red(pixel(img, 60, 400)) > red(pixel(img, 100, 400)));
+    assert(red(pixel(img, 100, 400)) > red(pixel(img, 140, 400)));
+
+    /* ellipse interior and outside near its bounding box corner */
+    assert(pixel(img, 500, 100) == 0xff000000);
+    assert(pixel(img, 445, 75) == 0xffffffff);
+
+    float d1 = elapsed_ms(t1, t2), d2 = elapsed_ms(t2, t3);
+    printf("canvas: PASS (%zu shapes, %zu edges)\n",
+        canvas.ctx->shapes.size(), canvas.ctx->edges.size());
+    printf("render (1 thread)          = %12.3f milliseconds\n", d1);
+    printf("render (%2zu threads)        = %12.3f milliseconds\n", num_threads, d2);
+
+    if (file) {
+        image::saveToFile(file, img);
+    }
+}
+
+static void make_star(MVGCanvas &canvas, vec2 pos, int points, bool curved)
+{
+    float r1 = 100.0f, r2 = 40.0f;
+    MVGPatch *p = canvas.new_patch(vec2(0), vec2(r1 * 2.0f));
+    p->set_position(pos);
+    p->new_contour();
+    for (int i = 0; i < points * 2; i++) {
+        float a1 = (float)M_PI * i / points, a2 = (float)M_PI * (i + 1) / points;
+        float l1 = i & 1 ? r2 : r1, l2 = i & 1 ? r1 : r2;
+        vec2 p1 = vec2(r1) + vec2(sinf(a1), -cosf(a1)) * l1;
+        vec2 p2 = vec2(r1) + vec2(sinf(a2), -cosf(a2)) * l2;
+        if (curved) {
+            p->new_quadratic_curve(p1, vec2(r1) + (p1 + p2 - vec2(r1 * 2.0f)), p2);
+        } else {
+            p->new_line(p1, p2);
+        }
+    }
+}
+
+static void test_cells()
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+
+    canvas.set_transform(mat3(1));
+    canvas.set_fill_brush(solid(0,0,1));
+    canvas.set_stroke_brush(solid(0,0,0));
+    canvas.set_stroke_width(3.0f);
+    make_star(canvas, vec2(160,160), 12, false);
+    make_star(canvas, vec2(480,160), 8, true);
+    canvas.set_stroke_width(0.0f);
+    make_star(canvas, vec2(160,360), 16, true);
+    canvas.emit(batch);
+
+    /* cells must contain a subset of the edges of their shape */
+    AContext &ctx = *canvas.ctx;
+    size_t binned = 0, visited = 0;
+    for (auto &shape : ctx.shapes) {
+        assert(shape.cell_count == AContext::cell_grid * AContext::cell_grid);
+        for (int i = 0; i < (int)shape.cell_count; i++) {
+            ACell &cell = ctx.cells[(int)shape.cell_offset + i];
+            assert(cell.edge_count >= 1 && cell.edge_count <= shape.edge_count);
+            visited += (size_t)cell.edge_count;
+            binned += (size_t)shape.edge_count;
+        }
+    }
+    assert(visited < binned);
+
+    /* output must be identical to visiting all edges for every fragment */
+    canvas_shader shader(&ctx);
+    draw_rasterizer r1(width, height, 0), r2(width, height, 0);
+    r1.set_shader(shader_canvas, &shader);
+    r2.set_shader(shader_canvas, &shader);
+
+    const auto t1 = high_resolution_clock::now();
+    r1.render(batch);
+    const auto t2 = high_resolution_clock::now();
+    for (auto &shape : ctx.shapes) {
+        shape.cell_count = 0;
+    }
+    r2.render(batch);
+    const auto t3 = high_resolution_clock::now();
+
+    assert(memcmp(r1.get_image()->getData(), r2.get_image()->getData(),
+        width * height * 4) == 0);
+
+    float d1 = elapsed_ms(t1, t2), d2 = elapsed_ms(t2, t3);
+    printf("cells: PASS (%zu of %zu edges visited per cell)\n", visited, binned);
+    printf("render (cells)             = %12.3f milliseconds\n", d1);
+    printf("render (all edges)         = %12.3f milliseconds\n", d2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *file = nullptr;
+
+    if (! (argc == 1 || (argc == 3 && strcmp(argv[1], "-file") == 0 &&
+           (file = argv[2]))) ) {
+        fprintf(stderr, "usage: %s [-file <output.png>]\n", argv[0]);
+        exit(1);
+    }
+
+    test_scene(file);
+    test_cells();
+}
@@ -0,0 +1,119 @@
+#include "test.h"
+
+static vec2 cubic(const vec2 p[4], float t)
+{
+    float s = 1.0f - t;
+    return p[0]*(s*s*s) + p[1]*(3.0f*s*s*t) + p[2]*(3.0f*s*t*t) + p[3]*(t*t*t);
+}
+
+static vec2 quadratic(const vec2 p[4], float t)
+{
+    float s = 1.0f - t;
+    return p[0]*(s*s) + p[1]*(2.0f*s*t) + p[2]*(t*t);
+}
+
+static float max_error(const AEdge &e, std::vector<AEdge> &quads)
+{
+    float n = (float)quads.size(), err = 0.0f;
+    for (size_t i = 0; i < quads.size(); i++) {
+        for (int j = 0; j <= 32; j++) {
+            float u = j / 32.0f, t = (i + u) / n;
+            vec2 d = cubic(e.p, t) - quadratic(quads[i].p, u);
+            err = std::max(err, glm::length(d));
+        }
+    }
+    return err;
+}
+
+static void test_exact()
+{
+    /* degree elevated quadratic converts to one identical quadratic */
+    vec2 q0(0,0), q1(50,100), q2(100,0);
+    AEdge e{MVGEdgeCubic, { q0, q0 + (q1 - q0) * (2.0f/3.0f),
+        q2 + (q1 - q2) * (2.0f/3.0f), q2 }};
+    std::vector<AEdge> quads;
+    AEdge::cubic_to_quadratics(e, 0.1f, quads);
+    assert(quads.size() == 1);
+    assert(quads[0].type == MVGEdgeQuadratic);
+    assert(glm::length(quads[0].p[1] - q1) < 1e-3f);
+    printf("exact: PASS\n");
+}
+
+static void test_tolerance()
+{
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> dist(0.0f, 200.0f);
+    float tolerances[] = { 1.0f, 0.1f, 0.01f };
+
+    for (float tol : tolerances) {
+        size_t count = 0;
+        float worst = 0.0f;
+        for (int i = 0; i < 1000; i++) {
+            AEdge e{MVGEdgeCubic, {
+                vec2(dist(gen), dist(gen)), vec2(dist(gen), dist(gen)),
+                vec2(dist(gen), dist(gen)), vec2(dist(gen), dist(gen)) }};
+            std::vector<AEdge> quads;
+            AEdge::cubic_to_quadratics(e, tol, quads);
+            assert(quads.front().p[0] == e.p[0]);
+            assert(quads.back().p[2] == e.p[3]);
+            for (size_t j = 1; j < quads.size(); j++) {
+                assert(quads[j].p[0] == quads[j-1].p[2]);
+            }
+            float err = max_error(e, quads);
+            assert(err <= tol * 1.01f + 1e-3f);
+            worst = std::max(worst, err);
+            count += quads.size();
+        }
+        printf("tolerance %5.2f: PASS (%5.2f quadratics per cubic, "
+            "max error %6.4f)\n", tol, count / 1000.0f, worst);
+    }
+}
+
+static void test_context()
+{
+    AContext ctx;
+    ctx.cubic_tolerance = 0.1f;
+    int shape_num = ctx.new_shape(vec2(0), vec2(100));
+    ctx.new_contour();
+    ctx.new_edge(AEdge{MVGEdgeCubic, {
+        vec2(0,0), vec2(0,100), vec2(100,100), vec2(100,0) }});
+    ctx.new_edge(AEdge{MVGEdgeLinear, { vec2(100,0), vec2(0,0) }});
+
+    AShape &shape = ctx.shapes[shape_num];
+    assert(shape.edge_count == (float)ctx.edges.size());
+    assert(ctx.contours[0].edge_count == shape.edge_count);
+    for (auto &e : ctx.edges) {
+        assert(e.type != MVGEdgeCubic);
+    }
+    printf("context: PASS (%zu edges)\n", ctx.edges.size());
+}
+
+static void bench_convert()
+{
+    std::mt19937 gen(2);
+    std::uniform_real_distribution<float> dist(0.0f, 4096.0f);
+    std::vector<AEdge> cubics, quads;
+    for (int i = 0; i < 100000; i++) {
+        cubics.push_back(AEdge{MVGEdgeCubic, {
+            vec2(dist(gen), dist(gen)), vec2(dist(gen), dist(gen)),
+            vec2(dist(gen), dist(gen)), vec2(dist(gen), dist(gen)) }});
+    }
+
+    const auto t1 = high_resolution_clock::now();
+    for (auto &e : cubics) {
+        AEdge::cubic_to_quadratics(e, AContext::default_cubic_tolerance, quads);
+    }
+    const auto t2 = high_resolution_clock::now();
+
+    float d = elapsed_ms(t1, t2) * 1e6f / cubics.size();
+    printf("cubic_to_quadratics        = %12.3f nanoseconds (%zu quadratics)\n",
+        d, quads.size());
+}
+
+int main(int argc, char **argv)
+{
+    test_exact();
+    test_tolerance();
+    test_context();
+    bench_convert();
+}
@@ -0,0 +1,116 @@
+#include "test.h"
+
+static int linear_find_brush(AContext &ctx, ABrush *b)
+{
+    for (size_t i = 0; i < ctx.brushes.size(); i++) {
+        if (AContext::brush_equals(&ctx.brushes[i], b)) return (int)i;
+    }
+    return -1;
+}
+
+static int linear_find_shape(AContext &ctx, AShape *s, AEdge *e)
+{
+    for (size_t i = 0; i < ctx.shapes.size(); i++) {
+        AEdge *oe = ctx.edges.data() + (int)ctx.shapes[i].edge_offset;
+        if (AContext::shape_equals(&ctx.shapes[i], oe, s, e)) return (int)i;
+    }
+    return -1;
+}
+
+static ABrush solid_brush(float r, float g, float b)
+{
+    return ABrush{MVGBrushSolid, { }, { vec4(r, g, b, 1) }};
+}
+
+static void test_brushes()
+{
+    AContext ctx;
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> dist(0, 63);
+
+    for (int i = 0; i < 10000; i++) {
+        ABrush b = solid_brush(dist(gen) / 63.0f, dist(gen) / 63.0f, 0.0f);
+        int expect = linear_find_brush(ctx, &b);
+        assert(ctx.find_brush(&b) == expect);
+        int brush_num = ctx.add_brush(&b);
+        assert(expect == -1 || brush_num == expect);
+    }
+
+    /* -0.0f equals 0.0f so it must hash to the same brush */
+    ABrush b0 = solid_brush(0.0f, 0.0f, 0.0f);
+    ABrush b1 = solid_brush(-0.0f, 0.0f, -0.0f);
+    assert(ctx.find_brush(&b0) == ctx.find_brush(&b1));
+
+    /* updated brushes are found by their new contents only */
+    ABrush b2 = solid_brush(0.5f, 0.5f, 0.5f);
+    int brush_num = ctx.find_brush(&b0);
+    assert(ctx.find_brush(&b2) == -1);
+    ctx.update_brush(brush_num, &b2);
+    assert(ctx.find_brush(&b2) == brush_num);
+    assert(ctx.find_brush(&b0) == linear_find_brush(ctx, &b0));
+
+    printf("brushes: PASS (%zu unique)\n", ctx.brushes.size());
+}
+
+static void test_shapes()
+{
+    AContext ctx;
+    std::mt19937 gen(2);
+    std::uniform_int_distribution<int> dist(1, 32);
+
+    for (int i = 0; i < 10000; i++) {
+        AShape s{0, 0, 0, 1, vec2(0), vec2((float)dist(gen)), -1, -1, 0};
+        AEdge e{MVGPrimitiveCircle, { vec2(s.size.x/2), vec2(s.size.x/2) }};
+        int expect = linear_find_shape(ctx, &s, &e);
+        assert(ctx.find_shape(&s, &e) == expect);
+        int shape_num = ctx.add_shape(&s, &e);
+        assert(expect == -1 || shape_num == expect);
+    }
+
+    /* shapes built incrementally are found once complete */
+    int shape_num = ctx.new_shape(vec2(0), vec2(10));
+    ctx.new_edge(AEdge{MVGEdgeLinear, { vec2(0,0), vec2(10,10) }});
+    ctx.new_edge(AEdge{MVGEdgeLinear, { vec2(10,10), vec2(0,0) }});
+    AShape s = ctx.shapes[shape_num];
+    AEdge *e = &ctx.edges[(int)s.edge_offset];
+    assert(ctx.find_shape(&s, e) == shape_num);
+
+    printf("shapes: PASS (%zu unique)\n", ctx.shapes.size());
+}
+
+static void bench_emit(size_t count)
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+
+    canvas.set_transform(mat3(1));
+    canvas.set_stroke_width(1.0f);
+    canvas.set_stroke_brush(MVGBrush{MVGBrushSolid, { }, { color(1,1,1,0.5f) }});
+    for (size_t i = 0; i < count; i++) {
+        /* every object has a unique fill brush */
+        float r = (i & 255) / 255.0f, g = ((i >> 8) & 255) / 255.0f;
+        float b = ((i >> 16) & 255) / 255.0f;
+        canvas.set_fill_brush(solid(r,g,b));
+        canvas.new_circle(vec2(0), 5.0f)->set_position(
+            vec2((float)(i % 100) * 10.0f, (float)(i / 100) * 10.0f));
+    }
+
+    const auto t1 = high_resolution_clock::now();
+    canvas.emit(batch);
+    const auto t2 = high_resolution_clock::now();
+
+    assert(canvas.ctx->brushes.size() == count + 1);
+
+    float d = elapsed_ms(t1, t2);
+    printf("emit (%6zu objects)       = %12.3f milliseconds\n", count, d);
+}
+
+int main(int argc, char **argv)
+{
+    test_brushes();
+    test_shapes();
+    bench_emit(1000);
+    bench_emit(10000);
+    bench_emit(100000);
+}
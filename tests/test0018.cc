@@ -0,0 +1,198 @@
+#include "test.h"
+
+static const int width = 640, height = 480;
+
+static void make_star(MVGPatch *p, float r1, float r2, int points)
+{
+    p->clear();
+    p->new_contour();
+    for (int i = 0; i < points * 2; i++) {
+        float a1 = (float)M_PI * i / points, a2 = (float)M_PI * (i + 1) / points;
+        float l1 = i & 1 ? r2 : r1, l2 = i & 1 ? r1 : r2;
+        p->new_line(vec2(r1) + vec2(sinf(a1), -cosf(a1)) * l1,
+                    vec2(r1) + vec2(sinf(a2), -cosf(a2)) * l2);
+    }
+}
+
+static void make_scene(MVGCanvas &canvas, size_t count, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<float> x(0, width), y(0, height), c(0, 1);
+
+    canvas.set_transform(mat3(1));
+    canvas.set_stroke_brush(solid(0,0,0));
+    for (size_t i = 0; i < count; i++) {
+        canvas.set_fill_brush(solid(c(gen), c(gen), c(gen)));
+        canvas.set_stroke_width((float)(i % 3));
+        switch (i % 4) {
+        case 0: canvas.new_circle(vec2(0), 10.0f); break;
+        case 1: canvas.new_rectangle(vec2(0), vec2(12,8)); break;
+        case 2: canvas.new_rounded_rectangle(vec2(0), vec2(12,8), 3.0f); break;
+        case 3: make_star(canvas.new_patch(vec2(0), vec2(40)), 20, 8, 6); break;
+        }
+        canvas.get_drawable(i)->set_position(vec2(x(gen), y(gen)));
+    }
+}
+
+static void change_scene(MVGCanvas &canvas, size_t count, std::mt19937 &gen)
+{
+    std::uniform_int_distribution<size_t> obj(0, canvas.num_drawables() - 1);
+    std::uniform_real_distribution<float> x(0, width), y(0, height), c(0, 1);
+
+    for (size_t i = 0; i < count; i++) {
+        MVGDrawable *o = canvas.get_drawable(obj(gen));
+        switch (i % 4) {
+        case 0: o->set_position(vec2(x(gen), y(gen))); break;
+        case 1: o->set_fill_brush(solid(c(gen), c(gen), c(gen))); break;
+        case 2: o->set_visible(!o->is_visible()); break;
+        case 3:
+            if (o->drawable_type == MVGCanvas::drawable_patch) {
+                make_star(static_cast<MVGPatch*>(o), 20, 4 + c(gen) * 12, 6);
+            } else {
+                o->set_stroke_width(c(gen) * 4.0f);
+            }
+            break;
+        }
+    }
+}
+
+/* copy of a buffer as seen by an uploader that only applies dirty ranges */
+typedef std::vector<char> shadow;
+
+template <typename T> static void upload(shadow &data, std::vector<T> &v,
+    std::vector<MVGDirty::range> &ranges)
+{
+    data.resize(v.size() * sizeof(T));
+    for (auto &r : ranges) {
+        assert(r.offset + r.length <= data.size());
+        memcpy(&data[r.offset], (char*)v.data() + r.offset, r.length);
+    }
+    assert(memcmp(data.data(), v.data(), data.size()) == 0);
+}
+
+static void upload(shadow *buffers, MVGDirty &dirty, AContext &ctx,
+    draw_list &batch)
+{
+    upload(buffers[MVGDirty::buffer_shapes], ctx.shapes,
+        dirty.ranges[MVGDirty::buffer_shapes]);
+    upload(buffers[MVGDirty::buffer_edges], ctx.edges,
+        dirty.ranges[MVGDirty::buffer_edges]);
+    upload(buffers[MVGDirty::buffer_brushes], ctx.brushes,
+        dirty.ranges[MVGDirty::buffer_brushes]);
+    upload(buffers[MVGDirty::buffer_cells], ctx.cells,
+        dirty.ranges[MVGDirty::buffer_cells]);
+    upload(buffers[MVGDirty::buffer_cell_edges], ctx.cell_edges,
+        dirty.ranges[MVGDirty::buffer_cell_edges]);
+    upload(buffers[MVGDirty::buffer_vertices], batch.vertices,
+        dirty.ranges[MVGDirty::buffer_vertices]);
+    upload(buffers[MVGDirty::buffer_indices], batch.indices,
+        dirty.ranges[MVGDirty::buffer_indices]);
+}
+
+static void test_retained()
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch, full;
+    MVGDirty dirty;
+    shadow buffers[MVGDirty::buffer_count];
+    std::vector<char> p1, p2;
+    std::mt19937 gen(1);
+
+    make_scene(canvas, 200, gen);
+    canvas.emit(batch, dirty);
+    assert(dirty.full);
+    upload(buffers, dirty, *canvas.ctx, batch);
+
+    for (int frame = 0; frame < 20; frame++) {
+        change_scene(canvas, 10, gen);
+        canvas.emit(batch, dirty);
+        assert(!dirty.full);
+        assert(dirty.ranges[MVGDirty::buffer_indices].size() == 0);
+
+        upload(buffers, dirty, *canvas.ctx, batch);
+    }
+
+    /* changing only the radius of a rounded rectangle uploads its edge */
+    MVGRect *rect = static_cast<MVGRect*>(canvas.get_drawable(2));
+    rect->set_visible(true);
+    canvas.emit(batch, dirty);
+    upload(buffers, dirty, *canvas.ctx, batch);
+    rect->set_radius(6.0f);
+    canvas.emit(batch, dirty);
+    assert(!dirty.full);
+    assert(dirty.ranges[MVGDirty::buffer_edges].size() > 0);
+    upload(buffers, dirty, *canvas.ctx, batch);
+    shadow &edges = buffers[MVGDirty::buffer_edges];
+    size_t found = 0;
+    for (size_t i = 0; i < edges.size() / sizeof(AEdge); i++) {
+        AEdge *e = (AEdge*)edges.data() + i;
+        found += e->type == MVGPrimitiveRoundedRectangle && e->p[2] == vec2(6.0f);
+    }
+    assert(found == 1);
+
+    /* retained output must render the same as a full emit */
+    render(batch, canvas.ctx.get(), width, height, p1);
+    canvas.emit(full);
+    render(full, canvas.ctx.get(), width, height, p2);
+    assert(memcmp(p1.data(), p2.data(), p1.size()) == 0);
+
+    /* a full emit invalidates the retained slots */
+    canvas.emit(batch, dirty);
+    assert(dirty.full);
+
+    /* changing the edge count of a patch rebuilds */
+    for (size_t i = 0; i < canvas.num_drawables(); i++) {
+        MVGDrawable *o = canvas.get_drawable(i);
+        if (o->drawable_type != MVGCanvas::drawable_patch) continue;
+        make_star(static_cast<MVGPatch*>(o), 20, 8, 7);
+        break;
+    }
+    canvas.emit(batch, dirty);
+    assert(dirty.full);
+
+    printf("retained: PASS\n");
+}
+
+static void bench_retained(size_t count, size_t changes, int frames)
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+    MVGDirty dirty;
+    std::mt19937 gen(2);
+
+    make_scene(canvas, count, gen);
+    canvas.emit(batch, dirty);
+    size_t total = dirty.bytes();
+
+    float d1 = 0, d2 = 0;
+    size_t bytes = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        change_scene(canvas, changes, gen);
+        const auto t1 = high_resolution_clock::now();
+        canvas.emit(batch, dirty);
+        const auto t2 = high_resolution_clock::now();
+        assert(!dirty.full);
+        d1 += elapsed_ms(t1, t2);
+        bytes += dirty.bytes();
+    }
+    for (int frame = 0; frame < frames; frame++) {
+        change_scene(canvas, changes, gen);
+        draw_list_clear(batch);
+        const auto t1 = high_resolution_clock::now();
+        canvas.emit(batch);
+        const auto t2 = high_resolution_clock::now();
+        d2 += elapsed_ms(t1, t2);
+    }
+
+    printf("emit (full)                = %12.3f milliseconds (%zu bytes)\n",
+        d2 / frames, total);
+    printf("emit (retained)            = %12.3f milliseconds (%zu bytes)\n",
+        d1 / frames, bytes / frames);
+}
+
+int main(int argc, char **argv)
+{
+    test_retained();
+    bench_retained(100000, 1000, 10);
+}
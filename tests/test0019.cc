@@ -0,0 +1,165 @@
+#include "test.h"
+
+static const int width = 640, height = 480;
+
+static bvh_box random_box(std::mt19937 &gen)
+{
+    std::uniform_real_distribution<float> pos(0, 1000), size(0, 20);
+    vec2 p(pos(gen), pos(gen));
+    return bvh_box{p, p + vec2(size(gen), size(gen))};
+}
+
+static void check_query(bvh_tree &tree, std::vector<bvh_box> &boxes,
+    bvh_box q)
+{
+    std::vector<int> result, expect;
+    tree.query(q, result);
+    for (size_t i = 0; i < boxes.size(); i++) {
+        if (boxes[i].intersects(q)) expect.push_back((int)i);
+    }
+    std::sort(result.begin(), result.end());
+    assert(result == expect);
+}
+
+static void test_bvh()
+{
+    std::mt19937 gen(1);
+    std::vector<bvh_box> boxes;
+    bvh_tree tree;
+
+    for (int i = 0; i < 10000; i++) {
+        boxes.push_back(random_box(gen));
+    }
+    tree.build(boxes.data(), boxes.size());
+    for (int i = 0; i < 100; i++) {
+        check_query(tree, boxes, random_box(gen));
+    }
+
+    /* refitted and rebuilt trees find moved boxes */
+    std::uniform_int_distribution<int> item(0, (int)boxes.size() - 1);
+    for (int i = 0; i < 1000; i++) {
+        int id = item(gen);
+        boxes[id] = random_box(gen);
+        tree.update(id, boxes[id]);
+    }
+    for (int i = 0; i < 100; i++) {
+        check_query(tree, boxes, random_box(gen));
+    }
+    tree.rebuild();
+    assert(tree.refits == 0);
+    for (int i = 0; i < 100; i++) {
+        check_query(tree, boxes, random_box(gen));
+    }
+
+    printf("bvh: PASS (%zu nodes)\n", tree.nodes.size());
+}
+
+static void test_pick()
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+
+    MVGCircle *c1 = canvas.new_circle(vec2(0), 50.0f);
+    MVGCircle *c2 = canvas.new_circle(vec2(0), 50.0f);
+    MVGRect *r1 = canvas.new_rectangle(vec2(0), vec2(50,50));
+    c1->set_position(vec2(100,100));
+    c2->set_position(vec2(150,100));
+    r1->set_position(vec2(400,100));
+
+    /* later drawables are on top */
+    assert(canvas.pick(vec2(130,100)) == c2);
+    assert(canvas.pick(vec2(60,100)) == c1);
+
+    /* circles are tested exactly, not by their bounds */
+    assert(canvas.pick(vec2(55,55)) == nullptr);
+    assert(canvas.pick(vec2(355,55)) == r1);
+
+    /* moved and hidden drawables */
+    c2->set_position(vec2(300,300));
+    assert(canvas.pick(vec2(130,100)) == c1);
+    assert(canvas.pick(vec2(300,300)) == c2);
+    c2->set_visible(false);
+    assert(canvas.pick(vec2(300,300)) == nullptr);
+
+    std::vector<MVGDrawable*> out;
+    canvas.query(vec2(0), vec2(200), out);
+    assert(out.size() == 1 && out[0] == c1);
+
+    printf("pick: PASS\n");
+}
+
+static void make_grid(MVGCanvas &canvas, int n, float spacing)
+{
+    canvas.set_stroke_width(1.0f);
+    canvas.set_stroke_brush(solid(0,0,0));
+    for (int i = 0; i < n * n; i++) {
+        int x = i % n, y = i / n;
+        canvas.set_fill_brush(solid((x & 15) / 15.0f, (y & 15) / 15.0f, 0.5f));
+        if (i & 1) {
+            canvas.new_circle(vec2(0), spacing * 0.4f);
+        } else {
+            canvas.new_rectangle(vec2(0), vec2(spacing * 0.4f));
+        }
+        canvas.get_drawable(i)->set_position(vec2(x, y) * spacing);
+    }
+}
+
+static void test_cull()
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list b1, b2;
+    std::vector<char> p1, p2;
+
+    /* zoomed and panned view of part of a larger grid */
+    make_grid(canvas, 100, 20.0f);
+    canvas.set_transform(mat3(1.5f, 0, -300, 0, 1.5f, -200, 0, 0, 1));
+    canvas.emit(b1);
+    render(b1, canvas.ctx.get(), width, height, p1);
+    canvas.set_viewport(vec2(0), vec2(width, height));
+    canvas.emit(b2);
+    render(b2, canvas.ctx.get(), width, height, p2);
+    assert(b2.vertices.size() < b1.vertices.size());
+    assert(memcmp(p1.data(), p2.data(), p1.size()) == 0);
+
+    printf("cull: PASS (%zu of %zu quads)\n", b2.vertices.size() / 4,
+        b1.vertices.size() / 4);
+}
+
+static void bench_cull(int n)
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+    float spacing = 10.0f, extent = n * spacing;
+
+    make_grid(canvas, n, spacing);
+    canvas.set_transform(mat3(1));
+
+    draw_list_clear(batch);
+    auto t1 = high_resolution_clock::now();
+    canvas.emit(batch);
+    auto t2 = high_resolution_clock::now();
+    float d = elapsed_ms(t1, t2);
+    printf("emit (no viewport)         = %12.3f milliseconds\n", d);
+
+    float fractions[] = { 1.0f, 0.1f, 0.01f };
+    for (float f : fractions) {
+        canvas.set_viewport(vec2(0), vec2(extent * sqrtf(f)));
+        draw_list_clear(batch);
+        t1 = high_resolution_clock::now();
+        canvas.emit(batch);
+        t2 = high_resolution_clock::now();
+        d = elapsed_ms(t1, t2);
+        printf("emit (%5.1f%% visible)      = %12.3f milliseconds (%zu quads)\n",
+            f * 100.0f, d, batch.vertices.size() / 4);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    test_bvh();
+    test_pick();
+    test_cull();
+    bench_cull(316);
+}
@@ -0,0 +1,184 @@
+#include "test.h"
+
+static const int width = 640, height = 480;
+
+static std::vector<AEdge> star(float r1, float r2, int points)
+{
+    std::vector<AEdge> edges;
+    for (int i = 0; i < points * 2; i++) {
+        float a1 = (float)M_PI * i / points, a2 = (float)M_PI * (i + 1) / points;
+        float l1 = i & 1 ? r2 : r1, l2 = i & 1 ? r1 : r2;
+        edges.push_back(AEdge{MVGEdgeLinear, {
+            vec2(r1) + vec2(sinf(a1), -cosf(a1)) * l1,
+            vec2(r1) + vec2(sinf(a2), -cosf(a2)) * l2 }});
+    }
+    return edges;
+}
+
+static void test_handles()
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    MVGStore &store = canvas.store;
+    std::mt19937 gen(1);
+    std::map<MVGHandle,vec2> live;
+
+    for (int i = 0; i < 1000; i++) {
+        vec2 pos((float)i, (float)(i * 2));
+        MVGHandle h = store.new_circle(pos, 1.0f);
+        live[h] = pos;
+    }
+
+    /* handles remain valid while other elements are removed and added */
+    for (int i = 0; i < 5000; i++) {
+        auto it = live.begin();
+        std::advance(it, gen() % live.size());
+        if (gen() & 1) {
+            store.remove(it->first);
+            live.erase(it);
+        } else {
+            vec2 pos((float)(gen() % 1000), (float)(gen() % 1000));
+            MVGHandle h = store.new_circle(pos, 1.0f);
+            assert(live.find(h) == live.end());
+            live[h] = pos;
+        }
+    }
+    assert(store.size() == live.size());
+    for (auto &l : live) {
+        assert(store.get_position(l.first) == l.second);
+    }
+
+    /* patch edges survive arena compaction */
+    std::vector<MVGHandle> patches;
+    for (int i = 0; i < 100; i++) {
+        auto e = star(20, 8, 3 + i % 8);
+        patches.push_back(store.new_patch(vec2(0), vec2(40), e.data(), e.size()));
+    }
+    for (int i = 0; i < 100; i += 2) {
+        store.remove(patches[i]);
+    }
+    for (int i = 1; i < 100; i += 2) {
+        auto e = star(20, 8, 3 + i % 8);
+        MVGStoreArray &a = store.array(patches[i]);
+        size_t j = store.index(patches[i]);
+        assert(a.edge_count[j] == (int)e.size());
+        assert(memcmp(&store.edges[a.edge_offset[j]], e.data(),
+            e.size() * sizeof(AEdge)) == 0);
+    }
+    assert(store.edges_unused <= store.edges.size() / 2);
+
+    printf("handles: PASS (%zu elements)\n", store.size());
+}
+
+static void test_render()
+{
+    font_manager_ft manager;
+    MVGCanvas c1(&manager), c2(&manager);
+    draw_list b1, b2;
+    std::vector<char> p1, p2;
+    std::mt19937 gen(2);
+    std::uniform_real_distribution<float> x(0, width), y(0, height), c(0, 1);
+    auto edges = star(20, 8, 5);
+
+    /* same scene in type order as objects and in the store */
+    for (int t = 0; t < 5; t++) {
+        for (int i = 0; i < 40; i++) {
+            vec2 pos(x(gen), y(gen));
+            MVGBrush fill = solid(c(gen), c(gen), c(gen));
+            float stroke = (float)(i % 3);
+            for (MVGCanvas *canvas : { &c1, &c2 }) {
+                canvas->set_fill_brush(fill);
+                canvas->set_stroke_width(stroke);
+            }
+            switch (t) {
+            case 0:
+                c1.new_circle(vec2(0), 10.0f)->set_position(pos);
+                c2.store.set_position(c2.store.new_circle(vec2(0), 10.0f), pos);
+                break;
+            case 1:
+                c1.new_ellipse(vec2(0), vec2(15,8))->set_position(pos);
+                c2.store.set_position(c2.store.new_ellipse(vec2(0), vec2(15,8)), pos);
+                break;
+            case 2:
+                c1.new_rounded_rectangle(vec2(0), vec2(12,8), (float)(i % 2) * 3.0f)
+                    ->set_position(pos);
+                c2.store.set_position(c2.store.new_rounded_rectangle(vec2(0),
+                    vec2(12,8), (float)(i % 2) * 3.0f), pos);
+                break;
+            case 3: {
+                MVGPatch *p = c1.new_patch(vec2(0), vec2(40));
+                p->set_position(pos);
+                for (auto &e : edges) p->new_edge(e);
+                c2.store.set_position(c2.store.new_patch(vec2(0), vec2(40),
+                    edges.data(), edges.size()), pos);
+                break;
+            }
+            case 4: {
+                MVGPath *p = c1.new_path(vec2(0), vec2(40));
+                p->set_position(pos);
+                for (auto &e : edges) p->new_edge(e);
+                c2.store.set_position(c2.store.new_path(vec2(0), vec2(40),
+                    edges.data(), edges.size()), pos);
+                break;
+            }
+            }
+        }
+    }
+
+    c1.emit(b1);
+    c2.emit(b2);
+    assert(b1.vertices.size() == b2.vertices.size());
+    render(b1, c1.ctx.get(), width, height, p1);
+    render(b2, c2.ctx.get(), width, height, p2);
+    assert(memcmp(p1.data(), p2.data(), p1.size()) == 0);
+
+    printf("render: PASS\n");
+}
+
+static void bench_objects(size_t count)
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+
+    const auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        canvas.new_circle(vec2(0), 5.0f)->set_position(
+            vec2((float)(i % 1000) * 10.0f, (float)(i / 1000) * 10.0f));
+    }
+    const auto t2 = high_resolution_clock::now();
+    canvas.emit(batch);
+    const auto t3 = high_resolution_clock::now();
+
+    float d1 = elapsed_ms(t1, t2), d2 = elapsed_ms(t2, t3);
+    printf("create (objects)           = %12.3f milliseconds\n", d1);
+    printf("emit (objects)             = %12.3f milliseconds\n", d2);
+}
+
+static void bench_store(size_t count)
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+
+    const auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        canvas.store.new_circle(
+            vec2((float)(i % 1000) * 10.0f, (float)(i / 1000) * 10.0f), 5.0f);
+    }
+    const auto t2 = high_resolution_clock::now();
+    canvas.emit(batch);
+    const auto t3 = high_resolution_clock::now();
+
+    float d1 = elapsed_ms(t1, t2), d2 = elapsed_ms(t2, t3);
+    printf("create (store)             = %12.3f milliseconds\n", d1);
+    printf("emit (store)               = %12.3f milliseconds\n", d2);
+}
+
+int main(int argc, char **argv)
+{
+    test_handles();
+    test_render();
+    bench_objects(1000000);
+    bench_store(1000000);
+}
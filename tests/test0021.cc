@@ -0,0 +1,159 @@
+#include "test.h"
+
+static const int width = 640, height = 480;
+
+static void test_select()
+{
+    font_manager_ft manager, msdf_manager;
+    MVGCanvas canvas(&manager);
+    canvas.set_text_lod(64.0f, 512.0f, 0.15f);
+
+    /* without msdf, text goes from bitmaps straight to outlines */
+    assert(canvas.select_lod(MVGText::lod_none, 10) == MVGText::lod_bitmap);
+    assert(canvas.select_lod(MVGText::lod_none, 100) == MVGText::lod_outline);
+    assert(canvas.select_lod(MVGText::lod_msdf, 100) == MVGText::lod_outline);
+    assert(canvas.select_lod(MVGText::lod_outline, 60) == MVGText::lod_outline);
+    assert(canvas.select_lod(MVGText::lod_outline, 50) == MVGText::lod_bitmap);
+
+    canvas.set_msdf_manager(&msdf_manager);
+    assert(canvas.select_lod(MVGText::lod_none, 64) == MVGText::lod_bitmap);
+    assert(canvas.select_lod(MVGText::lod_none, 65) == MVGText::lod_msdf);
+    assert(canvas.select_lod(MVGText::lod_none, 513) == MVGText::lod_outline);
+
+    /* levels hold until the size passes the bound by the hysteresis */
+    assert(canvas.select_lod(MVGText::lod_bitmap, 70) == MVGText::lod_bitmap);
+    assert(canvas.select_lod(MVGText::lod_bitmap, 75) == MVGText::lod_msdf);
+    assert(canvas.select_lod(MVGText::lod_msdf, 60) == MVGText::lod_msdf);
+    assert(canvas.select_lod(MVGText::lod_msdf, 50) == MVGText::lod_bitmap);
+    assert(canvas.select_lod(MVGText::lod_msdf, 580) == MVGText::lod_msdf);
+    assert(canvas.select_lod(MVGText::lod_msdf, 600) == MVGText::lod_outline);
+    assert(canvas.select_lod(MVGText::lod_outline, 450) == MVGText::lod_outline);
+    assert(canvas.select_lod(MVGText::lod_outline, 400) == MVGText::lod_msdf);
+
+    /* large jumps skip levels */
+    assert(canvas.select_lod(MVGText::lod_bitmap, 4096) == MVGText::lod_outline);
+    assert(canvas.select_lod(MVGText::lod_outline, 8) == MVGText::lod_bitmap);
+
+    /* jitter around a bound does not flip between levels */
+    MVGText::text_lod lod = MVGText::lod_bitmap;
+    for (int i = 0; i < 100; i++) {
+        lod = canvas.select_lod(lod, 64.0f + ((i & 1) ? 8.0f : -8.0f));
+        assert(lod == MVGText::lod_bitmap);
+    }
+
+    printf("select: PASS\n");
+}
+
+static void make_text(MVGCanvas &canvas, font_face *face, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        MVGText *t = canvas.new_text();
+        t->set_face(face);
+        t->set_size(16.0f);
+        t->set_text(pangram);
+        t->set_position(vec2(0, (float)i * 20.0f));
+    }
+}
+
+static void emit_scale(MVGCanvas &canvas, draw_list &batch, float scale)
+{
+    draw_list_clear(batch);
+    canvas.set_transform(mat3(scale, 0, 0, 0, scale, 0, 0, 0, 1));
+    canvas.emit(batch);
+}
+
+static bool has_shader(draw_list &batch, uint shader)
+{
+    for (auto &cmd : batch.cmds) {
+        if (cmd.shader == shader && cmd.count > 0) return true;
+    }
+    return false;
+}
+
+static void test_emit()
+{
+    font_manager_ft manager, msdf_manager;
+    msdf_manager.msdf_enabled = true;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+    font_face *face = manager.findFontByPath(font_paths[0]);
+
+    canvas.set_render_mode(MVGText::render_as_lod);
+    canvas.set_msdf_manager(&msdf_manager);
+    make_text(canvas, face, 4);
+    MVGText *t = static_cast<MVGText*>(canvas.get_drawable(0));
+
+    /* 16 pixel text is a bitmap at 1x, msdf at 8x and outlines at 64x */
+    emit_scale(canvas, batch, 1.0f);
+    assert(t->get_lod() == MVGText::lod_bitmap);
+    assert(has_shader(batch, shader_simple));
+    emit_scale(canvas, batch, 8.0f);
+    assert(t->get_lod() == MVGText::lod_msdf);
+    assert(has_shader(batch, shader_msdf));
+    emit_scale(canvas, batch, 64.0f);
+    assert(t->get_lod() == MVGText::lod_outline);
+    assert(has_shader(batch, shader_canvas));
+    assert(!has_shader(batch, shader_simple) && !has_shader(batch, shader_msdf));
+
+    /* stroked text is always drawn as outlines */
+    t->set_stroke_width(1.0f);
+    emit_scale(canvas, batch, 1.0f);
+    assert(t->get_lod() == MVGText::lod_bitmap);
+    assert(has_shader(batch, shader_canvas));
+
+    printf("emit: PASS\n");
+}
+
+static const char* lod_name(MVGText::text_lod lod)
+{
+    switch (lod) {
+    case MVGText::lod_bitmap: return "bitmap";
+    case MVGText::lod_msdf: return "msdf";
+    case MVGText::lod_outline: return "outline";
+    default: return "none";
+    }
+}
+
+static float time_emit(MVGCanvas &canvas, draw_list &batch, float scale)
+{
+    /* the first emit at a scale populates the atlas, time the second */
+    emit_scale(canvas, batch, scale);
+    const auto t1 = high_resolution_clock::now();
+    emit_scale(canvas, batch, scale);
+    const auto t2 = high_resolution_clock::now();
+    return elapsed_ms(t1, t2);
+}
+
+static void bench_zoom(size_t count)
+{
+    font_manager_ft manager, msdf_manager;
+    msdf_manager.msdf_enabled = true;
+    MVGCanvas lod(&manager), outline(&manager);
+    draw_list batch;
+    font_face *face = manager.findFontByPath(font_paths[0]);
+
+    lod.set_render_mode(MVGText::render_as_lod);
+    lod.set_msdf_manager(&msdf_manager);
+    outline.set_render_mode(MVGText::render_as_contour);
+    make_text(lod, face, count);
+    make_text(outline, face, count);
+
+    for (float scale = 0.25f; scale <= 512.0f; scale *= 2.0f) {
+        float d1 = time_emit(lod, batch, scale);
+        size_t v1 = batch.vertices.size();
+        float d2 = time_emit(outline, batch, scale);
+        size_t v2 = batch.vertices.size();
+        MVGText *t = static_cast<MVGText*>(lod.get_drawable(0));
+        printf("emit (%7.2fx lod)        = %12.3f milliseconds (%s, %zu vertices)\n",
+            scale, d1, lod_name(t->get_lod()), v1);
+        printf("emit (%7.2fx outline)    = %12.3f milliseconds (%zu vertices)\n",
+            scale, d2, v2);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    test_select();
+    test_emit();
+    bench_zoom(100);
+}
@@ -0,0 +1,161 @@
+#include "test.h"
+
+static const int width = 640, height = 480;
+
+static void make_scene(MVGCanvas &canvas, size_t count, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<float> x(0, width), y(0, height), c(0, 1);
+
+    canvas.set_stroke_brush(solid(0,0,0));
+    for (size_t i = 0; i < count; i++) {
+        canvas.set_fill_brush(solid(c(gen), c(gen), c(gen)));
+        canvas.set_stroke_width((float)(i % 3));
+        switch (i % 3) {
+        case 0: canvas.new_circle(vec2(0), 10.0f); break;
+        case 1: canvas.new_rectangle(vec2(0), vec2(12,8)); break;
+        case 2: canvas.new_rounded_rectangle(vec2(0), vec2(12,8), 3.0f); break;
+        }
+        canvas.get_drawable(i)->set_position(vec2(x(gen), y(gen)));
+    }
+}
+
+/* interpolation order differs so allow for rounding of one in 255 */
+static bool same_pixels(std::vector<char> &p1, std::vector<char> &p2)
+{
+    for (size_t i = 0; i < p1.size(); i++) {
+        if (abs((uint8_t)p1[i] - (uint8_t)p2[i]) > 1) return false;
+    }
+    return p1.size() == p2.size();
+}
+
+static void test_instanced()
+{
+    font_manager_ft manager;
+    MVGCanvas c1(&manager), c2(&manager);
+    font_face *face = manager.findFontByPath(font_paths[0]);
+    draw_list b1, b2;
+    std::vector<char> p1, p2;
+    std::mt19937 g1(1), g2(1);
+
+    /* same shapes and text drawn with quads and with instances */
+    b2.flags = list_instanced;
+    make_scene(c1, 300, g1);
+    make_scene(c2, 300, g2);
+    c1.emit(b1);
+    c2.emit(b2);
+    render_lines(b1, manager, face, 15, 10.5f, 30.0f);
+    render_lines(b2, manager, face, 15, 10.5f, 30.0f);
+
+    assert(b1.instances.size() == 0);
+    assert(b2.vertices.size() == 0 && b2.indices.size() == 0);
+    assert(b1.vertices.size() == b2.instances.size() * 4);
+    for (auto &cmd : b2.cmds) {
+        assert(cmd.mode == mode_instances);
+    }
+
+    render(b1, c1.ctx.get(), width, height, p1);
+    render(b2, c2.ctx.get(), width, height, p2);
+    assert(same_pixels(p1, p2));
+
+    printf("instanced: PASS (%zu instances, %zu commands)\n",
+        b2.instances.size(), b2.cmds.size());
+}
+
+static void test_retained()
+{
+    font_manager_ft manager;
+    MVGCanvas c1(&manager), c2(&manager);
+    draw_list b1, b2;
+    MVGDirty dirty;
+    std::vector<char> p1, p2;
+    std::mt19937 g1(2), g2(2);
+
+    /* retained instances are rewritten in place */
+    b2.flags = list_instanced;
+    make_scene(c1, 100, g1);
+    make_scene(c2, 100, g2);
+    c2.emit(b2, dirty);
+    assert(dirty.full);
+    for (size_t i = 0; i < 100; i += 7) {
+        c1.get_drawable(i)->set_position(vec2((float)i * 5.0f, 100.0f));
+        c2.get_drawable(i)->set_position(vec2((float)i * 5.0f, 100.0f));
+    }
+    c2.emit(b2, dirty);
+    assert(!dirty.full);
+    assert(dirty.ranges[MVGDirty::buffer_vertices].size() == 0);
+    assert(dirty.ranges[MVGDirty::buffer_instances].size() > 0);
+
+    c1.emit(b1);
+    render(b1, c1.ctx.get(), width, height, p1);
+    render(b2, c2.ctx.get(), width, height, p2);
+    assert(same_pixels(p1, p2));
+
+    printf("retained: PASS\n");
+}
+
+static size_t list_bytes(draw_list &batch)
+{
+    return batch.vertices.size() * sizeof(draw_vertex) +
+        batch.indices.size() * sizeof(uint) +
+        batch.instances.size() * sizeof(draw_instance);
+}
+
+static void bench_text(size_t iterations, uint flags)
+{
+    font_manager_ft manager;
+    font_face *face = manager.findFontByPath(font_paths[0]);
+    text_shaper_hb shaper;
+    text_renderer_ft renderer(&manager);
+    std::vector<glyph_shape> shapes;
+    draw_list batch;
+    text_segment segment(pangram, text_lang, face, 16 * 64, 0, 0, 0xff000000);
+
+    batch.flags = flags;
+    shaper.shape(shapes, segment);
+    renderer.render(batch, shapes, segment);
+    size_t glyphs = batch.instances.size() + batch.vertices.size() / 4;
+    size_t bytes = list_bytes(batch);
+
+    const auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        draw_list_clear(batch);
+        renderer.render(batch, shapes, segment);
+    }
+    const auto t2 = high_resolution_clock::now();
+
+    float d = elapsed_ms(t1, t2);
+    printf("text (%-9s)           = %12.3f milliseconds (%zu bytes/glyph)\n",
+        flags & list_instanced ? "instanced" : "quads", d, bytes / glyphs);
+}
+
+static void bench_canvas(size_t count, uint flags)
+{
+    font_manager_ft manager;
+    MVGCanvas canvas(&manager);
+    draw_list batch;
+    std::mt19937 gen(3);
+
+    batch.flags = flags;
+    make_scene(canvas, count, gen);
+    canvas.emit(batch);
+    size_t bytes = list_bytes(batch);
+
+    draw_list_clear(batch);
+    const auto t1 = high_resolution_clock::now();
+    canvas.emit(batch);
+    const auto t2 = high_resolution_clock::now();
+
+    float d = elapsed_ms(t1, t2);
+    printf("canvas (%-9s)         = %12.3f milliseconds (%zu bytes/shape)\n",
+        flags & list_instanced ? "instanced" : "quads", d, bytes / count);
+}
+
+int main(int argc, char **argv)
+{
+    test_instanced();
+    test_retained();
+    bench_text(100000, 0);
+    bench_text(100000, list_instanced);
+    bench_canvas(100000, 0);
+    bench_canvas(100000, list_instanced);
+}
@@ -0,0 +1,174 @@
+#include "test.h"
+
+#include "multi.h"
+
+static draw_instance quad(float x, float y)
+{
+    return draw_instance{{x, y, x + 10, y + 10}, {0, 0, 1, 1}, 0xff000000, 0};
+}
+
+static void check_same(draw_list &b1, draw_list &b2)
+{
+    assert(b1.cmds.size() == b2.cmds.size());
+    assert(b1.vertices.size() == b2.vertices.size());
+    assert(b1.indices.size() == b2.indices.size());
+    assert(b1.instances.size() == b2.instances.size());
+    assert(memcmp(b1.cmds.data(), b2.cmds.data(),
+        b1.cmds.size() * sizeof(draw_cmd)) == 0);
+    assert(memcmp(b1.vertices.data(), b2.vertices.data(),
+        b1.vertices.size() * sizeof(draw_vertex)) == 0);
+    assert(memcmp(b1.indices.data(), b2.indices.data(),
+        b1.indices.size() * sizeof(uint)) == 0);
+    assert(memcmp(b1.instances.data(), b2.instances.data(),
+        b1.instances.size() * sizeof(draw_instance)) == 0);
+}
+
+static void test_merge()
+{
+    image_ptr img = image::createBitmap(64, 64, pixel_format_alpha);
+
+    for (uint flags : { 0u, (uint)list_instanced }) {
+        draw_list whole, merged, part[3];
+        whole.flags = merged.flags = flags;
+        for (int i = 0; i < 30; i++) {
+            uint iid = i < 12 ? 1 : 2, shader = i < 25 ? shader_simple : shader_msdf;
+            draw_list_rect(whole, iid, shader, 0, quad((float)i, (float)i));
+            part[i / 10].flags = flags;
+            draw_list_rect(part[i / 10], iid, shader, 0, quad((float)i, (float)i));
+        }
+
+        /* modified rectangles of the same image are unioned */
+        draw_list_image_delta(part[0], img.get(),
+            bin_rect(bin_point(2,2), bin_point(8,8)), st_clamp);
+        draw_list_image_delta(part[2], img.get(),
+            bin_rect(bin_point(64,64), bin_point(0,0)), st_clamp);
+        draw_list_image_delta(part[1], img.get(),
+            bin_rect(bin_point(4,0), bin_point(20,6)), st_clamp);
+
+        for (auto &p : part) {
+            draw_list_merge(merged, p);
+        }
+        check_same(whole, merged);
+        assert(merged.cmds.size() == 3);
+        assert(merged.images.size() == 1);
+        int *r = merged.images[0].modrect;
+        assert(r[0] == 2 && r[1] == 0 && r[2] == 18 && r[3] == 8);
+    }
+
+    printf("merge: PASS\n");
+}
+
+static void make_segments(font_manager_ft &manager, size_t count,
+    std::vector<text_segment> &segments,
+    std::vector<std::vector<glyph_shape>> &shapes)
+{
+    text_shaper_hb shaper;
+
+    segments.clear();
+    shapes.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        font_face *face = manager.findFontByPath(font_paths[i % 2]);
+        segments.push_back(text_segment(pangram, text_lang, face,
+            (int)(10 + i % 5 * 4) * 64, 10.0f + (float)(i % 7) * 20.0f,
+            20.0f + (float)(i % 40) * 24.0f, 0xff000000));
+        shapes[i].clear();
+        shaper.shape(shapes[i], segments[i]);
+    }
+}
+
+static void render_sequential(draw_list &batch, font_manager_ft &manager,
+    std::vector<text_segment> &segments,
+    std::vector<std::vector<glyph_shape>> &shapes)
+{
+    text_renderer_ft renderer(&manager);
+
+    for (size_t i = 0; i < segments.size(); i++) {
+        renderer.render(batch, shapes[i], segments[i]);
+    }
+}
+
+static void test_parallel()
+{
+    std::vector<text_segment> segments;
+    std::vector<std::vector<glyph_shape>> shapes;
+
+    /* cold atlas, glyphs are added concurrently */
+    {
+        font_manager_ft manager;
+        draw_list b1, b2;
+        make_segments(manager, 500, segments, shapes);
+        text_renderer_mt renderer(&manager, 4, 16);
+        renderer.render(b1, shapes, segments);
+        render_sequential(b2, manager, segments, shapes);
+        assert(b1.cmds.size() == b2.cmds.size());
+        assert(b1.vertices.size() == b2.vertices.size());
+        assert(b1.images.size() == b2.images.size());
+    }
+
+    /* warm atlas, the merged list is the same for any thread count */
+    font_manager_ft manager;
+    draw_list expect;
+    make_segments(manager, 500, segments, shapes);
+    render_sequential(expect, manager, segments, shapes);
+    for (size_t threads = 1; threads <= 8; threads *= 2) {
+        for (uint flags : { 0u, (uint)list_instanced }) {
+            text_renderer_mt renderer(&manager, threads, 16);
+            draw_list b1, b2;
+            b1.flags = b2.flags = flags;
+            if (flags) render_sequential(b1, manager, segments, shapes);
+            else b1 = expect;
+            renderer.render(b2, shapes, segments);
+            check_same(b1, b2);
+            draw_list_clear(b2);
+            renderer.render(b2, shapes, segments);
+            check_same(b1, b2);
+        }
+    }
+
+    printf("parallel: PASS (%zu commands, %zu vertices)\n",
+        expect.cmds.size(), expect.vertices.size());
+}
+
+static void bench_parallel(size_t count, int frames)
+{
+    font_manager_ft manager;
+    std::vector<text_segment> segments;
+    std::vector<std::vector<glyph_shape>> shapes;
+    draw_list batch;
+
+    make_segments(manager, count, segments, shapes);
+    render_sequential(batch, manager, segments, shapes);
+
+    float d = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        draw_list_clear(batch);
+        const auto t1 = high_resolution_clock::now();
+        render_sequential(batch, manager, segments, shapes);
+        const auto t2 = high_resolution_clock::now();
+        d += elapsed_ms(t1, t2);
+    }
+    printf("render (sequential)        = %12.3f milliseconds\n", d / frames);
+
+    size_t max_threads = std::max(4u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        text_renderer_mt renderer(&manager, threads);
+        renderer.render(batch, shapes, segments);
+        d = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            draw_list_clear(batch);
+            const auto t1 = high_resolution_clock::now();
+            renderer.render(batch, shapes, segments);
+            const auto t2 = high_resolution_clock::now();
+            d += elapsed_ms(t1, t2);
+        }
+        printf("render (%2zu threads)        = %12.3f milliseconds\n",
+            threads, d / frames);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    test_merge();
+    test_parallel();
+    bench_parallel(20000, 10);
+}
@@ -0,0 +1,214 @@
+#include "test.h"
+
+#include <set>
+#include <numeric>
+
+#include "logger.h"
+#include "format.h"
+#include "ui9.h"
+
+static const int width = 1024, height = 768;
+
+static const char *wisdom[] = {
+    "The quick brown fox jumps over the lazy dog",
+    "Sphinx of black quartz, judge my vow",
+    "How vexingly quick daft zebras jump",
+    "Pack my box with five dozen liquor jugs",
+};
+
+/* copy of the rect function in gldemo, which uses the atlas 1x1 pixel */
+static void rect(draw_list &batch, font_atlas *atlas,
+    float x1, float y1, float x2, float y2, float z, uint color)
+{
+    int atlas_iid = atlas->get_image()->iid;
+    int atlas_shader = atlas->depth == 4 ? shader_msdf : shader_simple;
+    int atlas_flags = st_clamp | atlas_image_filter(atlas);
+
+    draw_list_image(batch, atlas->get_image(), atlas_flags);
+
+    float uv1 = 0.0f, uv2 = atlas->uv1x1;
+    uint o0 = draw_list_vertex(batch, {{x1, y1, z}, {uv1, uv1}, color});
+    uint o1 = draw_list_vertex(batch, {{x2, y1, z}, {uv2, uv1}, color});
+    uint o2 = draw_list_vertex(batch, {{x2, y2, z}, {uv2, uv2}, color});
+    uint o3 = draw_list_vertex(batch, {{x1, y2, z}, {uv1, uv2}, color});
+
+    draw_list_indices(batch, atlas_iid, mode_triangles, atlas_shader,
+        {o0, o3, o1, o1, o3, o2});
+}
+
+/* scene drawn by gldemo: scrolling wisdom, large text and stats lines */
+static void gldemo_scene(draw_list &batch, font_manager_ft &manager)
+{
+    font_face *face = manager.findFontByPath(font_paths[0]);
+
+    for (int j = 0; j < 9; j++) {
+        render_text(batch, manager, face, wisdom[j % 4], 12 + j % 5 * 3,
+            (float)(j * 37 % 300), (float)(j + 1) * 80.0f, 0xff808080);
+    }
+    render_text(batch, manager, face, "glyb", 300, 240.0f, 450.0f,
+        0xff000000);
+    float y = height - 10.0f;
+    for (int i = 0; i < 4; i++) {
+        font_atlas *atlas = manager.getCurrentAtlas(face);
+        rect(batch, atlas, 10.0f, y - 24.0f, 300.0f, y + 6.0f, -0.0001f,
+            0xbfffffff);
+        render_text(batch, manager, face, wisdom[i], 18, 10.0f, y,
+            0xff000000);
+        y -= 24.0f;
+    }
+}
+
+/* layout drawn by glgraph: a frame with a grid of labels and sliders */
+static void glgraph_scene(ui9::Root &root, MVGCanvas &canvas)
+{
+    auto frame1 = new ui9::Frame();
+    frame1->set_text("Simulation Settings");
+    frame1->set_position(vec3(0,0,0));
+    root.add_child(frame1);
+
+    auto grid1 = new ui9::Grid();
+    grid1->set_rows_homogeneous(false);
+    grid1->set_cols_homogeneous(false);
+    frame1->add_child(grid1);
+
+    const char* label_names[] = {
+        "Damping", "Center Attract", "Time Step", "Maximum Speed",
+        "Stopping Energy"
+    };
+
+    for (size_t i = 0; i < 5; i++) {
+        auto l1 = new ui9::Label();
+        l1->set_text(label_names[i]);
+        l1->set_preferred_size({100,50,0});
+        grid1->add_child(l1, 0, i);
+
+        auto s1 = new ui9::Slider();
+        s1->set_value((1.0f/6.0f) * (i+1));
+        s1->set_preferred_size({300,50,0});
+        grid1->add_child(s1, 1, i, 1, 1, { ui9::ratio, ui9::dynamic }, {1,1});
+
+        auto l2 = new ui9::Label();
+        l2->set_text(std::to_string(s1->get_value()));
+        l2->set_preferred_size({100,50,0});
+        grid1->add_child(l2, 2, i);
+    }
+
+    canvas.set_transform(mat3(1, 0, width/2.0f, 0, 1, height/2.0f, 0, 0, 1));
+    root.layout(&canvas);
+}
+
+/* text in two fonts interleaved line by line in two columns */
+static void columns_scene(draw_list &batch, font_manager_ft &manager)
+{
+    for (int i = 0; i < 40; i++) {
+        font_face *face = manager.findFontByPath(font_paths[i & 1]);
+        render_text(batch, manager, face, wisdom[i % 4], 14,
+            (float)(i % 2) * 500.0f + 10.0f, (float)(i / 2) * 36.0f + 20.0f,
+            0xff000000);
+    }
+}
+
+static void check_batch(const char *name, draw_list &batch, AContext *ctx)
+{
+    draw_list batched = batch;
+    std::vector<char> p1, p2;
+
+    size_t before = batch.cmds.size();
+    size_t after = draw_list_batch(batched);
+    assert(after == batched.cmds.size() && after <= before);
+    assert(batched.indices.size() == batch.indices.size());
+    assert(batched.instances.size() == batch.instances.size());
+
+    render(batch, ctx, width, height, p1);
+    render(batched, ctx, width, height, p2);
+    assert(memcmp(p1.data(), p2.data(), p1.size()) == 0);
+
+    printf("%s: PASS (%zu commands before, %zu after)\n", name, before, after);
+}
+
+static void test_batch()
+{
+    /* overlapping commands keep their order */
+    draw_list batch;
+    draw_instance r1{{0, 0, 10, 10}, {0, 0, 0, 0}, 0xff0000ff, 0};
+    draw_instance r2{{5, 5, 15, 15}, {0, 0, 0, 0}, 0xff00ff00, 0};
+    draw_instance r3{{20, 0, 30, 10}, {0, 0, 0, 0}, 0xffff0000, 0};
+    draw_list_rect(batch, 1, shader_simple, 0, r1);
+    draw_list_rect(batch, 2, shader_simple, 0, r2);
+    draw_list_rect(batch, 1, shader_simple, 0, r1);
+    assert(draw_list_batch(batch) == 3);
+
+    /* disjoint commands are joined */
+    draw_list_clear(batch);
+    draw_list_rect(batch, 1, shader_simple, 0, r1);
+    draw_list_rect(batch, 2, shader_simple, 0, r3);
+    draw_list_rect(batch, 1, shader_simple, 0, r2);
+    draw_list_rect(batch, 2, shader_msdf, 0, r3);
+    assert(draw_list_batch(batch) == 3);
+    assert(batch.cmds[0].iid == 1 && batch.cmds[0].count == 12);
+    assert(batch.cmds[1].iid == 2 && batch.cmds[1].shader == shader_simple);
+    assert(batch.indices[6] == 8 && batch.indices[12] == 4);
+
+    /* the same for instances */
+    draw_list_clear(batch);
+    batch.flags = list_instanced;
+    draw_list_rect(batch, 1, shader_simple, 0, r1);
+    draw_list_rect(batch, 2, shader_simple, 0, r3);
+    draw_list_rect(batch, 1, shader_simple, 0, r2);
+    assert(draw_list_batch(batch) == 2);
+    assert(batch.cmds[0].count == 2 && batch.cmds[1].offset == 2);
+    assert(batch.instances[1].color == r2.color);
+
+    printf("batch: PASS\n");
+}
+
+static void test_scenes()
+{
+    for (uint flags : { 0u, (uint)list_instanced }) {
+        font_manager_ft manager;
+        draw_list b1, b2;
+        b1.flags = b2.flags = flags;
+        gldemo_scene(b1, manager);
+        check_batch("gldemo", b1, nullptr);
+        columns_scene(b2, manager);
+        check_batch("columns", b2, nullptr);
+    }
+
+    for (uint flags : { 0u, (uint)list_instanced }) {
+        font_manager_ft manager("fonts");
+        MVGCanvas canvas(&manager);
+        ui9::Root root(&manager);
+        draw_list batch;
+        batch.flags = flags;
+        glgraph_scene(root, canvas);
+        canvas.emit(batch);
+        check_batch("glgraph", batch, canvas.ctx.get());
+    }
+}
+
+static void bench_batch(int frames)
+{
+    font_manager_ft manager;
+    draw_list batch, batched;
+
+    for (int i = 0; i < 25; i++) {
+        columns_scene(batch, manager);
+    }
+    float d = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        batched = batch;
+        const auto t1 = high_resolution_clock::now();
+        draw_list_batch(batched);
+        const auto t2 = high_resolution_clock::now();
+        d += elapsed_ms(t1, t2);
+    }
+    printf("batch (%5zu commands)     = %12.3f milliseconds (%zu commands)\n",
+        batch.cmds.size(), d / frames, batched.cmds.size());
+}
+
+int main(int argc, char **argv)
+{
+    test_batch();
+    test_scenes();
+    bench_batch(10);
+}
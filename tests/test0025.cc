@@ -0,0 +1,178 @@
+#include "test.h"
+
+static const int width = 1024, height = 768;
+
+/* expand compact vertices and indices back to a draw list */
+static void unpack(draw_list &batch, draw_list_compact &c, draw_list &out)
+{
+    out = batch;
+    if (c.packed_vertices()) {
+        for (size_t i = 0; i < c.vertices.size(); i++) {
+            draw_vertex16 &v = c.vertices[i];
+            out.vertices[i] = {{ v.pos[0] / c.pos_scale, v.pos[1] / c.pos_scale,
+                v.pos[2] / c.pos_scale }, { v.uv[0] / 65535.0f, v.uv[1] / 65535.0f },
+                v.color, (float)v.shape };
+        }
+    }
+    if (c.short_indices) {
+        for (size_t i = 0; i < batch.cmds.size(); i++) {
+            draw_cmd &cmd = batch.cmds[i];
+            if (cmd.mode == mode_instances) continue;
+            for (uint j = cmd.offset; j < cmd.offset + cmd.count; j++) {
+                out.indices[j] = c.indices[j] + c.bases[i];
+            }
+        }
+    }
+}
+
+static size_t diff_pixels(std::vector<char> &p1, std::vector<char> &p2,
+    int tolerance)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < p1.size(); i += 4) {
+        int d = 0;
+        for (size_t j = i; j < i + 4; j++) {
+            d = std::max(d, abs((uint8_t)p1[j] - (uint8_t)p2[j]));
+        }
+        count += d > tolerance;
+    }
+    return count;
+}
+
+static void test_text()
+{
+    font_manager_ft manager;
+    font_face *face = manager.findFontByPath(font_paths[0]);
+    draw_list batch, out;
+    draw_list_compact c;
+    std::vector<char> p1, p2;
+
+    render_lines(batch, manager, face, 32, 10.0f, 24.0f);
+    assert(draw_list_pack(batch, c));
+    assert(c.packed_vertices() && c.short_indices);
+    assert(c.pos_scale >= 16.0f);
+
+    unpack(batch, c, out);
+    assert(out.indices == batch.indices);
+    for (size_t i = 0; i < batch.vertices.size(); i++) {
+        draw_vertex &v1 = batch.vertices[i], &v2 = out.vertices[i];
+        for (int j = 0; j < 3; j++) {
+            assert(fabsf(v1.pos[j] - v2.pos[j]) <= 0.5f / c.pos_scale);
+        }
+        for (int j = 0; j < 2; j++) {
+            assert(fabsf(v1.uv[j] - v2.uv[j]) <= 0.5f / 65535.0f);
+        }
+        assert(v1.color == v2.color && v1.shape == v2.shape);
+    }
+
+    render(batch, nullptr, width, height, p1);
+    render(out, nullptr, width, height, p2);
+    /*
+     * quantized positions and uvs shift interpolation slightly and can
+     * move a glyph edge across a pixel center
+     */
+    size_t diff = diff_pixels(p1, p2, 4);
+    assert(diff * 1000 < (size_t)(width * height));
+
+    printf("text: PASS (scale %.0f, %zu of %d pixels differ by more than 4)\n",
+        c.pos_scale, diff, width * height);
+}
+
+static void test_fallback()
+{
+    font_manager_ft manager;
+    font_face *face = manager.findFontByPath(font_paths[0]);
+    draw_list batch;
+    draw_list_compact c;
+
+    /* positions beyond the int16 range at 1/4 pixel use float vertices */
+    render_lines(batch, manager, face, 1, 6000.0f, 24.0f);
+    assert(draw_list_pack(batch, c));
+    assert(c.packed_vertices() && c.pos_scale == 4.0f);
+    draw_list_clear(batch);
+    render_lines(batch, manager, face, 1, 9000.0f, 24.0f);
+    assert(draw_list_pack(batch, c));
+    assert(!c.packed_vertices() && c.short_indices);
+
+    /* commands spanning more than 65536 vertices use 32-bit indices */
+    draw_list_clear(batch);
+    render_lines(batch, manager, face, 500, 10.0f, 24.0f);
+    assert(batch.cmds.size() == 1 && batch.vertices.size() > 65536);
+    assert(draw_list_pack(batch, c));
+    assert(c.packed_vertices() && !c.short_indices);
+
+    /* canvas uvs are shape coordinates outside of [0,1] */
+    MVGCanvas canvas(&manager);
+    canvas.new_circle(vec2(0), 10.0f)->set_position(vec2(100, 100));
+    canvas.new_rectangle(vec2(0), vec2(20, 10))->set_position(vec2(200, 100));
+    draw_list_clear(batch);
+    canvas.emit(batch);
+    assert(draw_list_pack(batch, c));
+    assert(!c.packed_vertices() && c.short_indices);
+
+    /* instanced lists have no vertices or indices to pack */
+    draw_list_clear(batch);
+    batch.flags = list_instanced;
+    render_lines(batch, manager, face, 10, 10.0f, 24.0f);
+    draw_list_pack(batch, c);
+    assert(c.vertices.size() == 0 && c.indices.size() == 0);
+
+    printf("fallback: PASS\n");
+}
+
+static void bench_compact(int lines, int frames)
+{
+    font_manager_ft manager;
+    font_face *face = manager.findFontByPath(font_paths[0]);
+    draw_list batch, inst;
+    draw_list_compact c;
+
+    inst.flags = list_instanced;
+    render_lines(batch, manager, face, lines, 10.0f, 24.0f);
+    render_lines(inst, manager, face, lines, 10.0f, 24.0f);
+    draw_list_pack(batch, c);
+
+    size_t glyphs = batch.vertices.size() / 4;
+    size_t b1 = batch.vertices.size() * sizeof(draw_vertex) +
+        batch.indices.size() * sizeof(uint);
+    size_t b2 = c.vertices.size() * sizeof(draw_vertex16) +
+        c.indices.size() * sizeof(uint16_t);
+    size_t b3 = inst.instances.size() * sizeof(draw_instance);
+    printf("bytes per glyph (float)    = %12.3f\n", (float)b1 / glyphs);
+    printf("bytes per glyph (compact)  = %12.3f\n", (float)b2 / glyphs);
+    printf("bytes per glyph (instance) = %12.3f\n", (float)b3 / glyphs);
+
+    /* upload is modelled as a copy of the buffers to a staging area */
+    std::vector<char> staging(b1);
+    float d1 = 0, d2 = 0, d3 = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        const auto t1 = high_resolution_clock::now();
+        draw_list_pack(batch, c);
+        const auto t2 = high_resolution_clock::now();
+        memcpy(staging.data(), c.vertices.data(),
+            c.vertices.size() * sizeof(draw_vertex16));
+        memcpy(staging.data() + c.vertices.size() * sizeof(draw_vertex16),
+            c.indices.data(), c.indices.size() * sizeof(uint16_t));
+        const auto t3 = high_resolution_clock::now();
+        memcpy(staging.data(), batch.vertices.data(),
+            batch.vertices.size() * sizeof(draw_vertex));
+        memcpy(staging.data() + batch.vertices.size() * sizeof(draw_vertex),
+            batch.indices.data(), batch.indices.size() * sizeof(uint));
+        const auto t4 = high_resolution_clock::now();
+        d1 += elapsed_ms(t1, t2);
+        d2 += elapsed_ms(t2, t3);
+        d3 += elapsed_ms(t3, t4);
+    }
+    printf("pack (%7zu glyphs)      = %12.3f milliseconds\n", glyphs, d1 / frames);
+    printf("upload (compact)           = %12.3f milliseconds (%zu bytes)\n",
+        d2 / frames, b2);
+    printf("upload (float)             = %12.3f milliseconds (%zu bytes)\n",
+        d3 / frames, b1);
+}
+
+int main(int argc, char **argv)
+{
+    test_text();
+    test_fallback();
+    bench_compact(5000, 10);
+}
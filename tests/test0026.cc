@@ -0,0 +1,170 @@
+#include "test.h"
+
+static bin_rect rect(int x1, int y1, int x2, int y2)
+{
+    return bin_rect(bin_point(x1, y1), bin_point(x2, y2));
+}
+
+static bool covered(std::vector<bin_rect> &rects, int x, int y)
+{
+    for (auto &r : rects) {
+        if (x >= r.a.x && x < r.b.x && y >= r.a.y && y < r.b.y) return true;
+    }
+    return false;
+}
+
+static void check_disjoint(std::vector<bin_rect> &rects)
+{
+    for (size_t i = 0; i < rects.size(); i++) {
+        for (size_t j = i + 1; j < rects.size(); j++) {
+            assert(!rects[i].intersects(rects[j]));
+        }
+    }
+}
+
+static void test_union()
+{
+    std::vector<bin_rect> rects;
+
+    /* adjacent glyphs in a row merge, distant rows do not */
+    draw_rect_union(rects, rect(0, 0, 10, 12));
+    draw_rect_union(rects, rect(10, 0, 18, 12));
+    draw_rect_union(rects, rect(0, 500, 10, 512));
+    assert(rects.size() == 2);
+    assert(covered(rects, 17, 11) && covered(rects, 5, 505));
+    assert(!covered(rects, 5, 100));
+
+    /* intersecting rectangles merge and a bridge joins merged bounds */
+    draw_rect_union(rects, rect(5, 5, 15, 15));
+    draw_rect_union(rects, rect(0, 10, 18, 510));
+    assert(rects.size() == 1);
+
+    /* empty rectangles are ignored */
+    draw_rect_union(rects, rect(1024, 1024, 0, 0));
+    assert(rects.size() == 1);
+
+    /* random rectangles stay disjoint, covered and within the limit */
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> pos(0, 1000), size(1, 30);
+    std::vector<bin_rect> input;
+    rects.clear();
+    for (int i = 0; i < 50; i++) {
+        int x = pos(gen), y = pos(gen);
+        input.push_back(rect(x, y, x + size(gen), y + size(gen)));
+        draw_rect_union(rects, input.back());
+        assert(rects.size() <= 16);
+        check_disjoint(rects);
+    }
+    for (auto &r : input) {
+        assert(covered(rects, r.a.x, r.a.y));
+        assert(covered(rects, r.b.x - 1, r.b.y - 1));
+    }
+
+    printf("union: PASS (%zu rects)\n", rects.size());
+}
+
+static size_t rect_bytes(bin_rect r, int depth)
+{
+    return (size_t)std::max(0, r.b.x - r.a.x) *
+           (size_t)std::max(0, r.b.y - r.a.y) * depth;
+}
+
+static size_t image_bytes(draw_image &img, bool dirty)
+{
+    size_t bytes = 0;
+    if (dirty) {
+        for (auto &r : draw_image_rects(img)) bytes += rect_bytes(r, img.size[2]);
+    } else if (img.modrect[2] > 0 && img.modrect[3] > 0) {
+        bytes = (size_t)img.modrect[2] * img.modrect[3] * img.size[2];
+    }
+    return bytes;
+}
+
+/*
+ * glyph heavy warmup: each frame renders all previous text plus one new
+ * string in a new size, so each frame adds a handful of glyphs to the
+ * atlas, scattered across rows packed by earlier frames.
+ */
+static void render_frame(text_renderer_ft &renderer, font_manager_ft &manager,
+    draw_list &batch, int frame)
+{
+    text_shaper_hb shaper;
+    std::vector<glyph_shape> shapes;
+
+    for (int i = 0; i <= frame; i++) {
+        font_face *face = manager.findFontByPath(font_paths[i % 2]);
+        std::string s = "frame " + std::to_string(i) +
+            " The quick brown fox jumps over the lazy dog 0123456789";
+        text_segment segment(s, text_lang, face, (12 + i * 3) * 64,
+            10.0f, 20.0f + (float)i * 24.0f, 0xff000000);
+        shapes.clear();
+        shaper.shape(shapes, segment);
+        renderer.render(batch, shapes, segment);
+    }
+}
+
+static void test_warmup(int frames)
+{
+    font_manager_ft manager;
+    text_renderer_ft renderer(&manager);
+    draw_rasterizer r(640, 480, 0);
+    draw_list batch;
+    size_t bounds_bytes = 0, dirty_bytes = 0, uploads = 0;
+
+    for (int frame = 0; frame < frames; frame++) {
+        draw_list_clear(batch);
+        render_frame(renderer, manager, batch, frame);
+        for (auto &img : batch.images) {
+            assert(img.dirty.size() <= 16);
+            check_disjoint(img.dirty);
+            if (frame == 0) continue;
+            bounds_bytes += image_bytes(img, false);
+            dirty_bytes += image_bytes(img, true);
+            uploads += draw_image_rects(img).size();
+        }
+        r.update_images(batch);
+    }
+
+    /* incrementally updated textures match the atlas */
+    for (auto &atlas : manager.everyAtlas) {
+        auto ti = r.textures.find(atlas->get_image()->iid);
+        assert(ti != r.textures.end());
+        assert(memcmp(ti->second.pixels.data(), atlas->pixels,
+            atlas->width * atlas->height * atlas->depth) == 0);
+    }
+    assert(dirty_bytes <= bounds_bytes);
+
+    printf("warmup: PASS\n");
+    printf("upload (bounding rect)     = %12zu bytes/frame\n",
+        bounds_bytes / (frames - 1));
+    printf("upload (dirty rects)       = %12zu bytes/frame (%zu rects)\n",
+        dirty_bytes / (frames - 1), uploads / (frames - 1));
+}
+
+static void bench_union(size_t count)
+{
+    std::mt19937 gen(2);
+    std::uniform_int_distribution<int> pos(0, 1000), size(4, 24);
+    std::vector<bin_rect> input, rects;
+
+    for (size_t i = 0; i < count; i++) {
+        int x = pos(gen), y = pos(gen);
+        input.push_back(rect(x, y, x + size(gen), y + size(gen)));
+    }
+    const auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        if (i % 64 == 0) rects.clear();
+        draw_rect_union(rects, input[i]);
+    }
+    const auto t2 = high_resolution_clock::now();
+
+    float d = elapsed_ms(t1, t2);
+    printf("draw_rect_union (%zu)   = %12.3f milliseconds\n", count, d);
+}
+
+int main(int argc, char **argv)
+{
+    test_union();
+    test_warmup(20);
+    bench_union(100000);
+}
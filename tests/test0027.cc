@@ -0,0 +1,157 @@
+#include "test.h"
+
+/* glyph like blobs on a transparent background compress like an atlas */
+static image_ptr make_image(uint width, uint height, pixel_format format)
+{
+    image_ptr img = image::createBitmap(width, height, format);
+    uint d = img->getBytesPerPixel();
+    std::mt19937 gen(1);
+    for (uint y = 0; y < height; y++) {
+        for (uint x = 0; x < width; x++) {
+            bool on = ((x / 24) + (y / 32)) % 3 != 0 && (x % 24) < 18 &&
+                (y % 32) < 26 && (gen() & 3) != 0;
+            for (uint c = 0; c < d; c++) {
+                img->pixels[(y * width + x) * d + c] =
+                    on ? (uint8_t)(gen() | (c == 3 ? 0x80 : 0)) : 0;
+            }
+        }
+    }
+    return img;
+}
+
+static void test_formats()
+{
+    std::string rgba_path = temp_path("test0027_rgba.png");
+    std::string gray_path = temp_path("test0027_gray.png");
+    image_ptr rgba = make_image(97, 61, pixel_format_rgba);
+    image_ptr gray = make_image(97, 61, pixel_format_alpha);
+    image::saveToFile(rgba_path, rgba);
+    image::saveToFile(gray_path, gray);
+    size_t n = 97 * 61;
+
+    /* the file format is the default */
+    image_ptr img = image::createFromFile(rgba_path);
+    assert(img && img->format == pixel_format_rgba);
+    assert(memcmp(img->pixels, rgba->pixels, n * 4) == 0);
+    img = image::createFromFile(gray_path);
+    assert(img && img->format == pixel_format_rgb);
+
+    /* alpha images are saved as gray and load as alpha */
+    std::vector<uint8_t> buf(n * 4);
+    assert(image::PNG.load(file::getFile(gray_path), pixel_format_alpha,
+        buf.data(), 97, 61, 97));
+    assert(memcmp(buf.data(), gray->pixels, n) == 0);
+
+    /* converted formats match convertFormat, except luminance which
+     * libpng weights by channel */
+    pixel_format formats[] = {
+        pixel_format_rgb, pixel_format_alpha, pixel_format_argb,
+        pixel_format_rgb565
+    };
+    for (pixel_format f : formats) {
+        uint d = image::getBytesPerPixel(f);
+        image copy(*rgba);
+        copy.convertFormat(f);
+        assert(image::PNG.load(file::getFile(rgba_path), f,
+            buf.data(), 97, 61, 97 * d));
+        assert(memcmp(buf.data(), copy.pixels, n * d) == 0);
+    }
+    assert(image::PNG.load(file::getFile(rgba_path), pixel_format_luminance,
+        buf.data(), 97, 61, 97));
+
+    /* rows with a stride, e.g. a sub rectangle of a mapped buffer */
+    size_t stride = 128 * 4;
+    std::vector<uint8_t> big(stride * 64, 0xcc);
+    assert(image::PNG.load(file::getFile(rgba_path), pixel_format_rgba,
+        &big[stride * 2 + 8], 97, 61, stride));
+    for (uint y = 0; y < 61; y++) {
+        assert(memcmp(&big[stride * (y + 2) + 8], &rgba->pixels[y * 97 * 4],
+            97 * 4) == 0);
+        assert(big[stride * (y + 2) + 7] == 0xcc);
+        assert(big[stride * (y + 2) + 8 + 97 * 4] == 0xcc);
+    }
+
+    /* size mismatches and missing files fail */
+    assert(!image::PNG.load(file::getFile(rgba_path), pixel_format_rgba,
+        buf.data(), 96, 61, 96 * 4));
+    assert(!image::PNG.load(file::getFile(temp_path("test0027_none.png")),
+        pixel_format_rgba, buf.data(), 97, 61, 97 * 4));
+
+    printf("formats: PASS\n");
+}
+
+static void test_atlas()
+{
+    for (size_t depth : { (size_t)font_atlas::GRAY_DEPTH,
+                          (size_t)font_atlas::MSDF_DEPTH }) {
+        font_face face(1, temp_path("test0027_face"), "test");
+        font_atlas a(256, 256, depth);
+        std::mt19937 gen(2);
+        for (int i = 0; i < 40; i++) {
+            atlas_entry e = a.create(&face, 0, i, 12 * 64, 0, 0, 14, 18);
+            for (int y = 0; y < e.h; y++) {
+                for (int x = 0; x < e.w * (int)depth; x++) {
+                    a.pixels[(e.y + y) * 256 * depth + e.x * depth + x] =
+                        (uint8_t)gen();
+                }
+            }
+        }
+        a.save(nullptr, &face);
+
+        /* loads into the existing backing store */
+        font_atlas b(256, 256, depth);
+        uint8_t *pixels = b.pixels;
+        b.load(nullptr, &face);
+        assert(b.pixels == pixels && b.depth == depth);
+        assert(memcmp(a.pixels, b.pixels, 256 * 256 * depth) == 0);
+        assert(b.glyph_map.size() == a.glyph_map.size());
+
+        /* or allocates one of the image size */
+        font_atlas c(0, 0, 0), d(64, 64, depth);
+        c.depth = depth;
+        c.load(nullptr, &face);
+        d.load(nullptr, &face);
+        for (font_atlas *l : { &c, &d }) {
+            assert(l->width == 256 && l->height == 256 && l->depth == depth);
+            assert(l->get_image()->getWidth() == 256);
+            assert(memcmp(a.pixels, l->pixels, 256 * 256 * depth) == 0);
+        }
+    }
+
+    printf("atlas: PASS\n");
+}
+
+static void bench_load(uint size)
+{
+    std::string path = temp_path("test0027_bench.png");
+    image_ptr src = make_image(size, size, pixel_format_rgba);
+    image::saveToFile(path, src);
+
+    /* decode to a new image, convert, then copy into the atlas */
+    font_atlas atlas(size, size, font_atlas::GRAY_DEPTH);
+    const auto t1 = high_resolution_clock::now();
+    image_ptr img = image::createFromFile(path, &image::PNG, pixel_format_rgba);
+    img->convertFormat(pixel_format_alpha);
+    memcpy(atlas.pixels, img->pixels, (size_t)size * size);
+    const auto t2 = high_resolution_clock::now();
+
+    /* decode rows directly into the atlas */
+    std::vector<uint8_t> copy(atlas.pixels, atlas.pixels + (size_t)size * size);
+    const auto t3 = high_resolution_clock::now();
+    assert(image::PNG.load(file::getFile(path), pixel_format_alpha,
+        atlas.pixels, size, size, size));
+    const auto t4 = high_resolution_clock::now();
+    assert(memcmp(copy.data(), atlas.pixels, copy.size()) == 0);
+
+    float d1 = elapsed_ms(t1, t2), d2 = elapsed_ms(t3, t4);
+    printf("load (copy, %4ux%-4u)     = %12.3f milliseconds\n", size, size, d1);
+    printf("load (stream, %4ux%-4u)   = %12.3f milliseconds\n", size, size, d2);
+}
+
+int main(int argc, char **argv)
+{
+    test_formats();
+    test_atlas();
+    bench_load(2048);
+    bench_load(4096);
+}
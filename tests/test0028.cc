@@ -0,0 +1,113 @@
+#include "test.h"
+
+/* smooth fields with glyph shaped edges, like an MSDF atlas */
+static image_ptr make_image(uint width, uint height, pixel_format format)
+{
+    image_ptr img = image::createBitmap(width, height, format);
+    uint d = img->getBytesPerPixel();
+    std::mt19937 gen(1);
+    for (uint y = 0; y < height; y++) {
+        for (uint x = 0; x < width; x++) {
+            int cx = (int)(x % 40) - 20, cy = (int)(y % 48) - 24;
+            bool on = ((x / 40) + (y / 48)) % 5 != 0;
+            for (uint c = 0; c < d; c++) {
+                int v = 128 + (c & 1 ? cx : cy) * 5 + (int)(gen() & 3);
+                img->pixels[(y * width + x) * d + c] = on ?
+                    (uint8_t)std::max(0, std::min(255, v)) : 0;
+            }
+        }
+    }
+    return img;
+}
+
+static void check_load(std::string path, image_ptr &src)
+{
+    image_ptr img = image::createFromFile(path, &image::PNG, src->format);
+    assert(img);
+    assert(img->width == src->width && img->height == src->height);
+    assert(memcmp(img->pixels, src->pixels, (size_t)src->width *
+        src->height * src->getBytesPerPixel()) == 0);
+}
+
+static void test_roundtrip()
+{
+    std::string path = temp_path("test0028.png");
+    image_io_png png;
+    image_png_options opts;
+
+    pixel_format formats[] = {
+        pixel_format_rgba, pixel_format_rgb, pixel_format_alpha
+    };
+    int filters[] = {
+        image_png_filter_default, image_png_filter_none, image_png_filter_sub,
+        image_png_filter_up, image_png_filter_avg, image_png_filter_paeth,
+        image_png_filter_sub | image_png_filter_paeth
+    };
+    int strategies[] = {
+        image_png_strategy_default, image_png_strategy_filtered,
+        image_png_strategy_huffman, image_png_strategy_rle
+    };
+
+    for (pixel_format f : formats) {
+        /* odd sizes, including images smaller than one band */
+        for (uint size : { 1u, 37u, 301u }) {
+            image_ptr src = make_image(size, size + 3, f);
+            for (size_t threads : { 0, 1, 4 }) {
+                opts.num_threads = threads;
+                for (int filter : filters) {
+                    opts.filters = filter;
+                    opts.compression_level = (filter & 0x18) ? 1 : 9;
+                    assert(png.save_parallel(src.get(), path, opts));
+                    check_load(path, src);
+                }
+                for (int strategy : strategies) {
+                    opts.compression_strategy = strategy;
+                    assert(png.save_parallel(src.get(), path, opts));
+                    check_load(path, src);
+                }
+                opts.compression_strategy = image_png_strategy_default;
+            }
+
+            /* the libpng encoder honours the same options */
+            opts.num_threads = 0;
+            opts.filters = image_png_filter_up;
+            assert(png.save(src.get(), path, opts));
+            check_load(path, src);
+        }
+    }
+
+    printf("roundtrip: PASS\n");
+}
+
+static void bench_save(const char *name, image_ptr &img, int level,
+    int filters, size_t threads)
+{
+    std::string path = temp_path("test0028_bench.png");
+    image_io_png png;
+    image_png_options opts;
+    opts.compression_level = level;
+    opts.filters = filters;
+    opts.num_threads = threads;
+
+    const auto t1 = high_resolution_clock::now();
+    png.save(img.get(), path, opts);
+    const auto t2 = high_resolution_clock::now();
+    check_load(path, img);
+
+    float d = elapsed_ms(t1, t2);
+    printf("%-27s= %12.3f milliseconds (%zu bytes)\n", name, d,
+        file_size(path));
+}
+
+int main(int argc, char **argv)
+{
+    test_roundtrip();
+
+    image_ptr img = make_image(1024, 1024, pixel_format_rgba);
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bench_save("save (libpng default)", img, -1, 0, 0);
+    bench_save("save (libpng level 1 up)", img, 1, image_png_filter_up, 0);
+    bench_save("save (parallel default)", img, -1, 0, threads);
+    bench_save("save (parallel level 1 up)", img, 1, image_png_filter_up,
+        threads);
+}
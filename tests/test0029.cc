@@ -0,0 +1,190 @@
+#include "test.h"
+
+/* destination that allocates a vector in the requested format */
+struct vector_dest : image_dest
+{
+    std::vector<uint8_t> pixels;
+    uint width, height;
+    pixel_format format;
+
+    uint8_t* get(uint w, uint h, pixel_format f, size_t &stride)
+    {
+        width = w;
+        height = h;
+        format = f;
+        pixels.resize(stride * h);
+        return pixels.data();
+    }
+};
+
+static image_ptr random_image(uint width, uint height, pixel_format format,
+    std::mt19937 &gen)
+{
+    image_ptr img = image::createBitmap(width, height, format);
+    size_t n = (size_t)width * height * img->getBytesPerPixel();
+    for (size_t i = 0; i < n; i++) {
+        img->pixels[i] = (gen() & 7) ? (uint8_t)(i / 7) : (uint8_t)gen();
+    }
+    return img;
+}
+
+static void test_codec()
+{
+    std::mt19937 gen(1);
+    pixel_format formats[] = {
+        pixel_format_alpha, pixel_format_rgb, pixel_format_rgba
+    };
+
+    for (pixel_format f : formats) {
+        for (uint size : { 1u, 2u, 31u, 256u }) {
+            image_ptr img = random_image(size, size + 5, f, gen);
+            size_t n = (size_t)size * (size + 5) * img->getBytesPerPixel();
+            std::vector<uint8_t> enc;
+            image_io_rca::encode(enc, img.get());
+
+            /* decodes in the stored format */
+            vector_dest d1;
+            assert(image_io_rca::decode(enc, pixel_format_none, &d1));
+            assert(d1.format == f && d1.width == size);
+            assert(memcmp(d1.pixels.data(), img->pixels, n) == 0);
+
+            /* and converts to other formats */
+            image copy(*img);
+            copy.convertFormat(pixel_format_rgba);
+            vector_dest d2;
+            assert(image_io_rca::decode(enc, pixel_format_rgba, &d2));
+            assert(memcmp(d2.pixels.data(), copy.pixels,
+                (size_t)size * (size + 5) * 4) == 0);
+
+            /* truncated, extended and bit flipped streams are rejected */
+            std::vector<uint8_t> bad;
+            for (size_t len : { (size_t)10, enc.size() / 2, enc.size() - 1 }) {
+                bad.assign(enc.begin(), enc.begin() + len);
+                assert(!image_io_rca::decode(bad, pixel_format_none, &d1));
+            }
+            bad = enc;
+            bad.push_back(0);
+            assert(!image_io_rca::decode(bad, pixel_format_none, &d1));
+            for (size_t i = 8; i < enc.size(); i += 1 + enc.size() / 16) {
+                bad = enc;
+                bad[i] ^= (uint8_t)(1 << (i & 7));
+                assert(!image_io_rca::decode(bad, pixel_format_none, &d1));
+            }
+        }
+    }
+
+    /* empty images code to the smallest payloads and still decode */
+    for (pixel_format f : formats) {
+        image_ptr img = image::createBitmap(2048, 2048, f);
+        memset(img->pixels, 0, (size_t)2048 * 2048 * img->getBytesPerPixel());
+        std::vector<uint8_t> enc;
+        image_io_rca::encode(enc, img.get());
+        vector_dest d;
+        assert(image_io_rca::decode(enc, pixel_format_none, &d));
+    }
+
+    printf("codec: PASS\n");
+}
+
+/* coverage atlas filled by rendering text in many sizes */
+static void fill_atlas(font_manager_ft &manager)
+{
+    draw_list batch;
+
+    for (int i = 0; i < 40; i++) {
+        font_face *face = manager.findFontByPath(font_paths[i % 2]);
+        render_text(batch, manager, face, "The quick brown fox jumps over "
+            "the lazy dog 0123456789 ABCDEFGHIJKLMNOPQRSTUVWXYZ {}[]()<>$%&@#",
+            10 + i * 2, 0.0f, 0.0f, 0xff000000);
+    }
+}
+
+/* smooth fields with glyph shaped edges, like an MSDF atlas */
+static image_ptr field_image(uint width, uint height)
+{
+    image_ptr img = image::createBitmap(width, height, pixel_format_rgba);
+    for (uint y = 0; y < height; y++) {
+        for (uint x = 0; x < width; x++) {
+            int cx = (int)(x % 40) - 20, cy = (int)(y % 48) - 24;
+            bool on = ((x / 40) + (y / 48)) % 5 != 0;
+            for (uint c = 0; c < 4; c++) {
+                int v = c == 3 ? 255 : 128 + (c & 1 ? cx : cy) * 5 + (int)c;
+                img->pixels[(y * width + x) * 4 + c] = on ?
+                    (uint8_t)std::max(0, std::min(255, v)) : 0;
+            }
+        }
+    }
+    return img;
+}
+
+static void test_atlas()
+{
+    font_manager_ft manager;
+    fill_atlas(manager);
+    font_atlas *atlas = manager.everyAtlas[0].get();
+
+    font_face face(1, temp_path("test0029_face"), "test");
+    atlas->image_type = font_atlas::rca_file;
+    atlas->save(&manager, &face);
+    remove(atlas->get_path(&face, font_atlas::png_file).c_str());
+
+    /* png is loaded by default, rca only when chosen */
+    font_atlas png_only(64, 64, font_atlas::GRAY_DEPTH);
+    png_only.load(&manager, &face);
+    assert(png_only.width == 64);
+
+    font_atlas loaded(64, 64, font_atlas::GRAY_DEPTH);
+    loaded.image_type = font_atlas::rca_file;
+    loaded.load(&manager, &face);
+    assert(loaded.width == atlas->width && loaded.depth == atlas->depth);
+    assert(memcmp(loaded.pixels, atlas->pixels,
+        atlas->width * atlas->height * atlas->depth) == 0);
+    remove(atlas->get_path(&face, font_atlas::rca_file).c_str());
+
+    printf("atlas: PASS\n");
+}
+
+static void bench_codec(const char *name, image_ptr img)
+{
+    std::string png_path = temp_path("test0029.png");
+    std::string rca_path = temp_path("test0029.rca");
+    size_t raw = (size_t)img->width * img->height * img->getBytesPerPixel();
+    std::vector<uint8_t> buf(raw);
+
+    image::saveToFile(png_path, img);
+    const auto t1 = high_resolution_clock::now();
+    image::saveToFile(rca_path, img);
+    const auto t2 = high_resolution_clock::now();
+
+    const auto t3 = high_resolution_clock::now();
+    assert(image::PNG.load(file::getFile(png_path), img->format,
+        buf.data(), img->width, img->height, raw / img->height));
+    const auto t4 = high_resolution_clock::now();
+    assert(memcmp(buf.data(), img->pixels, raw) == 0);
+
+    memset(buf.data(), 0, raw);
+    const auto t5 = high_resolution_clock::now();
+    image_ptr dec = image::createFromFile(rca_path);
+    const auto t6 = high_resolution_clock::now();
+    assert(dec && memcmp(dec->pixels, img->pixels, raw) == 0);
+
+    size_t png_size = file_size(png_path), rca_size = file_size(rca_path);
+    printf("%s: %zu bytes, png %zu (%.2f%%), rca %zu (%.2f%%)\n", name, raw,
+        png_size, 100.0 * png_size / raw, rca_size, 100.0 * rca_size / raw);
+    printf("%-27s= %12.3f MB/s\n", "encode (rca)", mb_per_sec(raw, t1, t2));
+    printf("%-27s= %12.3f MB/s\n", "decode (png)", mb_per_sec(raw, t3, t4));
+    printf("%-27s= %12.3f MB/s\n", "decode (rca)", mb_per_sec(raw, t5, t6));
+}
+
+int main(int argc, char **argv)
+{
+    test_codec();
+    test_atlas();
+
+    font_manager_ft manager;
+    fill_atlas(manager);
+    font_atlas *atlas = manager.everyAtlas[0].get();
+    bench_codec("coverage atlas", image::createBitmap((uint)atlas->width,
+        (uint)atlas->height, pixel_format_alpha, atlas->pixels));
+    bench_codec("field atlas", field_image(1024, 1024));
+}
@@ -0,0 +1,145 @@
+#undef NDEBUG
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+
+#include <string>
+#include <random>
+#include <chrono>
+
+#include "bitcode.h"
+
+/*
+ * batch vlu encode and decode compared with the scalar functions
+ */
+
+static std::vector<uint64_t> random_symbols(std::mt19937_64 &gen, size_t count,
+    size_t max_bits, size_t run)
+{
+    std::vector<uint64_t> syms(count);
+    size_t bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i % run == 0) bits = gen() % (max_bits + 1);
+        syms[i] = gen() & msk(bits);
+    }
+    return syms;
+}
+
+static std::vector<uint8_t> scalar_encode(std::vector<uint64_t> &syms)
+{
+    vector_writer vw;
+    bitcode_writer bw(&vw);
+    for (auto s : syms) bw.write_vlu(s);
+    bw.flush();
+    return vw.buffer;
+}
+
+void test_vlu_batch()
+{
+    std::mt19937_64 gen(1);
+    size_t max_bits[] = { 7, 14, 21, 56 };
+    size_t runs[] = { 1, 5, 40 };
+
+    for (size_t iter = 0; iter < 2000; iter++) {
+        size_t count = gen() % 300;
+        std::vector<uint64_t> syms = random_symbols(gen, count,
+            max_bits[iter % 4], runs[(iter / 4) % 3]);
+
+        /* encoded bytes match the bitcode writer */
+        std::vector<uint8_t> ref = scalar_encode(syms);
+        std::vector<uint8_t> buf(count * 8);
+        size_t len = vlu_encode_56_n(buf.data(), syms.data(), count);
+        assert(len == ref.size());
+        assert(std::equal(ref.begin(), ref.end(), buf.begin()));
+
+        /* decoded symbols match, with and without trailing bytes */
+        std::vector<uint64_t> out(count);
+        size_t consumed;
+        assert(vlu_decode_56_n(out.data(), count, buf.data(), buf.size(),
+            consumed) == count);
+        assert(consumed == len && out == syms);
+
+        /* truncated buffers stop before the truncated symbol */
+        size_t cut = len ? gen() % len : 0, n = 0, expect = 0;
+        while (n < count && expect + vlu_encoded_size_56(syms[n]) <= cut) {
+            expect += vlu_encoded_size_56(syms[n++]);
+        }
+        assert(vlu_decode_56_n(out.data(), count, buf.data(), cut,
+            consumed) == n);
+        assert(consumed == expect);
+        assert(std::equal(out.begin(), out.begin() + n, syms.begin()));
+
+        /* the memory reader uses batches after unaligned fixed reads */
+        vector_writer vw;
+        bitcode_writer bw(&vw);
+        bw.write_fixed(5, 3);
+        for (auto s : syms) bw.write_vlu(s);
+        bw.flush();
+        bitcode_memory_reader mr(vw.buffer);
+        assert(mr.read_fixed(3) == 5);
+        mr.read_vlu_n(out.data(), count);
+        assert(out == syms);
+    }
+
+    printf("vlu_batch: PASS\n");
+}
+
+/*
+ * throughput of scalar and batch coding
+ */
+
+template <typename F>
+static double bench(F fn)
+{
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    fn();
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+void bench_vlu_batch(size_t count, size_t max_bits)
+{
+    std::mt19937_64 gen(2);
+    std::vector<uint64_t> syms = random_symbols(gen, count, max_bits, 1);
+    std::vector<uint64_t> out(count);
+    std::vector<uint8_t> buf(count * 8);
+    vector_writer vw;
+    bitcode_writer bw(&vw);
+    size_t len = 0, consumed;
+
+    double e1 = bench([&]() {
+        for (auto s : syms) bw.write_vlu(s);
+        bw.flush();
+    });
+    double e2 = bench([&]() {
+        len = vlu_encode_56_n(buf.data(), syms.data(), count);
+    });
+    bitcode_memory_reader mr(vw.buffer);
+    double d1 = bench([&]() {
+        for (size_t i = 0; i < count; i++) out[i] = mr.read_vlu();
+    });
+    assert(out == syms);
+    double d2 = bench([&]() {
+        vlu_decode_56_n(out.data(), count, buf.data(), len, consumed);
+    });
+    assert(out == syms && consumed == len);
+
+    char name[32];
+    snprintf(name, sizeof(name), "vlu%zu encode (scalar)", max_bits);
+    printf("%-27s= %12.3f Msymbols/sec\n", name, count / e1 / 1e6);
+    snprintf(name, sizeof(name), "vlu%zu encode (batch)", max_bits);
+    printf("%-27s= %12.3f Msymbols/sec\n", name, count / e2 / 1e6);
+    snprintf(name, sizeof(name), "vlu%zu decode (scalar)", max_bits);
+    printf("%-27s= %12.3f Msymbols/sec\n", name, count / d1 / 1e6);
+    snprintf(name, sizeof(name), "vlu%zu decode (batch)", max_bits);
+    printf("%-27s= %12.3f Msymbols/sec\n", name, count / d2 / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    test_vlu_batch();
+    bench_vlu_batch(10000000, 7);
+    bench_vlu_batch(10000000, 14);
+    bench_vlu_batch(10000000, 56);
+}
@@ -0,0 +1,197 @@
+#include "test.h"
+
+/*
+ * straightforward decoder following table 3-7 of the Unicode standard,
+ * with one U+FFFD for each maximal subpart of an ill-formed sequence.
+ */
+static void ref_decode(const uint8_t *p, size_t len,
+    std::vector<uint32_t> &codes, std::vector<uint32_t> &offsets)
+{
+    size_t i = 0;
+    while (i < len) {
+        uint8_t b = p[i];
+        size_t start = i++, need;
+        uint32_t cp;
+        uint8_t lo = 0x80, hi = 0xBF;
+        if (b < 0x80) {
+            need = 0, cp = b;
+        } else if (b >= 0xC2 && b <= 0xDF) {
+            need = 1, cp = b & 0x1f;
+        } else if (b >= 0xE0 && b <= 0xEF) {
+            need = 2, cp = b & 0x0f;
+            if (b == 0xE0) lo = 0xA0;
+            if (b == 0xED) hi = 0x9F;
+        } else if (b >= 0xF0 && b <= 0xF4) {
+            need = 3, cp = b & 0x07;
+            if (b == 0xF0) lo = 0x90;
+            if (b == 0xF4) hi = 0x8F;
+        } else {
+            need = 1, cp = 0xFFFD, lo = 1, hi = 0;
+        }
+        size_t k = 0;
+        for (; k < need && i < len && p[i] >= lo && p[i] <= hi; k++, i++) {
+            cp = (cp << 6) | (p[i] & 0x3f);
+            lo = 0x80, hi = 0xBF;
+        }
+        codes.push_back(k == need ? cp : 0xFFFD);
+        offsets.push_back((uint32_t)start);
+    }
+}
+
+static std::vector<uint32_t> decode(std::string s,
+    std::vector<uint32_t> *offsets = nullptr)
+{
+    std::vector<uint32_t> codes(s.size()), o(s.size());
+    size_t n = utf8_to_utf32_n(s.data(), s.size(), codes.data(), o.data());
+    assert(utf8_count(s.data(), s.size()) == n);
+    codes.resize(n);
+    o.resize(n);
+    if (offsets) *offsets = o;
+    return codes;
+}
+
+static void test_invalid()
+{
+    typedef std::vector<uint32_t> v;
+    const uint32_t R = 0xFFFD;
+
+    /* example from section 3.9 of the Unicode standard */
+    assert(decode("\x61\xF1\x80\x80\xE1\x80\xC2\x62\x80\x63\x80\xBF\x64") ==
+        (v{ 0x61, R, R, R, 0x62, R, 0x63, R, R, 0x64 }));
+
+    assert(decode("\xC0\xAF") == (v{ R, R }));             /* overlong */
+    assert(decode("\xE0\x80\xAF") == (v{ R, R, R }));      /* overlong */
+    assert(decode("\xED\xA0\x80") == (v{ R, R, R }));      /* surrogate */
+    assert(decode("\xF4\x90\x80\x80") == (v{ R, R, R, R })); /* > 10FFFF */
+    assert(decode("\xF8\x88\x80\x80\x80") == (v{ R, R, R, R, R }));
+    assert(decode("a\xE2\x82") == (v{ 'a', R }));          /* truncated */
+    assert(decode("\xE2\x82\xAC\xF0\x9F\x99\x83") == (v{ 0x20AC, 0x1F643 }));
+    assert(decode("\xF4\x8F\xBF\xBF\xEF\xBF\xBF") == (v{ 0x10FFFF, 0xFFFF }));
+
+    /* random bytes biased towards lead and continuation bytes */
+    std::mt19937 gen(1);
+    const uint8_t bytes[] = {
+        0x00, 0x41, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xc1,
+        0xc2, 0xdf, 0xe0, 0xe1, 0xec, 0xed, 0xee, 0xef, 0xf0, 0xf1, 0xf3,
+        0xf4, 0xf5, 0xff
+    };
+    for (size_t iter = 0; iter < 20000; iter++) {
+        std::string s(gen() % 40, 0);
+        for (auto &c : s) {
+            c = gen() & 1 ? bytes[gen() % sizeof(bytes)] : gen() % 256;
+        }
+        std::vector<uint32_t> rc, ro, o;
+        ref_decode((const uint8_t*)s.data(), s.size(), rc, ro);
+        assert(decode(s, &o) == rc && o == ro);
+    }
+
+    printf("invalid: PASS\n");
+}
+
+static void test_valid()
+{
+    std::mt19937 gen(2);
+
+    for (size_t iter = 0; iter < 2000; iter++) {
+        std::vector<uint32_t> codes, offsets;
+        std::string s;
+        size_t count = gen() % 200;
+        for (size_t i = 0; i < count; i++) {
+            /* mostly runs of ASCII to exercise the wide path */
+            uint32_t c = gen() % 4 ? 0x20 + gen() % 0x5f : gen() % 0x110000;
+            if (c >= 0xD800 && c < 0xE000) c = 0xFFFD;
+            char buf[8];
+            int len = utf32_to_utf8(buf, sizeof(buf), c);
+            codes.push_back(c);
+            offsets.push_back((uint32_t)s.size());
+            s.append(buf, len);
+        }
+        std::vector<uint32_t> o;
+        assert(decode(s, &o) == codes && o == offsets);
+        assert(utf8_strlen(s.c_str()) == count);
+        for (size_t i = 0; i < count; i++) {
+            assert(utf8_to_utf32(s.c_str() + offsets[i]) == codes[i]);
+            assert(utf8_codelen(s.c_str() + offsets[i]) ==
+                (i + 1 < count ? offsets[i+1] : s.size()) - offsets[i]);
+        }
+    }
+
+    printf("valid: PASS\n");
+}
+
+static const char *samples[] = {
+    "Ελληνικά: Ξεσκεπάζω την ψυχοφθόρα βδελυγμία. ",
+    "Русский: Съешь же ещё этих мягких французских булок, да выпей чаю. ",
+    "中文：我能吞下玻璃而不伤身体。 日本語：いろはにほへとちりぬるを ",
+    "हिन्दी: मैं काँच खा सकता हूँ और मुझे उससे कोई चोट नहीं पहुंचती ",
+    "Emoji: 🙃😙😃😜😍🌍🚀 ",
+    "English: The quick brown fox jumps over the lazy dog. ",
+};
+
+static void test_shape()
+{
+    font_manager_ft manager;
+    text_shaper_ft shaper;
+    font_face *face = manager.findFontByPath(font_paths[0]);
+
+    std::string text;
+    for (auto s : samples) text += s;
+    text += "\xE2\x82";
+
+    text_segment segment(text, text_lang, face, 12 * 64, 0, 0, 0xff000000);
+    std::vector<glyph_shape> shapes;
+    shaper.shape(shapes, segment);
+
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> codes = decode(text, &offsets);
+    assert(shapes.size() == codes.size());
+    for (size_t i = 0; i < shapes.size(); i++) {
+        assert(shapes[i].cluster == offsets[i]);
+    }
+
+    printf("shape: PASS\n");
+}
+
+static void bench_decode(std::string text, const char *name)
+{
+    std::vector<uint32_t> codes(text.size()), offsets(text.size());
+    const char *s = text.data();
+    size_t len = text.size(), n1 = 0, n2 = 0, n3 = 0;
+
+    const auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < len; i += utf8_codelen(s + i)) {
+        codes[n1] = utf8_to_utf32(s + i);
+        offsets[n1++] = (uint32_t)i;
+    }
+    const auto t2 = high_resolution_clock::now();
+    n2 = utf8_to_utf32_n(s, len, codes.data(), offsets.data());
+    const auto t3 = high_resolution_clock::now();
+    n3 = utf8_count(s, len);
+    const auto t4 = high_resolution_clock::now();
+    assert(n1 == n2 && n2 == n3);
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s (codelen)", name);
+    printf("%-27s= %12.3f MB/s\n", label, mb_per_sec(len, t1, t2));
+    snprintf(label, sizeof(label), "%s (bulk)", name);
+    printf("%-27s= %12.3f MB/s\n", label, mb_per_sec(len, t2, t3));
+    snprintf(label, sizeof(label), "%s (count)", name);
+    printf("%-27s= %12.3f MB/s\n", label, mb_per_sec(len, t3, t4));
+}
+
+int main(int argc, char **argv)
+{
+    test_invalid();
+    test_valid();
+    test_shape();
+
+    std::string ascii, multi;
+    while (ascii.size() < (64 << 20)) {
+        ascii += samples[5];
+    }
+    while (multi.size() < (64 << 20)) {
+        for (auto s : samples) multi += s;
+    }
+    bench_decode(ascii, "ascii");
+    bench_decode(multi, "multilingual");
+}
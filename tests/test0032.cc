@@ -0,0 +1,131 @@
+#include "test.h"
+
+#include <unistd.h>
+#include <ft2build.h>
+
+#include FT_FREETYPE_H
+
+static const char *font_dir = "fonts";
+
+static void test_mapping()
+{
+    std::weak_ptr<file> weak;
+    {
+        font_manager_ft manager;
+        font_face_ft *face = static_cast<font_face_ft*>
+            (manager.findFontByPath(font_paths[0]));
+        assert(face && face->fontFile && face->face_index == 0);
+        weak = face->fontFile;
+
+        /* faces read from the mapping in place */
+        const void *buf = face->fontFile->getBuffer();
+        assert(face->ftface->stream->base == (const FT_Byte*)buf);
+        assert(manager.mapFontFile(font_paths[0]) == face->fontFile);
+
+        /* thread copies share the mapping and load identical glyphs */
+        long refs = face->fontFile.use_count();
+        std::unique_ptr<font_face_ft> dup(face->dup_thread());
+        assert(dup && dup->fontFile == face->fontFile);
+        assert(dup->ftface != face->ftface);
+        assert(dup->ftface->stream->base == (const FT_Byte*)buf);
+        assert(face->fontFile.use_count() == refs + 1);
+        assert(dup->name == face->name);
+
+        for (uint32_t c = 0x20; c < 0x17f; c++) {
+            uint32_t g1 = FT_Get_Char_Index(face->ftface, c);
+            uint32_t g2 = FT_Get_Char_Index(dup->ftface, c);
+            assert(g1 == g2);
+            assert(FT_Load_Glyph(face->ftface, g1, FT_LOAD_NO_SCALE) == 0);
+            assert(FT_Load_Glyph(dup->ftface, g2, FT_LOAD_NO_SCALE) == 0);
+            FT_Outline *o1 = &face->ftface->glyph->outline;
+            FT_Outline *o2 = &dup->ftface->glyph->outline;
+            assert(o1->n_points == o2->n_points);
+            assert(memcmp(o1->points, o2->points,
+                o1->n_points * sizeof(FT_Vector)) == 0);
+        }
+        dup.reset();
+        assert(face->fontFile.use_count() == refs);
+
+        /* missing files fail without adding a face */
+        size_t count = manager.fontCount();
+        assert(manager.findFontByPath("fonts/missing.ttf") == nullptr);
+        assert(manager.fontCount() == count);
+    }
+
+    /* the mapping is released with the last face */
+    assert(weak.expired());
+
+    printf("mapping: PASS\n");
+}
+
+/* resident and shared (file backed) pages from /proc/self/statm */
+static bool statm(size_t &resident, size_t &shared)
+{
+    size_t size;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return false;
+    bool ok = fscanf(f, "%zu %zu %zu", &size, &resident, &shared) == 3;
+    fclose(f);
+    return ok;
+}
+
+static void bench_scan(int copies)
+{
+    FT_Library ftlib;
+    std::vector<FT_Face> ftfaces;
+    std::vector<std::string> paths;
+    size_t r0 = 0, s0 = 0, r1 = 0, s1 = 0, r2 = 0, s2 = 0, r3 = 0, s3 = 0;
+    long page = sysconf(_SC_PAGESIZE);
+
+    for (auto &p : file::list(font_dir)) {
+        size_t i = p.rfind(".ttf");
+        if (i != std::string::npos && i == p.size() - 4) paths.push_back(p);
+    }
+    std::sort(paths.begin(), paths.end());
+
+    /* faces opened by path, each with its own FreeType stream */
+    assert(FT_Init_FreeType(&ftlib) == 0);
+    statm(r0, s0);
+    auto t1 = high_resolution_clock::now();
+    for (int j = 0; j < copies; j++) {
+        for (auto &p : paths) {
+            FT_Face ftface;
+            if (FT_New_Face(ftlib, p.c_str(), 0, &ftface) == 0) {
+                ftfaces.push_back(ftface);
+            }
+        }
+    }
+    auto t2 = high_resolution_clock::now();
+    statm(r1, s1);
+    for (auto ftface : ftfaces) FT_Done_Face(ftface);
+    FT_Done_FreeType(ftlib);
+
+    /* faces opened from shared mappings with thread copies */
+    font_manager_ft manager;
+    std::vector<std::unique_ptr<font_face_ft>> dups;
+    statm(r2, s2);
+    auto t3 = high_resolution_clock::now();
+    for (auto &p : paths) manager.scanFontPath(p);
+    for (int j = 1; j < copies; j++) {
+        for (auto &face : manager.getFontList()) {
+            dups.push_back(std::unique_ptr<font_face_ft>(face->dup_thread()));
+        }
+    }
+    auto t4 = high_resolution_clock::now();
+    statm(r3, s3);
+
+    float d1 = elapsed_ms(t1, t2), d2 = elapsed_ms(t3, t4);
+    printf("open (FT_New_Face)         = %12.3f milliseconds "
+        "(%zu faces, rss +%zu KiB, shared +%zu KiB)\n", d1, ftfaces.size(),
+        (r1 - r0) * page / 1024, (s1 - s0) * page / 1024);
+    printf("open (FT_New_Memory_Face)  = %12.3f milliseconds "
+        "(%zu faces, rss +%zu KiB, shared +%zu KiB)\n", d2,
+        manager.fontCount() + dups.size(),
+        (r3 - r2) * page / 1024, (s3 - s2) * page / 1024);
+}
+
+int main(int argc, char **argv)
+{
+    test_mapping();
+    bench_scan(4);
+}
@@ -0,0 +1,141 @@
+#include "test.h"
+
+#include <unistd.h>
+#include <ft2build.h>
+
+#include FT_FREETYPE_H
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24, p[1] = v >> 16, p[2] = v >> 8, p[3] = v;
+}
+
+/*
+ * TrueType collection from whole fonts, each font keeps its own tables
+ * and its table directory is rebased to the offset of the font.
+ */
+static std::vector<uint8_t> make_collection(std::vector<std::string> paths)
+{
+    std::vector<uint8_t> ttc(12 + paths.size() * 4);
+    put_u32(&ttc[0], 0x74746366); /* ttcf */
+    put_u32(&ttc[4], 0x00010000);
+    put_u32(&ttc[8], (uint32_t)paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::vector<uint8_t> font = read_file(paths[i]);
+        ttc.resize((ttc.size() + 3) & ~3);
+        uint32_t base = (uint32_t)ttc.size();
+        size_t num_tables = (font[4] << 8) | font[5];
+        for (size_t j = 0; j < num_tables; j++) {
+            uint8_t *rec = &font[12 + j * 16];
+            put_u32(rec + 8, get_u32(rec + 8) + base);
+        }
+        put_u32(&ttc[12 + i * 4], base);
+        ttc.insert(ttc.end(), font.begin(), font.end());
+    }
+    return ttc;
+}
+
+static void test_extensions()
+{
+    assert(font_manager::isFontFile("fonts/DejaVuSans.ttf"));
+    assert(font_manager::isFontFile("a/b.otf"));
+    assert(font_manager::isFontFile("a/b.TTC"));
+    assert(font_manager::isFontFile("a/b.otc"));
+    assert(!font_manager::isFontFile("a/b.ttf.atlas.png"));
+    assert(!font_manager::isFontFile("a/b.txt"));
+    assert(!font_manager::isFontFile(".ttf"));
+
+    printf("extensions: PASS\n");
+}
+
+static void test_collection()
+{
+    std::string dir = temp_path("test0033");
+    std::string ttc_path = dir + "/pair.ttc";
+    std::string otf_path = dir + "/Roboto.OTF";
+    assert(file::makeDir(dir));
+    write_file(ttc_path, make_collection({ "fonts/DejaVuSans.ttf",
+        "fonts/DejaVuSerif-Bold.ttf" }));
+    write_file(otf_path, read_file("fonts/Roboto-Regular.ttf"));
+    write_file(dir + "/notes.txt", { 'n', 'o', '\n' });
+
+    font_manager_ft manager;
+    manager.scanFontDir(dir);
+    assert(manager.fontCount() == 3);
+
+    /* every face of the collection, sharing one mapping */
+    font_face_ft *f0 = static_cast<font_face_ft*>(manager.findFontById(1));
+    font_face_ft *f1 = static_cast<font_face_ft*>(manager.findFontById(2));
+    assert(f0->path == ttc_path && f0->face_index == 0);
+    assert(f1->path == ttc_path && f1->face_index == 1);
+    assert(f0->name == "DejaVuSans" && f1->name == "DejaVuSerif-Bold");
+    assert(f0->fontFile == f1->fontFile);
+    assert(f0->ftface->num_faces == 2);
+    assert(manager.findFontById(0)->path == otf_path);
+    assert(manager.findFontById(0)->name == "Roboto-Regular");
+
+    /* lookups by path find the first face, by name the exact face */
+    assert(manager.findFontByPath(ttc_path) == f0);
+    assert(manager.findFontByName("DejaVuSerif-Bold") == f1);
+    assert(manager.findFontByFamily("DejaVu Serif",
+        font_style_bold) == f1);
+    font_atlas atlas;
+    assert(atlas.get_path(f0, font_atlas::csv_file) == ttc_path + ".atlas.csv");
+    assert(atlas.get_path(f1, font_atlas::csv_file) == ttc_path + ".1.atlas.csv");
+
+    /* thread copies reopen the same face of the collection */
+    std::unique_ptr<font_face_ft> dup(f1->dup_thread());
+    assert(dup && dup->face_index == 1 && dup->name == f1->name);
+    assert(dup->fontFile == f1->fontFile);
+    assert(dup->ftface->face_index == 1);
+
+    remove(ttc_path.c_str());
+    remove(otf_path.c_str());
+    remove((dir + "/notes.txt").c_str());
+    rmdir(dir.c_str());
+
+    printf("collection: PASS\n");
+}
+
+static void bench_collection()
+{
+    std::string dir = "fonts", ttc_path = temp_path("test0033.ttc");
+    std::vector<std::string> paths;
+    for (auto &p : file::list(dir)) {
+        if (font_manager::isFontFile(p)) paths.push_back(p);
+    }
+    std::sort(paths.begin(), paths.end());
+    write_file(ttc_path, make_collection(paths));
+
+    font_manager_ft m1, m2;
+    const auto t1 = high_resolution_clock::now();
+    m1.scanFontDir(dir);
+    const auto t2 = high_resolution_clock::now();
+    m2.scanFontPath(ttc_path);
+    const auto t3 = high_resolution_clock::now();
+    assert(m1.fontCount() == m2.fontCount());
+    for (size_t i = 0; i < m1.fontCount(); i++) {
+        assert(m1.findFontById(i)->name == m2.findFontById(i)->name);
+    }
+    remove(ttc_path.c_str());
+
+    float d1 = elapsed_ms(t1, t2), d2 = elapsed_ms(t2, t3);
+    printf("scan (files)               = %12.3f milliseconds "
+        "(%zu faces, %zu mappings)\n", d1, m1.fontCount(),
+        m1.fontFileMap.size());
+    printf("scan (collection)          = %12.3f milliseconds "
+        "(%zu faces, %zu mappings)\n", d2, m2.fontCount(),
+        m2.fontFileMap.size());
+}
+
+int main(int argc, char **argv)
+{
+    test_extensions();
+    test_collection();
+    bench_collection();
+}
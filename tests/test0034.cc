@@ -0,0 +1,213 @@
+#include "test.h"
+
+#include "unicode.h"
+
+/* small character set with every kind of entry and an unnamed gap */
+static void make_data(std::vector<unicode_entry> &entries,
+    std::vector<unicode_block> &blocks)
+{
+    const char *digits[] = { "ZERO", "ONE", "TWO", "THREE", "FOUR", "FIVE",
+        "SIX", "SEVEN", "EIGHT", "NINE" };
+    entries.push_back({ 0x20, 0x20, "SPACE", unicode_name_plain,
+        unicode_category_Zs, unicode_bidi_WS, 0 });
+    for (uint32_t c = 0x30; c <= 0x39; c++) {
+        entries.push_back({ c, c, std::string("DIGIT ") + digits[c - 0x30],
+            unicode_name_plain, unicode_category_Nd, unicode_bidi_EN, 0 });
+    }
+    for (uint32_t c = 0x41; c <= 0x5a; c++) {
+        entries.push_back({ c, c, std::string("LATIN CAPITAL LETTER ") +
+            (char)c, unicode_name_plain, unicode_category_Lu,
+            unicode_bidi_L, 0 });
+        entries.push_back({ c + 0x20, c + 0x20, std::string("LATIN SMALL "
+            "LETTER ") + (char)c, unicode_name_plain, unicode_category_Ll,
+            unicode_bidi_L, 0 });
+    }
+    entries.push_back({ 0x300, 0x300, "COMBINING GRAVE ACCENT",
+        unicode_name_plain, unicode_category_Mn, unicode_bidi_NSM, 230 });
+    entries.push_back({ 0x323, 0x323, "COMBINING DOT BELOW",
+        unicode_name_plain, unicode_category_Mn, unicode_bidi_NSM, 220 });
+    entries.push_back({ 0x5d0, 0x5d0, "HEBREW LETTER ALEF",
+        unicode_name_plain, unicode_category_Lo, unicode_bidi_R, 0 });
+    entries.push_back({ 0x2029, 0x2029, "PARAGRAPH SEPARATOR",
+        unicode_name_plain, unicode_category_Zp, unicode_bidi_B, 0 });
+    entries.push_back({ 0x4e00, 0x9fff, "CJK UNIFIED IDEOGRAPH-",
+        unicode_name_code, unicode_category_Lo, unicode_bidi_L, 0 });
+    entries.push_back({ 0xac00, 0xd7a3, "HANGUL SYLLABLE ",
+        unicode_name_hangul, unicode_category_Lo, unicode_bidi_L, 0 });
+    entries.push_back({ 0xe000, 0xf8ff, "", unicode_name_none,
+        unicode_category_Co, unicode_bidi_L, 0 });
+    entries.push_back({ 0x1f600, 0x1f600, "GRINNING FACE",
+        unicode_name_plain, unicode_category_So, unicode_bidi_ON, 0 });
+
+    blocks.push_back({ 0x0000, 0x007f, "Basic Latin" });
+    blocks.push_back({ 0x0300, 0x036f, "Combining Diacritical Marks" });
+    blocks.push_back({ 0x0590, 0x05ff, "Hebrew" });
+    blocks.push_back({ 0x4e00, 0x9fff, "CJK Unified Ideographs" });
+    blocks.push_back({ 0xac00, 0xd7af, "Hangul Syllables" });
+    blocks.push_back({ 0x1f600, 0x1f64f, "Emoticons" });
+}
+
+static void test_lookup()
+{
+    std::vector<unicode_entry> entries;
+    std::vector<unicode_block> blocks;
+    std::vector<std::string> ngrams = { "LETTER", "LAT", "IN", "ER", "AL" };
+    std::string path = temp_path("test0034.db");
+    make_data(entries, blocks);
+    assert(unicode_db::compile(path, entries, blocks, ngrams));
+
+    unicode_db db;
+    assert(db.open(path));
+    assert(db.is_loaded());
+
+    /* every code point matches the entries it came from */
+    std::vector<int> entry_of(unicode_db::max_code, -1);
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (uint32_t c = entries[i].first; c <= entries[i].last; c++) {
+            entry_of[c] = (int)i;
+        }
+    }
+    for (uint32_t c = 0; c < unicode_db::max_code; c++) {
+        int block = -1;
+        for (size_t b = 0; b < blocks.size(); b++) {
+            if (c >= blocks[b].start && c <= blocks[b].end) block = (int)b;
+        }
+        assert(db.block(c) == block);
+        if (entry_of[c] == -1) {
+            assert(db.category(c) == unicode_category_Cn);
+            assert(db.name(c) == "");
+            continue;
+        }
+        const unicode_entry &e = entries[entry_of[c]];
+        assert(db.category(c) == e.category);
+        assert(db.bidi(c) == e.bidi);
+        assert(db.combining_class(c) == e.ccc);
+        if (e.name_kind == unicode_name_plain) {
+            assert(db.name(c) == e.name);
+        }
+    }
+    assert(db.category(0x110000) == unicode_category_Cn);
+    assert(db.block(0xffffffff) == -1);
+
+    /* derived names of ranges */
+    assert(db.name(0x4e00) == "CJK UNIFIED IDEOGRAPH-4E00");
+    assert(db.name(0x9fa5) == "CJK UNIFIED IDEOGRAPH-9FA5");
+    assert(db.name(0xac00) == "HANGUL SYLLABLE GA");
+    assert(db.name(0xac01) == "HANGUL SYLLABLE GAG");
+    assert(db.name(0xb098) == "HANGUL SYLLABLE NA");
+    assert(db.name(0xd7a3) == "HANGUL SYLLABLE HIH");
+    assert(db.name(0xe000) == "");
+
+    /* classes and blocks */
+    assert(db.is_space(0x20) && db.is_space(0x2029) && !db.is_space(0x41));
+    assert(db.is_mark(0x300) && db.is_mark(0x323) && !db.is_mark(0x61));
+    assert(db.num_blocks() == blocks.size());
+    for (size_t b = 0; b < blocks.size(); b++) {
+        assert(db.block_name(b) == blocks[b].name);
+        assert(db.block_at(b).start == blocks[b].start);
+        assert(db.block_at(b).end == blocks[b].end);
+    }
+    assert(unicode_db::category_name(db.category(0x5d0)) == std::string("Lo"));
+    assert(unicode_db::bidi_name(db.bidi(0x5d0)) == std::string("R"));
+
+    /* search by words, ignoring case, with quoted terms exact */
+    std::vector<size_t> names;
+    db.search({ "latin", "small" }, names);
+    assert(names.size() == 26);
+    assert(db.name_code(names[0]) == 0x61);
+    names.clear();
+    db.search({ "lat", "\"a\"" }, names);
+    assert(names.size() == 2);
+    assert(db.name_code(names[0]) == 0x41 && db.name_code(names[1]) == 0x61);
+    names.clear();
+    db.search({ "ideograph" }, names);
+    assert(names.size() == 1 && db.name_code(names[0]) == 0x4e00);
+    names.clear();
+    db.search({ "emoticons" }, names);
+    assert(names.size() == 0);
+
+    /* damaged files are rejected */
+    std::vector<uint8_t> data = read_file(path);
+    unicode_db bad;
+    assert(!bad.load(data.data(), data.size() - 4));
+    data[0] ^= 1;
+    assert(!bad.load(data.data(), data.size()));
+    assert(!bad.is_loaded());
+    data[0] ^= 1;
+    assert(bad.load(data.data(), data.size()));
+
+    /* and so are out of range indices in any section */
+    unicode_db_header h;
+    memcpy(&h, data.data(), sizeof(h));
+    auto corrupt = [&](uint32_t offset, uint32_t value, size_t width) {
+        std::vector<uint8_t> copy = data;
+        unicode_db db;
+        memcpy(&copy[offset], &value, width);
+        return !db.load(copy.data(), copy.size());
+    };
+    assert(corrupt(h.name_offsets + 8, 0xffff, 4));
+    assert(corrupt(h.name_offsets + h.num_names * 4, h.word_offsets, 4));
+    assert(corrupt(h.word_offsets + 4, 0xffff, 4));
+    assert(corrupt(h.ngram_offsets, 1000, 4));
+    assert(corrupt(h.prop_pages, 0xfff, 2));
+    assert(corrupt(h.name_pages + 2, 0xfff, 2));
+    assert(corrupt(h.prop_entries, h.num_records, 2));
+    assert(corrupt(h.name_entries + 0x41 * 2, h.num_names, 2));
+    assert(corrupt(h.records + 4, h.num_blocks, 2));
+    assert(corrupt(h.blocks + 8, h.num_names, 4));
+    assert(corrupt(h.name_data, 0xff, 1));
+    assert(corrupt(h.word_data, h.num_ngrams, 1));
+    assert(corrupt(offsetof(unicode_db_header, num_names), 0x10000, 4));
+    assert(corrupt(offsetof(unicode_db_header, blocks), h.length + 4, 4));
+
+    remove(path.c_str());
+
+    printf("lookup: PASS (%u records, %zu names, %u bytes)\n",
+        db.header->num_records, db.num_names(), db.header->length);
+}
+
+static void bench_lookup(size_t count)
+{
+    std::vector<unicode_entry> entries;
+    std::vector<unicode_block> blocks;
+    std::vector<std::string> ngrams;
+    std::string path = temp_path("test0034.db");
+    make_data(entries, blocks);
+    assert(unicode_db::compile(path, entries, blocks, ngrams));
+
+    const auto t1 = high_resolution_clock::now();
+    unicode_db db;
+    assert(db.open(path));
+    const auto t2 = high_resolution_clock::now();
+
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<uint32_t> code(0, 0x1ffff);
+    std::vector<uint32_t> codes(count);
+    for (auto &c : codes) c = code(gen);
+    size_t marks = 0;
+    const auto t3 = high_resolution_clock::now();
+    for (auto c : codes) {
+        marks += db.is_mark(c) + (db.block(c) >= 0);
+    }
+    const auto t4 = high_resolution_clock::now();
+    std::string name;
+    for (uint32_t c = 0x4e00; c < 0x4e00 + count / 100; c++) {
+        name = db.name(c);
+    }
+    const auto t5 = high_resolution_clock::now();
+    remove(path.c_str());
+
+    float d1 = elapsed_ms(t1, t2) * 1e3f;
+    float d2 = elapsed_ms(t3, t4) * 1e6f / count;
+    float d3 = elapsed_ms(t4, t5) * 1e6f / (count / 100);
+    printf("open                       = %12.3f microseconds\n", d1);
+    printf("lookup                     = %12.3f nanoseconds (%zu)\n", d2,
+        marks);
+    printf("name                       = %12.3f nanoseconds\n", d3);
+}
+
+int main(int argc, char **argv)
+{
+    test_lookup();
+    bench_lookup(10000000);
+}